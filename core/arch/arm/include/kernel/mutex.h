@@ -18,16 +18,48 @@
 #define MUTEX_OWNER_ID_CONDVAR_SLEEP	-2
 #define MUTEX_OWNER_ID_MUTEX_UNLOCK	-3
 
+#ifdef CFG_WITH_STATS
+/*
+ * Contention counters of a mutex, only collected for mutexes initialized
+ * with MUTEX_INITIALIZER_NAMED().
+ */
+struct mutex_counters {
+	const char *name;
+	bool registered;	/* Linked into the list of named mutexes */
+	uint32_t spins;		/* Contended locks obtained by spinning */
+	uint32_t sleeps;	/* Waits in normal world for the lock */
+	uint64_t lock_time;	/* Counter value when last write locked */
+	uint64_t hold_time;	/* Accumulated write locked time, in ticks */
+	uint64_t max_hold_time;	/* Longest write locked time, in ticks */
+	SLIST_ENTRY(mutex) link;
+};
+#endif
+
 struct mutex {
 	unsigned spin_lock;	/* used when operating on this struct */
 	struct wait_queue wq;
 	short state;		/* -1: write, 0: unlocked, > 0: readers */
 	short owner_id;		/* Only valid for state == -1 (write lock) */
 	TAILQ_ENTRY(mutex) link;
+#ifdef CFG_WITH_STATS
+	struct mutex_counters cnt;
+#endif
 };
 #define MUTEX_INITIALIZER \
 	{ .owner_id = MUTEX_OWNER_ID_NONE, .wq = WAIT_QUEUE_INITIALIZER, }
 
+/*
+ * Same as MUTEX_INITIALIZER, but the contention counters of the mutex are
+ * reported by mutex_get_stats() under @name.
+ */
+#ifdef CFG_WITH_STATS
+#define MUTEX_INITIALIZER_NAMED(n) \
+	{ .owner_id = MUTEX_OWNER_ID_NONE, .wq = WAIT_QUEUE_INITIALIZER, \
+	  .cnt = { .name = (n) }, }
+#else
+#define MUTEX_INITIALIZER_NAMED(n) MUTEX_INITIALIZER
+#endif
+
 TAILQ_HEAD(mutex_head, mutex);
 
 void mutex_init(struct mutex *m);
@@ -61,6 +93,25 @@ void mutex_read_lock(struct mutex *m);
 bool mutex_read_trylock(struct mutex *m);
 #endif
 
+#ifdef CFG_WITH_STATS
+#define MUTEX_STATS_DESC_LENGTH	32
+
+struct mutex_stats {
+	char desc[MUTEX_STATS_DESC_LENGTH];
+	uint32_t spins;		/* Contended locks obtained by spinning */
+	uint32_t sleeps;	/* Waits in normal world for the lock */
+	uint32_t max_hold_us;	/* Longest write locked time */
+	uint64_t hold_us;	/* Accumulated write locked time */
+};
+
+/*
+ * Fills in at most @num entries of @stats with the counters of the named
+ * mutexes which have been used so far. Counters are cleared if @reset is
+ * true. Returns the total number of named mutexes in use.
+ */
+size_t mutex_get_stats(struct mutex_stats *stats, size_t num, bool reset);
+#endif
+
 struct condvar {
 	unsigned spin_lock;
 	struct mutex *m;
@@ -68,10 +68,14 @@ struct thread_specific_data {
 	TAILQ_HEAD(, tee_ta_session) sess_stack;
 	struct tee_ta_ctx *ctx;
 	struct pgt_cache pgt_cache;
+#if defined(CFG_PERSISTENT_USER_MAP)
+	struct user_ta_ctx *pgt_persist_utc;
+#endif
 	void *rpc_fs_payload;
 	struct mobj *rpc_fs_payload_mobj;
 	uint64_t rpc_fs_payload_cookie;
 	size_t rpc_fs_payload_size;
+	uint32_t rpc_fs_payload_gen;
 };
 
 struct thread_user_vfp_state {
@@ -289,6 +293,12 @@ int thread_get_id(void);
  */
 int thread_get_id_may_fail(void);
 
+/*
+ * Returns true if the thread with id @thread_id is currently executing on
+ * some core, that is, it's neither free nor suspended.
+ */
+bool thread_is_active(int thread_id);
+
 /* Returns Thread Specific Data (TSD) pointer. */
 struct thread_specific_data *thread_get_tsd(void);
 
@@ -552,6 +562,17 @@ bool thread_is_in_normal_mode(void);
  */
 bool thread_is_from_abort_mode(void);
 
+/*
+ * Returns true if the abort handler currently running may unmask native
+ * interrupts. Native interrupts are handled on the temporary stack so
+ * that's only the case if neither the abort handler nor the code it
+ * interrupted is using that stack.
+ *
+ * Note: it's only valid to call this function from an abort exception
+ * handler before interrupts has been re-enabled.
+ */
+bool thread_abort_may_unmask_native_intr(void);
+
 /*
  * Adds a mutex to the list of held mutexes for current thread
  * Requires foreign interrupts to be disabled.
@@ -6,8 +6,10 @@
 #define KERNEL_USER_TA_H
 
 #include <assert.h>
+#include <kernel/handle.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
+#include <mm/pgt_cache.h>
 #include <mm/tee_mm.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
@@ -27,13 +29,16 @@ TAILQ_HEAD(user_ta_elf_head, user_ta_elf);
  * @is_32bit:		True if 32-bit TA, false if 64-bit TA
  * @open_sessions:	List of sessions opened by this TA
  * @cryp_states:	List of cryp states created by this TA
+ * @cryp_state_db:	Handles of the cryp states, given to the TA
  * @objects:		List of storage objects opened by this TA
+ * @object_db:		Handles of the storage objects, given to the TA
  * @storage_enums:	List of storage enumerators opened by this TA
  * @mobj_code:		Secure world memory for code and data
  * @mobj_stack:		Secure world memory for stack
  * @stack_addr:		Virtual address of stack
  * @load_addr:		ELF load addr (from TA address space)
  * @vm_info:		Virtual memory map of this context
+ * @pgt_persist:	Translation tables kept while the context isn't mapped
  * @ta_time_offs:	Time reference used by the TA
  * @areas:		Memory areas registered by pager
  * @se_service:		Secure element services state
@@ -48,13 +53,18 @@ struct user_ta_ctx {
 	bool is_32bit;
 	struct tee_ta_session_head open_sessions;
 	struct tee_cryp_state_head cryp_states;
+	struct handle_db cryp_state_db;
 	struct tee_obj_head objects;
+	struct handle_db object_db;
 	struct tee_storage_enum_head storage_enums;
 	struct user_ta_elf_head elfs;
 	struct mobj *mobj_stack;
 	vaddr_t stack_addr;
 	vaddr_t load_addr;
 	struct vm_info *vm_info;
+#if defined(CFG_PERSISTENT_USER_MAP)
+	struct pgt_persist pgt_persist;
+#endif
 	void *ta_time_offs;
 	struct tee_pager_area_head *areas;
 #if defined(CFG_SE_API)
@@ -389,6 +389,21 @@ void core_mmu_set_entry_primitive(void *table, size_t level, size_t idx,
 
 void core_mmu_get_user_pgdir(struct core_mmu_table_info *pgd_info);
 
+/*
+ * core_mmu_set_user_pgdir() - Like core_mmu_get_user_pgdir() but with the
+ * supplied table of PGT_SIZE bytes as directory
+ */
+void core_mmu_set_user_pgdir(struct core_mmu_table_info *pgd_info,
+			     void *tbl);
+
+/*
+ * core_mmu_get_user_map_of_pgdir() - Get the user mapping of a populated
+ * directory to pass to core_mmu_set_user_map()
+ */
+void core_mmu_get_user_map_of_pgdir(struct core_mmu_table_info *pgd_info,
+				    struct user_ta_ctx *utc,
+				    struct core_mmu_user_map *map);
+
 /*
  * core_mmu_set_entry() - Set entry in translation table
  * @tbl_info:	Translation table properties
@@ -117,8 +117,21 @@ struct mobj *mobj_phys_alloc(paddr_t pa, size_t size, uint32_t cattr,
 struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 				paddr_t page_offset, uint64_t cookie);
 
+/*
+ * Returns the registered shared memory object of @cookie with a reference
+ * taken, to be dropped with mobj_reg_shm_put(), or NULL if none.
+ */
 struct mobj *mobj_reg_shm_find_by_cookie(uint64_t cookie);
 
+/* Drops a reference taken by mobj_reg_shm_find_by_cookie() */
+void mobj_reg_shm_put(struct mobj *mobj);
+
+/*
+ * Unregisters the shared memory object of @cookie, the object is freed
+ * once the last reference taken by a lookup is dropped.
+ */
+TEE_Result mobj_reg_shm_release_by_cookie(uint64_t cookie);
+
 TEE_Result mobj_reg_shm_map(struct mobj *mobj);
 TEE_Result mobj_reg_shm_unmap(struct mobj *mobj);
 
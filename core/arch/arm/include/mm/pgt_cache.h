@@ -108,4 +108,71 @@ static inline void pgt_set_used_entries(struct pgt *pgt __unused,
 
 #endif
 
+struct core_mmu_user_map;
+struct user_ta_ctx;
+struct vm_region;
+
+#if defined(CFG_PERSISTENT_USER_MAP)
+/*
+ * struct pgt_persist - translation tables kept with a user TA context
+ * @dir:	Translation table directory, NULL if no tables are held
+ * @pgt_cache:	Page tables referenced from @dir
+ * @pgt_spare:	First table in @pgt_cache not referenced from @dir
+ * @num_pgt:	Number of tables held, including @dir
+ * @valid:	True if the tables match the regions of the context
+ * @num_users:	Number of threads with the tables mapped
+ * @link:	Link in the list of reclaimable contexts
+ */
+struct pgt_persist {
+	struct pgt *dir;
+	struct pgt_cache pgt_cache;
+	struct pgt *pgt_spare;
+	size_t num_pgt;
+	bool valid;
+	unsigned int num_users;
+	TAILQ_ENTRY(pgt_persist) link;
+};
+
+void pgt_persist_init(void);
+bool pgt_persist_map(struct user_ta_ctx *utc, struct core_mmu_user_map *map);
+void pgt_persist_unmap(void);
+void pgt_persist_invalidate(struct user_ta_ctx *utc);
+void pgt_persist_map_region(struct user_ta_ctx *utc, struct vm_region *reg);
+void pgt_persist_unmap_region(struct user_ta_ctx *utc,
+			      struct vm_region *reg);
+void pgt_persist_release(struct user_ta_ctx *utc);
+#else
+static inline void pgt_persist_init(void)
+{
+}
+
+static inline bool pgt_persist_map(struct user_ta_ctx *utc __unused,
+				   struct core_mmu_user_map *map __unused)
+{
+	return false;
+}
+
+static inline void pgt_persist_unmap(void)
+{
+}
+
+static inline void pgt_persist_invalidate(struct user_ta_ctx *utc __unused)
+{
+}
+
+static inline void pgt_persist_map_region(struct user_ta_ctx *utc __unused,
+					  struct vm_region *reg __unused)
+{
+}
+
+static inline void pgt_persist_unmap_region(struct user_ta_ctx *utc __unused,
+					    struct vm_region *reg __unused)
+{
+}
+
+static inline void pgt_persist_release(struct user_ta_ctx *utc __unused)
+{
+}
+#endif
+
 #endif /*MM_PGT_CACHE_H*/
@@ -222,6 +222,11 @@ struct tee_pager_stats {
 	size_t zi_released;
 	size_t npages;		/* number of load pages */
 	size_t npages_all;	/* number of pages */
+	size_t evictions;	/* mapped pages evicted to load another page */
+	size_t refaults;	/* loads of recently evicted pages */
+	size_t hides;		/* hidden pages, one TLB invalidation each */
+	size_t fault_around;	/* pages loaded ahead of a fault */
+	size_t fault_around_hits; /* pages loaded ahead later walked past */
 };
 
 #ifdef CFG_WITH_PAGER
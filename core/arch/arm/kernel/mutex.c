@@ -3,10 +3,14 @@
  * Copyright (c) 2015-2017, Linaro Limited
  */
 
+#include <arm.h>
+#include <compiler.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <string.h>
+#include <string_ext.h>
 #include <trace.h>
 
 void mutex_init(struct mutex *m)
@@ -14,15 +18,157 @@ void mutex_init(struct mutex *m)
 	*m = (struct mutex)MUTEX_INITIALIZER;
 }
 
+#ifdef CFG_WITH_STATS
+static unsigned int mutex_stats_spin_lock = SPINLOCK_UNLOCK;
+static SLIST_HEAD(, mutex) mutex_stats_head =
+	SLIST_HEAD_INITIALIZER(mutex_stats_head);
+
+static void register_named(struct mutex *m)
+{
+	uint32_t exceptions;
+
+	if (!m->cnt.name || m->cnt.registered)
+		return;
+
+	exceptions = cpu_spin_lock_xsave(&mutex_stats_spin_lock);
+	if (!m->cnt.registered) {
+		SLIST_INSERT_HEAD(&mutex_stats_head, m, cnt.link);
+		m->cnt.registered = true;
+	}
+	cpu_spin_unlock_xrestore(&mutex_stats_spin_lock, exceptions);
+}
+
+/* Counters are updated with m->spin_lock held */
+static void incr_spins(struct mutex *m)
+{
+	m->cnt.spins++;
+}
+
+static void incr_sleeps(struct mutex *m)
+{
+	m->cnt.sleeps++;
+}
+
+/* Hold time is only tracked for named mutexes to save the counter reads */
+static void record_lock_time(struct mutex *m)
+{
+	if (m->cnt.name)
+		m->cnt.lock_time = read_cntpct();
+}
+
+static void record_hold_time(struct mutex *m)
+{
+	uint64_t t;
+
+	if (!m->cnt.name)
+		return;
+	t = read_cntpct() - m->cnt.lock_time;
+	m->cnt.hold_time += t;
+	if (t > m->cnt.max_hold_time)
+		m->cnt.max_hold_time = t;
+}
+
+static uint64_t ticks_to_us(uint64_t ticks)
+{
+	uint64_t freq = read_cntfrq();
+
+	/* In two steps, the accumulated hold time may be large */
+	return ticks / freq * 1000000ULL + ticks % freq * 1000000ULL / freq;
+}
+
+size_t mutex_get_stats(struct mutex_stats *stats, size_t num, bool reset)
+{
+	uint32_t exceptions;
+	struct mutex *m;
+	size_t n = 0;
+
+	exceptions = cpu_spin_lock_xsave(&mutex_stats_spin_lock);
+	SLIST_FOREACH(m, &mutex_stats_head, cnt.link) {
+		cpu_spin_lock(&m->spin_lock);
+		if (n < num) {
+			memset(stats + n, 0, sizeof(*stats));
+			strlcpy(stats[n].desc, m->cnt.name,
+				sizeof(stats[n].desc));
+			stats[n].spins = m->cnt.spins;
+			stats[n].sleeps = m->cnt.sleeps;
+			stats[n].max_hold_us = ticks_to_us(m->cnt.max_hold_time);
+			stats[n].hold_us = ticks_to_us(m->cnt.hold_time);
+		}
+		if (reset) {
+			m->cnt.spins = 0;
+			m->cnt.sleeps = 0;
+			m->cnt.hold_time = 0;
+			m->cnt.max_hold_time = 0;
+		}
+		cpu_spin_unlock(&m->spin_lock);
+		n++;
+	}
+	cpu_spin_unlock_xrestore(&mutex_stats_spin_lock, exceptions);
+
+	return n;
+}
+#else /*CFG_WITH_STATS*/
+static void register_named(struct mutex *m __unused) { }
+static void incr_spins(struct mutex *m __unused) { }
+static void incr_sleeps(struct mutex *m __unused) { }
+static void record_lock_time(struct mutex *m __unused) { }
+static void record_hold_time(struct mutex *m __unused) { }
+#endif /*CFG_WITH_STATS*/
+
+#if CFG_MUTEX_SPIN_US > 0
+/*
+ * Called with m->spin_lock held when the mutex is found write locked by
+ * @owner. Spinning is only worth it if the owner is running on another
+ * core, if it's suspended (for instance waiting for an RPC) it will not
+ * release the mutex any time soon.
+ */
+static bool may_spin(short owner)
+{
+	return owner >= 0 && thread_is_active(owner);
+}
+
+/*
+ * Spins for at most CFG_MUTEX_SPIN_US while the mutex is write locked by
+ * @owner and @owner is running.
+ */
+static void spin_while_owner_runs(struct mutex *m, short owner)
+{
+	uint64_t start = read_cntpct();
+	uint64_t max_ticks = (uint64_t)read_cntfrq() * CFG_MUTEX_SPIN_US /
+			     1000000ULL;
+
+	while (__compiler_atomic_load(&m->state) == -1 &&
+	       __compiler_atomic_load(&m->owner_id) == owner &&
+	       thread_is_active(owner) &&
+	       read_cntpct() - start <= max_ticks)
+		;
+}
+#else
+static bool may_spin(short owner __unused)
+{
+	return false;
+}
+
+static void spin_while_owner_runs(struct mutex *m __unused,
+				  short owner __unused)
+{
+}
+#endif
+
 static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
 {
+	bool spun = false;
+
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != -1);
 	assert(thread_is_in_normal_mode());
 
+	register_named(m);
+
 	while (true) {
 		uint32_t old_itr_status;
 		bool can_lock;
+		bool spin = false;
 		struct wait_queue_elem wqe;
 		int owner = MUTEX_OWNER_ID_NONE;
 
@@ -39,24 +185,43 @@ static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
 
 		can_lock = !m->state;
 		if (!can_lock) {
-			wq_wait_init(&m->wq, &wqe, false /* wait_read */);
 			owner = m->owner_id;
 			assert(owner != thread_get_id_may_fail());
+			/* Spin only once, then wait in normal world */
+			spin = !spun && m->state == -1 && may_spin(owner);
+			if (!spin) {
+				wq_wait_init(&m->wq, &wqe,
+					     false /* wait_read */);
+				incr_sleeps(m);
+			}
 		} else {
 			m->state = -1; /* write locked */
 			thread_add_mutex(m);
+			record_lock_time(m);
+			if (spun)
+				incr_spins(m);
 		}
 
 		cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
-		if (!can_lock) {
+		if (can_lock)
+			return;
+
+		if (spin) {
+			/*
+			 * The owner is running on another core, it may
+			 * release the lock soon so it's cheaper to spin for
+			 * a while than to wait in normal world.
+			 */
+			spin_while_owner_runs(m, owner);
+			spun = true;
+		} else {
 			/*
 			 * Someone else is holding the lock, wait in normal
 			 * world for the lock to become available.
 			 */
 			wq_wait_final(&m->wq, &wqe, m, owner, fname, lineno);
-		} else
-			return;
+		}
 	}
 }
 
@@ -72,6 +237,7 @@ static void __mutex_unlock(struct mutex *m, const char *fname, int lineno)
 	if (!m->state)
 		panic();
 
+	record_hold_time(m);
 	thread_rem_mutex(m);
 	m->state = 0;
 
@@ -95,6 +261,7 @@ static bool __mutex_trylock(struct mutex *m, const char *fname __unused,
 	if (can_lock_write) {
 		m->state = -1;
 		thread_add_mutex(m);
+		record_lock_time(m);
 	}
 
 	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
@@ -126,13 +293,18 @@ static void __mutex_read_unlock(struct mutex *m, const char *fname, int lineno)
 
 static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
 {
+	bool spun = false;
+
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != -1);
 	assert(thread_is_in_normal_mode());
 
+	register_named(m);
+
 	while (true) {
 		uint32_t old_itr_status;
 		bool can_lock;
+		bool spin = false;
 		struct wait_queue_elem wqe;
 		int owner = MUTEX_OWNER_ID_NONE;
 
@@ -149,23 +321,37 @@ static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
 
 		can_lock = m->state != -1;
 		if (!can_lock) {
-			wq_wait_init(&m->wq, &wqe, true /* wait_read */);
 			owner = m->owner_id;
 			assert(owner != thread_get_id_may_fail());
+			/* Spin only once, then wait in normal world */
+			spin = !spun && may_spin(owner);
+			if (!spin) {
+				wq_wait_init(&m->wq, &wqe,
+					     true /* wait_read */);
+				incr_sleeps(m);
+			}
 		} else {
 			m->state++; /* read_locked */
+			if (spun)
+				incr_spins(m);
 		}
 
 		cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
-		if (!can_lock) {
+		if (can_lock)
+			return;
+
+		if (spin) {
+			/* See comment in __mutex_lock() */
+			spin_while_owner_runs(m, owner);
+			spun = true;
+		} else {
 			/*
 			 * Someone else is holding the lock, wait in normal
 			 * world for the lock to become available.
 			 */
 			wq_wait_final(&m->wq, &wqe, m, owner, fname, lineno);
-		} else
-			return;
+		}
 	}
 }
 
@@ -344,6 +530,8 @@ static void __condvar_wait(struct condvar *cv, struct mutex *m,
 		m->state--;
 	} else {
 		/* Only one lock (read or write), unlock the mutex */
+		if (m->state < 0)
+			record_hold_time(m);
 		thread_rem_mutex(m);
 		m->state = 0;
 	}
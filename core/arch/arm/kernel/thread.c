@@ -8,6 +8,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <keep.h>
 #include <kernel/asan.h>
 #include <kernel/misc.h>
@@ -140,7 +141,6 @@ static uint8_t thread_user_kdata_page[
 	__aligned(SMALL_PAGE_SIZE) __section(".nozi.kdata_page");
 #endif
 
-static unsigned int thread_global_lock = SPINLOCK_UNLOCK;
 static bool thread_prealloc_rpc_cache;
 
 static void init_canaries(void)
@@ -203,14 +203,28 @@ void thread_check_canaries(void)
 #endif/*CFG_WITH_STACK_CANARIES*/
 }
 
-static void lock_global(void)
+/*
+ * The state of a thread context is only changed with atomic operations,
+ * there's no global lock protecting the threads[] array. A FREE context
+ * is claimed with a compare-and-swap, any other transition is done by
+ * the core which currently owns the context.
+ */
+static bool thread_cas_state(struct thread_ctx *thr, uint32_t old_state,
+			     uint32_t new_state)
 {
-	cpu_spin_lock(&thread_global_lock);
+	uint32_t s = old_state;
+
+	/* The compare-and-swap is allowed to fail spuriously, so retry */
+	while (!atomic_cas_u32(&thr->state, &s, new_state))
+		if (s != old_state)
+			return false;
+	return true;
 }
 
-static void unlock_global(void)
+static void thread_set_state(struct thread_ctx *thr, uint32_t state)
 {
-	cpu_spin_unlock(&thread_global_lock);
+	/* Makes the updates of the context visible before the new state */
+	atomic_store_release_u32(&thr->state, state);
 }
 
 #ifdef ARM32
@@ -404,7 +418,7 @@ void thread_init_boot_thread(void)
 		thread_core_local[n].curr_thread = -1;
 
 	l->curr_thread = 0;
-	threads[0].state = THREAD_STATE_ACTIVE;
+	thread_set_state(threads, THREAD_STATE_ACTIVE);
 }
 
 void thread_clr_boot_thread(void)
@@ -414,31 +428,52 @@ void thread_clr_boot_thread(void)
 	assert(l->curr_thread >= 0 && l->curr_thread < CFG_NUM_THREADS);
 	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
 	assert(TAILQ_EMPTY(&threads[l->curr_thread].mutexes));
-	threads[l->curr_thread].state = THREAD_STATE_FREE;
+	thread_set_state(threads + l->curr_thread, THREAD_STATE_FREE);
 	l->curr_thread = -1;
 }
 
-static void thread_alloc_and_run(struct thread_smc_args *args)
+/*
+ * Each core starts searching for a free context at its own offset in
+ * threads[] to avoid that all cores compete for the same slots.
+ */
+static bool thread_claim_free(size_t *thread_id)
 {
+	size_t start = (get_core_pos() * CFG_NUM_THREADS) /
+		       CFG_TEE_CORE_NB_CORE;
+	bool retry = true;
 	size_t n;
-	struct thread_core_local *l = thread_get_core_local();
-	bool found_thread = false;
-
-	assert(l->curr_thread == -1);
-
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
+	size_t m;
+
+	while (retry) {
+		retry = false;
+		for (m = 0; m < CFG_NUM_THREADS; m++) {
+			n = (start + m) % CFG_NUM_THREADS;
+			if (thread_cas_state(threads + n, THREAD_STATE_FREE,
+					     THREAD_STATE_ACTIVE)) {
+				*thread_id = n;
+				return true;
+			}
+			/*
+			 * A reserved context is only held for a short while
+			 * by thread_reserve_all(), it will be free again.
+			 */
+			if (atomic_load_u32(&threads[n].state) ==
+			    THREAD_STATE_RESERVED)
+				retry = true;
 		}
 	}
 
-	unlock_global();
+	return false;
+}
+
+static void thread_alloc_and_run(struct thread_smc_args *args)
+{
+	size_t n = 0;
+	struct thread_core_local *l = thread_get_core_local();
+
+	assert(l->curr_thread == -1);
 
-	if (!found_thread) {
+	if (!thread_claim_free(&n)) {
 		args->a0 = OPTEE_SMC_RETURN_ETHREAD_LIMIT;
 		return;
 	}
@@ -521,16 +556,25 @@ static void thread_resume_from_rpc(struct thread_smc_args *args)
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
+	/*
+	 * The client is checked before the state is changed so that a
+	 * resume from the wrong client can't make a legitimate resume of
+	 * the thread fail. It's checked again once the thread is claimed
+	 * in case the thread was freed and reused by another client in
+	 * between, which is the only case where the state has to be put
+	 * back.
+	 */
 	if (n < CFG_NUM_THREADS &&
-	    threads[n].state == THREAD_STATE_SUSPENDED &&
-	    args->a7 == threads[n].hyp_clnt_id)
-		threads[n].state = THREAD_STATE_ACTIVE;
-	else
+	    args->a7 == threads[n].hyp_clnt_id &&
+	    thread_cas_state(threads + n, THREAD_STATE_SUSPENDED,
+			     THREAD_STATE_ACTIVE)) {
+		if (args->a7 != threads[n].hyp_clnt_id) {
+			thread_set_state(threads + n, THREAD_STATE_SUSPENDED);
+			rv = OPTEE_SMC_RETURN_ERESUME;
+		}
+	} else {
 		rv = OPTEE_SMC_RETURN_ERESUME;
-
-	unlock_global();
+	}
 
 	if (rv) {
 		args->a0 = rv;
@@ -642,6 +686,14 @@ bool thread_is_from_abort_mode(void)
 	return (l->flags >> THREAD_CLF_SAVED_SHIFT) & THREAD_CLF_ABORT;
 }
 
+bool thread_abort_may_unmask_native_intr(void)
+{
+	struct thread_core_local *l = thread_get_core_local();
+
+	/* On the abort stack, interrupting code on a thread stack */
+	return l->flags == THREAD_CLF_ABORT;
+}
+
 #ifdef ARM32
 bool thread_is_in_normal_mode(void)
 {
@@ -677,14 +729,10 @@ void thread_state_free(void)
 		(void *)(threads[ct].stack_va_end - STACK_THREAD_SIZE),
 		STACK_THREAD_SIZE);
 
-	lock_global();
-
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
-	threads[ct].state = THREAD_STATE_FREE;
 	threads[ct].flags = 0;
 	l->curr_thread = -1;
-
-	unlock_global();
+	thread_set_state(threads + ct, THREAD_STATE_FREE);
 }
 
 #ifdef CFG_WITH_PAGER
@@ -732,13 +780,10 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 	}
 	thread_lazy_restore_ns_vfp();
 
-	lock_global();
-
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
 	threads[ct].flags |= flags;
 	threads[ct].regs.cpsr = cpsr;
 	threads[ct].regs.pc = pc;
-	threads[ct].state = THREAD_STATE_SUSPENDED;
 
 	threads[ct].have_user_map = core_mmu_user_mapping_is_active();
 	if (threads[ct].have_user_map) {
@@ -747,8 +792,7 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 	}
 
 	l->curr_thread = -1;
-
-	unlock_global();
+	thread_set_state(threads + ct, THREAD_STATE_SUSPENDED);
 
 	return ct;
 }
@@ -815,6 +859,14 @@ int thread_get_id(void)
 	return ct;
 }
 
+bool thread_is_active(int thread_id)
+{
+	if (thread_id < 0 || thread_id >= CFG_NUM_THREADS)
+		return false;
+	return atomic_load_u32(&threads[thread_id].state) ==
+	       THREAD_STATE_ACTIVE;
+}
+
 static void init_handlers(const struct thread_handlers *handlers)
 {
 	thread_std_smc_handler_ptr = handlers->std_smc;
@@ -1290,19 +1342,47 @@ void thread_rem_mutex(struct mutex *m)
 	TAILQ_REMOVE(&threads[ct].mutexes, m, link);
 }
 
+/*
+ * Reserves all thread contexts, succeeds only if all are free. While
+ * reserved no context can be allocated, thread_claim_free() waits for
+ * the reservation to be released instead of failing.
+ */
+static bool thread_reserve_all(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		if (!thread_cas_state(threads + n, THREAD_STATE_FREE,
+				      THREAD_STATE_RESERVED)) {
+			while (n) {
+				n--;
+				thread_set_state(threads + n,
+						 THREAD_STATE_FREE);
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void thread_release_all(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++)
+		thread_set_state(threads + n, THREAD_STATE_FREE);
+}
+
 bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 {
 	bool rv;
 	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (!thread_reserve_all()) {
+		rv = false;
+		goto out;
 	}
 
 	rv = true;
@@ -1312,14 +1392,15 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 			*cookie = threads[n].rpc_carg;
 			threads[n].rpc_carg = 0;
 			threads[n].rpc_arg = NULL;
-			goto out;
+			goto out_release;
 		}
 	}
 
 	*cookie = 0;
 	thread_prealloc_rpc_cache = false;
+out_release:
+	thread_release_all();
 out:
-	unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
@@ -1327,22 +1408,14 @@ out:
 bool thread_enable_prealloc_rpc_cache(void)
 {
 	bool rv;
-	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	rv = thread_reserve_all();
+	if (rv) {
+		thread_prealloc_rpc_cache = true;
+		thread_release_all();
 	}
 
-	rv = true;
-	thread_prealloc_rpc_cache = true;
-out:
-	unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
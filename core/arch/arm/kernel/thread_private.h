@@ -19,6 +19,7 @@ enum thread_state {
 	THREAD_STATE_FREE,
 	THREAD_STATE_SUSPENDED,
 	THREAD_STATE_ACTIVE,
+	THREAD_STATE_RESERVED,
 };
 
 #ifdef ARM32
@@ -77,7 +78,7 @@ struct thread_vfp_state {
 
 struct thread_ctx {
 	struct thread_ctx_regs regs;
-	enum thread_state state;
+	uint32_t state;		/* enum thread_state, updated atomically */
 	vaddr_t stack_va_end;
 	uint32_t hyp_clnt_id;
 	uint32_t flags;
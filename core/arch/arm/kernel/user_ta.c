@@ -475,6 +475,8 @@ static void free_utc(struct user_ta_ctx *utc)
 	tee_svc_cryp_free_states(utc);
 	/* Close cryp objects opened by this TA */
 	tee_obj_close_all(utc);
+	handle_db_destroy(&utc->cryp_state_db);
+	handle_db_destroy(&utc->object_db);
 	/* Free emums created by this TA */
 	tee_svc_storage_close_all_enum(utc);
 	free(utc);
@@ -1298,23 +1298,34 @@ static void set_pg_region(struct core_mmu_table_info *dir_info,
 			 * We're assigning a new translation table.
 			 */
 			unsigned int idx;
-
-			assert(*pgt); /* We should have alloced enough */
+			paddr_t pa;
+			uint32_t attr;
 
 			/* Virtual addresses must grow */
 			assert(r.va > pg_info->va_base);
 
 			idx = core_mmu_va2idx(dir_info, r.va);
-			pg_info->table = (*pgt)->tbl;
 			pg_info->va_base = core_mmu_idx2va(dir_info, idx);
+
+			/* Reuse the table already mapping the range, if any */
+			core_mmu_get_entry(dir_info, idx, &pa, &attr);
+			if (attr & TEE_MATTR_TABLE) {
+				pg_info->table = phys_to_virt(pa,
+						MEM_AREA_TEE_RAM_RW_DATA);
+				assert(pg_info->table);
+			} else {
+				assert(*pgt); /* We should have alloced enough */
+
+				pg_info->table = (*pgt)->tbl;
 #ifdef CFG_PAGED_USER_TA
-			assert((*pgt)->vabase == pg_info->va_base);
+				assert((*pgt)->vabase == pg_info->va_base);
 #endif
-			*pgt = SLIST_NEXT(*pgt, link);
+				*pgt = SLIST_NEXT(*pgt, link);
 
-			core_mmu_set_entry(dir_info, idx,
-					   virt_to_phys(pg_info->table),
-					   pgt_attr);
+				core_mmu_set_entry(dir_info, idx,
+						   virt_to_phys(pg_info->table),
+						   pgt_attr);
+			}
 		}
 
 		r.size = MIN(CORE_MMU_PGDIR_SIZE - (r.va - pg_info->va_base),
@@ -1527,11 +1538,10 @@ void core_mmu_unmap_pages(vaddr_t vstart, size_t num_pages)
 void core_mmu_populate_user_map(struct core_mmu_table_info *dir_info,
 				struct user_ta_ctx *utc)
 {
-	struct core_mmu_table_info pg_info;
 	struct pgt_cache *pgt_cache = &thread_get_tsd()->pgt_cache;
-	struct pgt *pgt;
 	struct vm_region *r;
 	struct vm_region *r_last;
+	struct pgt *pgt;
 
 	/* Find the first and last valid entry */
 	r = TAILQ_FIRST(&utc->vm_info->regions);
@@ -1544,7 +1554,16 @@ void core_mmu_populate_user_map(struct core_mmu_table_info *dir_info,
 	 */
 	pgt_alloc(pgt_cache, &utc->ctx, r->va,
 		  r_last->va + r_last->size - 1);
+
 	pgt = SLIST_FIRST(pgt_cache);
+	core_mmu_populate_user_map_pgt(dir_info, utc, &pgt);
+}
+
+void core_mmu_populate_user_map_pgt(struct core_mmu_table_info *dir_info,
+				    struct user_ta_ctx *utc, struct pgt **pgt)
+{
+	struct core_mmu_table_info pg_info;
+	struct vm_region *r;
 
 	core_mmu_set_info_table(&pg_info, dir_info->level + 1, 0, NULL);
 
@@ -1552,7 +1571,75 @@ void core_mmu_populate_user_map(struct core_mmu_table_info *dir_info,
 		mobj_update_mapping(r->mobj, utc, r->va);
 
 	TAILQ_FOREACH(r, &utc->vm_info->regions, link)
-		set_pg_region(dir_info, r, &pgt, &pg_info);
+		set_pg_region(dir_info, r, pgt, &pg_info);
+}
+
+bool core_mmu_map_user_region_pgt(struct core_mmu_table_info *dir_info,
+				  struct user_ta_ctx *utc,
+				  struct vm_region *region, struct pgt **pgt)
+{
+	struct core_mmu_table_info pg_info;
+	vaddr_t va = ROUNDDOWN(region->va, CORE_MMU_PGDIR_SIZE);
+	vaddr_t end = region->va + region->size;
+	struct pgt *p = *pgt;
+	uint32_t attr;
+
+	/* Check that all the needed tables are at hand before mapping */
+	for (; va < end; va += CORE_MMU_PGDIR_SIZE) {
+		core_mmu_get_entry(dir_info, core_mmu_va2idx(dir_info, va),
+				   NULL, &attr);
+		if (!(attr & TEE_MATTR_TABLE)) {
+			if (!p)
+				return false;
+			p = SLIST_NEXT(p, link);
+			continue;
+		}
+#ifndef CFG_WITH_LPAE
+		if ((attr & TEE_MATTR_SECURE) !=
+		    (region->attr & TEE_MATTR_SECURE))
+			return false;
+#endif
+	}
+
+	core_mmu_set_info_table(&pg_info, dir_info->level + 1, 0, NULL);
+	mobj_update_mapping(region->mobj, utc, region->va);
+	set_pg_region(dir_info, region, pgt, &pg_info);
+	return true;
+}
+
+void core_mmu_unmap_user_region_pgt(struct core_mmu_table_info *dir_info,
+				    struct vm_region *region)
+{
+	struct core_mmu_table_info pg_info;
+	vaddr_t va = region->va;
+	vaddr_t end = region->va + region->size;
+	unsigned int idx;
+	paddr_t pa;
+	uint32_t attr;
+
+	core_mmu_set_info_table(&pg_info, dir_info->level + 1, 0, NULL);
+
+	while (va < end) {
+		idx = core_mmu_va2idx(dir_info, va);
+		core_mmu_get_entry(dir_info, idx, &pa, &attr);
+		pg_info.va_base = core_mmu_idx2va(dir_info, idx);
+		if (attr & TEE_MATTR_TABLE) {
+			pg_info.table = phys_to_virt(pa,
+						     MEM_AREA_TEE_RAM_RW_DATA);
+			assert(pg_info.table);
+			/* The table is kept, it's only emptied */
+			while (va < end && va < pg_info.va_base +
+						CORE_MMU_PGDIR_SIZE) {
+				core_mmu_set_entry(&pg_info,
+						   core_mmu_va2idx(&pg_info,
+								   va),
+						   0, 0);
+				va += SMALL_PAGE_SIZE;
+			}
+		} else {
+			va = pg_info.va_base + CORE_MMU_PGDIR_SIZE;
+		}
+	}
 }
 
 bool core_mmu_add_mapping(enum teecore_memtypes type, paddr_t addr, size_t len)
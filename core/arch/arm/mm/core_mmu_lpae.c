@@ -518,15 +518,27 @@ void core_mmu_set_info_table(struct core_mmu_table_info *tbl_info,
 		tbl_info->num_entries = XLAT_TABLE_ENTRIES;
 }
 
-void core_mmu_get_user_pgdir(struct core_mmu_table_info *pgd_info)
+void core_mmu_set_user_pgdir(struct core_mmu_table_info *pgd_info, void *tbl)
 {
 	vaddr_t va_range_base;
-	void *tbl = xlat_tables_ul1[thread_get_id()];
 
 	core_mmu_get_user_va_range(&va_range_base, NULL);
 	core_mmu_set_info_table(pgd_info, 2, va_range_base, tbl);
 }
 
+void core_mmu_get_user_pgdir(struct core_mmu_table_info *pgd_info)
+{
+	core_mmu_set_user_pgdir(pgd_info, xlat_tables_ul1[thread_get_id()]);
+}
+
+void core_mmu_get_user_map_of_pgdir(struct core_mmu_table_info *pgd_info,
+				    struct user_ta_ctx *utc,
+				    struct core_mmu_user_map *map)
+{
+	map->user_map = virt_to_phys(pgd_info->table) | TABLE_DESC;
+	map->asid = utc->vm_info->asid;
+}
+
 void core_mmu_create_user_map(struct user_ta_ctx *utc,
 			      struct core_mmu_user_map *map)
 {
@@ -537,8 +549,7 @@ void core_mmu_create_user_map(struct user_ta_ctx *utc,
 	core_mmu_get_user_pgdir(&dir_info);
 	memset(dir_info.table, 0, PGT_SIZE);
 	core_mmu_populate_user_map(&dir_info, utc);
-	map->user_map = virt_to_phys(dir_info.table) | TABLE_DESC;
-	map->asid = utc->vm_info->asid;
+	core_mmu_get_user_map_of_pgdir(&dir_info, utc, map);
 }
 
 bool core_mmu_find_table(vaddr_t va, unsigned max_level,
@@ -741,7 +752,17 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		dsb();	/* Make sure the write above is visible */
 	}
 
+#ifdef CFG_PERSISTENT_USER_MAP
+	/*
+	 * Translations of other ASIDs can't be used until their map is set
+	 * again, which invalidates them in turn. Invalidating the new ASID
+	 * also removes cached walks of the user L1 entry changed above.
+	 */
+	if (map && map->user_map)
+		tlbi_asid(map->asid);
+#else
 	tlbi_all();
+#endif
 
 	thread_unmask_exceptions(exceptions);
 }
@@ -821,7 +842,17 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		dsb();	/* Make sure the write above is visible */
 	}
 
+#ifdef CFG_PERSISTENT_USER_MAP
+	/*
+	 * Translations of other ASIDs can't be used until their map is set
+	 * again, which invalidates them in turn. Invalidating the new ASID
+	 * also removes cached walks of the user L1 entry changed above.
+	 */
+	if (map && map->user_map)
+		tlbi_asid(map->asid);
+#else
 	tlbi_all();
+#endif
 
 	thread_unmask_exceptions(exceptions);
 }
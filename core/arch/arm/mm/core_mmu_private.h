@@ -6,6 +6,7 @@
 #define CORE_MMU_PRIVATE_H
 
 #include <mm/core_mmu.h>
+#include <mm/pgt_cache.h>
 #include <mm/tee_mmu_types.h>
 
 
@@ -15,6 +16,43 @@ void core_mmu_set_info_table(struct core_mmu_table_info *tbl_info,
 			     unsigned level, vaddr_t va_base, void *table);
 void core_mmu_populate_user_map(struct core_mmu_table_info *dir_info,
 				struct user_ta_ctx *utc);
+
+/*
+ * core_mmu_populate_user_map_pgt() - Populate a user mapping using the
+ * supplied page tables instead of the tables of the current thread
+ * @dir_info:	Zeroed translation table directory
+ * @utc:	User TA context to map
+ * @pgt:	List of zeroed page tables, one for each directory entry in
+ *		the range covered by the regions of @utc. Updated to the
+ *		first table which wasn't used.
+ */
+void core_mmu_populate_user_map_pgt(struct core_mmu_table_info *dir_info,
+				    struct user_ta_ctx *utc, struct pgt **pgt);
+
+/*
+ * core_mmu_map_user_region_pgt() - Add a region to a user mapping
+ * populated with core_mmu_populate_user_map_pgt()
+ * @dir_info:	Translation table directory of the mapping
+ * @utc:	User TA context of the mapping
+ * @region:	Region to map, not overlapping any mapped region
+ * @pgt:	List of unused zeroed page tables, updated to the first table
+ *		which wasn't used
+ *
+ * Returns false without changing the mapping if there aren't enough
+ * page tables in @pgt.
+ */
+bool core_mmu_map_user_region_pgt(struct core_mmu_table_info *dir_info,
+				  struct user_ta_ctx *utc,
+				  struct vm_region *region, struct pgt **pgt);
+
+/*
+ * core_mmu_unmap_user_region_pgt() - Remove a region mapped with
+ * core_mmu_map_user_region_pgt() or core_mmu_populate_user_map_pgt().
+ * The page tables are left in place. The TLB is not invalidated.
+ */
+void core_mmu_unmap_user_region_pgt(struct core_mmu_table_info *dir_info,
+				    struct vm_region *region);
+
 void core_mmu_map_region(struct tee_mmap_region *mm);
 
 static inline bool core_mmap_is_end_of_table(const struct tee_mmap_region *mm)
@@ -219,15 +219,6 @@ static vaddr_t core_mmu_get_ul1_ttb_va(void)
 	return (vaddr_t)main_mmu_ul1_ttb[thread_get_id()];
 }
 
-static paddr_t core_mmu_get_ul1_ttb_pa(void)
-{
-	paddr_t pa = virt_to_phys((void *)core_mmu_get_ul1_ttb_va());
-
-	if (pa & ~TTB_UL1_MASK)
-		panic("invalid user l1 table");
-	return pa;
-}
-
 static void *core_mmu_alloc_l2(size_t size)
 {
 	/* Can't have this in .bss since it's not initialized yet */
@@ -455,14 +446,33 @@ void core_mmu_set_info_table(struct core_mmu_table_info *tbl_info,
 	}
 }
 
-void core_mmu_get_user_pgdir(struct core_mmu_table_info *pgd_info)
+void core_mmu_set_user_pgdir(struct core_mmu_table_info *pgd_info, void *tbl)
 {
-	void *tbl = (void *)core_mmu_get_ul1_ttb_va();
+	/* A table of PGT_SIZE bytes can also be used as UL1 table */
+	COMPILE_TIME_ASSERT(NUM_UL1_ENTRIES * sizeof(uint32_t) <= PGT_SIZE);
+	COMPILE_TIME_ASSERT(UL1_ALIGNMENT <= PGT_SIZE);
 
 	core_mmu_set_info_table(pgd_info, 1, 0, tbl);
 	pgd_info->num_entries = NUM_UL1_ENTRIES;
 }
 
+void core_mmu_get_user_pgdir(struct core_mmu_table_info *pgd_info)
+{
+	core_mmu_set_user_pgdir(pgd_info, (void *)core_mmu_get_ul1_ttb_va());
+}
+
+void core_mmu_get_user_map_of_pgdir(struct core_mmu_table_info *pgd_info,
+				    struct user_ta_ctx *utc,
+				    struct core_mmu_user_map *map)
+{
+	paddr_t pa = virt_to_phys(pgd_info->table);
+
+	if (pa & ~TTB_UL1_MASK)
+		panic("invalid user l1 table");
+	map->ttbr0 = pa | TEE_MMU_DEFAULT_ATTRS;
+	map->ctxid = utc->vm_info->asid;
+}
+
 void core_mmu_create_user_map(struct user_ta_ctx *utc,
 			      struct core_mmu_user_map *map)
 {
@@ -473,8 +483,7 @@ void core_mmu_create_user_map(struct user_ta_ctx *utc,
 	core_mmu_get_user_pgdir(&dir_info);
 	memset(dir_info.table, 0, dir_info.num_entries * sizeof(uint32_t));
 	core_mmu_populate_user_map(&dir_info, utc);
-	map->ttbr0 = core_mmu_get_ul1_ttb_pa() | TEE_MMU_DEFAULT_ATTRS;
-	map->ctxid = utc->vm_info->asid;
+	core_mmu_get_user_map_of_pgdir(&dir_info, utc, map);
 }
 
 bool core_mmu_find_table(vaddr_t va, unsigned max_level,
@@ -639,7 +648,16 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		isb();
 	}
 
+#ifdef CFG_PERSISTENT_USER_MAP
+	/*
+	 * Translations of other ASIDs can't be used until their map is set
+	 * again, which invalidates them in turn.
+	 */
+	if (map)
+		tlbi_asid(map->ctxid);
+#else
 	tlbi_all();
+#endif
 
 	/* Restore interrupts */
 	thread_unmask_exceptions(exceptions);
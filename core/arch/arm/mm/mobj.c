@@ -8,6 +8,8 @@
 #include <initcall.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
+#include <kernel/refcount.h>
+#include <kernel/slab.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_misc.h>
 #include <mm/core_mmu.h>
@@ -302,6 +304,9 @@ struct mobj_reg_shm {
 	struct mobj mobj;
 	SLIST_ENTRY(mobj_reg_shm) next;
 	uint64_t cookie;
+	/* One reference held by the registration, one per lookup */
+	struct refcount refcount;
+	bool registered;
 	tee_mm_entry_t *mm;
 	paddr_t page_offset;
 	int num_pages;
@@ -311,10 +316,51 @@ struct mobj_reg_shm {
 #define MOBJ_REG_SHM_SIZE(nr_pages) \
 	(sizeof(struct mobj_reg_shm) + sizeof(paddr_t) * (nr_pages))
 
-static SLIST_HEAD(reg_shm_head, mobj_reg_shm) reg_shm_list =
-	SLIST_HEAD_INITIALIZER(reg_shm_head);
+/*
+ * Registered shared memory objects hashed by cookie, a lookup only walks
+ * the few objects of one bucket with the lock held.
+ */
+#define REG_SHM_HASH_BITS	8
+
+SLIST_HEAD(reg_shm_head, mobj_reg_shm);
+
+static struct reg_shm_head reg_shm_hash[BIT(REG_SHM_HASH_BITS)];
+
+static unsigned int reg_shm_lock = SPINLOCK_UNLOCK;
+
+static struct reg_shm_head *reg_shm_bucket(uint64_t cookie)
+{
+	/* Fibonacci hashing, cookies are often aligned addresses */
+	uint64_t h = cookie * 0x9e3779b97f4a7c15ULL;
+
+	return reg_shm_hash + (h >> (64 - REG_SHM_HASH_BITS));
+}
+
+/*
+ * Registrations of up to MOBJ_REG_SHM_SLAB_PAGES pages, the common case,
+ * are allocated from an object cache, larger ones from the heap.
+ */
+#define MOBJ_REG_SHM_SLAB_PAGES	8
+
+static struct slab_cache mobj_reg_shm_cache =
+	SLAB_CACHE_INITIALIZER("mobj_reg_shm",
+			       MOBJ_REG_SHM_SIZE(MOBJ_REG_SHM_SLAB_PAGES),
+			       NULL);
+
+static struct mobj_reg_shm *reg_shm_calloc(size_t num_pages)
+{
+	if (num_pages <= MOBJ_REG_SHM_SLAB_PAGES)
+		return slab_alloc(&mobj_reg_shm_cache);
+	return calloc(1, MOBJ_REG_SHM_SIZE(num_pages));
+}
 
-static unsigned int reg_shm_slist_lock = SPINLOCK_UNLOCK;
+static void reg_shm_release(struct mobj_reg_shm *mrs)
+{
+	if (mrs->num_pages <= MOBJ_REG_SHM_SLAB_PAGES)
+		slab_free(&mobj_reg_shm_cache, mrs);
+	else
+		free(mrs);
+}
 
 static struct mobj_reg_shm *to_mobj_reg_shm(struct mobj *mobj);
 
@@ -368,18 +414,44 @@ static void *mobj_reg_shm_get_va(struct mobj *mobj, size_t offst)
 				 mrs->page_offset);
 }
 
+static void reg_shm_put(struct mobj_reg_shm *mrs)
+{
+	if (!refcount_dec(&mrs->refcount))
+		return;
+
+	mobj_reg_shm_unmap(&mrs->mobj);
+	reg_shm_release(mrs);
+}
+
+/* Called with reg_shm_lock held */
+static void reg_shm_unlink(struct mobj_reg_shm *mrs)
+{
+	SLIST_REMOVE(reg_shm_bucket(mrs->cookie), mrs, mobj_reg_shm, next);
+	mrs->registered = false;
+}
+
+/*
+ * Removes @mrs from the hash table unless already done, returns true if
+ * the caller has to drop the reference of the registration.
+ */
+static bool reg_shm_unregister(struct mobj_reg_shm *mrs)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&reg_shm_lock);
+	bool registered = mrs->registered;
+
+	if (registered)
+		reg_shm_unlink(mrs);
+	cpu_spin_unlock_xrestore(&reg_shm_lock, exceptions);
+
+	return registered;
+}
+
 static void mobj_reg_shm_free(struct mobj *mobj)
 {
 	struct mobj_reg_shm *mobj_reg_shm = to_mobj_reg_shm(mobj);
-	uint32_t exceptions;
 
-	mobj_reg_shm_unmap(mobj);
-
-	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_REMOVE(&reg_shm_list, mobj_reg_shm,
-		     mobj_reg_shm, next);
-	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
-	free(mobj_reg_shm);
+	if (reg_shm_unregister(mobj_reg_shm))
+		reg_shm_put(mobj_reg_shm);
 }
 
 static TEE_Result mobj_reg_shm_get_cattr(struct mobj *mobj __unused,
@@ -428,7 +500,7 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 	if (!num_pages)
 		return NULL;
 
-	mobj_reg_shm = calloc(1, MOBJ_REG_SHM_SIZE(num_pages));
+	mobj_reg_shm = reg_shm_calloc(num_pages);
 	if (!mobj_reg_shm)
 		return NULL;
 
@@ -451,31 +523,68 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 			goto err;
 	}
 
-	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_INSERT_HEAD(&reg_shm_list, mobj_reg_shm, next);
-	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+	refcount_set(&mobj_reg_shm->refcount, 1);
+	mobj_reg_shm->registered = true;
+
+	exceptions = cpu_spin_lock_xsave(&reg_shm_lock);
+	SLIST_INSERT_HEAD(reg_shm_bucket(cookie), mobj_reg_shm, next);
+	cpu_spin_unlock_xrestore(&reg_shm_lock, exceptions);
 
 	return &mobj_reg_shm->mobj;
 err:
-	free(mobj_reg_shm);
+	reg_shm_release(mobj_reg_shm);
+	return NULL;
+}
+
+/* Called with reg_shm_lock held */
+static struct mobj_reg_shm *reg_shm_find(uint64_t cookie)
+{
+	struct mobj_reg_shm *mrs;
+
+	SLIST_FOREACH(mrs, reg_shm_bucket(cookie), next)
+		if (mrs->cookie == cookie)
+			return mrs;
+
 	return NULL;
 }
 
 struct mobj *mobj_reg_shm_find_by_cookie(uint64_t cookie)
 {
-	struct mobj_reg_shm *mobj_reg_shm;
+	struct mobj_reg_shm *mrs;
 	uint32_t exceptions;
 
-	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_FOREACH(mobj_reg_shm, &reg_shm_list, next) {
-		if (mobj_reg_shm->cookie == cookie) {
-			cpu_spin_unlock_xrestore(&reg_shm_slist_lock,
-						 exceptions);
-			return &mobj_reg_shm->mobj;
-		}
-	}
-	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
-	return NULL;
+	exceptions = cpu_spin_lock_xsave(&reg_shm_lock);
+	mrs = reg_shm_find(cookie);
+	/* A registered object holds the reference of the registration */
+	if (mrs && !refcount_inc(&mrs->refcount))
+		panic();
+	cpu_spin_unlock_xrestore(&reg_shm_lock, exceptions);
+
+	return mrs ? &mrs->mobj : NULL;
+}
+
+void mobj_reg_shm_put(struct mobj *mobj)
+{
+	if (mobj)
+		reg_shm_put(to_mobj_reg_shm(mobj));
+}
+
+TEE_Result mobj_reg_shm_release_by_cookie(uint64_t cookie)
+{
+	struct mobj_reg_shm *mrs;
+	uint32_t exceptions;
+
+	exceptions = cpu_spin_lock_xsave(&reg_shm_lock);
+	mrs = reg_shm_find(cookie);
+	if (mrs)
+		reg_shm_unlink(mrs);
+	cpu_spin_unlock_xrestore(&reg_shm_lock, exceptions);
+
+	if (!mrs)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	reg_shm_put(mrs);
+	return TEE_SUCCESS;
 }
 
 TEE_Result mobj_reg_shm_map(struct mobj *mobj)
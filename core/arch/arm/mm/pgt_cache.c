@@ -58,7 +58,7 @@ static struct pgt_cache pgt_cache_list = SLIST_HEAD_INITIALIZER(pgt_cache_list);
 
 static struct pgt pgt_entries[PGT_CACHE_SIZE];
 
-static struct mutex pgt_mu = MUTEX_INITIALIZER;
+static struct mutex pgt_mu = MUTEX_INITIALIZER_NAMED("pgt_mu");
 static struct condvar pgt_cv = CONDVAR_INITIALIZER;
 
 #if defined(CFG_WITH_PAGER) && defined(CFG_WITH_LPAE)
@@ -115,6 +115,8 @@ void pgt_init(void)
 		p->tbl = pgt_tables[n];
 		SLIST_INSERT_HEAD(&pgt_free_list, p, link);
 	}
+
+	pgt_persist_init();
 }
 #endif
 
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+/*
+ * Translation tables kept with the user TA contexts.
+ *
+ * Normally each thread populates its own translation tables from the
+ * regions of a user TA context each time the context is mapped. Here the
+ * tables of a context are populated once and kept until the regions of
+ * the context are changed, mapping the context again is then only a
+ * switch of the translation table base and ASID followed by a TLB
+ * invalidation of that ASID. The regions of the parameters, which change
+ * with each invocation, are mapped into and removed from the kept tables
+ * directly.
+ *
+ * The tables are taken from a pool of CFG_PERSISTENT_USER_MAP_NUM_PGT
+ * tables. When the pool runs out the tables of the least recently used
+ * context which isn't mapped are reclaimed. If that isn't enough the
+ * caller falls back to the tables of the thread.
+ */
+
+#include <assert.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/tlb_helpers.h>
+#include <kernel/user_ta.h>
+#include <mm/core_mmu.h>
+#include <mm/pgt_cache.h>
+#include <mm/tee_mmu_types.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <trace.h>
+#include <util.h>
+
+#include "core_mmu_private.h"
+
+#define NUM_PGT		CFG_PERSISTENT_USER_MAP_NUM_PGT
+
+static struct pgt pgt_entries[NUM_PGT];
+static struct pgt_cache pgt_free_list = SLIST_HEAD_INITIALIZER(pgt_free_list);
+static size_t pgt_num_free;
+
+/* Contexts holding tables but not mapped, least recently used first */
+static TAILQ_HEAD(pgt_persist_head, pgt_persist) pgt_lru =
+	TAILQ_HEAD_INITIALIZER(pgt_lru);
+
+static struct mutex pgt_persist_mu = MUTEX_INITIALIZER;
+
+void pgt_persist_init(void)
+{
+	/* See pgt_init() for the choice of section */
+	static uint8_t pgt_tables[NUM_PGT][PGT_SIZE]
+			__aligned(PGT_SIZE) __section(".nozi.pgt_cache");
+	size_t n;
+
+	for (n = 0; n < NUM_PGT; n++) {
+		struct pgt *p = pgt_entries + n;
+
+		p->tbl = pgt_tables[n];
+		SLIST_INSERT_HEAD(&pgt_free_list, p, link);
+	}
+	pgt_num_free = NUM_PGT;
+}
+
+static struct pgt *pop_pgt(void)
+{
+	struct pgt *p = SLIST_FIRST(&pgt_free_list);
+
+	assert(p);
+	SLIST_REMOVE_HEAD(&pgt_free_list, link);
+	pgt_num_free--;
+	memset(p->tbl, 0, PGT_SIZE);
+	return p;
+}
+
+static void push_pgt(struct pgt *p)
+{
+	SLIST_INSERT_HEAD(&pgt_free_list, p, link);
+	pgt_num_free++;
+}
+
+/*
+ * Returns the tables of a context which isn't mapped to the pool. The
+ * walks of the ASID may still be cached and must be invalidated before
+ * the tables are used for anything else.
+ */
+static void free_tables(struct user_ta_ctx *utc)
+{
+	struct pgt_persist *pp = &utc->pgt_persist;
+	struct pgt *p;
+
+	assert(!pp->num_users);
+	if (!pp->dir)
+		return;
+
+	while (!SLIST_EMPTY(&pp->pgt_cache)) {
+		p = SLIST_FIRST(&pp->pgt_cache);
+		SLIST_REMOVE_HEAD(&pp->pgt_cache, link);
+		push_pgt(p);
+	}
+	push_pgt(pp->dir);
+	pp->dir = NULL;
+	pp->pgt_spare = NULL;
+	pp->num_pgt = 0;
+	pp->valid = false;
+
+	tlbi_asid(utc->vm_info->asid);
+}
+
+static size_t get_num_req_pgt(struct user_ta_ctx *utc)
+{
+	struct vm_region *r = TAILQ_FIRST(&utc->vm_info->regions);
+	struct vm_region *r_last;
+	vaddr_t b;
+	vaddr_t e;
+
+	/* The directory is always needed */
+	if (!r)
+		return 1;
+
+	r_last = TAILQ_LAST(&utc->vm_info->regions, vm_region_head);
+	b = ROUNDDOWN(r->va, CORE_MMU_PGDIR_SIZE);
+	e = ROUNDUP(r_last->va + r_last->size, CORE_MMU_PGDIR_SIZE);
+	return ((e - b) >> CORE_MMU_PGDIR_SHIFT) + 1;
+}
+
+static bool alloc_tables(struct user_ta_ctx *utc)
+{
+	struct pgt_persist *pp = &utc->pgt_persist;
+	size_t num_pgt = get_num_req_pgt(utc);
+	struct pgt_persist *lru;
+	size_t n;
+
+	if (num_pgt > NUM_PGT)
+		return false;
+
+	while (pgt_num_free < num_pgt) {
+		lru = TAILQ_FIRST(&pgt_lru);
+		if (!lru)
+			return false;
+		TAILQ_REMOVE(&pgt_lru, lru, link);
+		free_tables(container_of(lru, struct user_ta_ctx,
+					 pgt_persist));
+	}
+
+	pp->dir = pop_pgt();
+	for (n = 1; n < num_pgt; n++)
+		SLIST_INSERT_HEAD(&pp->pgt_cache, pop_pgt(), link);
+	pp->num_pgt = num_pgt;
+	return true;
+}
+
+/*
+ * Returns in @map the mapping of @utc in the tables kept with the
+ * context, populating the tables first if needed. The mapping is used by
+ * the current thread until pgt_persist_unmap() is called. Returns false
+ * if there aren't enough tables available, the context must then be
+ * mapped with core_mmu_create_user_map() instead.
+ */
+bool pgt_persist_map(struct user_ta_ctx *utc, struct core_mmu_user_map *map)
+{
+	struct thread_specific_data *tsd = thread_get_tsd();
+	struct pgt_persist *pp = &utc->pgt_persist;
+	struct core_mmu_table_info dir_info;
+	bool ret = false;
+
+	assert(!tsd->pgt_persist_utc);
+
+	mutex_lock(&pgt_persist_mu);
+
+	if (!pp->valid) {
+		/* Tables mapped by another thread can't be changed */
+		if (pp->num_users)
+			goto out;
+		if (pp->dir)
+			TAILQ_REMOVE(&pgt_lru, pp, link);
+		free_tables(utc);
+		if (!alloc_tables(utc))
+			goto out;
+		core_mmu_set_user_pgdir(&dir_info, pp->dir->tbl);
+		pp->pgt_spare = SLIST_FIRST(&pp->pgt_cache);
+		core_mmu_populate_user_map_pgt(&dir_info, utc, &pp->pgt_spare);
+		pp->valid = true;
+	} else {
+		if (!pp->num_users)
+			TAILQ_REMOVE(&pgt_lru, pp, link);
+		core_mmu_set_user_pgdir(&dir_info, pp->dir->tbl);
+	}
+
+	core_mmu_get_user_map_of_pgdir(&dir_info, utc, map);
+	pp->num_users++;
+	tsd->pgt_persist_utc = utc;
+	ret = true;
+out:
+	mutex_unlock(&pgt_persist_mu);
+	return ret;
+}
+
+/* Ends the use of the mapping returned by pgt_persist_map(), if any */
+void pgt_persist_unmap(void)
+{
+	struct thread_specific_data *tsd = thread_get_tsd();
+	struct pgt_persist *pp;
+
+	if (!tsd->pgt_persist_utc)
+		return;
+	pp = &tsd->pgt_persist_utc->pgt_persist;
+	tsd->pgt_persist_utc = NULL;
+
+	mutex_lock(&pgt_persist_mu);
+
+	assert(pp->num_users);
+	pp->num_users--;
+	if (!pp->num_users)
+		TAILQ_INSERT_TAIL(&pgt_lru, pp, link);
+
+	mutex_unlock(&pgt_persist_mu);
+}
+
+/*
+ * Called when the regions of @utc have changed, the tables are populated
+ * again the next time the context is mapped.
+ */
+void pgt_persist_invalidate(struct user_ta_ctx *utc)
+{
+	mutex_lock(&pgt_persist_mu);
+	utc->pgt_persist.valid = false;
+	mutex_unlock(&pgt_persist_mu);
+}
+
+/*
+ * Called when @reg has been added to the regions of @utc. The region is
+ * mapped in the tables directly if the spare tables are enough, else the
+ * tables are populated again the next time the context is mapped.
+ */
+void pgt_persist_map_region(struct user_ta_ctx *utc, struct vm_region *reg)
+{
+	struct pgt_persist *pp = &utc->pgt_persist;
+	struct core_mmu_table_info dir_info;
+
+	mutex_lock(&pgt_persist_mu);
+
+	if (pp->valid) {
+		core_mmu_set_user_pgdir(&dir_info, pp->dir->tbl);
+		if (!core_mmu_map_user_region_pgt(&dir_info, utc, reg,
+						  &pp->pgt_spare))
+			pp->valid = false;
+	}
+
+	mutex_unlock(&pgt_persist_mu);
+}
+
+/*
+ * Called when @reg is about to be removed from the regions of @utc. The
+ * entries of the region are cleared and the TLB of the ASID invalidated.
+ */
+void pgt_persist_unmap_region(struct user_ta_ctx *utc,
+			      struct vm_region *reg)
+{
+	struct pgt_persist *pp = &utc->pgt_persist;
+	struct core_mmu_table_info dir_info;
+
+	mutex_lock(&pgt_persist_mu);
+
+	if (pp->valid) {
+		core_mmu_set_user_pgdir(&dir_info, pp->dir->tbl);
+		core_mmu_unmap_user_region_pgt(&dir_info, reg);
+		tlbi_asid(utc->vm_info->asid);
+	}
+
+	mutex_unlock(&pgt_persist_mu);
+}
+
+/* Called when the vm_info of @utc is about to be freed */
+void pgt_persist_release(struct user_ta_ctx *utc)
+{
+	struct pgt_persist *pp = &utc->pgt_persist;
+
+	mutex_lock(&pgt_persist_mu);
+
+	if (pp->dir) {
+		TAILQ_REMOVE(&pgt_lru, pp, link);
+		free_tables(utc);
+	}
+
+	mutex_unlock(&pgt_persist_mu);
+}
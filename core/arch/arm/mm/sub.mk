@@ -8,4 +8,5 @@ srcs-y += core_mmu_v7.c
 endif
 srcs-y += tee_mm.c
 srcs-y += pgt_cache.c
+srcs-$(CFG_PERSISTENT_USER_MAP) += pgt_persist.c
 srcs-y += mobj.c
@@ -4,16 +4,51 @@
  */
 
 #include <kernel/panic.h>
+#include <kernel/slab.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_common.h>
 #include <mm/tee_mm.h>
 #include <mm/tee_pager.h>
+#include <string.h>
 #include <trace.h>
 #include <util.h>
 
+/*
+ * The free space of a pool is kept as maximal free extents in a tree
+ * ordered by offset where each node also knows the largest extent below
+ * it. The first fitting extent in address order, or the last one with
+ * TEE_MM_POOL_HI_ALLOC, is found in O(log n) and the allocation is taken
+ * from its low end, or high end, which gives the same placement as a
+ * first fit walk over the allocated entries. A freed entry is merged with
+ * the free extents next to it, also in O(log n).
+ */
+
+static struct slab_cache tee_mm_entry_cache =
+	SLAB_CACHE_INITIALIZER("tee_mm_entry", sizeof(tee_mm_entry_t), NULL);
+
+static tee_mm_entry_t *node_to_entry(struct va_tree_node *node)
+{
+	return container_of(node, tee_mm_entry_t, node);
+}
+
+static void insert_entry(struct va_tree *tree, tee_mm_entry_t *e,
+			 uint32_t offset, uint32_t size)
+{
+	e->offset = offset;
+	e->size = size;
+	va_tree_insert(tree, &e->node, offset, size);
+}
+
+static size_t pool_num_units(const tee_mm_pool_t *pool)
+{
+	return (pool->hi - pool->lo) >> pool->shift;
+}
+
 bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
 		 uint32_t flags)
 {
+	tee_mm_entry_t *e;
+
 	if (pool == NULL)
 		return false;
 
@@ -22,277 +57,357 @@ bool tee_mm_init(tee_mm_pool_t *pool, paddr_t lo, paddr_t hi, uint8_t shift,
 
 	assert(((uint64_t)(hi - lo) >> shift) < (uint64_t)UINT32_MAX);
 
+	memset(pool, 0, sizeof(*pool));
 	pool->lo = lo;
 	pool->hi = hi;
 	pool->shift = shift;
 	pool->flags = flags;
-	pool->entry = calloc(1, sizeof(tee_mm_entry_t));
-
-	if (pool->entry == NULL)
-		return false;
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		pool->entry->offset = ((hi - lo - 1) >> shift) + 1;
-	pool->entry->pool = pool;
 	pool->lock = SPINLOCK_UNLOCK;
 
+	if (hi > lo) {
+		e = slab_alloc(&tee_mm_entry_cache);
+		if (e == NULL)
+			return false;
+		e->pool = pool;
+		insert_entry(&pool->free, e, 0, pool_num_units(pool));
+		pool->num_free = 1;
+	}
+	pool->initialized = true;
+
 	return true;
 }
 
-void tee_mm_final(tee_mm_pool_t *pool)
+static void free_tree(struct va_tree *tree)
 {
-	if (pool == NULL || pool->entry == NULL)
-		return;
+	struct va_tree_node *node;
 
-	while (pool->entry->next != NULL)
-		tee_mm_free(pool->entry->next);
-	free(pool->entry);
-	pool->entry = NULL;
+	while (tree->root) {
+		node = tree->root;
+		va_tree_remove(tree, node);
+		slab_free(&tee_mm_entry_cache, node_to_entry(node));
+	}
 }
 
-static void tee_mm_add(tee_mm_entry_t *p, tee_mm_entry_t *nn)
+void tee_mm_final(tee_mm_pool_t *pool)
 {
-	/* add to list */
-	nn->next = p->next;
-	p->next = nn;
+	if (pool == NULL || !pool->initialized)
+		return;
+
+	free_tree(&pool->used);
+	free_tree(&pool->free);
+	pool->num_entries = 0;
+	pool->num_free = 0;
+	pool->initialized = false;
 }
 
 #ifdef CFG_WITH_STATS
-static size_t tee_mm_stats_allocated(tee_mm_pool_t *pool)
+void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
+			   bool reset)
 {
-	tee_mm_entry_t *entry;
-	uint32_t sz = 0;
+	uint32_t exceptions;
 
 	if (!pool)
-		return 0;
+		return;
 
-	entry = pool->entry;
-	while (entry) {
-		sz += entry->size;
-		entry = entry->next;
-	}
+	memset(stats, 0, sizeof(*stats));
+
+	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	return sz << pool->shift;
+	stats->size = pool->hi - pool->lo;
+	stats->max_allocated = pool->max_allocated << pool->shift;
+	stats->allocated = pool->allocated << pool->shift;
+	stats->num_alloc_fail = pool->num_alloc_fail;
+	stats->biggest_alloc_fail = pool->biggest_alloc_fail;
+	stats->biggest_alloc_fail_used =
+		pool->biggest_alloc_fail_used << pool->shift;
+
+	if (reset) {
+		pool->max_allocated = 0;
+		pool->num_alloc_fail = 0;
+		pool->biggest_alloc_fail = 0;
+		pool->biggest_alloc_fail_used = 0;
+	}
+	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 }
 
-void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
-			   bool reset)
+void tee_mm_get_frag_stats(tee_mm_pool_t *pool,
+			   struct tee_mm_frag_stats *stats)
 {
 	uint32_t exceptions;
 
-	if (!pool)
-		return;
-
 	memset(stats, 0, sizeof(*stats));
+	if (!pool || !pool->initialized)
+		return;
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	stats->size = pool->hi - pool->lo;
-	stats->max_allocated = pool->max_allocated;
-	stats->allocated = tee_mm_stats_allocated(pool);
+	stats->num_free_extents = pool->num_free;
+	stats->free_size = (pool_num_units(pool) - pool->allocated) <<
+			   pool->shift;
+	if (pool->free.root)
+		stats->largest_free_extent = pool->free.root->max_size <<
+					     pool->shift;
 
-	if (reset)
-		pool->max_allocated = 0;
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 }
 
-static void update_max_allocated(tee_mm_pool_t *pool)
+static void stats_alloc(tee_mm_pool_t *pool, size_t psize)
+{
+	pool->allocated += psize;
+	if (pool->allocated > pool->max_allocated)
+		pool->max_allocated = pool->allocated;
+}
+
+static void stats_free(tee_mm_pool_t *pool, size_t psize)
 {
-	size_t sz = tee_mm_stats_allocated(pool);
+	pool->allocated -= psize;
+}
 
-	if (sz > pool->max_allocated)
-		pool->max_allocated = sz;
+static void stats_alloc_fail(tee_mm_pool_t *pool, size_t size)
+{
+	pool->num_alloc_fail++;
+	if (size > pool->biggest_alloc_fail) {
+		pool->biggest_alloc_fail = size;
+		pool->biggest_alloc_fail_used = pool->allocated;
+	}
 }
 #else /* CFG_WITH_STATS */
-static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
+static inline void stats_alloc(tee_mm_pool_t *pool __unused,
+			       size_t psize __unused)
+{
+}
+
+static inline void stats_free(tee_mm_pool_t *pool __unused,
+			      size_t psize __unused)
+{
+}
+
+static inline void stats_alloc_fail(tee_mm_pool_t *pool __unused,
+				    size_t size __unused)
 {
 }
 #endif /* CFG_WITH_STATS */
 
 tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, size_t size)
 {
-	size_t psize;
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *unused = NULL;
+	struct va_tree_node *node;
+	tee_mm_entry_t *ext;
 	tee_mm_entry_t *nn;
-	size_t remaining;
 	uint32_t exceptions;
+	uint32_t offset;
+	bool hi_alloc;
+	size_t psize;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->initialized)
 		return NULL;
 
-	nn = malloc(sizeof(tee_mm_entry_t));
+	nn = slab_alloc(&tee_mm_entry_cache);
 	if (!nn)
 		return NULL;
 
-	exceptions = cpu_spin_lock_xsave(&pool->lock);
-
-	entry = pool->entry;
 	if (size == 0)
 		psize = 0;
 	else
 		psize = ((size - 1) >> pool->shift) + 1;
+	hi_alloc = pool->flags & TEE_MM_POOL_HI_ALLOC;
 
-	/* find free slot */
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL && psize >
-		       (entry->offset - entry->next->offset -
-			entry->next->size))
-			entry = entry->next;
-	} else {
-		while (entry->next != NULL && psize >
-		       (entry->next->offset - entry->size - entry->offset))
-			entry = entry->next;
-	}
+	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	/* check if we have enough memory */
-	if (entry->next == NULL) {
-		if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-			/*
-			 * entry->offset is a "block count" offset from
-			 * pool->lo. The byte offset is
-			 * (entry->offset << pool->shift).
-			 * In the HI_ALLOC allocation scheme the memory is
-			 * allocated from the end of the segment, thus to
-			 * validate there is sufficient memory validate that
-			 * (entry->offset << pool->shift) > size.
-			 */
-			if ((entry->offset << pool->shift) < size) {
-				/* out of memory */
-				goto err;
-			}
+	if (!psize) {
+		/* Takes no space, placed at the start of the allocations */
+		nn->offset = hi_alloc ? pool_num_units(pool) : 0;
+		nn->size = 0;
+	} else {
+		node = va_tree_find_fit(&pool->free, psize, hi_alloc);
+		if (!node) {
+			/* out of memory */
+			goto err;
+		}
+		ext = node_to_entry(node);
+		if (hi_alloc)
+			offset = ext->offset + ext->size - psize;
+		else
+			offset = ext->offset;
+		va_tree_remove(&pool->free, node);
+
+		if (ext->size == psize) {
+			unused = ext;
+			pool->num_free--;
+		} else if (hi_alloc) {
+			insert_entry(&pool->free, ext, ext->offset,
+				     ext->size - psize);
 		} else {
-			if (pool->hi <= pool->lo)
-				panic("invalid pool");
-
-			remaining = (pool->hi - pool->lo);
-			remaining -= ((entry->offset + entry->size) <<
-				      pool->shift);
-
-			if (remaining < size) {
-				/* out of memory */
-				goto err;
-			}
+			insert_entry(&pool->free, ext, ext->offset + psize,
+				     ext->size - psize);
 		}
+		insert_entry(&pool->used, nn, offset, psize);
+		stats_alloc(pool, psize);
 	}
-
-	tee_mm_add(entry, nn);
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		nn->offset = entry->offset - psize;
-	else
-		nn->offset = entry->offset + entry->size;
-	nn->size = psize;
 	nn->pool = pool;
-
-	update_max_allocated(pool);
+	pool->num_entries++;
 
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
+	slab_free(&tee_mm_entry_cache, unused);
 	return nn;
 err:
+	stats_alloc_fail(pool, size);
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
-	free(nn);
+	slab_free(&tee_mm_entry_cache, nn);
 	return NULL;
 }
 
-static inline bool fit_in_gap(tee_mm_pool_t *pool, tee_mm_entry_t *e,
-			      paddr_t offslo, paddr_t offshi)
-{
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		if (offshi > e->offset ||
-		    (e->next != NULL &&
-		     (offslo < e->next->offset + e->next->size)) ||
-		    (offshi << pool->shift) - 1 > (pool->hi - pool->lo))
-			/* memory not available */
-			return false;
-	} else {
-		if (offslo < (e->offset + e->size) ||
-		    (e->next != NULL && (offshi > e->next->offset)) ||
-		    (offshi << pool->shift) > (pool->hi - pool->lo))
-			/* memory not available */
-			return false;
-	}
-
-	return true;
-}
-
 tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, paddr_t base, size_t size)
 {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *unused[2] = { NULL, NULL };
+	struct va_tree_node *node;
+	tee_mm_entry_t *spare;
+	tee_mm_entry_t *ext;
+	uint32_t exceptions;
+	paddr_t ext_end;
 	paddr_t offslo;
 	paddr_t offshi;
 	tee_mm_entry_t *mm;
-	uint32_t exceptions;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->initialized)
 		return NULL;
 
 	/* Wrapping and sanity check */
 	if ((base + size) < base || base < pool->lo)
 		return NULL;
 
-	mm = malloc(sizeof(tee_mm_entry_t));
+	mm = slab_alloc(&tee_mm_entry_cache);
 	if (!mm)
 		return NULL;
+	/* Needed if the range splits a free extent in two */
+	spare = slab_alloc(&tee_mm_entry_cache);
+	if (!spare) {
+		slab_free(&tee_mm_entry_cache, mm);
+		return NULL;
+	}
 
-	exceptions = cpu_spin_lock_xsave(&pool->lock);
-
-	entry = pool->entry;
 	offslo = (base - pool->lo) >> pool->shift;
 	offshi = ((base - pool->lo + size - 1) >> pool->shift) + 1;
 
-	/* find slot */
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL &&
-		       offshi < entry->next->offset + entry->next->size)
-			entry = entry->next;
-	} else {
-		while (entry->next != NULL && offslo > entry->next->offset)
-			entry = entry->next;
+	exceptions = cpu_spin_lock_xsave(&pool->lock);
+
+	if (offshi <= offslo) {
+		/* Takes no space */
+		if (offslo > pool_num_units(pool))
+			goto err;
+		mm->offset = offslo;
+		mm->size = 0;
+		unused[0] = spare;
+		goto out;
 	}
 
 	/* Check that memory is available */
-	if (!fit_in_gap(pool, entry, offslo, offshi))
+	node = va_tree_find(&pool->free, offslo);
+	if (!node)
+		goto err;
+	ext = node_to_entry(node);
+	ext_end = ext->offset + ext->size;
+	if (offshi > ext_end)
 		goto err;
 
-	tee_mm_add(entry, mm);
+	va_tree_remove(&pool->free, node);
+	if (offslo > ext->offset) {
+		insert_entry(&pool->free, ext, ext->offset,
+			     offslo - ext->offset);
+		if (ext_end > offshi) {
+			spare->pool = pool;
+			insert_entry(&pool->free, spare, offshi,
+				     ext_end - offshi);
+			pool->num_free++;
+		} else {
+			unused[0] = spare;
+		}
+	} else {
+		unused[0] = spare;
+		if (ext_end > offshi) {
+			insert_entry(&pool->free, ext, offshi,
+				     ext_end - offshi);
+		} else {
+			unused[1] = ext;
+			pool->num_free--;
+		}
+	}
 
-	mm->offset = offslo;
-	mm->size = offshi - offslo;
+	insert_entry(&pool->used, mm, offslo, offshi - offslo);
+	stats_alloc(pool, mm->size);
+out:
 	mm->pool = pool;
-
-	update_max_allocated(pool);
+	pool->num_entries++;
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
+	slab_free(&tee_mm_entry_cache, unused[0]);
+	slab_free(&tee_mm_entry_cache, unused[1]);
 	return mm;
 err:
+	stats_alloc_fail(pool, size);
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
-	free(mm);
+	slab_free(&tee_mm_entry_cache, spare);
+	slab_free(&tee_mm_entry_cache, mm);
 	return NULL;
 }
 
 void tee_mm_free(tee_mm_entry_t *p)
 {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *unused[2] = { NULL, NULL };
+	struct va_tree_node *node;
+	tee_mm_pool_t *pool;
 	uint32_t exceptions;
+	tee_mm_entry_t *ext;
+	uint32_t offset;
+	uint32_t end;
 
 	if (!p || !p->pool)
 		return;
+	pool = p->pool;
 
-	exceptions = cpu_spin_lock_xsave(&p->pool->lock);
-	entry = p->pool->entry;
+	exceptions = cpu_spin_lock_xsave(&pool->lock);
 
-	/* remove entry from list */
-	while (entry->next != NULL && entry->next != p)
-		entry = entry->next;
+	pool->num_entries--;
+	if (!p->size) {
+		unused[0] = p;
+		goto out;
+	}
 
-	if (!entry->next)
+	if (va_tree_find(&pool->used, p->offset) != &p->node)
 		panic("invalid mm_entry");
+	va_tree_remove(&pool->used, &p->node);
+	stats_free(pool, p->size);
+
+	/* The entry becomes a free extent, merged with its neighbours */
+	ext = p;
+	offset = p->offset;
+	end = p->offset + p->size;
+	if (offset) {
+		node = va_tree_find(&pool->free, offset - 1);
+		if (node) {
+			va_tree_remove(&pool->free, node);
+			unused[0] = ext;
+			ext = node_to_entry(node);
+			offset = ext->offset;
+			pool->num_free--;
+		}
+	}
+	node = va_tree_find(&pool->free, end);
+	if (node) {
+		va_tree_remove(&pool->free, node);
+		unused[1] = node_to_entry(node);
+		end = unused[1]->offset + unused[1]->size;
+		pool->num_free--;
+	}
+	insert_entry(&pool->free, ext, offset, end - offset);
+	pool->num_free++;
 
-	entry->next = entry->next->next;
-	cpu_spin_unlock_xrestore(&p->pool->lock, exceptions);
+out:
+	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 
-	free(p);
+	slab_free(&tee_mm_entry_cache, unused[0]);
+	slab_free(&tee_mm_entry_cache, unused[1]);
 }
 
 size_t tee_mm_get_bytes(const tee_mm_entry_t *mm)
@@ -313,11 +428,11 @@ bool tee_mm_is_empty(tee_mm_pool_t *pool)
 	bool ret;
 	uint32_t exceptions;
 
-	if (pool == NULL || pool->entry == NULL)
+	if (pool == NULL || !pool->initialized)
 		return true;
 
 	exceptions = cpu_spin_lock_xsave(&pool->lock);
-	ret = pool->entry == NULL || pool->entry->next == NULL;
+	ret = !pool->num_entries;
 	cpu_spin_unlock_xrestore(&pool->lock, exceptions);
 
 	return ret;
@@ -334,28 +449,20 @@ tee_mm_pool_t tee_mm_shm;
 
 tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, paddr_t addr)
 {
-	tee_mm_entry_t *entry = pool->entry;
-	uint16_t offset = (addr - pool->lo) >> pool->shift;
+	tee_mm_pool_t *p = (tee_mm_pool_t *)pool;
+	struct va_tree_node *node;
 	uint32_t exceptions;
 
-	if (addr > pool->hi || addr < pool->lo)
+	if (!pool->initialized || addr > pool->hi || addr < pool->lo)
 		return NULL;
 
-	exceptions = cpu_spin_lock_xsave(&((tee_mm_pool_t *)pool)->lock);
-
-	while (entry->next != NULL) {
-		entry = entry->next;
+	exceptions = cpu_spin_lock_xsave(&p->lock);
+	node = va_tree_find(&p->used, (addr - pool->lo) >> pool->shift);
+	cpu_spin_unlock_xrestore(&p->lock, exceptions);
 
-		if ((offset >= entry->offset) &&
-		    (offset < (entry->offset + entry->size))) {
-			cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock,
-						 exceptions);
-			return entry;
-		}
-	}
-
-	cpu_spin_unlock_xrestore(&((tee_mm_pool_t *)pool)->lock, exceptions);
-	return NULL;
+	if (!node)
+		return NULL;
+	return node_to_entry(node);
 }
 
 uintptr_t tee_mm_get_smem(const tee_mm_entry_t *mm)
@@ -8,10 +8,12 @@
 #include <assert.h>
 #include <bitstring.h>
 #include <kernel/panic.h>
+#include <kernel/slab.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_common.h>
 #include <kernel/tee_misc.h>
 #include <kernel/tlb_helpers.h>
+#include <kernel/va_tree.h>
 #include <mm/core_memprot.h>
 #include <mm/core_mmu.h>
 #include <mm/mobj.h>
@@ -55,6 +57,9 @@
 static bitstr_t bit_decl(g_asid, MMU_NUM_ASIDS);
 static unsigned int g_asid_spinlock = SPINLOCK_UNLOCK;
 
+static struct slab_cache vm_region_cache =
+	SLAB_CACHE_INITIALIZER("vm_region", sizeof(struct vm_region), NULL);
+
 static vaddr_t select_va_in_range(vaddr_t prev_end, uint32_t prev_attr,
 				  vaddr_t next_begin, uint32_t next_attr,
 				  const struct vm_region *reg)
@@ -107,6 +112,15 @@ static vaddr_t select_va_in_range(vaddr_t prev_end, uint32_t prev_attr,
 	return 0;
 }
 
+static struct vm_region *find_vm_region(struct vm_info *vmi, vaddr_t va)
+{
+	struct va_tree_node *node = va_tree_find(&vmi->region_tree, va);
+
+	if (!node)
+		return NULL;
+	return container_of(node, struct vm_region, tree_node);
+}
+
 static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 {
 	struct vm_region *r;
@@ -134,7 +148,7 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 			if (va) {
 				reg->va = va;
 				TAILQ_INSERT_HEAD(&vmi->regions, reg, link);
-				return TEE_SUCCESS;
+				goto out;
 			}
 		} else {
 			va = select_va_in_range(prev_r->va + prev_r->size,
@@ -143,7 +157,7 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 			if (va) {
 				reg->va = va;
 				TAILQ_INSERT_BEFORE(r, reg, link);
-				return TEE_SUCCESS;
+				goto out;
 			}
 		}
 		prev_r = r;
@@ -156,7 +170,7 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 		if (va) {
 			reg->va = va;
 			TAILQ_INSERT_TAIL(&vmi->regions, reg, link);
-			return TEE_SUCCESS;
+			goto out;
 		}
 	} else {
 		va = select_va_in_range(va_range_base, 0,
@@ -164,11 +178,14 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 		if (va) {
 			reg->va = va;
 			TAILQ_INSERT_HEAD(&vmi->regions, reg, link);
-			return TEE_SUCCESS;
+			goto out;
 		}
 	}
 
 	return TEE_ERROR_ACCESS_CONFLICT;
+out:
+	va_tree_insert(&vmi->region_tree, &reg->tree_node, reg->va, reg->size);
+	return TEE_SUCCESS;
 }
 
 static size_t get_num_req_pgts(struct user_ta_ctx *utc, vaddr_t *begin,
@@ -201,7 +218,7 @@ TEE_Result vm_map(struct user_ta_ctx *utc, vaddr_t *va, size_t len,
 		  uint32_t prot, struct mobj *mobj, size_t offs)
 {
 	TEE_Result res;
-	struct vm_region *reg = calloc(1, sizeof(*reg));
+	struct vm_region *reg = slab_alloc(&vm_region_cache);
 	uint32_t attr = 0;
 	const uint32_t prot_mask = TEE_MATTR_PROT_MASK | TEE_MATTR_PERMANENT |
 				   TEE_MATTR_EPHEMERAL;
@@ -249,6 +266,12 @@ TEE_Result vm_map(struct user_ta_ctx *utc, vaddr_t *va, size_t len,
 		}
 	}
 
+	/* Parameters are mapped into kept tables instead of repopulating */
+	if (reg->attr & TEE_MATTR_EPHEMERAL)
+		pgt_persist_map_region(utc, reg);
+	else
+		pgt_persist_invalidate(utc);
+
 	/*
 	 * If the context currently is active set it again to update
 	 * the mapping.
@@ -262,8 +285,9 @@ TEE_Result vm_map(struct user_ta_ctx *utc, vaddr_t *va, size_t len,
 
 err_rem_reg:
 	TAILQ_REMOVE(&utc->vm_info->regions, reg, link);
+	va_tree_remove(&utc->vm_info->region_tree, &reg->tree_node);
 err_free_reg:
-	free(reg);
+	slab_free(&vm_region_cache, reg);
 	return res;
 }
 
@@ -293,6 +317,7 @@ TEE_Result vm_set_prot(struct user_ta_ctx *utc, vaddr_t va, size_t len,
 			}
 			r->attr &= ~TEE_MATTR_PROT_MASK;
 			r->attr |= prot & TEE_MATTR_PROT_MASK;
+			pgt_persist_invalidate(utc);
 			return TEE_SUCCESS;
 		}
 	}
@@ -424,7 +449,8 @@ static void free_pgt(struct user_ta_ctx *utc, vaddr_t base, size_t size)
 static void umap_remove_region(struct vm_info *vmi, struct vm_region *reg)
 {
 	TAILQ_REMOVE(&vmi->regions, reg, link);
-	free(reg);
+	va_tree_remove(&vmi->region_tree, &reg->tree_node);
+	slab_free(&vm_region_cache, reg);
 }
 
 static void clear_param_map(struct user_ta_ctx *utc)
@@ -432,9 +458,12 @@ static void clear_param_map(struct user_ta_ctx *utc)
 	struct vm_region *next_r;
 	struct vm_region *r;
 
-	TAILQ_FOREACH_SAFE(r, &utc->vm_info->regions, link, next_r)
-		if (r->attr & TEE_MATTR_EPHEMERAL)
+	TAILQ_FOREACH_SAFE(r, &utc->vm_info->regions, link, next_r) {
+		if (r->attr & TEE_MATTR_EPHEMERAL) {
+			pgt_persist_unmap_region(utc, r);
 			umap_remove_region(utc->vm_info, r);
+		}
+	}
 }
 
 static TEE_Result param_mem_to_user_va(struct user_ta_ctx *utc,
@@ -585,7 +614,7 @@ TEE_Result tee_mmu_add_rwmem(struct user_ta_ctx *utc, struct mobj *mobj,
 			     vaddr_t *va)
 {
 	TEE_Result res;
-	struct vm_region *reg = calloc(1, sizeof(*reg));
+	struct vm_region *reg = slab_alloc(&vm_region_cache);
 
 	if (!reg)
 		return TEE_ERROR_OUT_OF_MEMORY;
@@ -601,10 +630,11 @@ TEE_Result tee_mmu_add_rwmem(struct user_ta_ctx *utc, struct mobj *mobj,
 
 	res = umap_add_region(utc->vm_info, reg);
 	if (res) {
-		free(reg);
+		slab_free(&vm_region_cache, reg);
 		return res;
 	}
 
+	pgt_persist_invalidate(utc);
 	res = alloc_pgt(utc);
 	if (res)
 		umap_remove_region(utc->vm_info, reg);
@@ -616,14 +646,12 @@ TEE_Result tee_mmu_add_rwmem(struct user_ta_ctx *utc, struct mobj *mobj,
 
 void tee_mmu_rem_rwmem(struct user_ta_ctx *utc, struct mobj *mobj, vaddr_t va)
 {
-	struct vm_region *reg;
+	struct vm_region *reg = find_vm_region(utc->vm_info, va);
 
-	TAILQ_FOREACH(reg, &utc->vm_info->regions, link) {
-		if (reg->mobj == mobj && reg->va == va) {
-			free_pgt(utc, reg->va, reg->size);
-			umap_remove_region(utc->vm_info, reg);
-			return;
-		}
+	if (reg && reg->mobj == mobj && reg->va == va) {
+		free_pgt(utc, reg->va, reg->size);
+		umap_remove_region(utc->vm_info, reg);
+		pgt_persist_invalidate(utc);
 	}
 }
 
@@ -632,6 +660,8 @@ void vm_info_final(struct user_ta_ctx *utc)
 	if (!utc->vm_info)
 		return;
 
+	pgt_persist_release(utc);
+
 	/* clear MMU entries to avoid clash when asid is reused */
 	tlbi_asid(utc->vm_info->asid);
 
@@ -647,16 +677,12 @@ void vm_info_final(struct user_ta_ctx *utc)
 bool tee_mmu_is_vbuf_inside_ta_private(const struct user_ta_ctx *utc,
 				  const void *va, size_t size)
 {
-	struct vm_region *r;
+	struct vm_region *r = find_vm_region(utc->vm_info, (vaddr_t)va);
 
-	TAILQ_FOREACH(r, &utc->vm_info->regions, link) {
-		if (r->attr & (TEE_MATTR_EPHEMERAL | TEE_MATTR_PERMANENT))
-			continue;
-		if (core_is_buffer_inside(va, size, r->va, r->size))
-			return true;
-	}
+	if (!r || (r->attr & (TEE_MATTR_EPHEMERAL | TEE_MATTR_PERMANENT)))
+		return false;
 
-	return false;
+	return core_is_buffer_inside(va, size, r->va, r->size);
 }
 
 /* return true only if buffer intersects TA private memory */
@@ -679,68 +705,57 @@ TEE_Result tee_mmu_vbuf_to_mobj_offs(const struct user_ta_ctx *utc,
 				     const void *va, size_t size,
 				     struct mobj **mobj, size_t *offs)
 {
-	struct vm_region *r;
-
-	TAILQ_FOREACH(r, &utc->vm_info->regions, link) {
-		if (!r->mobj)
-			continue;
-		if (core_is_buffer_inside(va, size, r->va, r->size)) {
-			size_t poffs;
+	struct vm_region *r = find_vm_region(utc->vm_info, (vaddr_t)va);
+	size_t poffs;
 
-			poffs = mobj_get_phys_offs(r->mobj,
-						   CORE_MMU_USER_PARAM_SIZE);
-			*mobj = r->mobj;
-			*offs = (vaddr_t)va - r->va + r->offset - poffs;
-			return TEE_SUCCESS;
-		}
-	}
+	if (!r || !r->mobj || !core_is_buffer_inside(va, size, r->va, r->size))
+		return TEE_ERROR_BAD_PARAMETERS;
 
-	return TEE_ERROR_BAD_PARAMETERS;
+	poffs = mobj_get_phys_offs(r->mobj, CORE_MMU_USER_PARAM_SIZE);
+	*mobj = r->mobj;
+	*offs = (vaddr_t)va - r->va + r->offset - poffs;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result tee_mmu_user_va2pa_attr(const struct user_ta_ctx *utc,
 			void *ua, paddr_t *pa, uint32_t *attr)
 {
-	struct vm_region *region;
+	struct vm_region *region = find_vm_region(utc->vm_info, (vaddr_t)ua);
 
-	TAILQ_FOREACH(region, &utc->vm_info->regions, link) {
-		if (!core_is_buffer_inside(ua, 1, region->va, region->size))
-			continue;
+	if (!region)
+		return TEE_ERROR_ACCESS_DENIED;
 
-		if (pa) {
-			TEE_Result res;
-			paddr_t p;
-			size_t offset;
-			size_t granule;
-
-			/*
-			 * mobj and input user address may each include
-			 * a specific offset-in-granule position.
-			 * Drop both to get target physical page base
-			 * address then apply only user address
-			 * offset-in-granule.
-			 * Mapping lowest granule is the small page.
-			 */
-			granule = MAX(region->mobj->phys_granule,
-				      (size_t)SMALL_PAGE_SIZE);
-			assert(!granule || IS_POWER_OF_TWO(granule));
-
-			offset = region->offset +
-				 ROUNDDOWN((vaddr_t)ua - region->va, granule);
-
-			res = mobj_get_pa(region->mobj, offset, granule, &p);
-			if (res != TEE_SUCCESS)
-				return res;
+	if (pa) {
+		TEE_Result res;
+		paddr_t p;
+		size_t offset;
+		size_t granule;
 
-			*pa = p | ((vaddr_t)ua & (granule - 1));
-		}
-		if (attr)
-			*attr = region->attr;
+		/*
+		 * mobj and input user address may each include
+		 * a specific offset-in-granule position.
+		 * Drop both to get target physical page base
+		 * address then apply only user address
+		 * offset-in-granule.
+		 * Mapping lowest granule is the small page.
+		 */
+		granule = MAX(region->mobj->phys_granule,
+			      (size_t)SMALL_PAGE_SIZE);
+		assert(!granule || IS_POWER_OF_TWO(granule));
 
-		return TEE_SUCCESS;
+		offset = region->offset +
+			 ROUNDDOWN((vaddr_t)ua - region->va, granule);
+
+		res = mobj_get_pa(region->mobj, offset, granule, &p);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		*pa = p | ((vaddr_t)ua & (granule - 1));
 	}
+	if (attr)
+		*attr = region->attr;
 
-	return TEE_ERROR_ACCESS_DENIED;
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_mmu_user_va2pa_helper(const struct user_ta_ctx *utc, void *ua,
@@ -853,6 +868,7 @@ void tee_mmu_set_ctx(struct tee_ta_ctx *ctx)
 	struct thread_specific_data *tsd = thread_get_tsd();
 
 	core_mmu_set_user_map(NULL);
+	pgt_persist_unmap();
 	/*
 	 * No matter what happens below, the current user TA will not be
 	 * current any longer. Make sure pager is in sync with that.
@@ -867,7 +883,12 @@ void tee_mmu_set_ctx(struct tee_ta_ctx *ctx)
 		struct core_mmu_user_map map;
 		struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
 
-		core_mmu_create_user_map(utc, &map);
+		/*
+		 * With CFG_PERSISTENT_USER_MAP the tables kept with the
+		 * context are used unless they can't be populated.
+		 */
+		if (!pgt_persist_map(utc, &map))
+			core_mmu_create_user_map(utc, &map);
 		core_mmu_set_user_map(&map);
 		tee_pager_assign_uta_tables(utc);
 	}
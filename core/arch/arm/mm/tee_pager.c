@@ -18,6 +18,7 @@
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
 #include <kernel/tlb_helpers.h>
+#include <kernel/va_tree.h>
 #include <mm/core_memprot.h>
 #include <mm/tee_mm.h>
 #include <mm/tee_pager.h>
@@ -48,24 +49,45 @@ enum area_type {
 	AREA_TYPE_LOCK,
 };
 
+/*
+ * struct tee_pager_area - A range of virtual memory handled by the pager
+ *
+ * @pmem_map	one entry per page in the area, points to the physical
+ *		page currently backing that page or NULL if none
+ * @fa_next	page number in the area where the next fault is expected
+ *		if the area is accessed sequentially
+ * @fa_window	number of pages loaded ahead on the last fault
+ */
 struct tee_pager_area {
 	union {
 		const uint8_t *hashes;
 		struct pager_rw_pstate *rwp;
 	} u;
+	struct tee_pager_pmem **pmem_map;
 	uint8_t *store;
 	enum area_type type;
 	uint32_t flags;
 	vaddr_t base;
 	size_t size;
+	size_t fa_next;
+	size_t fa_window;
 	struct pgt *pgt;
 	TAILQ_ENTRY(tee_pager_area) link;
+	struct va_tree_node tree_node;
 };
 
-TAILQ_HEAD(tee_pager_area_head, tee_pager_area);
+TAILQ_HEAD(tee_pager_area_list, tee_pager_area);
 
-static struct tee_pager_area_head tee_pager_area_head =
-	TAILQ_HEAD_INITIALIZER(tee_pager_area_head);
+/* Areas are kept in a list and indexed by address in a tree */
+struct tee_pager_area_head {
+	struct tee_pager_area_list list;
+	struct va_tree tree;
+};
+
+static struct tee_pager_area_head tee_pager_area_head = {
+	.list = TAILQ_HEAD_INITIALIZER(tee_pager_area_head.list),
+	.tree = VA_TREE_INITIALIZER,
+};
 
 #define INVALID_PGIDX	UINT_MAX
 
@@ -77,11 +99,17 @@ static struct tee_pager_area_head tee_pager_area_head =
  *		Used during remapping of the page when the content need to
  *		be updated before it's available at the new location.
  * @area	a pointer to the pager area
+ * @last_ref	value of pager_vtime when the page was last known to be
+ *		referenced
+ * @loading	true while the page is filled without the pager lock held,
+ *		the page is then in none of the lists and not yet mapped
  */
 struct tee_pager_pmem {
 	unsigned pgidx;
 	void *va_alias;
 	struct tee_pager_area *area;
+	size_t last_ref;
+	bool loading;
 	TAILQ_ENTRY(tee_pager_pmem) link;
 };
 
@@ -102,6 +130,12 @@ static struct internal_aes_gcm_key pager_ae_key;
 /* Number of registered physical pages, used hiding pages. */
 static size_t tee_pager_npages;
 
+/* Virtual time of the pager, incremented on each handled fault */
+static size_t pager_vtime;
+
+/* Number of recently evicted pages remembered to detect refaults */
+#define TEE_PAGER_EVICT_HISTORY	32
+
 #ifdef CFG_WITH_STATS
 static struct tee_pager_stats pager_stats;
 
@@ -135,6 +169,49 @@ static inline void set_npages(void)
 	pager_stats.npages = tee_pager_npages;
 }
 
+static inline void incr_hides(void)
+{
+	pager_stats.hides++;
+}
+
+static inline void incr_fault_around(void)
+{
+	pager_stats.fault_around++;
+}
+
+static inline void add_fault_around_hits(size_t n)
+{
+	pager_stats.fault_around_hits += n;
+}
+
+static struct {
+	struct tee_pager_area *area;
+	unsigned int pgidx;
+} evict_history[TEE_PAGER_EVICT_HISTORY];
+static size_t evict_history_pos;
+
+static inline void stat_evict(struct tee_pager_pmem *pmem)
+{
+	pager_stats.evictions++;
+	evict_history[evict_history_pos].area = pmem->area;
+	evict_history[evict_history_pos].pgidx = pmem->pgidx;
+	evict_history_pos = (evict_history_pos + 1) % TEE_PAGER_EVICT_HISTORY;
+}
+
+static inline void stat_load(struct tee_pager_area *area, unsigned int pgidx)
+{
+	size_t n;
+
+	for (n = 0; n < TEE_PAGER_EVICT_HISTORY; n++) {
+		if (evict_history[n].area == area &&
+		    evict_history[n].pgidx == pgidx) {
+			evict_history[n].area = NULL;
+			pager_stats.refaults++;
+			return;
+		}
+	}
+}
+
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
 	*stats = pager_stats;
@@ -143,6 +220,11 @@ void tee_pager_get_stats(struct tee_pager_stats *stats)
 	pager_stats.ro_hits = 0;
 	pager_stats.rw_hits = 0;
 	pager_stats.zi_released = 0;
+	pager_stats.evictions = 0;
+	pager_stats.refaults = 0;
+	pager_stats.hides = 0;
+	pager_stats.fault_around = 0;
+	pager_stats.fault_around_hits = 0;
 }
 
 #else /* CFG_WITH_STATS */
@@ -152,6 +234,12 @@ static inline void incr_hidden_hits(void) { }
 static inline void incr_zi_released(void) { }
 static inline void incr_npages_all(void) { }
 static inline void set_npages(void) { }
+static inline void incr_hides(void) { }
+static inline void incr_fault_around(void) { }
+static inline void add_fault_around_hits(size_t n __unused) { }
+static inline void stat_evict(struct tee_pager_pmem *pmem __unused) { }
+static inline void stat_load(struct tee_pager_area *area __unused,
+			     unsigned int pgidx __unused) { }
 
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
@@ -418,6 +506,47 @@ static vaddr_t area_idx2va(struct tee_pager_area *area, size_t idx)
 	return (idx << SMALL_PAGE_SHIFT) + (area->base & ~CORE_MMU_PGDIR_MASK);
 }
 
+/* Returns the page number within the area of table entry @idx */
+static size_t area_idx2pgnum(struct tee_pager_area *area, size_t idx)
+{
+	size_t pgnum = idx - ((area->base & CORE_MMU_PGDIR_MASK) >>
+			      SMALL_PAGE_SHIFT);
+
+	assert(pgnum < area->size / SMALL_PAGE_SIZE);
+	return pgnum;
+}
+
+static struct tee_pager_pmem *area_get_pmem(struct tee_pager_area *area,
+					    size_t idx)
+{
+	return area->pmem_map[area_idx2pgnum(area, idx)];
+}
+
+/* Makes @pmem back table entry @idx of @area */
+static void pmem_assign(struct tee_pager_pmem *pmem,
+			struct tee_pager_area *area, size_t idx)
+{
+	pmem->area = area;
+	pmem->pgidx = idx;
+	area->pmem_map[area_idx2pgnum(area, idx)] = pmem;
+}
+
+static bool pmem_is_loading(struct tee_pager_area *area, vaddr_t va)
+{
+	struct tee_pager_pmem *pmem = area_get_pmem(area, area_va2idx(area, va));
+
+	return pmem && pmem->loading;
+}
+
+static void pmem_unassign(struct tee_pager_pmem *pmem)
+{
+	if (pmem->area && pmem->pgidx != INVALID_PGIDX)
+		pmem->area->pmem_map[area_idx2pgnum(pmem->area,
+						    pmem->pgidx)] = NULL;
+	pmem->area = NULL;
+	pmem->pgidx = INVALID_PGIDX;
+}
+
 void tee_pager_early_init(void)
 {
 	size_t n;
@@ -483,6 +612,11 @@ static struct tee_pager_area *alloc_area(struct pgt *pgt,
 	if (!area)
 		return NULL;
 
+	area->pmem_map = calloc(size / SMALL_PAGE_SIZE,
+				sizeof(*area->pmem_map));
+	if (!area->pmem_map)
+		goto bad;
+
 	if (flags & (TEE_MATTR_PW | TEE_MATTR_UW)) {
 		if (flags & TEE_MATTR_LOCKED) {
 			at = AREA_TYPE_LOCK;
@@ -515,15 +649,31 @@ out:
 bad:
 	tee_mm_free(mm_store);
 	free(area->u.rwp);
+	free(area->pmem_map);
 	free(area);
 	return NULL;
 }
 
+static void area_insert(struct tee_pager_area_head *area_head,
+			struct tee_pager_area *area)
+{
+	TAILQ_INSERT_TAIL(&area_head->list, area, link);
+	va_tree_insert(&area_head->tree, &area->tree_node, area->base,
+		       area->size);
+}
+
+static void area_remove(struct tee_pager_area_head *area_head,
+			struct tee_pager_area *area)
+{
+	TAILQ_REMOVE(&area_head->list, area, link);
+	va_tree_remove(&area_head->tree, &area->tree_node);
+}
+
 static void area_insert_tail(struct tee_pager_area *area)
 {
 	uint32_t exceptions = pager_lock_check_stack(8);
 
-	TAILQ_INSERT_TAIL(&tee_pager_area_head, area, link);
+	area_insert(&tee_pager_area_head, area);
 
 	pager_unlock(exceptions);
 }
@@ -570,16 +720,15 @@ void tee_pager_add_core_area(vaddr_t base, size_t size, uint32_t flags,
 static struct tee_pager_area *find_area(struct tee_pager_area_head *areas,
 					vaddr_t va)
 {
-	struct tee_pager_area *area;
+	struct va_tree_node *node;
 
 	if (!areas)
 		return NULL;
 
-	TAILQ_FOREACH(area, areas, link) {
-		if (core_is_buffer_inside(va, 1, area->base, area->size))
-			return area;
-	}
-	return NULL;
+	node = va_tree_find(&areas->tree, va);
+	if (!node)
+		return NULL;
+	return container_of(node, struct tee_pager_area, tree_node);
 }
 
 #ifdef CFG_PAGED_USER_TA
@@ -683,7 +832,6 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 					   idx * TEE_SHA256_HASH_SIZE;
 
 			memcpy(va_alias, stored_page, SMALL_PAGE_SIZE);
-			incr_ro_hits();
 
 			if (hash_sha256_check(hash, va_alias,
 					      SMALL_PAGE_SIZE) != TEE_SUCCESS) {
@@ -706,7 +854,6 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 			EMSG("PH 0x%" PRIxVA " failed", page_va);
 			panic();
 		}
-		incr_rw_hits();
 		break;
 	case AREA_TYPE_LOCK:
 		FMSG("Zero init %p %#" PRIxVA, va_alias, page_va);
@@ -748,6 +895,7 @@ static void free_area(struct tee_pager_area *area)
 				virt_to_phys(area->store)));
 	if (area->type == AREA_TYPE_RW)
 		free(area->u.rwp);
+	free(area->pmem_map);
 	free(area);
 }
 
@@ -760,10 +908,10 @@ static bool pager_add_uta_area(struct user_ta_ctx *utc, vaddr_t base,
 	size_t s = ROUNDUP(size, SMALL_PAGE_SIZE);
 
 	if (!utc->areas) {
-		utc->areas = malloc(sizeof(*utc->areas));
+		utc->areas = calloc(1, sizeof(*utc->areas));
 		if (!utc->areas)
 			return false;
-		TAILQ_INIT(utc->areas);
+		TAILQ_INIT(&utc->areas->list);
 	}
 
 	flags = TEE_MATTR_PRW | TEE_MATTR_URWX;
@@ -780,7 +928,7 @@ static bool pager_add_uta_area(struct user_ta_ctx *utc, vaddr_t base,
 		area = alloc_area(NULL, b, s2, flags, NULL, NULL);
 		if (!area)
 			return false;
-		TAILQ_INSERT_TAIL(utc->areas, area, link);
+		area_insert(utc->areas, area);
 		b += s2;
 		s -= s2;
 	}
@@ -811,9 +959,9 @@ bool tee_pager_add_uta_area(struct user_ta_ctx *utc, vaddr_t base, size_t size)
 		struct tee_pager_area *next_a;
 
 		/* Remove all added areas */
-		TAILQ_FOREACH_SAFE(area, utc->areas, link, next_a) {
+		TAILQ_FOREACH_SAFE(area, &utc->areas->list, link, next_a) {
 			if (!area->pgt) {
-				TAILQ_REMOVE(utc->areas, area, link);
+				area_remove(utc->areas, area);
 				free_area(area);
 			}
 		}
@@ -826,7 +974,7 @@ bool tee_pager_add_uta_area(struct user_ta_ctx *utc, vaddr_t base, size_t size)
 	 */
 	tee_pager_assign_uta_tables(utc);
 	core_mmu_get_user_pgdir(&dir_info);
-	TAILQ_FOREACH(area, utc->areas, link) {
+	TAILQ_FOREACH(area, &utc->areas->list, link) {
 		paddr_t pa;
 		size_t idx;
 		uint32_t attr;
@@ -881,18 +1029,25 @@ static void transpose_area(struct tee_pager_area *area, struct pgt *new_pgt,
 		struct core_mmu_table_info old_ti;
 		struct core_mmu_table_info new_ti;
 		struct tee_pager_pmem *pmem;
+		size_t n;
 
 		init_tbl_info_from_pgt(&old_ti, area->pgt);
 		init_tbl_info_from_pgt(&new_ti, new_pgt);
 
-
-		TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
+		/*
+		 * The page numbers within the area are unchanged by the
+		 * move so area->pmem_map stays valid, only the table
+		 * indexes of the pages need to be updated.
+		 */
+		for (n = 0; n < area->size / SMALL_PAGE_SIZE; n++) {
 			vaddr_t va;
 			paddr_t pa;
 			uint32_t attr;
 
-			if (pmem->area != area)
+			pmem = area->pmem_map[n];
+			if (!pmem)
 				continue;
+			assert(!pmem->loading);
 			core_mmu_get_entry(&old_ti, pmem->pgidx, &pa, &attr);
 			core_mmu_set_entry(&old_ti, pmem->pgidx, 0, 0);
 
@@ -924,7 +1079,7 @@ void tee_pager_transfer_uta_region(struct user_ta_ctx *src_utc,
 	struct tee_pager_area *area;
 	struct tee_pager_area *next_a;
 
-	TAILQ_FOREACH_SAFE(area, src_utc->areas, link, next_a) {
+	TAILQ_FOREACH_SAFE(area, &src_utc->areas->list, link, next_a) {
 		vaddr_t new_area_base;
 		size_t new_idx;
 
@@ -932,7 +1087,7 @@ void tee_pager_transfer_uta_region(struct user_ta_ctx *src_utc,
 					  src_base, size))
 			continue;
 
-		TAILQ_REMOVE(src_utc->areas, area, link);
+		area_remove(src_utc->areas, area);
 
 		new_area_base = dst_base + (src_base - area->base);
 		new_idx = (new_area_base - dst_pgt[0]->vabase) /
@@ -947,7 +1102,7 @@ void tee_pager_transfer_uta_region(struct user_ta_ctx *src_utc,
 		 * could be tricky to find.
 		 */
 		assert(!find_area(dst_utc->areas, area->base));
-		TAILQ_INSERT_TAIL(dst_utc->areas, area, link);
+		area_insert(dst_utc->areas, area);
 	}
 }
 
@@ -956,19 +1111,21 @@ static void rem_area(struct tee_pager_area_head *area_head,
 {
 	struct tee_pager_pmem *pmem;
 	uint32_t exceptions;
+	size_t n;
 
 	exceptions = pager_lock_check_stack(64);
 
-	TAILQ_REMOVE(area_head, area, link);
+	area_remove(area_head, area);
 
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		if (pmem->area == area) {
-			area_set_entry(area, pmem->pgidx, 0, 0);
-			tlbi_mva_allasid(area_idx2va(area, pmem->pgidx));
-			pgt_dec_used_entries(area->pgt);
-			pmem->area = NULL;
-			pmem->pgidx = INVALID_PGIDX;
-		}
+	for (n = 0; n < area->size / SMALL_PAGE_SIZE; n++) {
+		pmem = area->pmem_map[n];
+		if (!pmem)
+			continue;
+		assert(!pmem->loading);
+		area_set_entry(area, pmem->pgidx, 0, 0);
+		tlbi_mva_allasid(area_idx2va(area, pmem->pgidx));
+		pgt_dec_used_entries(area->pgt);
+		pmem_unassign(pmem);
 	}
 
 	pager_unlock(exceptions);
@@ -983,7 +1140,7 @@ void tee_pager_rem_uta_region(struct user_ta_ctx *utc, vaddr_t base,
 	struct tee_pager_area *next_a;
 	size_t s = ROUNDUP(size, SMALL_PAGE_SIZE);
 
-	TAILQ_FOREACH_SAFE(area, utc->areas, link, next_a) {
+	TAILQ_FOREACH_SAFE(area, &utc->areas->list, link, next_a) {
 		if (core_is_buffer_inside(area->base, area->size, base, s))
 			rem_area(utc->areas, area);
 	}
@@ -997,10 +1154,10 @@ void tee_pager_rem_uta_areas(struct user_ta_ctx *utc)
 		return;
 
 	while (true) {
-		area = TAILQ_FIRST(utc->areas);
+		area = TAILQ_FIRST(&utc->areas->list);
 		if (!area)
 			break;
-		TAILQ_REMOVE(utc->areas, area, link);
+		area_remove(utc->areas, area);
 		free_area(area);
 	}
 
@@ -1020,6 +1177,7 @@ bool tee_pager_set_uta_area_attr(struct user_ta_ctx *utc, vaddr_t base,
 	paddr_t pa;
 	uint32_t a;
 	uint32_t f;
+	size_t n;
 
 	f = (flags & TEE_MATTR_URWX) | TEE_MATTR_UR | TEE_MATTR_PR;
 	if (f & TEE_MATTR_UW)
@@ -1037,8 +1195,10 @@ bool tee_pager_set_uta_area_attr(struct user_ta_ctx *utc, vaddr_t base,
 		b += s2;
 		s -= s2;
 
-		TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-			if (pmem->area != area)
+		for (n = 0; n < area->size / SMALL_PAGE_SIZE; n++) {
+			pmem = area->pmem_map[n];
+			/* A page being loaded is mapped with the new flags */
+			if (!pmem || pmem->loading)
 				continue;
 			area_get_entry(pmem->area, pmem->pgidx, &pa, &a);
 			if (a & TEE_MATTR_VALID_BLOCK)
@@ -1082,94 +1242,217 @@ out:
 KEEP_PAGER(tee_pager_set_uta_area_attr);
 #endif /*CFG_PAGED_USER_TA*/
 
-static bool tee_pager_unhide_page(vaddr_t page_va)
+/*
+ * Hides a mapped page, that is, unmaps it while keeping its content.
+ * Returns false if the page isn't mapped.
+ */
+static bool hide_page(struct tee_pager_pmem *pmem)
+{
+	paddr_t pa;
+	uint32_t attr;
+	uint32_t a;
+
+	/* we cannot hide pages when pmem->area is not defined. */
+	if (!pmem->area)
+		return false;
+
+	area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
+	if (!(attr & TEE_MATTR_VALID_BLOCK))
+		return false;
+
+	assert(pa == get_pmem_pa(pmem));
+	if (attr & (TEE_MATTR_PW | TEE_MATTR_UW)){
+		a = TEE_MATTR_HIDDEN_DIRTY_BLOCK;
+		FMSG("Hide %#" PRIxVA,
+		     area_idx2va(pmem->area, pmem->pgidx));
+	} else
+		a = TEE_MATTR_HIDDEN_BLOCK;
+
+	area_set_entry(pmem->area, pmem->pgidx, pa, a);
+	tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
+	incr_hides();
+
+	return true;
+}
+
+/*
+ * Page replacement policies
+ *
+ * The MMU doesn't tell which pages are accessed. Instead pages are hidden,
+ * and a hidden page that is accessed is unhidden by the abort handler. A
+ * page that is still hidden hasn't been referenced since it was hidden.
+ *
+ * The policies search tee_pager_pmem_head from the head for a page to
+ * evict. Unhidden pages get pmem->last_ref updated before the unhide
+ * callback is called, and so do loaded pages.
+ *
+ * @fault:	called at the end of each handled fault, or NULL
+ * @unhide:	called when a hidden page has been unhidden, or NULL
+ * @get_victim:	returns the page to evict. The caller removes it from
+ *		the list.
+ */
+struct pager_policy {
+	void (*fault)(void);
+	void (*unhide)(struct tee_pager_pmem *pmem);
+	struct tee_pager_pmem *(*get_victim)(void);
+};
+
+#ifdef CFG_PAGER_POLICY_HIDE
+/*
+ * FIFO where the oldest third of the pages is hidden after each fault.
+ * An unhidden page is moved to the back, which gives it a second chance.
+ */
+static void hide_fault(void)
 {
 	struct tee_pager_pmem *pmem;
+	size_t n = 0;
 
 	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		paddr_t pa;
-		uint32_t attr;
+		if (n >= TEE_PAGER_NHIDE)
+			break;
+		n++;
 
-		if (pmem->pgidx == INVALID_PGIDX)
-			continue;
+		hide_page(pmem);
+	}
+}
 
-		area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
+static void hide_unhide(struct tee_pager_pmem *pmem)
+{
+	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+	TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+}
 
-		if (!(attr &
-		     (TEE_MATTR_HIDDEN_BLOCK | TEE_MATTR_HIDDEN_DIRTY_BLOCK)))
-			continue;
+static struct tee_pager_pmem *hide_get_victim(void)
+{
+	return TAILQ_FIRST(&tee_pager_pmem_head);
+}
 
-		if (area_va2idx(pmem->area, page_va) == pmem->pgidx) {
-			uint32_t a = get_area_mattr(pmem->area->flags);
+static const struct pager_policy pager_policy = {
+	.fault = hide_fault,
+	.unhide = hide_unhide,
+	.get_victim = hide_get_victim,
+};
+#endif /*CFG_PAGER_POLICY_HIDE*/
 
-			/* page is hidden, show and move to back */
-			if (pa != get_pmem_pa(pmem))
-				panic("unexpected pa");
+#ifdef CFG_PAGER_POLICY_CLOCK
+/*
+ * Second chance CLOCK, the head of the list is the clock hand. Pages are
+ * only hidden when the hand passes them looking for a page to evict, a
+ * page that is still hidden when the hand comes back is evicted.
+ */
+static struct tee_pager_pmem *clock_get_victim(void)
+{
+	struct tee_pager_pmem *pmem = NULL;
+	size_t n;
 
-			/*
-			 * If it's not a dirty block, then it should be
-			 * read only.
-			 */
-			if (!(attr & TEE_MATTR_HIDDEN_DIRTY_BLOCK))
-				a &= ~(TEE_MATTR_PW | TEE_MATTR_UW);
-			else
-				FMSG("Unhide %#" PRIxVA, page_va);
+	/* After one turn all pages are hidden, so two turns at most */
+	for (n = 0; n <= tee_pager_npages; n++) {
+		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		if (!pmem || !hide_page(pmem))
+			return pmem;
 
-			if (page_va == 0x8000a000)
-				FMSG("unhide %#" PRIxVA " a %#" PRIX32,
-					page_va, a);
-			area_set_entry(pmem->area, pmem->pgidx, pa, a);
-			/*
-			 * Note that TLB invalidation isn't needed since
-			 * there wasn't a valid mapping before. We should
-			 * use a barrier though, to make sure that the
-			 * change is visible.
-			 */
-			dsb_ishst();
+		TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	}
 
-			TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
-			TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
-			incr_hidden_hits();
-			return true;
+	return pmem;
+}
+
+static const struct pager_policy pager_policy = {
+	.get_victim = clock_get_victim,
+};
+#endif /*CFG_PAGER_POLICY_CLOCK*/
+
+#ifdef CFG_PAGER_POLICY_WSCLOCK
+/* Pages referenced within this many faults are in the working set */
+#define TEE_PAGER_WS_WINDOW	(tee_pager_npages / 2)
+
+/*
+ * WSClock, as CLOCK but a hidden page is only evicted if it's outside
+ * the working set. If the hand makes a full turn without finding such a
+ * page the least recently referenced hidden page is evicted.
+ */
+static struct tee_pager_pmem *wsclock_get_victim(void)
+{
+	struct tee_pager_pmem *oldest = NULL;
+	struct tee_pager_pmem *pmem = NULL;
+	size_t n;
+
+	for (n = 0; n < tee_pager_npages; n++) {
+		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		if (!pmem || !pmem->area)
+			return pmem;
+
+		if (hide_page(pmem)) {
+			/* Referenced since the hand passed last time */
+			pmem->last_ref = pager_vtime;
+		} else {
+			if (pager_vtime - pmem->last_ref > TEE_PAGER_WS_WINDOW)
+				return pmem;
+			if (!oldest || pager_vtime - pmem->last_ref >
+				       pager_vtime - oldest->last_ref)
+				oldest = pmem;
 		}
+
+		TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
 	}
 
-	return false;
+	if (oldest)
+		return oldest;
+	return TAILQ_FIRST(&tee_pager_pmem_head);
 }
 
-static void tee_pager_hide_pages(void)
-{
-	struct tee_pager_pmem *pmem;
-	size_t n = 0;
+static const struct pager_policy pager_policy = {
+	.get_victim = wsclock_get_victim,
+};
+#endif /*CFG_PAGER_POLICY_WSCLOCK*/
 
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		paddr_t pa;
-		uint32_t attr;
-		uint32_t a;
+static bool tee_pager_unhide_page(struct tee_pager_area *area,
+				  vaddr_t page_va)
+{
+	size_t pgidx = area_va2idx(area, page_va);
+	struct tee_pager_pmem *pmem = area_get_pmem(area, pgidx);
+	uint32_t a = get_area_mattr(area->flags);
+	uint32_t attr;
+	paddr_t pa;
 
-		if (n >= TEE_PAGER_NHIDE)
-			break;
-		n++;
+	if (!pmem)
+		return false;
 
-		/* we cannot hide pages when pmem->area is not defined. */
-		if (!pmem->area)
-			continue;
+	area_get_entry(area, pgidx, &pa, &attr);
+	if (!(attr & (TEE_MATTR_HIDDEN_BLOCK | TEE_MATTR_HIDDEN_DIRTY_BLOCK)))
+		return false;
 
-		area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
-		if (!(attr & TEE_MATTR_VALID_BLOCK))
-			continue;
+	/* page is hidden, show and move to back */
+	if (pa != get_pmem_pa(pmem))
+		panic("unexpected pa");
 
-		assert(pa == get_pmem_pa(pmem));
-		if (attr & (TEE_MATTR_PW | TEE_MATTR_UW)){
-			a = TEE_MATTR_HIDDEN_DIRTY_BLOCK;
-			FMSG("Hide %#" PRIxVA,
-			     area_idx2va(pmem->area, pmem->pgidx));
-		} else
-			a = TEE_MATTR_HIDDEN_BLOCK;
+	/*
+	 * If it's not a dirty block, then it should be
+	 * read only.
+	 */
+	if (!(attr & TEE_MATTR_HIDDEN_DIRTY_BLOCK))
+		a &= ~(TEE_MATTR_PW | TEE_MATTR_UW);
+	else
+		FMSG("Unhide %#" PRIxVA, page_va);
+
+	if (page_va == 0x8000a000)
+		FMSG("unhide %#" PRIxVA " a %#" PRIX32, page_va, a);
+	area_set_entry(area, pgidx, pa, a);
+	/*
+	 * Note that TLB invalidation isn't needed since
+	 * there wasn't a valid mapping before. We should
+	 * use a barrier though, to make sure that the
+	 * change is visible.
+	 */
+	dsb_ishst();
 
-		area_set_entry(pmem->area, pmem->pgidx, pa, a);
-		tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
-	}
+	pmem->last_ref = pager_vtime;
+	if (pager_policy.unhide)
+		pager_policy.unhide(pmem);
+	incr_hidden_hits();
+	return true;
 }
 
 /*
@@ -1189,32 +1472,35 @@ static bool tee_pager_release_one_phys(struct tee_pager_area *area,
 
 	FMSG("%" PRIxVA " : %" PRIxPA "|%x", page_va, pa, attr);
 
-	TAILQ_FOREACH(pmem, &tee_pager_lock_pmem_head, link) {
-		if (pmem->area != area || pmem->pgidx != pgidx)
-			continue;
-
-		assert(pa == get_pmem_pa(pmem));
-		area_set_entry(area, pgidx, 0, 0);
-		pgt_dec_used_entries(area->pgt);
-		TAILQ_REMOVE(&tee_pager_lock_pmem_head, pmem, link);
-		pmem->area = NULL;
-		pmem->pgidx = INVALID_PGIDX;
-		tee_pager_npages++;
-		set_npages();
-		TAILQ_INSERT_HEAD(&tee_pager_pmem_head, pmem, link);
-		incr_zi_released();
-		return true;
-	}
+	/* Only pages of locked areas are in the lock list */
+	if (area->type != AREA_TYPE_LOCK)
+		return false;
+	pmem = area_get_pmem(area, pgidx);
+	if (!pmem || pmem->loading)
+		return false;
 
-	return false;
+	assert(pa == get_pmem_pa(pmem));
+	area_set_entry(area, pgidx, 0, 0);
+	pgt_dec_used_entries(area->pgt);
+	TAILQ_REMOVE(&tee_pager_lock_pmem_head, pmem, link);
+	pmem_unassign(pmem);
+	tee_pager_npages++;
+	set_npages();
+	TAILQ_INSERT_HEAD(&tee_pager_pmem_head, pmem, link);
+	incr_zi_released();
+	return true;
 }
 
-/* Finds the oldest page and unmats it from its old virtual address */
+/*
+ * Gets a page to evict from the replacement policy and unmaps it from its
+ * old virtual address. The page is returned detached from the lists,
+ * pager_load_map_page() puts it back once it's mapped again.
+ */
 static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
 {
 	struct tee_pager_pmem *pmem;
 
-	pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+	pmem = pager_policy.get_victim();
 	if (!pmem) {
 		EMSG("No pmem entries");
 		return NULL;
@@ -1223,6 +1509,7 @@ static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
 		uint32_t a;
 
 		assert(pmem->area && pmem->area->pgt);
+		stat_evict(pmem);
 		area_get_entry(pmem->area, pmem->pgidx, NULL, &a);
 		area_set_entry(pmem->area, pmem->pgidx, 0, 0);
 		pgt_dec_used_entries(pmem->area->pgt);
@@ -1231,18 +1518,13 @@ static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
 	}
 
 	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
-	pmem->pgidx = INVALID_PGIDX;
-	pmem->area = NULL;
+	pmem_unassign(pmem);
 	if (area->type == AREA_TYPE_LOCK) {
-		/* Move page to lock list */
+		/* The page will go to the lock list */
 		if (tee_pager_npages <= 0)
 			panic("running out of page");
 		tee_pager_npages--;
 		set_npages();
-		TAILQ_INSERT_TAIL(&tee_pager_lock_pmem_head, pmem, link);
-	} else {
-		/* move page to back */
-		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
 	}
 
 	return pmem;
@@ -1354,10 +1636,179 @@ static void stat_handle_fault(void)
 }
 #endif
 
+/*
+ * Loads the content of @page_va in @area into @pmem, a page returned by
+ * tee_pager_get_page(), and maps it read-only. The page must not be
+ * mapped already.
+ *
+ * Called with the pager lock held, the lock is released while the page
+ * is copied and checked or decrypted so other cores can handle their
+ * faults meanwhile. The page is reserved in area->pmem_map with
+ * @pmem->loading set, a fault on the same page from another core is
+ * retried until the page is mapped. @exceptions is the exception mask
+ * used while the lock is released, see get_load_exceptions().
+ */
+static void pager_load_map_page(struct tee_pager_area *area,
+				struct tee_pager_pmem *pmem, vaddr_t page_va,
+				uint32_t exceptions)
+{
+	uint32_t attr;
+	paddr_t pa;
+
+	pmem_assign(pmem, area, area_va2idx(area, page_va));
+	pmem->loading = true;
+	pager_unlock(exceptions);
+
+	/* load page code & data */
+	tee_pager_load_page(area, page_va, pmem->va_alias);
+
+	exceptions = pager_lock(NULL);
+	pmem->loading = false;
+	if (area->type == AREA_TYPE_RO)
+		incr_ro_hits();
+	else if (area->type == AREA_TYPE_RW)
+		incr_rw_hits();
+	pmem->last_ref = pager_vtime;
+	stat_load(area, pmem->pgidx);
+	attr = get_area_mattr(area->flags) &
+		~(TEE_MATTR_PW | TEE_MATTR_UW);
+	pa = get_pmem_pa(pmem);
+
+	/*
+	 * We've updated the page using the aliased mapping and
+	 * some cache maintenence is now needed if it's an
+	 * executable page.
+	 *
+	 * Since the d-cache is a Physically-indexed,
+	 * physically-tagged (PIPT) cache we can clean either the
+	 * aliased address or the real virtual address. In this
+	 * case we choose the real virtual address.
+	 *
+	 * The i-cache can also be PIPT, but may be something else
+	 * too like VIPT. The current code requires the caches to
+	 * implement the IVIPT extension, that is:
+	 * "instruction cache maintenance is required only after
+	 * writing new data to a physical address that holds an
+	 * instruction."
+	 *
+	 * To portably invalidate the icache the page has to
+	 * be mapped at the final virtual address but not
+	 * executable.
+	 */
+	if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
+		uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
+				TEE_MATTR_PW | TEE_MATTR_UW;
+
+		/* Set a temporary read-only mapping */
+		area_set_entry(pmem->area, pmem->pgidx, pa,
+			       attr & ~mask);
+		tlbi_mva_allasid(page_va);
+
+		/*
+		 * Doing these operations to LoUIS (Level of
+		 * unification, Inner Shareable) would be enough
+		 */
+		cache_op_inner(DCACHE_AREA_CLEAN, (void *)page_va,
+			       SMALL_PAGE_SIZE);
+		cache_op_inner(ICACHE_AREA_INVALIDATE, (void *)page_va,
+			       SMALL_PAGE_SIZE);
+
+		/* Set the final mapping */
+		area_set_entry(area, pmem->pgidx, pa, attr);
+		tlbi_mva_allasid(page_va);
+	} else {
+		area_set_entry(area, pmem->pgidx, pa, attr);
+		/*
+		 * No need to flush TLB for this entry, it was
+		 * invalid. We should use a barrier though, to make
+		 * sure that the change is visible.
+		 */
+		dsb_ishst();
+	}
+	pgt_inc_used_entries(area->pgt);
+
+	if (area->type == AREA_TYPE_LOCK)
+		TAILQ_INSERT_TAIL(&tee_pager_lock_pmem_head, pmem, link);
+	else
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+
+	FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
+}
+
+/*
+ * Fault-around: when faults in an area hit page after page the following
+ * pages of the area are loaded in the same fault. The window starts at
+ * one page and doubles each time the next fault lands right after the
+ * pages loaded ahead, any other fault resets it. Only read-only areas
+ * are considered, loading a read-write page ahead means decrypting a
+ * page which may never be used.
+ */
+static void fault_around(struct tee_pager_area *area, vaddr_t page_va,
+			 uint32_t exceptions)
+{
+	size_t pgnum = (page_va - area->base) >> SMALL_PAGE_SHIFT;
+	size_t max_window = MIN((size_t)CFG_PAGER_FAULT_AROUND,
+				tee_pager_npages / 4);
+	struct tee_pager_pmem *pmem;
+	vaddr_t va;
+	size_t n;
+
+	if (area->type != AREA_TYPE_RO || !max_window)
+		return;
+
+	if (pgnum == area->fa_next && pgnum) {
+		/* The pages loaded ahead last time were all used */
+		add_fault_around_hits(area->fa_window);
+		if (area->fa_window)
+			area->fa_window = MIN(area->fa_window * 2, max_window);
+		else
+			area->fa_window = 1;
+	} else {
+		area->fa_window = 0;
+	}
+	area->fa_next = pgnum + 1 + area->fa_window;
+
+	for (n = 1; n <= area->fa_window; n++) {
+		va = page_va + n * SMALL_PAGE_SIZE;
+		if (va >= area->base + area->size ||
+		    area->pmem_map[pgnum + n])
+			break;
+
+		pmem = tee_pager_get_page(area);
+		if (!pmem)
+			break;
+		pager_load_map_page(area, pmem, va, exceptions);
+		incr_fault_around();
+	}
+}
+
+/*
+ * Returns the exception mask to load pages with for the fault @ai, which
+ * is handled with @exceptions masked.
+ *
+ * Native interrupts are unmasked during the load if they were unmasked
+ * where the fault occurred and the abort handler can take them, so the
+ * hash check or decryption of a page doesn't add to their latency.
+ * Foreign interrupts stay masked, taking one means suspending the
+ * faulting thread which can't be done from the abort handler.
+ */
+static uint32_t get_load_exceptions(struct abort_info *ai,
+				    uint32_t exceptions)
+{
+	uint32_t aborted_excp = (ai->regs->spsr >> ARM32_CPSR_F_SHIFT) &
+				THREAD_EXCP_ALL;
+
+	if (!(aborted_excp & THREAD_EXCP_NATIVE_INTR) &&
+	    thread_abort_may_unmask_native_intr())
+		return exceptions & ~THREAD_EXCP_NATIVE_INTR;
+	return exceptions;
+}
+
 bool tee_pager_handle_fault(struct abort_info *ai)
 {
 	struct tee_pager_area *area;
 	vaddr_t page_va = ai->va & ~SMALL_PAGE_MASK;
+	uint32_t load_exceptions;
 	uint32_t exceptions;
 	bool ret;
 
@@ -1379,6 +1830,7 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 	exceptions = pager_lock(ai);
 
 	stat_handle_fault();
+	pager_vtime++;
 
 	/* check if the access is valid */
 	if (abort_is_user_exception(ai)) {
@@ -1394,10 +1846,17 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 		goto out;
 	}
 
-	if (!tee_pager_unhide_page(page_va)) {
+	if (pmem_is_loading(area, page_va)) {
+		/*
+		 * Another core is loading the page, returning lets the
+		 * access fault again until the page is mapped.
+		 */
+		ret = true;
+		goto out;
+	}
+
+	if (!tee_pager_unhide_page(area, page_va)) {
 		struct tee_pager_pmem *pmem = NULL;
-		uint32_t attr;
-		paddr_t pa;
 
 		/*
 		 * The page wasn't hidden, but some other core may have
@@ -1419,74 +1878,15 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 			panic();
 		}
 
-		/* load page code & data */
-		tee_pager_load_page(area, page_va, pmem->va_alias);
-
-
-		pmem->area = area;
-		pmem->pgidx = area_va2idx(area, ai->va);
-		attr = get_area_mattr(area->flags) &
-			~(TEE_MATTR_PW | TEE_MATTR_UW);
-		pa = get_pmem_pa(pmem);
-
-		/*
-		 * We've updated the page using the aliased mapping and
-		 * some cache maintenence is now needed if it's an
-		 * executable page.
-		 *
-		 * Since the d-cache is a Physically-indexed,
-		 * physically-tagged (PIPT) cache we can clean either the
-		 * aliased address or the real virtual address. In this
-		 * case we choose the real virtual address.
-		 *
-		 * The i-cache can also be PIPT, but may be something else
-		 * too like VIPT. The current code requires the caches to
-		 * implement the IVIPT extension, that is:
-		 * "instruction cache maintenance is required only after
-		 * writing new data to a physical address that holds an
-		 * instruction."
-		 *
-		 * To portably invalidate the icache the page has to
-		 * be mapped at the final virtual address but not
-		 * executable.
-		 */
-		if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
-			uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
-					TEE_MATTR_PW | TEE_MATTR_UW;
-
-			/* Set a temporary read-only mapping */
-			area_set_entry(pmem->area, pmem->pgidx, pa,
-				       attr & ~mask);
-			tlbi_mva_allasid(page_va);
-
-			/*
-			 * Doing these operations to LoUIS (Level of
-			 * unification, Inner Shareable) would be enough
-			 */
-			cache_op_inner(DCACHE_AREA_CLEAN, (void *)page_va,
-				       SMALL_PAGE_SIZE);
-			cache_op_inner(ICACHE_AREA_INVALIDATE, (void *)page_va,
-				       SMALL_PAGE_SIZE);
-
-			/* Set the final mapping */
-			area_set_entry(area, pmem->pgidx, pa, attr);
-			tlbi_mva_allasid(page_va);
-		} else {
-			area_set_entry(area, pmem->pgidx, pa, attr);
-			/*
-			 * No need to flush TLB for this entry, it was
-			 * invalid. We should use a barrier though, to make
-			 * sure that the change is visible.
-			 */
-			dsb_ishst();
-		}
-		pgt_inc_used_entries(area->pgt);
-
-		FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
+		assert(!area_get_pmem(area, area_va2idx(area, page_va)));
+		load_exceptions = get_load_exceptions(ai, exceptions);
+		pager_load_map_page(area, pmem, page_va, load_exceptions);
+		fault_around(area, page_va, load_exceptions);
 
 	}
 
-	tee_pager_hide_pages();
+	if (pager_policy.fault)
+		pager_policy.fault();
 	ret = true;
 out:
 	pager_unlock(exceptions);
@@ -1526,6 +1926,8 @@ void tee_pager_add_pages(vaddr_t vaddr, size_t npages, bool unmap)
 			panic("out of mem");
 
 		pmem->va_alias = pager_add_alias_page(pa);
+		pmem->last_ref = 0;
+		pmem->loading = false;
 
 		if (unmap) {
 			pmem->area = NULL;
@@ -1537,9 +1939,9 @@ void tee_pager_add_pages(vaddr_t vaddr, size_t npages, bool unmap)
 			 * The page is still mapped, let's assign the area
 			 * and update the protection bits accordingly.
 			 */
-			pmem->area = find_area(&tee_pager_area_head, va);
+			pmem_assign(pmem, find_area(&tee_pager_area_head, va),
+				    pgidx);
 			assert(pmem->area->pgt == find_core_pgt(va));
-			pmem->pgidx = pgidx;
 			assert(pa == get_pmem_pa(pmem));
 			area_set_entry(pmem->area, pgidx, pa,
 				       get_area_mattr(pmem->area->flags));
@@ -1573,7 +1975,7 @@ void tee_pager_assign_uta_tables(struct user_ta_ctx *utc)
 	struct tee_pager_area *area;
 	struct pgt *pgt = SLIST_FIRST(&thread_get_tsd()->pgt_cache);
 
-	TAILQ_FOREACH(area, utc->areas, link) {
+	TAILQ_FOREACH(area, &utc->areas->list, link) {
 		if (!area->pgt)
 			area->pgt = find_pgt(pgt, area->base);
 		else
@@ -1595,8 +1997,7 @@ static void pager_save_and_release_entry(struct tee_pager_pmem *pmem)
 	tee_pager_save_page(pmem, attr);
 	assert(pmem->area->pgt->num_used_entries);
 	pmem->area->pgt->num_used_entries--;
-	pmem->pgidx = INVALID_PGIDX;
-	pmem->area = NULL;
+	pmem_unassign(pmem);
 }
 
 void tee_pager_pgt_save_and_release_entries(struct pgt *pgt)
@@ -1618,7 +2019,8 @@ void tee_pager_pgt_save_and_release_entries(struct pgt *pgt)
 
 out:
 	if (is_user_ta_ctx(pgt->ctx)) {
-		TAILQ_FOREACH(area, to_user_ta_ctx(pgt->ctx)->areas, link) {
+		TAILQ_FOREACH(area, &to_user_ta_ctx(pgt->ctx)->areas->list,
+			      link) {
 			if (area->pgt == pgt)
 				area->pgt = NULL;
 		}
@@ -8,7 +8,9 @@
 #include <mm/core_mmu.h>
 #include <mm/core_memprot.h>
 #include <platform_config.h>
+#include <string.h>
 #include <trace.h>
+#include <util.h>
 
 #include "rng_support.h"
 
@@ -46,7 +48,7 @@ static inline int hwrng_waithost_fifo_full(void)
 	return 0;
 }
 
-uint8_t hw_get_random_byte(void)
+TEE_Result hw_get_random_bytes(void *buf, size_t len)
 {
 	/*
 	 * Only the HW RNG IP is used to generate the value through the
@@ -62,11 +64,9 @@ uint8_t hw_get_random_byte(void)
 	 *   data are valid.
 	 *
 	 * Main principle:
-	 *  For performance reason, a local SW fifo is used to store the
-	 *  content of the HOST FIFO (max size = 8bytes). When a random
-	 *  value is expected, this SW fifo is used to return a stored value.
-	 *  When the local SW fifo is empty, it is filled with the HOST FIFO
-	 *  according the following sequence:
+	 *  The HOST FIFO is drained in full each time, the caller's buffer
+	 *  is filled with as many bytes as needed according the following
+	 *  sequence:
 	 *
 	 *  - wait HOST FIFO full
 	 *      o Indicates that max 8-bytes (64b) are available
@@ -74,52 +74,36 @@ uint8_t hw_get_random_byte(void)
 	 *      available. No STATUS bit to indicate that the HOST FIFO
 	 *      is empty is provided.
 	 *  - check STATUS bits
-	 *  - update the local SW fifo with the HOST FIFO
-	 *
-	 *  This avoid to wait at each iteration that a valid random value is
-	 *  available. _LOCAL_FIFO_SIZE indicates the size of the local SW fifo.
+	 *  - copy the HOST FIFO content to the caller's buffer
 	 *
+	 *  No random byte is kept once the request is served.
 	 */
 
+#define _HOST_FIFO_SIZE 8
 
-#define _LOCAL_FIFO_SIZE 8     /* min 2, 4, 6, max 8 */
-
-	static uint8_t lfifo[_LOCAL_FIFO_SIZE];     /* local fifo */
-	static int pos = -1;
-
-	static int nbcall;  /* debug purpose - 0 is the initial value*/
-
-	volatile uint32_t tmpval[_LOCAL_FIFO_SIZE/2];
-	uint8_t value;
+	uint8_t fifo[_HOST_FIFO_SIZE];
+	uint8_t *p = buf;
+	uint32_t val;
+	size_t n;
 	int i;
 
-	nbcall++;
-
-	/* Retrieve data from local fifo */
-	if (pos >= 0) {
-		pos++;
-		value = lfifo[pos];
-		if (pos == (_LOCAL_FIFO_SIZE - 1))
-			pos = -1;
-		return value;
+	while (len) {
+		if (hwrng_waithost_fifo_full())
+			return TEE_ERROR_GENERIC;
+
+		/* Read the FIFO according the number of expected element */
+		for (i = 0; i < _HOST_FIFO_SIZE / 2; i++) {
+			val = read32(rng_base() + RNG_VAL_OFFSET);
+			fifo[2 * i] = val & 0xFF;
+			fifo[2 * i + 1] = (val >> 8) & 0xFF;
+		}
+
+		n = MIN(len, sizeof(fifo));
+		memcpy(p, fifo, n);
+		p += n;
+		len -= n;
 	}
 
-	if (hwrng_waithost_fifo_full())
-		return 0;
-
-	/* Read the FIFO according the number of expected element */
-	for (i = 0; i < _LOCAL_FIFO_SIZE / 2; i++)
-		tmpval[i] = read32(rng_base() + RNG_VAL_OFFSET) & 0xFFFF;
-
-	/* Update the local SW fifo for next request */
-	pos = 0;
-	for (i = 0; i < _LOCAL_FIFO_SIZE / 2; i++) {
-		lfifo[pos] = tmpval[i] & 0xFF;
-		pos++;
-		lfifo[pos] = (tmpval[i] >> 8) & 0xFF;
-		pos++;
-	};
-
-	pos = 0;
-	return lfifo[pos];
+	memset(fifo, 0, sizeof(fifo));
+	return TEE_SUCCESS;
 }
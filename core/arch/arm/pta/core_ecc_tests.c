@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <crypto/crypto.h>
+#include <string.h>
+#include <tee_api_defines.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define TEST_KEY_SIZE		256
+#define TEST_CURVE		TEE_ECC_CURVE_NIST_P256
+#define TEST_ALGO		TEE_ALG_ECDSA_P256
+#define TEST_DEFAULT_NUM_OPS	16
+
+/* Generated on first use and shared by all invocations */
+static struct self_test_once key_once = SELF_TEST_ONCE_INITIALIZER;
+static struct ecc_keypair key;
+
+static void free_key(void)
+{
+	crypto_bignum_free(key.d);
+	crypto_bignum_free(key.x);
+	crypto_bignum_free(key.y);
+	memset(&key, 0, sizeof(key));
+}
+
+static TEE_Result gen_key(void)
+{
+	TEE_Result res;
+
+	res = crypto_acipher_alloc_ecc_keypair(&key, TEST_KEY_SIZE);
+	if (res)
+		return res;
+	key.curve = TEST_CURVE;
+	res = crypto_acipher_gen_ecc_key(&key);
+	if (res) {
+		EMSG("ECC key generation failed: %#" PRIx32, res);
+		free_key();
+	}
+	return res;
+}
+
+static void print_ops(const char *what __maybe_unused, size_t num_ops,
+		      uint64_t us)
+{
+	uint64_t ops_s __maybe_unused = 0;
+
+	if (us)
+		ops_s = (num_ops * 1000000ULL) / us;
+	IMSG("ecdsa-p%d %s: %zu ops, %" PRIu64 " us, %" PRIu64 " ops/s",
+	     TEST_KEY_SIZE, what, num_ops, us, ops_s);
+}
+
+/*
+ * Measures ECDSA signing and verification throughput. Both use the
+ * fixed-base tables of CFG_CRYPTO_ECC_FP once the generator and the
+ * public key have been seen twice.
+ *
+ * [in]  value[0].a	Number of signatures and verifications, 0 for a default
+ * [out] value[1].a	Elapsed time signing in microseconds
+ * [out] value[1].b	Elapsed time verifying in microseconds
+ */
+TEE_Result core_ecc_tests(uint32_t nParamTypes,
+			  TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct ecc_public_key pub;
+	uint8_t sig[2 * TEST_KEY_SIZE / 8];
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	TEE_Result res;
+	size_t num_ops;
+	size_t sig_len = 0;
+	uint64_t sign_us;
+	uint64_t verify_us;
+	uint64_t t;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_ops = pParams[0].value.a;
+	if (!num_ops)
+		num_ops = TEST_DEFAULT_NUM_OPS;
+
+	res = self_test_once(&key_once, gen_key);
+	if (res)
+		return res;
+
+	memset(digest, 0xa5, sizeof(digest));
+	pub.x = key.x;
+	pub.y = key.y;
+	pub.curve = key.curve;
+
+	t = read_cntpct();
+	for (n = 0; n < num_ops; n++) {
+		digest[0] = n;
+		sig_len = sizeof(sig);
+		res = crypto_acipher_ecc_sign(TEST_ALGO, &key, digest,
+					      sizeof(digest), sig, &sig_len);
+		if (res) {
+			EMSG("ECDSA sign failed: %#" PRIx32, res);
+			return res;
+		}
+	}
+	sign_us = ticks_to_us(read_cntpct() - t);
+
+	/* Verify the last signature repeatedly */
+	t = read_cntpct();
+	for (n = 0; n < num_ops; n++) {
+		res = crypto_acipher_ecc_verify(TEST_ALGO, &pub, digest,
+						sizeof(digest), sig, sig_len);
+		if (res) {
+			EMSG("ECDSA verify failed: %#" PRIx32, res);
+			return res;
+		}
+	}
+	verify_us = ticks_to_us(read_cntpct() - t);
+
+	/* A signature of another digest must not verify */
+	digest[0]++;
+	res = crypto_acipher_ecc_verify(TEST_ALGO, &pub, digest,
+					sizeof(digest), sig, sig_len);
+	if (res != TEE_ERROR_SIGNATURE_INVALID) {
+		EMSG("ECDSA verify of bad signature: %#" PRIx32, res);
+		return TEE_ERROR_GENERIC;
+	}
+
+	print_ops("sign", num_ops, sign_us);
+	print_ops("verify", num_ops, verify_us);
+
+	pParams[1].value.a = sign_us;
+	pParams[1].value.b = verify_us;
+	return TEE_SUCCESS;
+}
@@ -3,6 +3,7 @@
  * Copyright (c) 2017, Linaro Limited
  */
 
+#include <arm.h>
 #include <assert.h>
 #include <string.h>
 #include <tee/fs_htree.h>
@@ -19,11 +20,25 @@
  */
 #define TEST_BLOCK_SIZE		144
 
+/* Parameters of test_read_ahead_reqs() and test_throughput() */
+#define TEST_RA_BLOCKS		64
+#define TEST_READ_AHEAD		8
+#define TEST_TP_ROUNDS		16
+
+/*
+ * @num_reqs:	number of storage requests, blocks fetched by
+ *		test_read_ahead() are read without a request
+ * @ra_idx:	first block fetched by test_read_ahead()
+ * @ra_num:	number of blocks fetched by test_read_ahead()
+ */
 struct test_aux {
 	uint8_t *data;
 	size_t data_len;
 	size_t data_alloced;
 	uint8_t *block;
+	size_t num_reqs;
+	size_t ra_idx;
+	size_t ra_num;
 };
 
 static TEE_Result test_get_offs_size(enum tee_fs_htree_type type, size_t idx,
@@ -99,6 +114,10 @@ static TEE_Result test_read_init(void *aux, struct tee_fs_rpc_operation *op,
 
 	res = test_get_offs_size(type, idx, vers, &offs, &sz);
 	if (res == TEE_SUCCESS) {
+		if (type != TEE_FS_HTREE_TYPE_BLOCK || idx < a->ra_idx ||
+		    idx >= a->ra_idx + a->ra_num)
+			a->num_reqs++;
+
 		memset(op, 0, sizeof(*op));
 		op->params[0].u.value.a = (vaddr_t)aux;
 		op->params[0].u.value.b = offs;
@@ -136,6 +155,9 @@ static TEE_Result test_write_init(void *aux, struct tee_fs_rpc_operation *op,
 				  enum tee_fs_htree_type type, size_t idx,
 				  uint8_t vers, void **data)
 {
+	struct test_aux *a = aux;
+
+	a->ra_num = 0;
 	return test_read_init(aux, op, type, idx, vers, data);
 }
 
@@ -158,24 +180,24 @@ static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
 
 }
 
+static void test_read_ahead(void *aux, size_t idx, size_t num)
+{
+	struct test_aux *a = aux;
+
+	a->ra_idx = idx;
+	a->ra_num = num;
+	a->num_reqs++;
+}
+
 static const struct tee_fs_htree_storage test_htree_ops = {
 	.block_size = TEST_BLOCK_SIZE,
 	.rpc_read_init = test_read_init,
 	.rpc_read_final = test_read_final,
 	.rpc_write_init = test_write_init,
 	.rpc_write_final = test_write_final,
+	.rpc_read_ahead = test_read_ahead,
 };
 
-#define CHECK_RES(res, cleanup)						\
-		do {							\
-			TEE_Result _res = (res);			\
-									\
-			if (_res != TEE_SUCCESS) {			\
-				EMSG("error: res = %#" PRIx32, _res);	\
-				{ cleanup; }				\
-			}						\
-		} while (0)
-
 static uint32_t val_from_bn_n_salt(size_t bn, size_t n, uint8_t salt)
 {
 	assert(bn < UINT16_MAX);
@@ -616,17 +638,199 @@ out:
 	return res;
 }
 
+static TEE_Result read_range(struct tee_fs_htree **ht, size_t num_blocks,
+			     size_t read_ahead, uint8_t salt)
+{
+	TEE_Result res;
+	size_t n;
+
+	for (n = 0; n < num_blocks; n++) {
+		if (read_ahead && !(n % read_ahead))
+			tee_fs_htree_read_ahead(*ht, n, read_ahead);
+		res = read_block(ht, n, salt);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Reads back a freshly opened object with read-ahead hints and checks that
+ * the blocks of each hinted span are read without a request of their own.
+ */
+static TEE_Result test_read_ahead_reqs(size_t num_blocks)
+{
+	struct test_aux *aux = aux_alloc(num_blocks);
+	struct tee_fs_htree *ht = NULL;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	struct tee_ta_session *sess;
+	const TEE_UUID *uuid;
+	TEE_Result res;
+
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res)
+		goto out;
+	uuid = &sess->ctx->uuid;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+
+	aux->num_reqs = 0;
+	res = read_range(&ht, num_blocks, TEST_READ_AHEAD, 1);
+	CHECK_RES(res, goto out);
+	if (aux->num_reqs >
+	    ROUNDUP(num_blocks, TEST_READ_AHEAD) / TEST_READ_AHEAD) {
+		EMSG("%zu blocks read with %zu requests", num_blocks,
+		     aux->num_reqs);
+		res = TEE_ERROR_GENERIC;
+	}
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	return res;
+}
+
+static uint32_t throughput(const char *what __maybe_unused,
+			   size_t num_blocks, size_t num_reqs __maybe_unused,
+			   uint64_t ticks)
+{
+	uint64_t us = ticks_to_us(ticks);
+	uint64_t kib_s = 0;
+
+	if (us)
+		kib_s = (num_blocks * TEST_BLOCK_SIZE * 1000000ULL) /
+			(us * 1024);
+	IMSG("htree %s: %zu blocks, %zu requests, %" PRIu64 " us, %" PRIu64
+	     " KiB/s", what, num_blocks, num_reqs, us, kib_s);
+	return kib_s;
+}
+
+/*
+ * Measures sequential writes, and sequential reads without and with
+ * read-ahead hints, of @num_blocks blocks. The object is opened again
+ * before each read so the blocks come from storage. The storage is only
+ * a memcpy() so the numbers are about the crypto and the number of
+ * storage requests a real storage would have to serve. @kib_s receives
+ * the write, read and read with read-ahead throughput in KiB/s.
+ */
+static TEE_Result test_throughput(size_t num_blocks, uint32_t kib_s[3])
+{
+	const size_t ra_vals[] = { 0, TEST_READ_AHEAD };
+	struct test_aux *aux = aux_alloc(num_blocks);
+	struct tee_fs_htree *ht = NULL;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	struct tee_ta_session *sess;
+	const TEE_UUID *uuid;
+	uint64_t ticks;
+	TEE_Result res;
+	uint64_t t;
+	size_t n;
+	size_t m;
+
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res)
+		goto out;
+	uuid = &sess->ctx->uuid;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+
+	aux->num_reqs = 0;
+	t = read_cntpct();
+	for (n = 0; n < TEST_TP_ROUNDS; n++) {
+		res = do_range(write_block, &ht, 0, num_blocks, n);
+		CHECK_RES(res, goto out);
+		res = tee_fs_htree_sync_to_storage(&ht, hash);
+		CHECK_RES(res, goto out);
+	}
+	kib_s[0] = throughput("write", num_blocks * TEST_TP_ROUNDS,
+			      aux->num_reqs, read_cntpct() - t);
+	tee_fs_htree_close(&ht);
+
+	for (m = 0; m < ARRAY_SIZE(ra_vals); m++) {
+		aux->num_reqs = 0;
+		ticks = 0;
+		for (n = 0; n < TEST_TP_ROUNDS; n++) {
+			res = tee_fs_htree_open(false, hash, uuid,
+						&test_htree_ops, aux, &ht);
+			CHECK_RES(res, goto out);
+			t = read_cntpct();
+			res = read_range(&ht, num_blocks, ra_vals[m],
+					 TEST_TP_ROUNDS - 1);
+			CHECK_RES(res, goto out);
+			ticks += read_cntpct() - t;
+			tee_fs_htree_close(&ht);
+		}
+		kib_s[1 + m] = throughput(ra_vals[m] ? "read ahead" : "read",
+					  num_blocks * TEST_TP_ROUNDS,
+					  aux->num_reqs, ticks);
+	}
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	return res;
+}
+
+/*
+ * [out] value[0].a	Sequential write throughput in KiB/s
+ * [out] value[0].b	Sequential read throughput in KiB/s
+ * [out] value[1].a	Sequential read throughput with read-ahead in KiB/s
+ */
 TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
-			       TEE_Param pParams[TEE_NUM_PARAMS] __unused)
+			       TEE_Param pParams[TEE_NUM_PARAMS])
 {
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t kib_s[3] = { 0 };
 	TEE_Result res;
 
-	if (nParamTypes)
+	if (nParamTypes != exp_pt)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	res = test_write_read(10);
 	if (res)
 		return res;
 
-	return test_corrupt(5);
+	res = test_corrupt(5);
+	if (res)
+		return res;
+
+	res = test_read_ahead_reqs(TEST_RA_BLOCKS);
+	if (res)
+		return res;
+
+	res = test_throughput(TEST_RA_BLOCKS, kib_s);
+	if (res)
+		return res;
+
+	pParams[0].value.a = kib_s[0];
+	pParams[0].value.b = kib_s[1];
+	pParams[1].value.a = kib_s[2];
+	pParams[1].value.b = 0;
+	return TEE_SUCCESS;
 }
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_pobj.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+/* Number of files used by test_many_files() */
+#define TEST_NUM_FILES		128
+#define TEST_DATA_SIZE		32
+
+/* File size used by test_write_read(), a multiple of the RPMB block size */
+#define TEST_RW_SIZE		4096
+
+/* Files are created in the storage of this (non-existing) TA */
+static const TEE_UUID test_uuid = {
+	0x5f8b97df, 0x2d0d, 0x4ad2,
+	{ 0x98, 0xd2, 0x74, 0xf4, 0x38, 0x27, 0x98, 0xbb }
+};
+
+static void init_pobj(struct tee_pobj *po, uint32_t *obj_id, uint32_t n)
+{
+	memset(po, 0, sizeof(*po));
+	po->uuid = test_uuid;
+	*obj_id = n;
+	po->obj_id = obj_id;
+	po->obj_id_len = sizeof(*obj_id);
+	po->fops = &rpmb_fs_ops;
+}
+
+static TEE_Result create_file(uint32_t n, const void *data, size_t len)
+{
+	struct tee_file_handle *fh = NULL;
+	struct tee_pobj po;
+	uint32_t obj_id;
+	TEE_Result res;
+
+	init_pobj(&po, &obj_id, n);
+	res = rpmb_fs_ops.create(&po, false, NULL, 0, NULL, 0, data, len,
+				 &fh);
+	if (!res)
+		rpmb_fs_ops.close(&fh);
+	return res;
+}
+
+static TEE_Result open_read_file(uint32_t n, void *data, size_t len)
+{
+	struct tee_file_handle *fh = NULL;
+	struct tee_pobj po;
+	uint32_t obj_id;
+	TEE_Result res;
+	size_t sz = 0;
+
+	init_pobj(&po, &obj_id, n);
+	res = rpmb_fs_ops.open(&po, &sz, &fh);
+	if (res)
+		return res;
+
+	if (data) {
+		res = rpmb_fs_ops.read(fh, 0, data, &len);
+		if (!res && (sz != len || len != TEST_DATA_SIZE))
+			res = TEE_ERROR_CORRUPT_OBJECT;
+	}
+
+	rpmb_fs_ops.close(&fh);
+	return res;
+}
+
+static TEE_Result rename_file(uint32_t old_n, uint32_t new_n)
+{
+	struct tee_pobj old_po;
+	struct tee_pobj new_po;
+	uint32_t old_id;
+	uint32_t new_id;
+
+	init_pobj(&old_po, &old_id, old_n);
+	init_pobj(&new_po, &new_id, new_n);
+	return rpmb_fs_ops.rename(&old_po, &new_po, false);
+}
+
+static TEE_Result remove_file(uint32_t n)
+{
+	struct tee_pobj po;
+	uint32_t obj_id;
+
+	init_pobj(&po, &obj_id, n);
+	return rpmb_fs_ops.remove(&po);
+}
+
+/*
+ * Writes ranges of various sizes up to several RPMB blocks, aligned and
+ * unaligned, each write packing as many blocks as the device accepts in
+ * one request, and checks what's read back.
+ */
+static TEE_Result test_write_read(void)
+{
+	static const size_t ranges[][2] = {
+		{ 0, TEST_RW_SIZE }, { 0, 256 }, { 256, 512 },
+		{ 100, 1000 }, { 1, 2046 }, { 3000, TEST_RW_SIZE - 3000 },
+		{ 255, 2 }, { 1024, 2048 },
+	};
+	struct tee_file_handle *fh = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *ref = malloc(TEST_RW_SIZE);
+	uint8_t *buf = malloc(TEST_RW_SIZE);
+	struct tee_pobj po;
+	uint32_t obj_id;
+	size_t len;
+	size_t n;
+	size_t m;
+
+	if (!ref || !buf) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	for (n = 0; n < TEST_RW_SIZE; n++)
+		ref[n] = n;
+
+	init_pobj(&po, &obj_id, 0);
+	res = rpmb_fs_ops.create(&po, false, NULL, 0, NULL, 0, ref,
+				 TEST_RW_SIZE, &fh);
+	CHECK_RES(res, goto out);
+
+	for (n = 0; n < ARRAY_SIZE(ranges); n++) {
+		for (m = 0; m < ranges[n][1]; m++)
+			buf[m] = n + m * 7;
+		memcpy(ref + ranges[n][0], buf, ranges[n][1]);
+
+		res = rpmb_fs_ops.write(fh, ranges[n][0], buf, ranges[n][1]);
+		CHECK_RES(res, goto out);
+
+		len = TEST_RW_SIZE;
+		res = rpmb_fs_ops.read(fh, 0, buf, &len);
+		CHECK_RES(res, goto out);
+		if (len != TEST_RW_SIZE || memcmp(buf, ref, len)) {
+			EMSG("range %zu: data mismatch", n);
+			res = TEE_ERROR_CORRUPT_OBJECT;
+			goto out;
+		}
+	}
+
+out:
+	if (fh) {
+		rpmb_fs_ops.close(&fh);
+		remove_file(0);
+	}
+	free(ref);
+	free(buf);
+	return res;
+}
+
+static uint32_t ops_per_second(const char *what __maybe_unused,
+			       size_t num_ops, uint64_t ticks)
+{
+	uint64_t us = ticks_to_us(ticks);
+	uint64_t ops_s = 0;
+
+	if (us)
+		ops_s = (num_ops * 1000000ULL) / us;
+	IMSG("rpmb %s: %zu files, %" PRIu64 " us, %" PRIu64 " ops/s",
+	     what, num_ops, us, ops_s);
+	return ops_s;
+}
+
+/*
+ * Creates, looks up, renames and removes @num_files files, enough for the
+ * FAT to span several blocks. Each phase is timed and returned in @ops_s
+ * as operations per second, the checks that each lookup finds exactly
+ * what's expected are done outside the timed loops.
+ */
+static TEE_Result test_many_files(size_t num_files, uint32_t ops_s[4])
+{
+	uint8_t data[TEST_DATA_SIZE];
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t t;
+	size_t n;
+
+	memset(data, 0x5a, sizeof(data));
+
+	t = read_cntpct();
+	for (n = 0; n < num_files; n++) {
+		res = create_file(n, data, sizeof(data));
+		CHECK_RES(res, goto out);
+	}
+	ops_s[0] = ops_per_second("create", num_files, read_cntpct() - t);
+
+	t = read_cntpct();
+	for (n = 0; n < num_files; n++) {
+		res = open_read_file(n, data, sizeof(data));
+		CHECK_RES(res, goto out);
+	}
+	ops_s[1] = ops_per_second("open+read", num_files, read_cntpct() - t);
+
+	t = read_cntpct();
+	for (n = 0; n < num_files; n++) {
+		res = rename_file(n, n + num_files);
+		CHECK_RES(res, goto out);
+	}
+	ops_s[2] = ops_per_second("rename", num_files, read_cntpct() - t);
+
+	for (n = 0; n < num_files; n++) {
+		if (open_read_file(n, NULL, 0) != TEE_ERROR_ITEM_NOT_FOUND) {
+			EMSG("file %zu: found after rename", n);
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+		res = open_read_file(n + num_files, data, sizeof(data));
+		CHECK_RES(res, goto out);
+	}
+
+	t = read_cntpct();
+	for (n = 0; n < num_files; n++) {
+		res = remove_file(n + num_files);
+		CHECK_RES(res, goto out);
+	}
+	ops_s[3] = ops_per_second("remove", num_files, read_cntpct() - t);
+
+	for (n = 0; n < num_files; n++) {
+		if (open_read_file(n + num_files, NULL, 0) !=
+		    TEE_ERROR_ITEM_NOT_FOUND) {
+			EMSG("file %zu: found after remove", n + num_files);
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+
+	return TEE_SUCCESS;
+
+out:
+	/* Remove what's left in either name */
+	for (n = 0; n < num_files; n++) {
+		remove_file(n);
+		remove_file(n + num_files);
+	}
+	return res;
+}
+
+/*
+ * [out] value[0].a	Files created per second
+ * [out] value[0].b	Files opened and read per second
+ * [out] value[1].a	Files renamed per second
+ * [out] value[1].b	Files removed per second
+ */
+TEE_Result core_fs_rpmb_tests(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t ops_s[4] = { 0 };
+	TEE_Result res;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = test_write_read();
+	if (res)
+		return res;
+
+	res = test_many_files(TEST_NUM_FILES, ops_s);
+	if (res)
+		return res;
+
+	pParams[0].value.a = ops_s[0];
+	pParams[0].value.b = ops_s[1];
+	pParams[1].value.a = ops_s[2];
+	pParams[1].value.b = ops_s[3];
+	return TEE_SUCCESS;
+}
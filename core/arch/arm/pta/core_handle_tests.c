@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <kernel/handle.h>
+#include <stdlib.h>
+#include <tee_api_defines.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define TEST_DEFAULT_NUM_HANDLES	1024
+#define TEST_MAX_NUM_HANDLES		(HANDLE_IDX_MASK + 1)
+#define TEST_NUM_LOOKUPS		(64 * 1024)
+
+struct test_item {
+	int handle;
+};
+
+/*
+ * Checks that only current handles are accepted: handles of deallocated
+ * slots, handles of reused slots with an old generation and made up
+ * handles must all fail.
+ */
+static TEE_Result test_validation(struct handle_db *db,
+				  struct test_item *items, size_t num_items)
+{
+	int old_handle;
+	size_t n;
+
+	for (n = 0; n < num_items; n++)
+		if (handle_lookup(db, items[n].handle) != items + n)
+			return TEE_ERROR_GENERIC;
+
+	if (handle_lookup(db, 0) || handle_lookup(db, -1) ||
+	    handle_lookup(db, items[0].handle + num_items) ||
+	    handle_lookup(db, items[0].handle + (1 << HANDLE_IDX_BITS)))
+		return TEE_ERROR_GENERIC;
+
+	old_handle = items[0].handle;
+	if (handle_put(db, old_handle) != items ||
+	    handle_lookup(db, old_handle) || handle_put(db, old_handle))
+		return TEE_ERROR_GENERIC;
+
+	/* The freed slot is reused with a new generation */
+	items[0].handle = handle_get(db, items);
+	if (items[0].handle <= 0 || items[0].handle == old_handle ||
+	    (items[0].handle & HANDLE_IDX_MASK) !=
+	    (old_handle & HANDLE_IDX_MASK))
+		return TEE_ERROR_GENERIC;
+	if (handle_lookup(db, old_handle) ||
+	    handle_lookup(db, items[0].handle) != items)
+		return TEE_ERROR_GENERIC;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Checks handle validation with many live handles, measures lookups while
+ * they're live and checks that no handle is valid once all are
+ * deallocated.
+ *
+ * [in]  value[0].a	Number of live handles, 0 for a default
+ * [out] value[1].a	Elapsed time of TEST_NUM_LOOKUPS lookups in
+ *			microseconds
+ */
+TEE_Result core_handle_tests(uint32_t nParamTypes,
+			     TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct handle_db db = HANDLE_DB_INITIALIZER;
+	TEE_Result res = TEE_SUCCESS;
+	struct test_item *items;
+	size_t num_items;
+	uint64_t us;
+	uint64_t t;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_items = pParams[0].value.a;
+	if (!num_items)
+		num_items = TEST_DEFAULT_NUM_HANDLES;
+	if (num_items > TEST_MAX_NUM_HANDLES)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	items = calloc(num_items, sizeof(*items));
+	if (!items)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < num_items; n++) {
+		items[n].handle = handle_get(&db, items + n);
+		if (items[n].handle <= 0) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			goto out;
+		}
+	}
+
+	res = test_validation(&db, items, num_items);
+	if (res) {
+		EMSG("handle validation failed");
+		goto out;
+	}
+
+	t = read_cntpct();
+	for (n = 0; n < TEST_NUM_LOOKUPS; n++) {
+		if (handle_lookup(&db, items[n % num_items].handle) !=
+		    items + n % num_items) {
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+	us = ticks_to_us(read_cntpct() - t);
+	IMSG("%zu handles, %d lookups: %" PRIu64 " us", num_items,
+	     TEST_NUM_LOOKUPS, us);
+	pParams[1].value.a = us;
+
+	for (n = 0; n < num_items; n++) {
+		if (handle_put(&db, items[n].handle) != items + n) {
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+	for (n = 0; n < num_items; n++) {
+		if (handle_lookup(&db, items[n].handle)) {
+			EMSG("deallocated handle %#x still valid",
+			     items[n].handle);
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+
+out:
+	handle_db_destroy(&db);
+	free(items);
+	return res;
+}
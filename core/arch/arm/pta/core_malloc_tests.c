@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee_api_defines.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define TEST_DEFAULT_NUM_OPS	(64 * 1024)
+#define TEST_NUM_SLOTS		64
+#define TEST_MAX_SIZE		320
+
+struct test_slot {
+	uint8_t *buf;
+	size_t size;
+	uint8_t pattern;
+};
+
+static uint32_t next_rand(uint32_t *state)
+{
+	/* Numerical Recipes LCG, good enough to pick sizes and slots */
+	*state = *state * 1664525 + 1013904223;
+	return *state >> 8;
+}
+
+static bool check_slot(struct test_slot *slot)
+{
+	size_t n;
+
+	for (n = 0; n < slot->size; n++)
+		if (slot->buf[n] != slot->pattern)
+			return false;
+	return true;
+}
+
+/*
+ * Allocates and frees small buffers of random sizes, mostly within the
+ * size classes of the heap caches, with a working set of TEST_NUM_SLOTS
+ * buffers. Every buffer is filled with a pattern which is checked before
+ * it's freed to catch buffers handed out twice. Invoked from several
+ * threads at once to measure how the heap scales with the number of
+ * cores.
+ *
+ * [in]  value[0].a	Number of allocations, 0 for a default
+ * [out] value[1].a	Elapsed time in microseconds
+ */
+TEE_Result core_malloc_tests(uint32_t nParamTypes,
+			     TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct test_slot slots[TEST_NUM_SLOTS];
+	uint32_t state = (vaddr_t)slots;
+	TEE_Result res = TEE_SUCCESS;
+	struct test_slot *slot;
+	uint64_t us;
+	size_t num_ops;
+	uint64_t t;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_ops = pParams[0].value.a;
+	if (!num_ops)
+		num_ops = TEST_DEFAULT_NUM_OPS;
+
+	memset(slots, 0, sizeof(slots));
+
+	t = read_cntpct();
+	for (n = 0; n < num_ops; n++) {
+		slot = slots + next_rand(&state) % TEST_NUM_SLOTS;
+
+		if (slot->buf) {
+			if (!check_slot(slot)) {
+				EMSG("buffer %p corrupted", (void *)slot->buf);
+				res = TEE_ERROR_CORRUPT_OBJECT;
+				goto out;
+			}
+			free(slot->buf);
+		}
+
+		slot->size = next_rand(&state) % TEST_MAX_SIZE + 1;
+		slot->pattern = 0;
+		if (n & 1)
+			slot->buf = malloc(slot->size);
+		else
+			slot->buf = calloc(1, slot->size);
+		if (!slot->buf) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			goto out;
+		}
+		if (!(n & 1) && !check_slot(slot)) {
+			EMSG("calloc() buffer %p not cleared",
+			     (void *)slot->buf);
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+		slot->pattern = n;
+		memset(slot->buf, slot->pattern, slot->size);
+	}
+	us = ticks_to_us(read_cntpct() - t);
+
+	IMSG("%zu allocations of up to %d bytes: %" PRIu64 " us",
+	     num_ops, TEST_MAX_SIZE, us);
+	pParams[1].value.a = us;
+	pParams[1].value.b = 0;
+
+out:
+	for (n = 0; n < TEST_NUM_SLOTS; n++)
+		free(slots[n].buf);
+	return res;
+}
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <malloc.h>
+#include <mempool.h>
+#include <mpalib.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define TEST_MAX_BITS		2048
+#define TEST_NUM_VARS		24
+#define TEST_NUM_ROUNDS		4
+
+typedef void (*exp_mod_func)(mpanum dest, const mpanum op1,
+			     const mpanum op2, const mpanum n,
+			     const mpanum r_modn, const mpanum r2_modn,
+			     const mpa_word_t n_inv, mpa_scratch_mem pool);
+
+static const struct {
+	const char *name;
+	exp_mod_func func;
+} exp_mod_funcs[] = {
+	{ "ladder", mpa_exp_mod_ladder },
+	{ "fixed window", mpa_exp_mod },
+	{ "sliding window", mpa_exp_mod_vartime },
+};
+
+/* 2048-bit MODP group prime from RFC 3526 */
+static const char kat_mod[] =
+	"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E08"
+	"8A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B"
+	"302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9"
+	"A637ED6B0BFF5CB6F406B7EDEE386BFB5A899FA5AE9F24117C4B1FE6"
+	"49286651ECE45B3DC2007CB8A163BF0598DA48361C55D39A69163FA8"
+	"FD24CF5F83655D23DCA3AD961C62F356208552BB9ED529077096966D"
+	"670C354E4ABC9804F1746C08CA18217C32905E462E36CE3BE39E772C"
+	"180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF695581718"
+	"3995497CEA956AE515D2261898FA051015728E5A8AACAA68FFFFFFFF"
+	"FFFFFFFF";
+static const char kat_base[] =
+	"1137FE6643293E595737DA8C74718889B6085223E3213810F7FCF810"
+	"9C323621DAE8461A51B324C85D02F3CA39F275B2EE37FCF828F94014"
+	"66653B549554C0550819AD854A18D8134B15A42F73C41D3C53550DFF"
+	"793D0CA83192756EF4CD626B9C3DDAA7567CC54A9D802BA4968DD8BA"
+	"ADA6D46B6E134FEFF1A8727133B8813A39FF44BD2A2721DEBFD529D3"
+	"1437DD1505D2BBA6C417D4D29AB09A71A3917EB0C599302A7579B9DC"
+	"08B99CF2873759F6A3684E156F31CEE61064ECE2DCE320810A842D32"
+	"08F25C253C41CC2A3C53A2808C687ECC88BE89846F376BC21ED4DA5F"
+	"4C4D501181D7EC3EAB9E8C69A0A35949675CC5FB0716A8EF209EA975"
+	"887D09E1";
+static const char kat_exp[] =
+	"8B0B07ACD9F82F492D163049473CCD7B4BE9DC58E5A0757C10EB14E0"
+	"D268990F5C86DD7F9368FA78AA41AFA88EDBD82AE1D8948FE7FA22E3"
+	"4AB2A492381BBCD416855963DCDC02420A96FE7407106FF440698662"
+	"3FEFFB32F2BA5ACAF5C21F8534D4984496C05D637473C56B544CC446"
+	"68172942B48756E0103FB4315B30579360762C51D069F24955EB4C26"
+	"3869C9BCDB03F85AA863FB820A7984D0B1AF546BA35A0B82A1C4DE75"
+	"F300DB0DC87F6D42C3C14BA8CD511DC3D186A18203F52E522907BE8F"
+	"5A16430D033E74CD3CC762C5FF23CFE383D2DFABA67A61A8AF33EC53"
+	"82A56A7024E96582198824041E5D7ECDD927BB3930C0EEA9A504F782"
+	"4283D2C0";
+static const char kat_res[] =
+	"5183B5E6440A6E90673DD3E630F5B8CED2130CA9E940193AE41EE1E2"
+	"287BD1372451964342FBEB2376DEAA181A64391B5320375D7ED565EB"
+	"AA76A9E42B8088C803E89F925245E75D6DF98F0E7D43A233A75BDB93"
+	"6B0DDC6EEDD971C3E2B5E716CC92E799292999B1ADB5106DC6B0522F"
+	"EF89C3170A5BB00BDD4CD70069130DCA554F85461DB55741E995E2D9"
+	"20B9C00C8C65DAE17F916F4A6CDD4F7E4B521B61D3191FCC5F9C5156"
+	"E0B39341F2CFD0792279B7F70BB76F5E59063D7F8999D13106B4FC03"
+	"2D75097C8D1E76FC0497E33A55C7C888D6E1ECE1B1D46DCC5DA1FFDB"
+	"3FA24CE514D11179107734247C805AF0B6685A6C9EC2561C47588455"
+	"336C245A";
+
+/* Small known answers, base, exponent, modulus and result */
+static const char *const kat_small[][4] = {
+	{ "4", "D", "1F1", "1BD" },
+	{ "0", "10001", "C35", "0" },
+	{ "123", "0", "C35", "1" },
+	{ "C34", "FFFFFFFF", "C35", "C34" },
+};
+
+/*
+ * The scratch pool is allocated on first use and kept for later
+ * invocations, the memory pool can't be freed. Concurrent invocations
+ * share it, the memory pool lets one thread at a time allocate from it.
+ */
+static struct self_test_once scratch_once = SELF_TEST_ONCE_INITIALIZER;
+static mpa_scratch_mem_base scratch;
+
+static TEE_Result init_scratch(void)
+{
+	size_t sz = mpa_scratch_mem_size_in_U32(TEST_NUM_VARS,
+						TEST_MAX_BITS * 2) *
+		    sizeof(uint32_t);
+	void *data;
+
+	data = malloc(sz);
+	if (!data)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	scratch.bn_bits = TEST_MAX_BITS * 2;
+	scratch.pool = mempool_alloc_pool(data, sz, NULL);
+	if (!scratch.pool) {
+		free(data);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	return TEE_SUCCESS;
+}
+
+struct test_vars {
+	mpanum n;
+	mpanum r_modn;
+	mpanum r2_modn;
+	mpanum base;
+	mpanum exp;
+	mpanum expected;
+	mpanum res;
+	mpa_word_t n_inv;
+};
+
+static TEE_Result set_operands(struct test_vars *v, const char *base,
+			       const char *exp, const char *n,
+			       const char *expected)
+{
+	if (mpa_set_str(v->base, base) < 0 || mpa_set_str(v->exp, exp) < 0 ||
+	    mpa_set_str(v->n, n) < 0 ||
+	    mpa_set_str(v->expected, expected) < 0)
+		return TEE_ERROR_BAD_FORMAT;
+
+	if (mpa_compute_fmm_context(v->n, v->r_modn, v->r2_modn, &v->n_inv,
+				    &scratch))
+		return TEE_ERROR_GENERIC;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result check_all(struct test_vars *v, const char *what)
+{
+	size_t n;
+
+	for (n = 0; n < ARRAY_SIZE(exp_mod_funcs); n++) {
+		exp_mod_funcs[n].func(v->res, v->base, v->exp, v->n,
+				      v->r_modn, v->r2_modn, v->n_inv,
+				      &scratch);
+		if (mpa_cmp(v->res, v->expected)) {
+			EMSG("%s: %s: unexpected result", what,
+			     exp_mod_funcs[n].name);
+			return TEE_ERROR_GENERIC;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result test_known_answers(struct test_vars *v)
+{
+	TEE_Result res;
+	size_t n;
+
+	for (n = 0; n < ARRAY_SIZE(kat_small); n++) {
+		res = set_operands(v, kat_small[n][0], kat_small[n][1],
+				   kat_small[n][2], kat_small[n][3]);
+		if (!res)
+			res = check_all(v, "small");
+		if (res)
+			return res;
+	}
+
+	/* Fermat: 2^(p - 1) mod p = 1 for the prime p */
+	res = set_operands(v, "2", kat_mod, kat_mod, "1");
+	if (res)
+		return res;
+	mpa_sub_word(v->exp, v->exp, 1, &scratch);
+	res = check_all(v, "fermat");
+	if (res)
+		return res;
+
+	res = set_operands(v, kat_base, kat_exp, kat_mod, kat_res);
+	if (res)
+		return res;
+	return check_all(v, "2048-bit");
+}
+
+/*
+ * Expects the 2048-bit operands from test_known_answers(), returns the
+ * time of one exponentiation with each variant in @us
+ */
+static void test_speed(struct test_vars *v,
+		       uint32_t us[ARRAY_SIZE(exp_mod_funcs)])
+{
+	uint64_t t;
+	size_t n;
+	size_t r;
+
+	for (n = 0; n < ARRAY_SIZE(exp_mod_funcs); n++) {
+		t = read_cntpct();
+		for (r = 0; r < TEST_NUM_ROUNDS; r++)
+			exp_mod_funcs[n].func(v->res, v->base, v->exp, v->n,
+					      v->r_modn, v->r2_modn, v->n_inv,
+					      &scratch);
+		us[n] = ticks_to_us(read_cntpct() - t) / TEST_NUM_ROUNDS;
+		IMSG("mpa exp_mod %s: 2048-bit exponent, %" PRIu32 " us",
+		     exp_mod_funcs[n].name, us[n]);
+	}
+}
+
+/*
+ * [out] value[0].a	Time of a 2048-bit exponentiation with the ladder
+ *			in microseconds
+ * [out] value[0].b	Same with the fixed window
+ * [out] value[1].a	Same with the sliding window
+ */
+TEE_Result core_mpa_tests(uint32_t nParamTypes,
+			  TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t us[ARRAY_SIZE(exp_mod_funcs)] = { 0 };
+	struct test_vars v;
+	mpanum *vars[] = {
+		&v.n, &v.r_modn, &v.r2_modn, &v.base, &v.exp, &v.expected,
+		&v.res,
+	};
+	TEE_Result res;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = self_test_once(&scratch_once, init_scratch);
+	if (res)
+		return res;
+
+	for (n = 0; n < ARRAY_SIZE(vars); n++) {
+		if (!mpa_alloc_static_temp_var(vars[n], &scratch)) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			goto out;
+		}
+	}
+
+	res = test_known_answers(&v);
+	if (!res)
+		test_speed(&v, us);
+
+out:
+	/* Free in reverse order to keep the pool stack like */
+	while (n--)
+		mpa_free_static_temp_var(vars[n], &scratch);
+
+	if (!res) {
+		pParams[0].value.a = us[0];
+		pParams[0].value.b = us[1];
+		pParams[1].value.a = us[2];
+		pParams[1].value.b = 0;
+	}
+	return res;
+}
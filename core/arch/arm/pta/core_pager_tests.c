@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <mm/core_memprot.h>
+#include <mm/tee_pager.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+/* Number of locked pages faulted in and released on each round */
+#define TEST_NUM_LOCKED_PAGES	8
+#define TEST_NUM_ROUNDS		64
+
+/* Number of paged read-write pages touched on each round */
+#define TEST_NUM_RW_PAGES	32
+
+/*
+ * The pager can't give back virtual memory so the areas are allocated on
+ * first use and kept for later invocations.
+ */
+static uint8_t *locked_mem;
+static uint8_t *rw_mem;
+
+static uint32_t latency_ns(const char *what __maybe_unused,
+			   size_t num_faults, uint64_t ticks)
+{
+	uint64_t ns = 0;
+
+	if (num_faults)
+		ns = ticks_to_us(ticks) * 1000 / num_faults;
+	IMSG("pager %s: %zu accesses, %" PRIu64 " ns/access",
+	     what, num_faults, ns);
+	return ns;
+}
+
+/*
+ * Each access hits a page which was released since last time, so every
+ * access is a fault finding a free physical page.
+ */
+static TEE_Result test_locked_faults(uint32_t *ns)
+{
+	const size_t sz = TEST_NUM_LOCKED_PAGES * SMALL_PAGE_SIZE;
+	volatile uint32_t *p;
+	uint64_t ticks = 0;
+	uint64_t t;
+	size_t r;
+	size_t n;
+
+	if (!locked_mem)
+		locked_mem = tee_pager_alloc(sz, TEE_MATTR_LOCKED);
+	if (!locked_mem)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (r = 0; r < TEST_NUM_ROUNDS; r++) {
+		t = read_cntpct();
+		for (n = 0; n < TEST_NUM_LOCKED_PAGES; n++) {
+			p = (uint32_t *)(locked_mem + n * SMALL_PAGE_SIZE);
+			*p = r + n;
+		}
+		ticks += read_cntpct() - t;
+
+		for (n = 0; n < TEST_NUM_LOCKED_PAGES; n++) {
+			p = (uint32_t *)(locked_mem + n * SMALL_PAGE_SIZE);
+			if (*p != r + n) {
+				EMSG("page %zu: unexpected content", n);
+				return TEE_ERROR_GENERIC;
+			}
+		}
+
+		tee_pager_release_phys(locked_mem, sz);
+	}
+
+	*ns = latency_ns("locked fault",
+			 TEST_NUM_LOCKED_PAGES * TEST_NUM_ROUNDS, ticks);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Cycles through paged read-write pages, depending on the number of
+ * physical pages available this mixes hidden page hits, evictions and
+ * loads of previously evicted pages.
+ */
+static TEE_Result test_rw_faults(uint32_t *ns)
+{
+	const size_t sz = TEST_NUM_RW_PAGES * SMALL_PAGE_SIZE;
+	volatile uint32_t *p;
+	uint64_t t;
+	size_t r;
+	size_t n;
+
+	if (!rw_mem)
+		rw_mem = tee_pager_alloc(sz, 0);
+	if (!rw_mem)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	t = read_cntpct();
+	for (r = 0; r < TEST_NUM_ROUNDS; r++) {
+		for (n = 0; n < TEST_NUM_RW_PAGES; n++) {
+			p = (uint32_t *)(rw_mem + n * SMALL_PAGE_SIZE);
+			if (r && *p != r - 1 + n) {
+				EMSG("page %zu: unexpected content", n);
+				return TEE_ERROR_GENERIC;
+			}
+			*p = r + n;
+		}
+	}
+	*ns = latency_ns("rw access", TEST_NUM_RW_PAGES * TEST_NUM_ROUNDS,
+			 read_cntpct() - t);
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * [out] value[0].a	Latency of a locked page fault in nanoseconds
+ * [out] value[0].b	Average latency of a paged read-write access in
+ *			nanoseconds
+ */
+TEE_Result core_pager_tests(uint32_t nParamTypes,
+			    TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t locked_ns = 0;
+	uint32_t rw_ns = 0;
+	TEE_Result res;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = test_locked_faults(&locked_ns);
+	if (res)
+		return res;
+
+	res = test_rw_faults(&rw_ns);
+	if (res)
+		return res;
+
+	pParams[0].value.a = locked_ns;
+	pParams[0].value.b = rw_ns;
+	return TEE_SUCCESS;
+}
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <crypto/crypto.h>
+#include <string.h>
+#include <tee_api_defines.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define TEST_KEY_SIZE		2048
+#define TEST_ALGO		TEE_ALG_RSASSA_PKCS1_V1_5_SHA256
+#define TEST_DEFAULT_NUM_SIGNS	16
+
+/*
+ * The key is generated on first use and shared by all invocations, it's
+ * only read once generated so concurrent invocations measure the
+ * signing only.
+ */
+static struct self_test_once key_once = SELF_TEST_ONCE_INITIALIZER;
+static struct rsa_keypair key;
+
+static void free_key(void)
+{
+	crypto_bignum_free(key.e);
+	crypto_bignum_free(key.d);
+	crypto_bignum_free(key.n);
+	crypto_bignum_free(key.p);
+	crypto_bignum_free(key.q);
+	crypto_bignum_free(key.qp);
+	crypto_bignum_free(key.dp);
+	crypto_bignum_free(key.dq);
+	memset(&key, 0, sizeof(key));
+}
+
+static TEE_Result gen_key(void)
+{
+	TEE_Result res;
+
+	res = crypto_acipher_alloc_rsa_keypair(&key, TEST_KEY_SIZE);
+	if (res)
+		return res;
+	res = crypto_acipher_gen_rsa_key(&key, TEST_KEY_SIZE);
+	if (res) {
+		EMSG("RSA key generation failed: %#" PRIx32, res);
+		free_key();
+	}
+	return res;
+}
+
+/*
+ * Measures RSA signing throughput. The normal world client invokes this
+ * from several threads at once to measure how asymmetric crypto scales
+ * with the number of cores, see CFG_CORE_BIGNUM_SCRATCH_POOLS.
+ *
+ * [in]  value[0].a	Number of signatures, 0 for a default
+ * [out] value[1].a	Elapsed time in microseconds
+ */
+TEE_Result core_rsa_tests(uint32_t nParamTypes,
+			  TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct rsa_public_key pub;
+	uint8_t sig[TEST_KEY_SIZE / 8];
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	uint64_t ops_s __maybe_unused = 0;
+	TEE_Result res;
+	size_t num_signs;
+	size_t sig_len = 0;
+	uint64_t us;
+	uint64_t t;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_signs = pParams[0].value.a;
+	if (!num_signs)
+		num_signs = TEST_DEFAULT_NUM_SIGNS;
+
+	res = self_test_once(&key_once, gen_key);
+	if (res)
+		return res;
+
+	memset(digest, 0xa5, sizeof(digest));
+
+	t = read_cntpct();
+	for (n = 0; n < num_signs; n++) {
+		digest[0] = n;
+		sig_len = sizeof(sig);
+		res = crypto_acipher_rsassa_sign(TEST_ALGO, &key, -1, digest,
+						 sizeof(digest), sig, &sig_len);
+		if (res) {
+			EMSG("RSA sign failed: %#" PRIx32, res);
+			return res;
+		}
+	}
+	us = ticks_to_us(read_cntpct() - t);
+
+	/* Check the last signature */
+	pub.e = key.e;
+	pub.n = key.n;
+	res = crypto_acipher_rsassa_verify(TEST_ALGO, &pub, -1, digest,
+					   sizeof(digest), sig, sig_len);
+	if (res) {
+		EMSG("RSA verify failed: %#" PRIx32, res);
+		return res;
+	}
+
+	/* The signature must not verify with another digest */
+	digest[0]++;
+	res = crypto_acipher_rsassa_verify(TEST_ALGO, &pub, -1, digest,
+					   sizeof(digest), sig, sig_len);
+	if (res != TEE_ERROR_SIGNATURE_INVALID) {
+		EMSG("RSA verify of bad signature: %#" PRIx32, res);
+		return TEE_ERROR_GENERIC;
+	}
+
+	if (us)
+		ops_s = (num_signs * 1000000ULL) / us;
+	IMSG("rsa%d sign: %zu signatures, %" PRIu64 " us, %" PRIu64 " ops/s",
+	     TEST_KEY_SIZE, num_signs, us, ops_s);
+
+	pParams[1].value.a = us;
+	return TEE_SUCCESS;
+}
@@ -7,6 +7,11 @@
 #include <stdbool.h>
 #include <trace.h>
 #include <kernel/panic.h>
+#include <kernel/va_tree.h>
+#include <mm/core_memprot.h>
+#include <mm/core_mmu.h>
+#include <mm/mobj.h>
+#include <mm/tee_mm.h>
 #include <util.h>
 #include "core_self_tests.h"
 
@@ -418,13 +423,313 @@ static int self_test_malloc(void)
 	return ret;
 }
 
+#define VA_TREE_TEST_LOOKUPS	4096
+
+/* Checks va_tree_find_fit() against a walk of the @num ranges in @nodes */
+static int check_va_tree_fit(struct va_tree *tree, struct va_tree_node *nodes,
+			     size_t num)
+{
+	struct va_tree_node *first;
+	struct va_tree_node *last;
+	size_t size;
+	size_t n;
+
+	for (size = SMALL_PAGE_SIZE; size <= 4 * SMALL_PAGE_SIZE;
+	     size += SMALL_PAGE_SIZE) {
+		first = NULL;
+		last = NULL;
+		for (n = 0; n < num; n++) {
+			if (!nodes[n].size || nodes[n].size < size)
+				continue;
+			if (!first)
+				first = nodes + n;
+			last = nodes + n;
+		}
+		if (va_tree_find_fit(tree, size, false) != first ||
+		    va_tree_find_fit(tree, size, true) != last)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Checks lookups in a tree of @num ranges inserted out of order, before
+ * and after removing every other range, and compares the cost of a
+ * lookup with walking the ranges in a list.
+ */
+static int self_test_va_tree_num(size_t num)
+{
+	struct va_tree_node *nodes = calloc(num, sizeof(*nodes));
+	struct va_tree tree = VA_TREE_INITIALIZER;
+	uint64_t tree_us __maybe_unused;
+	uint64_t list_us __maybe_unused;
+	struct va_tree_node *n;
+	vaddr_t va;
+	size_t i;
+	size_t j;
+	uint64_t t;
+	int ret = 0;
+
+	if (!nodes)
+		return -1;
+
+	/* num is a power of 2, so i * 37 % num visits every range once */
+	for (i = 0; i < num; i++) {
+		j = (i * 37) % num;
+		va_tree_insert(&tree, nodes + j, (j + 1) * 4 * SMALL_PAGE_SIZE,
+			       (j % 3 + 1) * SMALL_PAGE_SIZE);
+	}
+
+	for (i = 0; i < num; i++) {
+		va = nodes[i].va;
+		if (va_tree_find(&tree, va) != nodes + i ||
+		    va_tree_find(&tree, va + nodes[i].size - 1) != nodes + i ||
+		    va_tree_find(&tree, va - 1) ||
+		    va_tree_find(&tree, va + nodes[i].size))
+			ret = -1;
+	}
+	if (check_va_tree_fit(&tree, nodes, num))
+		ret = -1;
+
+	t = read_cntpct();
+	for (i = 0; i < VA_TREE_TEST_LOOKUPS; i++)
+		if (!va_tree_find(&tree, nodes[(i * 37) % num].va))
+			ret = -1;
+	tree_us = ticks_to_us(read_cntpct() - t);
+
+	t = read_cntpct();
+	for (i = 0; i < VA_TREE_TEST_LOOKUPS; i++) {
+		va = nodes[(i * 37) % num].va;
+		for (j = 0; j < num; j++)
+			if (va - nodes[j].va < nodes[j].size)
+				break;
+		if (j == num)
+			ret = -1;
+	}
+	list_us = ticks_to_us(read_cntpct() - t);
+
+	IMSG("va_tree: %zu ranges: %" PRIu64 " ns/lookup, list walk %" PRIu64
+	     " ns/lookup", num, tree_us * 1000 / VA_TREE_TEST_LOOKUPS,
+	     list_us * 1000 / VA_TREE_TEST_LOOKUPS);
+
+	for (i = 0; i < num; i += 2) {
+		va_tree_remove(&tree, nodes + i);
+		nodes[i].size = 0;
+	}
+	if (check_va_tree_fit(&tree, nodes, num))
+		ret = -1;
+
+	for (i = 0; i < num; i++) {
+		n = va_tree_find(&tree, (i + 1) * 4 * SMALL_PAGE_SIZE);
+		if (n != ((i & 1) ? nodes + i : NULL))
+			ret = -1;
+	}
+
+	free(nodes);
+	LOG("  va_tree %zu ranges => %s", num, ret ? "FAILED" : "ok");
+	return ret;
+}
+
+static int self_test_va_tree(void)
+{
+	static const size_t nums[] = { 8, 32, 128, 512 };
+	size_t n;
+
+	for (n = 0; n < ARRAY_SIZE(nums); n++)
+		if (self_test_va_tree_num(nums[n]))
+			return -1;
+
+	return 0;
+}
+
+#define TEE_MM_TEST_BASE	0x40000000
+#define TEE_MM_TEST_NUM_UNITS	64
+
+/*
+ * Checks the placement of allocations in a pool of TEE_MM_TEST_NUM_UNITS
+ * pages, that freed entries are reused and that the free extents around a
+ * freed entry are merged back into one.
+ */
+static int self_test_tee_mm_flags(uint32_t flags)
+{
+	bool hi = flags & TEE_MM_POOL_HI_ALLOC;
+	tee_mm_entry_t *mm[4] = { NULL };
+	tee_mm_pool_t pool;
+	uint32_t exp;
+	size_t n;
+	int ret = 0;
+
+	if (!tee_mm_init(&pool, TEE_MM_TEST_BASE,
+			 TEE_MM_TEST_BASE +
+			 TEE_MM_TEST_NUM_UNITS * SMALL_PAGE_SIZE,
+			 SMALL_PAGE_SHIFT, flags))
+		return -1;
+
+	/* Three entries of 1, 2 and 3 pages next to each other */
+	exp = hi ? TEE_MM_TEST_NUM_UNITS : 0;
+	for (n = 0; n < 3; n++) {
+		mm[n] = tee_mm_alloc(&pool, (n + 1) * SMALL_PAGE_SIZE);
+		if (!mm[n]) {
+			ret = -1;
+			goto out;
+		}
+		if (hi)
+			exp -= n + 1;
+		if (tee_mm_get_offset(mm[n]) != exp ||
+		    tee_mm_find(&pool, tee_mm_get_smem(mm[n])) != mm[n])
+			ret = -1;
+		if (!hi)
+			exp += n + 1;
+	}
+
+	/* The hole of the second entry is reused by a smaller allocation */
+	exp = tee_mm_get_offset(mm[1]);
+	tee_mm_free(mm[1]);
+	mm[1] = tee_mm_alloc(&pool, SMALL_PAGE_SIZE);
+	if (!mm[1] || tee_mm_get_offset(mm[1]) != exp + hi)
+		ret = -1;
+	if (tee_mm_find(&pool, TEE_MM_TEST_BASE + (exp + !hi) *
+					       SMALL_PAGE_SIZE))
+		ret = -1;
+
+	/* A fixed allocation in the middle of the pool */
+	mm[3] = tee_mm_alloc2(&pool, TEE_MM_TEST_BASE + 32 * SMALL_PAGE_SIZE,
+			      2 * SMALL_PAGE_SIZE);
+	if (!mm[3] || tee_mm_get_offset(mm[3]) != 32 ||
+	    tee_mm_alloc2(&pool, TEE_MM_TEST_BASE + 33 * SMALL_PAGE_SIZE,
+			  SMALL_PAGE_SIZE))
+		ret = -1;
+
+	for (n = 0; n < ARRAY_SIZE(mm); n++) {
+		tee_mm_free(mm[n]);
+		mm[n] = NULL;
+	}
+	if (!tee_mm_is_empty(&pool))
+		ret = -1;
+
+	/* Everything is merged back into a single free extent */
+	mm[0] = tee_mm_alloc(&pool, TEE_MM_TEST_NUM_UNITS * SMALL_PAGE_SIZE);
+	if (!mm[0] || tee_mm_get_offset(mm[0]))
+		ret = -1;
+out:
+	for (n = 0; n < ARRAY_SIZE(mm); n++)
+		tee_mm_free(mm[n]);
+	tee_mm_final(&pool);
+	LOG("  tee_mm flags %#" PRIx32 " => %s", flags, ret ? "FAILED" : "ok");
+	return ret;
+}
+
+static int self_test_tee_mm(void)
+{
+	if (self_test_tee_mm_flags(TEE_MM_POOL_NO_FLAGS) ||
+	    self_test_tee_mm_flags(TEE_MM_POOL_HI_ALLOC))
+		return -1;
+
+	return 0;
+}
+
+#define REG_SHM_TEST_NUM	512
+/* Page aligned cookies unlikely to be registered by normal world */
+#define REG_SHM_COOKIE(n)	(0x7e57000000000000ULL + (n) * SMALL_PAGE_SIZE)
+
+/*
+ * Registers REG_SHM_TEST_NUM objects on a page of the non-secure shared
+ * memory, checks lookups by cookie and that an unregistered object stays
+ * valid until the reference of a lookup is dropped.
+ */
+static int self_test_reg_shm(void)
+{
+	struct mobj **mobjs;
+	uint64_t cookie;
+	struct mobj *mobj;
+	vaddr_t va_start;
+	vaddr_t va_end;
+	paddr_t pa;
+	size_t n;
+	int ret = 0;
+
+	core_mmu_get_mem_by_type(MEM_AREA_NSEC_SHM, &va_start, &va_end);
+	if (!va_start)
+		return 0;
+	pa = virt_to_phys((void *)va_start);
+
+	mobjs = calloc(REG_SHM_TEST_NUM, sizeof(*mobjs));
+	if (!mobjs)
+		return -1;
+
+	for (n = 0; n < REG_SHM_TEST_NUM; n++) {
+		mobjs[n] = mobj_reg_shm_alloc(&pa, 1, 0, REG_SHM_COOKIE(n));
+		if (!mobjs[n]) {
+			ret = -1;
+			goto out;
+		}
+	}
+
+	for (n = 0; n < REG_SHM_TEST_NUM; n++) {
+		mobj = mobj_reg_shm_find_by_cookie(REG_SHM_COOKIE(n));
+		if (mobj != mobjs[n])
+			ret = -1;
+		mobj_reg_shm_put(mobj);
+	}
+	if (mobj_reg_shm_find_by_cookie(REG_SHM_COOKIE(REG_SHM_TEST_NUM)))
+		ret = -1;
+
+	/* Unregister while a lookup holds a reference */
+	cookie = REG_SHM_COOKIE(0);
+	mobj = mobj_reg_shm_find_by_cookie(cookie);
+	if (mobj_reg_shm_release_by_cookie(cookie) ||
+	    mobj_reg_shm_find_by_cookie(cookie) ||
+	    mobj->size != SMALL_PAGE_SIZE)
+		ret = -1;
+	if (mobj_reg_shm_release_by_cookie(cookie) != TEE_ERROR_ITEM_NOT_FOUND)
+		ret = -1;
+	mobj_reg_shm_put(mobj);
+	mobjs[0] = NULL;
+
+	for (n = 2; n < REG_SHM_TEST_NUM; n += 2) {
+		if (mobj_reg_shm_release_by_cookie(REG_SHM_COOKIE(n)))
+			ret = -1;
+		mobjs[n] = NULL;
+	}
+	for (n = 0; n < REG_SHM_TEST_NUM; n++) {
+		mobj = mobj_reg_shm_find_by_cookie(REG_SHM_COOKIE(n));
+		if (mobj != mobjs[n])
+			ret = -1;
+		mobj_reg_shm_put(mobj);
+	}
+out:
+	for (n = 0; n < REG_SHM_TEST_NUM; n++)
+		mobj_free(mobjs[n]);
+	free(mobjs);
+	LOG("  reg_shm => %s", ret ? "FAILED" : "ok");
+	return ret;
+}
+
+TEE_Result self_test_once(struct self_test_once *once,
+			  TEE_Result (*init)(void))
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	mutex_lock(&once->mu);
+	if (!once->done) {
+		res = init();
+		once->done = !res;
+	}
+	mutex_unlock(&once->mu);
+
+	return res;
+}
+
 /* exported entry points for some basic test */
 TEE_Result core_self_tests(uint32_t nParamTypes __unused,
 		TEE_Param pParams[TEE_NUM_PARAMS] __unused)
 {
 	if (self_test_mul_signed_overflow() || self_test_add_overflow() ||
 	    self_test_sub_overflow() || self_test_mul_unsigned_overflow() ||
-	    self_test_division() || self_test_malloc()) {
+	    self_test_division() || self_test_malloc() ||
+	    self_test_va_tree() || self_test_tee_mm() ||
+	    self_test_reg_shm()) {
 		EMSG("some self_test_xxx failed! you should enable local LOG");
 		return TEE_ERROR_GENERIC;
 	}
@@ -5,8 +5,54 @@
 #ifndef CORE_SELF_TESTS_H
 #define CORE_SELF_TESTS_H
 
+#include <arm.h>
+#include <kernel/mutex.h>
+#include <stdbool.h>
 #include <tee_api_types.h>
 #include <tee_api_defines.h>
+#include <trace.h>
+#include <types_ext.h>
+
+#define CHECK_RES(res, cleanup)						\
+		do {							\
+			TEE_Result _res = (res);			\
+									\
+			if (_res != TEE_SUCCESS) {			\
+				EMSG("error: res = %#" PRIx32, _res);	\
+				{ cleanup; }				\
+			}						\
+		} while (0)
+
+/*
+ * Tests measuring performance also check the outcome of what they time,
+ * outside the timed loops where possible. The figures are logged and,
+ * for tests with a command of their own, returned to the caller in
+ * output value parameters.
+ */
+
+/* Converts a number of system counter ticks to microseconds */
+static inline uint64_t ticks_to_us(uint64_t ticks)
+{
+	uint64_t freq = read_cntfrq();
+
+	return (ticks / freq) * 1000000 + ((ticks % freq) * 1000000) / freq;
+}
+
+/*
+ * State a test sets up on first use and keeps for later invocations, like
+ * a generated key. self_test_once() calls @init until it succeeds once,
+ * concurrent callers wait for it. @init must undo what it did before
+ * returning an error.
+ */
+struct self_test_once {
+	struct mutex mu;
+	bool done;
+};
+
+#define SELF_TEST_ONCE_INITIALIZER { .mu = MUTEX_INITIALIZER }
+
+TEE_Result self_test_once(struct self_test_once *once,
+			  TEE_Result (*init)(void));
 
 /* basic run-time tests */
 TEE_Result core_self_tests(uint32_t nParamTypes,
@@ -18,4 +64,28 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 TEE_Result core_mutex_tests(uint32_t nParamTypes,
 			    TEE_Param pParams[TEE_NUM_PARAMS]);
 
+TEE_Result core_fs_rpmb_tests(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_pager_tests(uint32_t nParamTypes,
+			    TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_rsa_tests(uint32_t nParamTypes,
+			  TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_mpa_tests(uint32_t nParamTypes,
+			  TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_ecc_tests(uint32_t nParamTypes,
+			  TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_handle_tests(uint32_t nParamTypes,
+			     TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_malloc_tests(uint32_t nParamTypes,
+			     TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_slab_tests(uint32_t nParamTypes,
+			   TEE_Param pParams[TEE_NUM_PARAMS]);
+
 #endif /*CORE_SELF_TESTS_H*/
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <kernel/slab.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee_api_defines.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define TEST_DEFAULT_NUM_OBJS	256
+#define TEST_MAX_NUM_OBJS	4096
+#define TEST_NUM_ROUNDS		64
+#define TEST_MAGIC		0x51ab51ab
+
+struct test_obj {
+	uint32_t magic;
+	uint32_t data[19];
+};
+
+static void test_obj_ctor(void *obj)
+{
+	struct test_obj *o = obj;
+
+	o->magic = TEST_MAGIC;
+}
+
+static struct slab_cache test_obj_cache =
+	SLAB_CACHE_INITIALIZER("test_obj", sizeof(struct test_obj),
+			       test_obj_ctor);
+
+static bool obj_is_new(struct test_obj *o)
+{
+	size_t n;
+
+	if (o->magic != TEST_MAGIC || ((vaddr_t)o & (SLAB_OBJ_ALIGN - 1)))
+		return false;
+	for (n = 0; n < ARRAY_SIZE(o->data); n++)
+		if (o->data[n])
+			return false;
+	return true;
+}
+
+/*
+ * Allocates @num_objs objects, checks that they are aligned, constructed
+ * and not handed out twice, and frees them every other object first.
+ */
+static TEE_Result test_objs(struct test_obj **objs, size_t num_objs)
+{
+	size_t n;
+
+	for (n = 0; n < num_objs; n++) {
+		objs[n] = slab_alloc(&test_obj_cache);
+		if (!objs[n])
+			return TEE_ERROR_OUT_OF_MEMORY;
+		if (!obj_is_new(objs[n]))
+			return TEE_ERROR_GENERIC;
+		memset(objs[n]->data, n, sizeof(objs[n]->data));
+	}
+
+	for (n = 0; n < num_objs; n++)
+		if (objs[n]->data[0] != ((n & 0xff) * 0x01010101))
+			return TEE_ERROR_GENERIC;
+
+	for (n = 0; n < num_objs; n += 2) {
+		slab_free(&test_obj_cache, objs[n]);
+		objs[n] = NULL;
+	}
+	for (n = 1; n < num_objs; n += 2) {
+		slab_free(&test_obj_cache, objs[n]);
+		objs[n] = NULL;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Allocates and frees @num_objs objects TEST_NUM_ROUNDS times and checks
+ * that freed objects are reused, that is that the cache doesn't grow from
+ * one round to the next.
+ */
+static TEE_Result test_reuse(struct test_obj **objs, size_t num_objs)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct slab_stats stats;
+	uint32_t num_slabs = 0;
+	size_t m;
+	size_t n;
+
+	for (m = 0; m < TEST_NUM_ROUNDS && !res; m++) {
+		for (n = 0; n < num_objs; n++) {
+			objs[n] = slab_alloc(&test_obj_cache);
+			if (!objs[n]) {
+				res = TEE_ERROR_OUT_OF_MEMORY;
+				break;
+			}
+		}
+
+		slab_get_stats(&test_obj_cache, &stats);
+		if (!res && m && stats.num_slabs != num_slabs) {
+			EMSG("round %zu: %" PRIu32 " slabs, expected %" PRIu32,
+			     m, stats.num_slabs, num_slabs);
+			res = TEE_ERROR_GENERIC;
+		}
+		num_slabs = stats.num_slabs;
+
+		for (n = 0; n < num_objs; n++) {
+			slab_free(&test_obj_cache, objs[n]);
+			objs[n] = NULL;
+		}
+	}
+
+	return res;
+}
+
+/*
+ * Checks the objects of a slab cache, that empty slabs are returned to
+ * the heap and that freed objects are reused.
+ *
+ * [in]  value[0].a	Number of live objects, 0 for a default
+ */
+TEE_Result core_slab_tests(uint32_t nParamTypes,
+			   TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	struct slab_stats stats;
+	struct test_obj **objs;
+	TEE_Result res;
+	size_t num_objs;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_objs = pParams[0].value.a;
+	if (!num_objs)
+		num_objs = TEST_DEFAULT_NUM_OBJS;
+	if (num_objs > TEST_MAX_NUM_OBJS)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	objs = calloc(num_objs, sizeof(*objs));
+	if (!objs)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = test_objs(objs, num_objs);
+	if (res) {
+		EMSG("slab object check failed");
+		for (n = 0; n < num_objs; n++)
+			slab_free(&test_obj_cache, objs[n]);
+		goto out;
+	}
+
+	slab_get_stats(&test_obj_cache, &stats);
+	if (stats.allocated || stats.num_slabs > 1) {
+		EMSG("%" PRIu32 " objects and %" PRIu32 " slabs left",
+		     stats.allocated, stats.num_slabs);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	res = test_reuse(objs, num_objs);
+
+out:
+	free(objs);
+	return res;
+}
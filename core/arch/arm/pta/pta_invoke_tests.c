@@ -408,6 +408,30 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 #endif
 	case PTA_INVOKE_TESTS_CMD_MUTEX:
 		return core_mutex_tests(nParamTypes, pParams);
+#if defined(CFG_RPMB_FS)
+	case PTA_INVOKE_TESTS_CMD_FS_RPMB:
+		return core_fs_rpmb_tests(nParamTypes, pParams);
+#endif
+#if defined(CFG_WITH_PAGER)
+	case PTA_INVOKE_TESTS_CMD_PAGER:
+		return core_pager_tests(nParamTypes, pParams);
+#endif
+#if defined(CFG_CRYPTO_RSA)
+	case PTA_INVOKE_TESTS_CMD_RSA:
+		return core_rsa_tests(nParamTypes, pParams);
+#endif
+	case PTA_INVOKE_TESTS_CMD_MPA:
+		return core_mpa_tests(nParamTypes, pParams);
+#if defined(CFG_CRYPTO_ECC)
+	case PTA_INVOKE_TESTS_CMD_ECC:
+		return core_ecc_tests(nParamTypes, pParams);
+#endif
+	case PTA_INVOKE_TESTS_CMD_HANDLE:
+		return core_handle_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_MALLOC:
+		return core_malloc_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_SLAB:
+		return core_slab_tests(nParamTypes, pParams);
 	default:
 		break;
 	}
@@ -5,12 +5,15 @@
 #include <compiler.h>
 #include <stdio.h>
 #include <trace.h>
+#include <kernel/mutex.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/slab.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
 #include <string.h>
 #include <string_ext.h>
 #include <malloc.h>
+#include <util.h>
 
 #define TA_NAME		"stats.ta"
 
@@ -20,6 +23,12 @@
 
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
+#define STATS_CMD_MUTEX_STATS		2
+#define STATS_CMD_PAGER_POLICY_STATS	3
+#define STATS_CMD_PAGER_FAULT_AROUND_STATS	4
+#define STATS_CMD_MALLOC_CACHE_STATS	5
+#define STATS_CMD_SLAB_STATS		6
+#define STATS_CMD_MM_FRAG_STATS		7
 
 #define STATS_NB_POOLS			3
 
@@ -115,6 +124,173 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	return TEE_SUCCESS;
 }
 
+/*
+ * Counters used to compare page replacement policies. Like
+ * STATS_CMD_PAGER_STATS this resets the pager counters.
+ */
+static TEE_Result get_pager_policy_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_pager_stats stats;
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_pager_get_stats(&stats);
+	p[0].value.a = stats.evictions;
+	p[0].value.b = stats.refaults;
+	p[1].value.a = stats.hides;
+	p[1].value.b = stats.hidden_hits;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Pages loaded ahead by fault-around and how many of them were walked
+ * past by the following faults. Like STATS_CMD_PAGER_STATS this resets
+ * the pager counters.
+ */
+static TEE_Result get_pager_fault_around_stats(uint32_t type,
+					       TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_pager_stats stats;
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 1 output value as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_pager_get_stats(&stats);
+	p[0].value.a = stats.fault_around;
+	p[0].value.b = stats.fault_around_hits;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Hits and misses of the per-thread caches of small heap buffers and the
+ * bytes they currently hold. Like STATS_CMD_ALLOC_STATS the counters are
+ * reset with malloc_reset_stats().
+ */
+static TEE_Result get_malloc_cache_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct malloc_cache_stats stats;
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	malloc_get_cache_stats(&stats);
+	p[0].value.a = stats.hits;
+	p[0].value.b = stats.misses;
+	p[1].value.a = stats.cached;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * p[0].memref.buffer = output buffer to an array of struct slab_stats, one
+ * for each object cache used so far
+ */
+static TEE_Result get_slab_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	size_t num_caches;
+	size_t size;
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_caches = slab_get_all_stats(p[0].memref.buffer,
+					p[0].memref.size /
+					sizeof(struct slab_stats));
+	size = num_caches * sizeof(struct slab_stats);
+	if (p[0].memref.size < size) {
+		p[0].memref.size = size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	p[0].memref.size = size;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Fragmentation of the free space of the secure DDR pool
+ * p[0].value.a = number of free extents
+ * p[0].value.b = free bytes
+ * p[1].value.a = bytes of the largest free extent
+ */
+static TEE_Result get_mm_frag_stats(uint32_t type,
+				    TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_mm_frag_stats stats;
+
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_mm_get_frag_stats(&tee_mm_sec_ddr, &stats);
+	p[0].value.a = stats.num_free_extents;
+	p[0].value.b = stats.free_size;
+	p[1].value.a = stats.largest_free_extent;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_mutex_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	size_t num;
+	size_t size;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].memref.buffer = output buffer to array of struct mutex_stats
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	if (!ALIGNMENT_IS_OK(p[1].memref.buffer, struct mutex_stats))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num = mutex_get_stats(NULL, 0, false);
+	size = num * sizeof(struct mutex_stats);
+	if (p[1].memref.size < size) {
+		p[1].memref.size = size;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	/* More mutexes may have been registered since the first call */
+	num = MIN(num, mutex_get_stats(p[1].memref.buffer, num,
+				       !!p[0].value.a));
+	p[1].memref.size = num * sizeof(struct mutex_stats);
+
+	return TEE_SUCCESS;
+}
+
 /*
  * Trusted Application Entry Points
  */
@@ -128,6 +304,18 @@ static TEE_Result invoke_command(void *psess __unused,
 		return get_pager_stats(ptypes, params);
 	case STATS_CMD_ALLOC_STATS:
 		return get_alloc_stats(ptypes, params);
+	case STATS_CMD_MUTEX_STATS:
+		return get_mutex_stats(ptypes, params);
+	case STATS_CMD_PAGER_POLICY_STATS:
+		return get_pager_policy_stats(ptypes, params);
+	case STATS_CMD_PAGER_FAULT_AROUND_STATS:
+		return get_pager_fault_around_stats(ptypes, params);
+	case STATS_CMD_MALLOC_CACHE_STATS:
+		return get_malloc_cache_stats(ptypes, params);
+	case STATS_CMD_SLAB_STATS:
+		return get_slab_stats(ptypes, params);
+	case STATS_CMD_MM_FRAG_STATS:
+		return get_mm_frag_stats(ptypes, params);
 	default:
 		break;
 	}
@@ -2,6 +2,22 @@ srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += pta_invoke_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_self_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += interrupt_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mutex_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mpa_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_handle_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_malloc_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_slab_tests.c
+ifeq ($(CFG_RPMB_FS),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_fs_rpmb_tests.c
+endif
+ifeq ($(CFG_WITH_PAGER),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_pager_tests.c
+endif
+ifeq ($(CFG_CRYPTO_RSA),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_rsa_tests.c
+endif
+ifeq ($(CFG_CRYPTO_ECC),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_ecc_tests.c
+endif
 ifeq ($(CFG_WITH_USER_TA),y)
 srcs-$(CFG_SECSTOR_TA_MGMT_PTA) += secstor_ta_mgmt.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_fs_htree_tests.c
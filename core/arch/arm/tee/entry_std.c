@@ -113,11 +113,12 @@ static TEE_Result copy_in_params(const struct optee_msg_param *params,
 	size_t n;
 	uint8_t pt[TEE_NUM_PARAMS];
 
+	/* Cleared first since cleanup_params() is called on error too */
+	memset(ta_param, 0, sizeof(*ta_param));
+
 	if (num_params > TEE_NUM_PARAMS)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	memset(ta_param, 0, sizeof(*ta_param));
-
 	for (n = 0; n < num_params; n++) {
 		uint32_t attr;
 		saved_attr[n] = params[n].attr;
@@ -172,17 +173,33 @@ static TEE_Result copy_in_params(const struct optee_msg_param *params,
 	return TEE_SUCCESS;
 }
 
-static void cleanup_params(const struct optee_msg_param *params,
+/*
+ * Frees the objects of the non-contiguous temporary memrefs and drops the
+ * references to the registered memrefs taken by copy_in_params()
+ */
+static void cleanup_params(struct tee_ta_param *ta_param,
 			   const uint64_t *saved_attr,
 			   uint32_t num_params)
 {
 	size_t n;
 
-	for (n = 0; n < num_params; n++)
-		if (msg_param_attr_is_tmem(saved_attr[n]) &&
-		    saved_attr[n] & OPTEE_MSG_ATTR_NONCONTIG)
-			mobj_free(mobj_reg_shm_find_by_cookie(
-					  params[n].u.tmem.shm_ref));
+	for (n = 0; n < num_params && n < TEE_NUM_PARAMS; n++) {
+		switch (saved_attr[n] & OPTEE_MSG_ATTR_TYPE_MASK) {
+		case OPTEE_MSG_ATTR_TYPE_TMEM_INPUT:
+		case OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT:
+		case OPTEE_MSG_ATTR_TYPE_TMEM_INOUT:
+			if (saved_attr[n] & OPTEE_MSG_ATTR_NONCONTIG)
+				mobj_free(ta_param->u[n].mem.mobj);
+			break;
+		case OPTEE_MSG_ATTR_TYPE_RMEM_INPUT:
+		case OPTEE_MSG_ATTR_TYPE_RMEM_OUTPUT:
+		case OPTEE_MSG_ATTR_TYPE_RMEM_INOUT:
+			mobj_reg_shm_put(ta_param->u[n].mem.mobj);
+			break;
+		default:
+			break;
+		}
+	}
 }
 
 static void copy_out_param(struct tee_ta_param *ta_param, uint32_t num_params,
@@ -298,8 +315,7 @@ static void entry_open_session(struct thread_smc_args *smc_args,
 	plat_prng_add_jitter_entropy();
 
 cleanup_params:
-	cleanup_params(arg->params + num_meta, saved_attr,
-		       num_params - num_meta);
+	cleanup_params(&param, saved_attr, num_params - num_meta);
 
 out:
 	if (s)
@@ -363,7 +379,7 @@ static void entry_invoke_command(struct thread_smc_args *smc_args,
 	copy_out_param(&param, num_params, arg->params, saved_attr);
 
 out:
-	cleanup_params(arg->params, saved_attr, num_params);
+	cleanup_params(&param, saved_attr, num_params);
 
 	arg->ret = res;
 	arg->ret_origin = err_orig;
@@ -423,16 +439,13 @@ static void unregister_shm(struct thread_smc_args *smc_args,
 			   struct optee_msg_arg *arg, uint32_t num_params)
 {
 	if (num_params == 1) {
-		struct mobj *mobj;
 		uint64_t cookie = arg->params[0].u.rmem.shm_ref;
 
-		mobj = mobj_reg_shm_find_by_cookie(cookie);
-		if (mobj) {
-			mobj_free(mobj);
-			arg->ret = TEE_SUCCESS;
-		} else {
+		if (mobj_reg_shm_release_by_cookie(cookie)) {
 			EMSG("Can't find mapping with given cookie");
 			arg->ret = TEE_ERROR_BAD_PARAMETERS;
+		} else {
+			arg->ret = TEE_SUCCESS;
 		}
 	} else {
 		arg->ret = TEE_ERROR_BAD_PARAMETERS;
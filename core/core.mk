@@ -14,6 +14,17 @@ PLATFORM_$(PLATFORM) := y
 PLATFORM_FLAVOR_$(PLATFORM_FLAVOR) := y
 
 $(call cfg-depends-all,CFG_PAGED_USER_TA,CFG_WITH_PAGER CFG_WITH_USER_TA)
+ifeq ($(CFG_WITH_PAGER),y)
+ifeq ($(CFG_PAGER_POLICY),hide)
+$(call force,CFG_PAGER_POLICY_HIDE,y)
+else ifeq ($(CFG_PAGER_POLICY),clock)
+$(call force,CFG_PAGER_POLICY_CLOCK,y)
+else ifeq ($(CFG_PAGER_POLICY),wsclock)
+$(call force,CFG_PAGER_POLICY_WSCLOCK,y)
+else
+$(error Error: unknown CFG_PAGER_POLICY '$(CFG_PAGER_POLICY)')
+endif
+endif
 include core/crypto.mk
 
 # Setup compiler for this sub module
@@ -33,6 +33,15 @@ CFG_CRYPTO_RSA ?= y
 CFG_CRYPTO_DH ?= y
 CFG_CRYPTO_ECC ?= y
 
+# Fixed-base comb tables speeding up ECC point multiplications with the
+# curve generators and recently used public keys. Each of the
+# CFG_CRYPTO_ECC_FP_ENTRIES cached points gets a table of
+# 2^CFG_CRYPTO_ECC_FP_LUT affine points allocated from the core heap, that
+# is 2 KiB per P-256 point and 4.5 KiB per P-521 point with the defaults.
+CFG_CRYPTO_ECC_FP ?= $(CFG_CRYPTO_ECC)
+CFG_CRYPTO_ECC_FP_ENTRIES ?= 4
+CFG_CRYPTO_ECC_FP_LUT ?= 5
+
 # Authenticated encryption
 CFG_CRYPTO_CCM ?= y
 CFG_CRYPTO_GCM ?= y
@@ -136,3 +145,13 @@ _CFG_CRYPTO_WITH_MAC := $(call cryp-one-enabled, HMAC CMAC CBC_MAC)
 _CFG_CRYPTO_WITH_CBC := $(call cryp-one-enabled, CBC CBC_MAC)
 _CFG_CRYPTO_WITH_ASN1 := $(call cryp-one-enabled, RSA DSA ECC)
 _CFG_CRYPTO_WITH_FORTUNA_PRNG := $(call cryp-all-enabled, AES SHA256)
+
+# Without software PRNG, serve crypto_rng_read() and get_rng_array() from a
+# per-thread AES-256 CTR_DRBG (NIST SP 800-90A) seeded by the platform
+# hw_get_random_bytes() instead of reading the hardware for each byte.
+ifneq ($(CFG_WITH_SOFTWARE_PRNG),y)
+CFG_HW_RNG_DRBG ?= $(call cryp-all-enabled, AES CTR)
+$(eval $(call cfg-depends-all,CFG_HW_RNG_DRBG,CFG_CRYPTO_AES CFG_CRYPTO_CTR))
+else
+$(call force,CFG_HW_RNG_DRBG,n)
+endif
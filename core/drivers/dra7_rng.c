@@ -13,6 +13,9 @@
 #include <mm/core_mmu.h>
 #include <platform_config.h>
 #include <rng_support.h>
+#include <string.h>
+#include <trace.h>
+#include <util.h>
 
 #define	RNG_OUTPUT_L            0x0000
 #define	RNG_OUTPUT_H            0x0004
@@ -72,20 +75,25 @@ register_phys_mem(MEM_AREA_IO_SEC, RNG_BASE, RNG_REG_SIZE);
 
 static unsigned int rng_lock = SPINLOCK_UNLOCK;
 
-uint8_t hw_get_random_byte(void)
+TEE_Result hw_get_random_bytes(void *buf, size_t len)
 {
-	static int pos;
-	static union {
+	vaddr_t rng = (vaddr_t)phys_to_virt(RNG_BASE, MEM_AREA_IO_SEC);
+	uint8_t *p = buf;
+	uint32_t exceptions;
+	union {
 		uint32_t val[2];
 		uint8_t byte[8];
 	} random;
-	vaddr_t rng = (vaddr_t)phys_to_virt(RNG_BASE, MEM_AREA_IO_SEC);
-	uint8_t ret;
+	size_t n;
 
-	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
-	cpu_spin_lock(&rng_lock);
+	while (len) {
+		/*
+		 * The output registers are read into a local copy, @buf may
+		 * not be touched with exceptions masked.
+		 */
+		exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+		cpu_spin_lock(&rng_lock);
 
-	if (!pos) {
 		/* Is the result ready (available)? */
 		while (!(read32(rng + RNG_STATUS) & RNG_READY)) {
 			/* Is the shutdown threshold reached? */
@@ -110,16 +118,18 @@ uint8_t hw_get_random_byte(void)
 		random.val[1] = read32(rng + RNG_OUTPUT_H);
 		/* Acknowledge read complete */
 		write32(RNG_READY, rng + RNG_INTACK);
-	}
 
-	ret = random.byte[pos];
+		cpu_spin_unlock(&rng_lock);
+		thread_set_exceptions(exceptions);
 
-	pos = (pos + 1) % 8;
-
-	cpu_spin_unlock(&rng_lock);
-	thread_set_exceptions(exceptions);
+		n = MIN(len, sizeof(random));
+		memcpy(p, random.byte, n);
+		p += n;
+		len -= n;
+	}
 
-	return ret;
+	memset(&random, 0, sizeof(random));
+	return TEE_SUCCESS;
 }
 
 static TEE_Result dra7_rng_init(void)
@@ -7,12 +7,14 @@
 
 #include <initcall.h>
 #include <io.h>
-#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/tee_time.h>
 #include <mm/core_memprot.h>
 #include <mm/core_mmu.h>
 #include <platform_config.h>
 #include <rng_support.h>
+#include <string.h>
 #include <trace.h>
 #include <types_ext.h>
 #include <util.h>
@@ -35,7 +37,7 @@
 register_phys_mem(MEM_AREA_IO_SEC, ALG_SC_BASE, ALG_SC_REG_SIZE);
 register_phys_mem(MEM_AREA_IO_SEC, RNG_BASE, RNG_REG_SIZE);
 
-static struct mutex rng_mutex = MUTEX_INITIALIZER;
+static unsigned int rng_lock = SPINLOCK_UNLOCK;
 
 static TEE_Result hi16xx_rng_init(void)
 {
@@ -60,32 +62,33 @@ static TEE_Result hi16xx_rng_init(void)
 	return TEE_SUCCESS;
 }
 
-uint8_t hw_get_random_byte(void)
+TEE_Result hw_get_random_bytes(void *buf, size_t len)
 {
-	static vaddr_t r;
-	static int pos;
-	static union {
-		uint32_t val;
-		uint8_t byte[4];
-	} random;
-	uint8_t ret;
+	vaddr_t r = (vaddr_t)phys_to_virt(RNG_BASE, MEM_AREA_IO_SEC) + RNG_NUM;
+	uint8_t *p = buf;
+	uint32_t exceptions;
+	uint32_t val;
+	size_t n;
 
-	mutex_lock(&rng_mutex);
-
-	if (!r)
-		r = (vaddr_t)phys_to_virt(RNG_BASE, MEM_AREA_IO_SEC) + RNG_NUM;
-
-	if (!pos)
-		random.val = read32(r);
-
-	ret = random.byte[pos++];
-
-	if (pos == 4)
-		pos = 0;
-
-	mutex_unlock(&rng_mutex);
+	/*
+	 * A spinlock since this may be called outside of thread context.
+	 * The output register is read into a local copy, @buf may not be
+	 * touched with exceptions masked.
+	 */
+	while (len) {
+		exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+		cpu_spin_lock(&rng_lock);
+		val = read32(r);
+		cpu_spin_unlock(&rng_lock);
+		thread_set_exceptions(exceptions);
+
+		n = MIN(len, sizeof(val));
+		memcpy(p, &val, n);
+		p += n;
+		len -= n;
+	}
 
-	return ret;
+	return TEE_SUCCESS;
 }
 
 driver_init(hi16xx_rng_init);
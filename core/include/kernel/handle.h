@@ -5,14 +5,34 @@
 #ifndef KERNEL_HANDLE_H
 #define KERNEL_HANDLE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/*
+ * A handle holds the index of its slot in the lower HANDLE_IDX_BITS and
+ * the generation of the slot above. The generation of a slot is bumped
+ * each time its handle is deallocated so a stale or forged handle isn't
+ * mistaken for the current one. Handles are always > 0.
+ */
+#define HANDLE_IDX_BITS		16
+#define HANDLE_IDX_MASK		((1U << HANDLE_IDX_BITS) - 1)
+#define HANDLE_GEN_MASK		((1U << (31 - HANDLE_IDX_BITS)) - 1)
+
+struct handle_db_entry {
+	void *ptr;
+	uint16_t gen;
+	/* Index + 1 of the next free slot when free, 0 ends the list */
+	uint32_t next_free;
+};
+
 struct handle_db {
-	void **ptrs;
+	struct handle_db_entry *entries;
 	size_t max_ptrs;
+	/* Index + 1 of the first free slot, 0 if there's none */
+	uint32_t free_head;
 };
 
-#define HANDLE_DB_INITIALIZER { NULL, 0 }
+#define HANDLE_DB_INITIALIZER { NULL, 0, 0 }
 
 /*
  * Frees all internal data structures of the database, but does not free
@@ -25,7 +45,7 @@ void handle_db_destroy(struct handle_db *db);
  * Allocates a new handle and assigns the supplied pointer to it,
  * ptr must not be NULL.
  * The function returns
- * >= 0 on success and
+ * > 0 on success and
  * -1 on failure
  */
 int handle_get(struct handle_db *db, void *ptr);
@@ -38,7 +58,7 @@ void *handle_put(struct handle_db *db, int handle);
 
 /*
  * Returns the assiciated pointer of the handle if the handle is a valid
- * handle.
+ * handle, in constant time regardless of the number of handles.
  * Returns NULL on failure.
  */
 void *handle_lookup(struct handle_db *db, int handle);
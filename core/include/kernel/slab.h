@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+#ifndef KERNEL_SLAB_H
+#define KERNEL_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/queue.h>
+
+/*
+ * Caches of fixed size objects
+ *
+ * The objects of a cache are carved out of slabs, naturally aligned
+ * chunks of the heap holding a few objects each. Objects are aligned to
+ * SLAB_OBJ_ALIGN so that two objects never share a cache line. Freed
+ * objects are kept in their slab and reused by the next allocations of
+ * the cache, a slab is returned to the heap once all its objects are free
+ * unless it's the only spare slab of the cache.
+ *
+ * A cache is defined statically with SLAB_CACHE_INITIALIZER() and is set
+ * up on its first allocation, so objects can be allocated as soon as the
+ * heap is available.
+ */
+
+/* Largest data cache line size of the supported cores */
+#define SLAB_OBJ_ALIGN		64
+
+struct slab;
+TAILQ_HEAD(slab_head, slab);
+
+struct slab_cache {
+	const char *name;
+	size_t obj_size;
+	void (*ctor)(void *obj);
+	unsigned int lock;
+	/* The fields below are set up on the first allocation */
+	size_t slab_size;
+	size_t obj_stride;
+	size_t num_objs_per_slab;
+	/* Slabs with free objects, empty slabs last */
+	struct slab_head slabs;
+	size_t num_slabs;
+	size_t num_empty_slabs;
+	size_t num_allocated;
+	size_t max_allocated;
+	size_t num_alloc_fail;
+	SLIST_ENTRY(slab_cache) link;
+};
+
+/*
+ * Initializer of a cache of objects of @size bytes. Allocated objects are
+ * cleared and then passed to @ctor, unless it's NULL.
+ */
+#define SLAB_CACHE_INITIALIZER(_name, size, _ctor) \
+	{ .name = (_name), .obj_size = (size), .ctor = (_ctor) }
+
+/* Returns a new object of @sc or NULL if out of memory */
+void *slab_alloc(struct slab_cache *sc);
+
+/* Returns @obj, NULL or an object allocated from @sc, to @sc */
+void slab_free(struct slab_cache *sc, void *obj);
+
+struct slab_stats {
+	char desc[32];
+	uint32_t obj_size;
+	uint32_t allocated;
+	uint32_t max_allocated;
+	uint32_t num_slabs;
+	uint32_t slab_size;
+	uint32_t num_alloc_fail;
+};
+
+void slab_get_stats(struct slab_cache *sc, struct slab_stats *stats);
+
+/*
+ * Fills @stats with the statistics of up to @num caches which have been
+ * used so far, returns the number of such caches.
+ */
+size_t slab_get_all_stats(struct slab_stats *stats, size_t num);
+
+#endif /*KERNEL_SLAB_H*/
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+#ifndef KERNEL_VA_TREE_H
+#define KERNEL_VA_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <types_ext.h>
+
+/*
+ * Index of non-overlapping virtual address ranges, a red-black tree
+ * ordered by start address.
+ *
+ * Since the ranges don't overlap the range containing an address is the
+ * one with the greatest start address not above it, so no augmentation
+ * of the nodes is needed to find it in O(log n). Each node also keeps
+ * the size of the largest range of its subtree, va_tree_find_fit() uses
+ * it to find the first or last range of a minimal size in O(log n).
+ *
+ * A struct va_tree_node is embedded in the structure describing the range,
+ * container_of() gives the structure back from a node returned by
+ * va_tree_find().
+ */
+struct va_tree_node {
+	vaddr_t va;
+	size_t size;
+	size_t max_size;
+	struct va_tree_node *parent;
+	struct va_tree_node *child[2];
+	bool red;
+};
+
+struct va_tree {
+	struct va_tree_node *root;
+};
+
+#define VA_TREE_INITIALIZER { NULL }
+
+/*
+ * Inserts @node covering [@va, @va + @size) into @tree, the range must
+ * not overlap any range already in the tree.
+ */
+void va_tree_insert(struct va_tree *tree, struct va_tree_node *node,
+		    vaddr_t va, size_t size);
+
+/* Removes @node, which must be in @tree */
+void va_tree_remove(struct va_tree *tree, struct va_tree_node *node);
+
+/* Returns the node of the range containing @va or NULL if none */
+struct va_tree_node *va_tree_find(struct va_tree *tree, vaddr_t va);
+
+/*
+ * Returns the node of the range with the lowest start address, or the
+ * highest if @last is true, among the ranges of at least @size bytes.
+ * Returns NULL if there's no such range.
+ */
+struct va_tree_node *va_tree_find_fit(struct va_tree *tree, size_t size,
+				      bool last);
+
+#endif /*KERNEL_VA_TREE_H*/
@@ -6,6 +6,7 @@
 #ifndef TEE_MM_H
 #define TEE_MM_H
 
+#include <kernel/va_tree.h>
 #include <malloc.h>
 #include <types_ext.h>
 
@@ -14,23 +15,37 @@
 /* Flag to indicate that memory is allocated from hi address to low address */
 #define TEE_MM_POOL_HI_ALLOC            (1u << 0)
 
+/*
+ * An entry is either allocated or, internally to the pool, describes a
+ * free extent. Allocated entries and free extents are kept in separate
+ * trees ordered by offset, the free extents tree finds the first fitting
+ * extent in O(log n).
+ */
 struct _tee_mm_entry_t {
 	struct _tee_mm_pool_t *pool;
-	struct _tee_mm_entry_t *next;
+	struct va_tree_node node;
 	uint32_t offset;	/* offset in pages/sections */
 	uint32_t size;		/* size in pages/sections */
 };
 typedef struct _tee_mm_entry_t tee_mm_entry_t;
 
 struct _tee_mm_pool_t {
-	tee_mm_entry_t *entry;
+	struct va_tree used;	/* Allocated entries of non-zero size */
+	struct va_tree free;	/* Free extents, never adjacent */
+	size_t num_entries;	/* Allocated entries, including zero sized */
+	size_t num_free;	/* Free extents */
+	bool initialized;
 	paddr_t lo;		/* low boundary of the pool */
 	paddr_t hi;		/* high boundary of the pool */
 	uint32_t flags;		/* Config flags for the pool */
 	uint8_t shift;		/* size shift */
 	unsigned int lock;
 #ifdef CFG_WITH_STATS
+	size_t allocated;	/* In pages/sections */
 	size_t max_allocated;
+	size_t num_alloc_fail;
+	size_t biggest_alloc_fail;
+	size_t biggest_alloc_fail_used;
 #endif
 };
 typedef struct _tee_mm_pool_t tee_mm_pool_t;
@@ -112,6 +127,19 @@ bool tee_mm_is_empty(tee_mm_pool_t *pool);
 #ifdef CFG_WITH_STATS
 void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
 			   bool reset);
+
+/*
+ * Fragmentation of the free space of a pool, sizes in bytes. A free
+ * extent is a maximal range of free space.
+ */
+struct tee_mm_frag_stats {
+	uint32_t num_free_extents;
+	uint32_t free_size;
+	uint32_t largest_free_extent;
+};
+
+void tee_mm_get_frag_stats(tee_mm_pool_t *pool,
+			   struct tee_mm_frag_stats *stats);
 #endif
 
 #endif
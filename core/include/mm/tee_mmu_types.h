@@ -5,6 +5,7 @@
 #ifndef TEE_MMU_TYPES_H
 #define TEE_MMU_TYPES_H
 
+#include <kernel/va_tree.h>
 #include <stdint.h>
 #include <sys/queue.h>
 #include <util.h>
@@ -78,12 +79,18 @@ struct vm_region {
 	size_t size;
 	uint32_t attr; /* TEE_MATTR_* above */
 	TAILQ_ENTRY(vm_region) link;
+	struct va_tree_node tree_node;
 };
 
 TAILQ_HEAD(vm_region_head, vm_region);
 
+/*
+ * @regions is ordered by address, @region_tree indexes the same regions
+ * for lookups by address
+ */
 struct vm_info {
 	struct vm_region_head regions;
+	struct va_tree region_tree;
 	unsigned int asid;
 };
 
@@ -5,8 +5,15 @@
 #ifndef __RNG_SUPPORT_H__
 #define __RNG_SUPPORT_H__
 
-#include <stdint.h>
+#include <stddef.h>
+#include <tee_api_types.h>
 
-uint8_t hw_get_random_byte(void);
+/*
+ * Fills @buf with @len bytes from the platform random source, implemented
+ * by the platform when CFG_WITH_SOFTWARE_PRNG isn't enabled. May be
+ * called with exceptions unmasked or outside of thread context and must
+ * not keep any of the returned bytes once done.
+ */
+TEE_Result hw_get_random_bytes(void *buf, size_t len);
 
 #endif /* __RNG_SUPPORT_H__ */
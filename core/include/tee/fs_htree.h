@@ -78,6 +78,11 @@ struct tee_fs_rpc_operation;
  *			operation
  * @rpc_write_init:	initialize a struct tee_fs_rpc_operation for an RPC
  *			write operation
+ * @rpc_read_ahead:	optional, hint that data blocks @idx up to
+ *			@idx + @num - 1 are about to be read. The storage
+ *			may fetch them with a single request and serve
+ *			following @rpc_read_init for those blocks from
+ *			memory.
  *
  * The @idx arguments starts counting from 0. The @vers arguments are either
  * 0 or 1. The @data arguments is a pointer to a buffer in non-secure shared
@@ -94,6 +99,7 @@ struct tee_fs_htree_storage {
 				     enum tee_fs_htree_type type, size_t idx,
 				     uint8_t vers, void **data);
 	TEE_Result (*rpc_write_final)(struct tee_fs_rpc_operation *op);
+	void (*rpc_read_ahead)(void *aux, size_t idx, size_t num);
 };
 
 struct tee_fs_htree;
@@ -170,4 +176,17 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht, size_t block_num,
 TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht, size_t block_num,
 				   void *block);
 
+/**
+ * tee_fs_htree_read_ahead() - hint that data blocks are about to be read
+ * @ht:		hash tree
+ * @block_num:	first block number
+ * @num_blocks:	number of blocks
+ *
+ * Lets the storage fetch blocks not beyond the end of the hash tree with a
+ * single request if it supports that, the blocks are still read with
+ * tee_fs_htree_read_block().
+ */
+void tee_fs_htree_read_ahead(struct tee_fs_htree *ht, size_t block_num,
+			     size_t num_blocks);
+
 #endif /*__TEE_FS_HTREE_H*/
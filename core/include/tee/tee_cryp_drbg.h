@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#ifndef TEE_CRYP_DRBG_H
+#define TEE_CRYP_DRBG_H
+
+#include <stddef.h>
+#include <tee_api_types.h>
+
+/*
+ * Fills @buf with @len bytes from the calling thread's CTR_DRBG instance,
+ * seeded and periodically reseeded by hw_get_random_bytes().
+ */
+TEE_Result tee_cryp_drbg_read(void *buf, size_t len);
+
+#endif /* TEE_CRYP_DRBG_H */
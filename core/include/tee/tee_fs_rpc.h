@@ -76,4 +76,11 @@ static inline void tee_fs_rpc_cache_clear(
  */
 void *tee_fs_rpc_cache_alloc(size_t size, struct mobj **mobj, uint64_t *cookie);
 
+/*
+ * Returns a counter which is increased each time the cached FS RPC memory
+ * of the current thread is handed out or freed. As long as the value is
+ * unchanged the memory holds what an earlier RPC left there.
+ */
+uint32_t tee_fs_rpc_cache_get_gen(void);
+
 #endif /* TEE_FS_RPC_H */
@@ -14,6 +14,7 @@
 
 struct tee_obj {
 	TAILQ_ENTRY(tee_obj) link;
+	uint32_t handle;	/* handle in the object_db of the TA */
 	TEE_ObjectInfo info;
 	bool busy;		/* true if used by an operation */
 	uint32_t have_attrs;	/* bitfield identifying set properties */
@@ -24,7 +25,11 @@ struct tee_obj {
 	uint32_t flags;		/* permission flags for persistent objects */
 };
 
-void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o);
+/*
+ * Allocates the handle of @o in @utc and adds it to the objects of @utc,
+ * tee_obj_get() finds it by that handle.
+ */
+TEE_Result tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o);
 
 TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 		       struct tee_obj **obj);
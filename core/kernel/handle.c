@@ -2,6 +2,7 @@
 /*
  * Copyright (c) 2014, Linaro Limited
  */
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/handle.h>
@@ -17,63 +18,103 @@
 void handle_db_destroy(struct handle_db *db)
 {
 	if (db) {
-		free(db->ptrs);
-		db->ptrs = NULL;
+		free(db->entries);
+		db->entries = NULL;
 		db->max_ptrs = 0;
+		db->free_head = 0;
 	}
 }
 
-int handle_get(struct handle_db *db, void *ptr)
+static bool grow_db(struct handle_db *db)
 {
+	size_t new_max_ptrs;
 	size_t n;
 	void *p;
-	size_t new_max_ptrs;
 
-	if (!db || !ptr)
-		return -1;
-
-	/* Try to find an empty location */
-	for (n = 0; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
-	}
-
-	/* No location available, grow the ptrs array */
 	if (db->max_ptrs)
 		new_max_ptrs = db->max_ptrs * 2;
 	else
 		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
-	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+	if (new_max_ptrs > HANDLE_IDX_MASK + 1)
+		return false;
+
+	p = realloc(db->entries, new_max_ptrs * sizeof(*db->entries));
 	if (!p)
-		return -1;
-	db->ptrs = p;
-	memset(db->ptrs + db->max_ptrs, 0,
-	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
+		return false;
+	db->entries = p;
+
+	/* The free list is empty, the new slots make up the whole list */
+	for (n = db->max_ptrs; n < new_max_ptrs; n++) {
+		db->entries[n].ptr = NULL;
+		db->entries[n].gen = 1;
+		db->entries[n].next_free = n + 2;
+	}
+	db->entries[new_max_ptrs - 1].next_free = 0;
+	db->free_head = db->max_ptrs + 1;
 	db->max_ptrs = new_max_ptrs;
+	return true;
+}
+
+static struct handle_db_entry *find_entry(struct handle_db *db, int handle)
+{
+	struct handle_db_entry *e;
+	size_t idx;
+
+	if (!db || handle <= 0)
+		return NULL;
 
-	/* Since n stopped at db->max_ptrs there is an empty location there */
-	db->ptrs[n] = ptr;
-	return n;
+	idx = handle & HANDLE_IDX_MASK;
+	if (idx >= db->max_ptrs)
+		return NULL;
+
+	e = db->entries + idx;
+	if (!e->ptr || e->gen != ((unsigned int)handle >> HANDLE_IDX_BITS))
+		return NULL;
+	return e;
+}
+
+int handle_get(struct handle_db *db, void *ptr)
+{
+	struct handle_db_entry *e;
+	size_t n;
+
+	if (!db || !ptr)
+		return -1;
+
+	if (!db->free_head && !grow_db(db))
+		return -1;
+
+	n = db->free_head - 1;
+	e = db->entries + n;
+	db->free_head = e->next_free;
+	e->ptr = ptr;
+	return (e->gen << HANDLE_IDX_BITS) | n;
 }
 
 void *handle_put(struct handle_db *db, int handle)
 {
+	struct handle_db_entry *e = find_entry(db, handle);
 	void *p;
 
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	if (!e)
 		return NULL;
 
-	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	p = e->ptr;
+	e->ptr = NULL;
+	/* Generation 0 is never used, a handle can't be 0 */
+	e->gen++;
+	if (e->gen > HANDLE_GEN_MASK)
+		e->gen = 1;
+	e->next_free = db->free_head;
+	db->free_head = (e - db->entries) + 1;
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, int handle)
 {
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
-		return NULL;
+	struct handle_db_entry *e = find_entry(db, handle);
 
-	return db->ptrs[handle];
+	if (!e)
+		return NULL;
+	return e->ptr;
 }
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <assert.h>
+#include <kernel/asan.h>
+#include <kernel/slab.h>
+#include <kernel/spinlock.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string_ext.h>
+#include <types_ext.h>
+#include <util.h>
+
+/*
+ * A slab is a naturally aligned chunk of heap of slab_size bytes, the
+ * slab of an object is found by rounding down the address of the object.
+ * The slab starts with a struct slab followed by the objects, the first
+ * word of a free object links to the next free object of the slab.
+ *
+ * This file is built without KASan instrumentation since it accesses the
+ * free objects, the objects are instead tagged as allocated or free heap
+ * for the rest of core.
+ */
+
+#define SLAB_MIN_SIZE		512
+#define SLAB_MIN_NUM_OBJS	4
+#define SLAB_HDR_SIZE		ROUNDUP(sizeof(struct slab), SLAB_OBJ_ALIGN)
+
+struct slab {
+	TAILQ_ENTRY(slab) link;
+	void *free_list;
+	size_t num_free;
+};
+
+static SLIST_HEAD(slab_cache_head, slab_cache) slab_caches =
+	SLIST_HEAD_INITIALIZER(slab_caches);
+static unsigned int slab_caches_lock = SPINLOCK_UNLOCK;
+
+/* Called with sc->lock held */
+static void init_cache(struct slab_cache *sc)
+{
+	size_t slab_size = SLAB_MIN_SIZE;
+
+	sc->obj_stride = ROUNDUP(MAX(sc->obj_size, sizeof(void *)),
+				 SLAB_OBJ_ALIGN);
+	while (slab_size < SLAB_HDR_SIZE + SLAB_MIN_NUM_OBJS * sc->obj_stride)
+		slab_size *= 2;
+	sc->num_objs_per_slab = (slab_size - SLAB_HDR_SIZE) / sc->obj_stride;
+	TAILQ_INIT(&sc->slabs);
+	sc->slab_size = slab_size;
+}
+
+static void register_cache(struct slab_cache *sc)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&slab_caches_lock);
+
+	SLIST_INSERT_HEAD(&slab_caches, sc, link);
+	cpu_spin_unlock_xrestore(&slab_caches_lock, exceptions);
+}
+
+static struct slab *alloc_slab(struct slab_cache *sc)
+{
+	struct slab *s = memalign(sc->slab_size, sc->slab_size);
+	uint8_t *obj;
+	size_t n;
+
+	if (!s)
+		return NULL;
+
+	s->free_list = NULL;
+	obj = (uint8_t *)s + SLAB_HDR_SIZE +
+	      sc->num_objs_per_slab * sc->obj_stride;
+	for (n = 0; n < sc->num_objs_per_slab; n++) {
+		obj -= sc->obj_stride;
+		*(void **)obj = s->free_list;
+		s->free_list = obj;
+	}
+	s->num_free = sc->num_objs_per_slab;
+	asan_tag_heap_free((uint8_t *)s + SLAB_HDR_SIZE,
+			   (uint8_t *)s + sc->slab_size);
+
+	return s;
+}
+
+/* Called with sc->lock held */
+static void *get_obj(struct slab_cache *sc)
+{
+	struct slab *s = TAILQ_FIRST(&sc->slabs);
+	void *obj;
+
+	if (!s)
+		return NULL;
+
+	if (s->num_free == sc->num_objs_per_slab)
+		sc->num_empty_slabs--;
+	obj = s->free_list;
+	s->free_list = *(void **)obj;
+	s->num_free--;
+	if (!s->num_free)
+		TAILQ_REMOVE(&sc->slabs, s, link);
+
+	sc->num_allocated++;
+	if (sc->num_allocated > sc->max_allocated)
+		sc->max_allocated = sc->num_allocated;
+
+	return obj;
+}
+
+void *slab_alloc(struct slab_cache *sc)
+{
+	bool new_cache = false;
+	uint32_t exceptions;
+	struct slab *s;
+	void *obj;
+
+	exceptions = cpu_spin_lock_xsave(&sc->lock);
+	if (!sc->slab_size) {
+		init_cache(sc);
+		new_cache = true;
+	}
+	obj = get_obj(sc);
+	cpu_spin_unlock_xrestore(&sc->lock, exceptions);
+
+	if (new_cache)
+		register_cache(sc);
+
+	if (!obj) {
+		/* The heap has its own lock, allocate the slab unlocked */
+		s = alloc_slab(sc);
+
+		exceptions = cpu_spin_lock_xsave(&sc->lock);
+		if (s) {
+			TAILQ_INSERT_TAIL(&sc->slabs, s, link);
+			sc->num_slabs++;
+			sc->num_empty_slabs++;
+			obj = get_obj(sc);
+		} else {
+			sc->num_alloc_fail++;
+		}
+		cpu_spin_unlock_xrestore(&sc->lock, exceptions);
+
+		if (!obj)
+			return NULL;
+	}
+
+	asan_tag_access(obj, (uint8_t *)obj + sc->obj_size);
+	memset(obj, 0, sc->obj_size);
+	if (sc->ctor)
+		sc->ctor(obj);
+
+	return obj;
+}
+
+void slab_free(struct slab_cache *sc, void *obj)
+{
+	struct slab *spare = NULL;
+	uint32_t exceptions;
+	struct slab *s;
+
+	if (!obj)
+		return;
+
+	s = (struct slab *)ROUNDDOWN((vaddr_t)obj, sc->slab_size);
+	assert(!(((vaddr_t)obj - (vaddr_t)s - SLAB_HDR_SIZE) %
+		 sc->obj_stride));
+	asan_tag_heap_free(obj, (uint8_t *)obj + sc->obj_stride);
+
+	exceptions = cpu_spin_lock_xsave(&sc->lock);
+
+	assert(s->num_free < sc->num_objs_per_slab);
+	*(void **)obj = s->free_list;
+	s->free_list = obj;
+	s->num_free++;
+	sc->num_allocated--;
+
+	if (s->num_free == 1) {
+		/* The slab was full, prefer it to the empty ones */
+		TAILQ_INSERT_HEAD(&sc->slabs, s, link);
+	}
+	if (s->num_free == sc->num_objs_per_slab) {
+		/* Keep one spare slab, return the others to the heap */
+		TAILQ_REMOVE(&sc->slabs, s, link);
+		if (sc->num_empty_slabs) {
+			spare = s;
+			sc->num_slabs--;
+		} else {
+			TAILQ_INSERT_TAIL(&sc->slabs, s, link);
+			sc->num_empty_slabs++;
+		}
+	}
+
+	cpu_spin_unlock_xrestore(&sc->lock, exceptions);
+
+	free(spare);
+}
+
+void slab_get_stats(struct slab_cache *sc, struct slab_stats *stats)
+{
+	uint32_t exceptions;
+
+	memset(stats, 0, sizeof(*stats));
+	strlcpy(stats->desc, sc->name, sizeof(stats->desc));
+	stats->obj_size = sc->obj_size;
+
+	exceptions = cpu_spin_lock_xsave(&sc->lock);
+	stats->allocated = sc->num_allocated;
+	stats->max_allocated = sc->max_allocated;
+	stats->num_slabs = sc->num_slabs;
+	stats->slab_size = sc->slab_size;
+	stats->num_alloc_fail = sc->num_alloc_fail;
+	cpu_spin_unlock_xrestore(&sc->lock, exceptions);
+}
+
+size_t slab_get_all_stats(struct slab_stats *stats, size_t num)
+{
+	struct slab_cache *sc;
+	uint32_t exceptions;
+	size_t n = 0;
+
+	exceptions = cpu_spin_lock_xsave(&slab_caches_lock);
+	SLIST_FOREACH(sc, &slab_caches, link) {
+		if (n < num)
+			slab_get_stats(sc, stats + n);
+		n++;
+	}
+	cpu_spin_unlock_xrestore(&slab_caches_lock, exceptions);
+
+	return n;
+}
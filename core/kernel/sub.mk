@@ -11,3 +11,6 @@ srcs-$(CFG_CORE_SANITIZE_UNDEFINED) += ubsan.c
 srcs-$(CFG_CORE_SANITIZE_KADDRESS) += asan.c
 cflags-remove-asan.c-y += $(cflags_kasan)
 srcs-y += refcount.c
+srcs-y += va_tree.c
+srcs-y += slab.c
+cflags-remove-slab.c-y += $(cflags_kasan)
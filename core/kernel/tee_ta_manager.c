@@ -13,6 +13,7 @@
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/slab.h>
 #include <kernel/tee_common.h>
 #include <kernel/tee_misc.h>
 #include <kernel/tee_ta_manager.h>
@@ -32,9 +33,24 @@
 #include <util.h>
 
 /* This mutex protects the critical section in tee_ta_init_session */
-struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
+struct mutex tee_ta_mutex = MUTEX_INITIALIZER_NAMED("tee_ta_mutex");
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
 
+static void session_ctor(void *obj)
+{
+	struct tee_ta_session *s = obj;
+
+	s->cancel_mask = true;
+	condvar_init(&s->refc_cv);
+	condvar_init(&s->lock_cv);
+	s->lock_thread = THREAD_ID_INVALID;
+	s->ref_count = 1;
+}
+
+static struct slab_cache tee_ta_session_cache =
+	SLAB_CACHE_INITIALIZER("tee_ta_session",
+			       sizeof(struct tee_ta_session), session_ctor);
+
 #ifndef CFG_CONCURRENT_SINGLE_INSTANCE_TA
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static int tee_ta_single_instance_thread = THREAD_ID_INVALID;
@@ -409,7 +425,7 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 #if defined(CFG_TA_GPROF_SUPPORT)
 	free(sess->sbuf);
 #endif
-	free(sess);
+	slab_free(&tee_ta_session_cache, sess);
 
 	tee_ta_clear_busy(ctx);
 
@@ -471,18 +487,12 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 {
 	TEE_Result res;
 	struct tee_ta_ctx *ctx;
-	struct tee_ta_session *s = calloc(1, sizeof(struct tee_ta_session));
+	struct tee_ta_session *s = slab_alloc(&tee_ta_session_cache);
 
 	*err = TEE_ORIGIN_TEE;
 	if (!s)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	s->cancel_mask = true;
-	condvar_init(&s->refc_cv);
-	condvar_init(&s->lock_cv);
-	s->lock_thread = THREAD_ID_INVALID;
-	s->ref_count = 1;
-
 
 	/*
 	 * We take the global TA mutex here and hold it while doing
@@ -515,7 +525,7 @@ out:
 		*sess = s;
 	} else {
 		TAILQ_REMOVE(open_sessions, s, link);
-		free(s);
+		slab_free(&tee_ta_session_cache, s);
 	}
 	mutex_unlock(&tee_ta_mutex);
 	return res;
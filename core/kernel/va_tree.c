@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+#include <assert.h>
+#include <kernel/va_tree.h>
+#include <util.h>
+
+static bool is_red(struct va_tree_node *n)
+{
+	return n && n->red;
+}
+
+static size_t max_size(struct va_tree_node *n)
+{
+	return n ? n->max_size : 0;
+}
+
+/* Recomputes @n->max_size from @n and its children */
+static void update_max_size(struct va_tree_node *n)
+{
+	size_t m = MAX(max_size(n->child[0]), max_size(n->child[1]));
+
+	n->max_size = MAX(n->size, m);
+}
+
+/* Makes @new take the place of @old as child of @parent */
+static void replace_child(struct va_tree *tree, struct va_tree_node *parent,
+			  struct va_tree_node *old, struct va_tree_node *new)
+{
+	if (!parent)
+		tree->root = new;
+	else if (parent->child[0] == old)
+		parent->child[0] = new;
+	else
+		parent->child[1] = new;
+}
+
+/*
+ * Rotates the subtree at @n, @n->child[!dir] takes the place of @n which
+ * becomes its child[dir]. dir 0 is a left rotation, 1 a right rotation.
+ */
+static void rotate(struct va_tree *tree, struct va_tree_node *n, int dir)
+{
+	struct va_tree_node *c = n->child[!dir];
+
+	n->child[!dir] = c->child[dir];
+	if (c->child[dir])
+		c->child[dir]->parent = n;
+	c->parent = n->parent;
+	replace_child(tree, n->parent, n, c);
+	c->child[dir] = n;
+	n->parent = c;
+
+	/* c now covers the subtree of n, only n has to be recomputed */
+	c->max_size = n->max_size;
+	update_max_size(n);
+}
+
+void va_tree_insert(struct va_tree *tree, struct va_tree_node *node,
+		    vaddr_t va, size_t size)
+{
+	struct va_tree_node **link = &tree->root;
+	struct va_tree_node *parent = NULL;
+	struct va_tree_node *gparent;
+	struct va_tree_node *uncle;
+	int dir;
+
+	node->va = va;
+	node->size = size;
+	node->max_size = size;
+
+	while (*link) {
+		parent = *link;
+		assert(va + size <= parent->va ||
+		       va >= parent->va + parent->size);
+		if (parent->max_size < size)
+			parent->max_size = size;
+		link = &parent->child[va >= parent->va];
+	}
+
+	node->parent = parent;
+	node->child[0] = NULL;
+	node->child[1] = NULL;
+	node->red = true;
+	*link = node;
+
+	while (is_red(node->parent)) {
+		parent = node->parent;
+		/* The root is black so a red parent has a parent */
+		gparent = parent->parent;
+		dir = parent == gparent->child[1];
+		uncle = gparent->child[!dir];
+
+		if (is_red(uncle)) {
+			parent->red = false;
+			uncle->red = false;
+			gparent->red = true;
+			node = gparent;
+			continue;
+		}
+
+		if (node == parent->child[!dir]) {
+			rotate(tree, parent, dir);
+			node = parent;
+			parent = node->parent;
+		}
+		parent->red = false;
+		gparent->red = true;
+		rotate(tree, gparent, !dir);
+	}
+
+	tree->root->red = false;
+}
+
+/*
+ * Exchanges the positions in the tree of @n, which has two children, and
+ * its in-order successor @s, leaving @n with at most one child.
+ */
+static void swap_with_successor(struct va_tree *tree, struct va_tree_node *n,
+				struct va_tree_node *s)
+{
+	struct va_tree_node *s_parent = s->parent;
+	struct va_tree_node *s_right = s->child[1];
+	bool red = n->red;
+
+	n->red = s->red;
+	s->red = red;
+
+	replace_child(tree, n->parent, n, s);
+	s->parent = n->parent;
+	s->child[0] = n->child[0];
+	s->child[0]->parent = s;
+
+	if (s_parent == n) {
+		s->child[1] = n;
+		n->parent = s;
+	} else {
+		s->child[1] = n->child[1];
+		s->child[1]->parent = s;
+		s_parent->child[0] = n;
+		n->parent = s_parent;
+	}
+
+	n->child[0] = NULL;
+	n->child[1] = s_right;
+	if (s_right)
+		s_right->parent = n;
+}
+
+/*
+ * Restores the properties of the tree after a black node was removed
+ * from below @parent, @node (possibly NULL) took its place.
+ */
+static void remove_fixup(struct va_tree *tree, struct va_tree_node *node,
+			 struct va_tree_node *parent)
+{
+	struct va_tree_node *sibling;
+	int dir;
+
+	while (node != tree->root && !is_red(node)) {
+		dir = parent->child[1] == node;
+		sibling = parent->child[!dir];
+
+		if (is_red(sibling)) {
+			sibling->red = false;
+			parent->red = true;
+			rotate(tree, parent, dir);
+			sibling = parent->child[!dir];
+		}
+
+		if (!is_red(sibling->child[0]) && !is_red(sibling->child[1])) {
+			sibling->red = true;
+			node = parent;
+			parent = node->parent;
+			continue;
+		}
+
+		if (!is_red(sibling->child[!dir])) {
+			sibling->child[dir]->red = false;
+			sibling->red = true;
+			rotate(tree, sibling, !dir);
+			sibling = parent->child[!dir];
+		}
+		sibling->red = parent->red;
+		parent->red = false;
+		sibling->child[!dir]->red = false;
+		rotate(tree, parent, dir);
+		node = tree->root;
+	}
+
+	if (node)
+		node->red = false;
+}
+
+void va_tree_remove(struct va_tree *tree, struct va_tree_node *node)
+{
+	struct va_tree_node *child;
+	struct va_tree_node *parent;
+	struct va_tree_node *n;
+
+	if (node->child[0] && node->child[1]) {
+		struct va_tree_node *s = node->child[1];
+
+		while (s->child[0])
+			s = s->child[0];
+		swap_with_successor(tree, node, s);
+	}
+
+	child = node->child[0] ? node->child[0] : node->child[1];
+	parent = node->parent;
+	if (child)
+		child->parent = parent;
+	replace_child(tree, parent, node, child);
+
+	/*
+	 * The subtrees of all the ancestors have lost the node, including
+	 * the successor if it took the place of the node above
+	 */
+	for (n = parent; n; n = n->parent)
+		update_max_size(n);
+
+	if (!node->red)
+		remove_fixup(tree, child, parent);
+
+	node->parent = NULL;
+	node->child[0] = NULL;
+	node->child[1] = NULL;
+}
+
+struct va_tree_node *va_tree_find(struct va_tree *tree, vaddr_t va)
+{
+	struct va_tree_node *n = tree->root;
+
+	while (n) {
+		if (va < n->va)
+			n = n->child[0];
+		else if (va - n->va < n->size)
+			return n;
+		else
+			n = n->child[1];
+	}
+
+	return NULL;
+}
+
+struct va_tree_node *va_tree_find_fit(struct va_tree *tree, size_t size,
+				      bool last)
+{
+	struct va_tree_node *n = tree->root;
+
+	if (!n || n->max_size < size)
+		return NULL;
+
+	/* There's a fit in the subtree of n, look on the preferred side first */
+	while (true) {
+		if (n->child[last] && n->child[last]->max_size >= size)
+			n = n->child[last];
+		else if (n->size >= size)
+			return n;
+		else
+			n = n->child[!last];
+	}
+}
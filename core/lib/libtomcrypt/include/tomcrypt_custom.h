@@ -238,7 +238,11 @@
    #endif
 
    /* do we want fixed point ECC */
-   /* #define LTC_MECC_FP */
+   #ifdef CFG_CRYPTO_ECC_FP
+   #define LTC_MECC_FP
+   #define FP_ENTRIES CFG_CRYPTO_ECC_FP_ENTRIES
+   #define FP_LUT     CFG_CRYPTO_ECC_FP_LUT
+   #endif
 
    /* Timing Resistant */
    #define LTC_ECC_TIMING_RESISTANT
@@ -48,25 +48,41 @@
 
 /* number of entries in the cache */
 #ifndef FP_ENTRIES
-#define FP_ENTRIES 16
+#define FP_ENTRIES 4
 #endif
 
 /* number of bits in LUT */
 #ifndef FP_LUT
-#define FP_LUT     8U
+#define FP_LUT     5U
 #endif
 
 #if (FP_LUT > 12) || (FP_LUT < 2)
    #error FP_LUT must be between 2 and 12 inclusively
 #endif   
 
-/** Our FP cache */
+/* largest modulus cached (P-521) and the matching size of a coordinate */
+#define FP_MAX_BYTES   66
+#define FP_MAX_STRIDE  ((FP_MAX_BYTES + sizeof(unsigned long) - 1) & ~(sizeof(unsigned long) - 1))
+
+/** Our FP cache
+ *
+ * Coordinates are kept as big endian octet strings of "stride" bytes (the
+ * modulus size rounded up to a whole word) rather than as bignums. The
+ * bignums are carved from the per-thread scratch pools which are reset
+ * when an operation completes, and a fixed layout lets select_row() read
+ * the LUT in constant time.
+ *
+ * The mutex only protects the bookkeeping: an entry is pinned by "refs"
+ * while an operation uses its LUT, or builds it, outside the mutex.
+ */
 static struct {
-   ecc_point *g,              /* cached COPY of base point */
-             *LUT[1U<<FP_LUT]; /* fixed point lookup */ 
-   void      *mu;             /* copy of the montgomery constant */
-   int        lru_count;      /* amount of times this entry has been used */
-   int        lock;           /* flag to indicate cache eviction permitted (0) or not (1) */
+   unsigned char *key;        /* modulus and x, y, z of the base point */
+   unsigned char *lut;        /* fixed point lookup, 1<<FP_LUT rows of x, y */
+   unsigned long  stride;     /* size in bytes of a coordinate */
+   int            lru_count;  /* amount of times this entry has been used */
+   int            lock;       /* flag to indicate cache eviction permitted (0) or not (1) */
+   int            refs;       /* number of operations using the entry */
+   int            building;   /* flag to indicate the LUT is being built */
 } fp_cache[FP_ENTRIES];
 
 LTC_MUTEX_GLOBAL(ltc_ecc_fp_lock)
@@ -601,13 +617,83 @@ static const struct {
 #endif
 };
 
+/* size of the key of an entry, the modulus and three coordinates */
+#define FP_KEY_SIZE(stride)  (4 * (stride))
+
+/* size of a LUT row, the affine x and y */
+#define FP_ROW_SIZE(stride)  (2 * (stride))
+
+/* returns the size of a coordinate for this modulus or 0 if it's too large to be cached */
+static unsigned long fp_stride(void *modulus)
+{
+   unsigned long len = mp_unsigned_bin_size(modulus);
+
+   if (len > FP_MAX_BYTES) {
+      return 0;
+   }
+   return (len + sizeof(unsigned long) - 1) & ~(sizeof(unsigned long) - 1);
+}
+
+/* store a as a big endian number of exactly len bytes */
+static int fp_store(void *a, unsigned char *out, unsigned long len)
+{
+   unsigned long n = mp_unsigned_bin_size(a);
+
+   if (n > len) {
+      return CRYPT_BUFFER_OVERFLOW;
+   }
+   zeromem(out, len - n);
+   return mp_to_unsigned_bin(a, out + len - n);
+}
+
+/* build the key identifying a base point on a curve */
+static int fp_make_key(ecc_point *g, void *modulus, unsigned char *key, unsigned long stride)
+{
+   int err;
+
+   if (((err = fp_store(modulus, key, stride)) != CRYPT_OK) ||
+       ((err = fp_store(g->x, key + stride, stride)) != CRYPT_OK) ||
+       ((err = fp_store(g->y, key + 2 * stride, stride)) != CRYPT_OK) ||
+       ((err = fp_store(g->z, key + 3 * stride, stride)) != CRYPT_OK)) {
+      return err;
+   }
+   return CRYPT_OK;
+}
+
+/* load the affine x and y of a LUT row */
+static int fp_load_row(ecc_point *P, const unsigned char *row, unsigned long stride)
+{
+   int err;
+
+   if (((err = mp_read_unsigned_bin(P->x, (unsigned char *)row, stride)) != CRYPT_OK) ||
+       ((err = mp_read_unsigned_bin(P->y, (unsigned char *)row + stride, stride)) != CRYPT_OK)) {
+      return err;
+   }
+   return CRYPT_OK;
+}
+
+/* free the key and LUT of an entry, must be called with the cache mutex locked */
+static void fp_free_entry(int idx)
+{
+   if (fp_cache[idx].lut != NULL) {
+      zeromem(fp_cache[idx].lut, (1U<<FP_LUT) * FP_ROW_SIZE(fp_cache[idx].stride));
+      XFREE(fp_cache[idx].lut);
+   }
+   XFREE(fp_cache[idx].key);
+   fp_cache[idx].key       = NULL;
+   fp_cache[idx].lut       = NULL;
+   fp_cache[idx].stride    = 0;
+   fp_cache[idx].lru_count = 0;
+   fp_cache[idx].lock      = 0;
+}
+
 /* find a hole and free as required, return -1 if no hole found */
 static int find_hole(void)
 {
    unsigned x;
    int      y, z;
    for (z = -1, y = INT_MAX, x = 0; x < FP_ENTRIES; x++) {
-       if (fp_cache[x].lru_count < y && fp_cache[x].lock == 0) {
+       if (fp_cache[x].lru_count < y && fp_cache[x].lock == 0 && fp_cache[x].refs == 0) {
           z = x;
           y = fp_cache[x].lru_count;
        }
@@ -621,31 +707,19 @@ static int find_hole(void)
    }
 
    /* free entry z */
-   if (z >= 0 && fp_cache[z].g) {
-      if (fp_cache[z].mu != NULL) {
-         mp_clear(fp_cache[z].mu);
-         fp_cache[z].mu = NULL;
-      }
-      ltc_ecc_del_point(fp_cache[z].g);
-      fp_cache[z].g  = NULL;
-      for (x = 0; x < (1U<<FP_LUT); x++) {
-         ltc_ecc_del_point(fp_cache[z].LUT[x]);
-         fp_cache[z].LUT[x] = NULL;
-      }
-      fp_cache[z].lru_count = 0;
+   if (z >= 0 && fp_cache[z].key) {
+      fp_free_entry(z);
    }
    return z;
 }
 
 /* determine if a base is already in the cache and if so, where */
-static int find_base(ecc_point *g)
+static int find_base(const unsigned char *key, unsigned long stride)
 {
    int x;
    for (x = 0; x < FP_ENTRIES; x++) {
-      if (fp_cache[x].g != NULL && 
-          mp_cmp(fp_cache[x].g->x, g->x) == LTC_MP_EQ && 
-          mp_cmp(fp_cache[x].g->y, g->y) == LTC_MP_EQ && 
-          mp_cmp(fp_cache[x].g->z, g->z) == LTC_MP_EQ) {
+      if (fp_cache[x].key != NULL && fp_cache[x].stride == stride &&
+          XMEMCMP(fp_cache[x].key, key, FP_KEY_SIZE(stride)) == 0) {
          break;
       }
    }
@@ -655,61 +729,150 @@ static int find_base(ecc_point *g)
    return x;
 }
 
-/* add a new base to the cache */
-static int add_entry(int idx, ecc_point *g)
+/* add a new base to the cache, the LUT is only allocated once it's built */
+static int add_entry(int idx, const unsigned char *key, unsigned long stride)
 {
-   unsigned x, y;
-
-   /* allocate base and LUT */
-   fp_cache[idx].g = ltc_ecc_new_point();
-   if (fp_cache[idx].g == NULL) {
+   fp_cache[idx].key = XMALLOC(FP_KEY_SIZE(stride));
+   if (fp_cache[idx].key == NULL) {
       return CRYPT_MEM;
    }
+   XMEMCPY(fp_cache[idx].key, key, FP_KEY_SIZE(stride));
+   fp_cache[idx].stride    = stride;
+   fp_cache[idx].lru_count = 0;
+   return CRYPT_OK;
+}
 
-   /* copy x and y */
-   if ((mp_copy(g->x, fp_cache[idx].g->x) != CRYPT_OK) ||
-       (mp_copy(g->y, fp_cache[idx].g->y) != CRYPT_OK) ||
-       (mp_copy(g->z, fp_cache[idx].g->z) != CRYPT_OK)) {
-      ltc_ecc_del_point(fp_cache[idx].g);
-      fp_cache[idx].g = NULL;
-      return CRYPT_MEM;
-   }              
-
-   for (x = 0; x < (1U<<FP_LUT); x++) {
-      fp_cache[idx].LUT[x] = ltc_ecc_new_point();
-      if (fp_cache[idx].LUT[x] == NULL) {
-         for (y = 0; y < x; y++) {
-            ltc_ecc_del_point(fp_cache[idx].LUT[y]);
-            fp_cache[idx].LUT[y] = NULL;
-         }
-         ltc_ecc_del_point(fp_cache[idx].g);
-         fp_cache[idx].g         = NULL;
-         fp_cache[idx].lru_count = 0;
-         return CRYPT_MEM;
+/* look up (or add) a base and pin the entry if its LUT can be used, must be
+ * called with the cache mutex locked
+ *
+ * Returns the index of the pinned entry or -1 if the caller has to use the
+ * plain point multiplication. *build is set if the caller has to build the
+ * LUT before using it.
+ */
+static int fp_acquire(const unsigned char *key, unsigned long stride, int *build)
+{
+   int idx;
+
+   *build = 0;
+
+   /* find point */
+   idx = find_base(key, stride);
+
+   /* no entry? */
+   if (idx == -1) {
+      /* find hole and add it */
+      idx = find_hole();
+      if (idx >= 0 && add_entry(idx, key, stride) != CRYPT_OK) {
+         idx = -1;
       }
    }
-   
-   fp_cache[idx].lru_count = 0;
-   return CRYPT_OK;
+   if (idx == -1) {
+      return -1;
+   }
+
+   /* increment LRU */
+   ++(fp_cache[idx].lru_count);
+
+   /* if it's 2 or more build the LUT, unless already done or in progress */
+   if (fp_cache[idx].lut == NULL) {
+      if (fp_cache[idx].lru_count < 2 || fp_cache[idx].building) {
+         return -1;
+      }
+      fp_cache[idx].building = 1;
+      *build = 1;
+   }
+   ++(fp_cache[idx].refs);
+   return idx;
+}
+
+/* unpin an entry */
+static void fp_release(int idx)
+{
+   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
+   --(fp_cache[idx].refs);
+   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+}
+
+/* compute the montgomery constants of the modulus */
+static int fp_setup(void *modulus, void **mp, void **mu)
+{
+   int err;
+
+   if ((err = mp_montgomery_setup(modulus, mp)) != CRYPT_OK) {
+      return err;
+   }
+   if ((err = mp_init(mu)) != CRYPT_OK) {
+      return err;
+   }
+   return mp_montgomery_normalization(*mu, modulus);
+}
+
+/* publish the LUT of an entry, or NULL if building it failed */
+static void fp_publish(int idx, unsigned char *lut)
+{
+   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
+   fp_cache[idx].lut      = lut;
+   fp_cache[idx].building = 0;
+   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+}
+
+/* map P to affine co-ordinates (x and y staying in montgomery form) and store them in a LUT row */
+static int fp_store_affine(ecc_point *P, unsigned char *row, unsigned long stride,
+                           void *modulus, void *mp, void *t1, void *t2)
+{
+   int err;
+
+   /* convert z to normal from montgomery */
+   if ((err = mp_copy(P->z, t1)) != CRYPT_OK)                                 { return err; }
+   if ((err = mp_montgomery_reduce(t1, modulus, mp)) != CRYPT_OK)             { return err; }
+
+   /* invert it */
+   if ((err = mp_invmod(t1, modulus, t1)) != CRYPT_OK)                        { return err; }
+
+   /* get 1/z^2 and 1/z^3 */
+   if ((err = mp_sqrmod(t1, modulus, t2)) != CRYPT_OK)                        { return err; }
+   if ((err = mp_mulmod(t1, t2, modulus, t1)) != CRYPT_OK)                    { return err; }
+
+   /* fix x and y */
+   if ((err = mp_mulmod(P->x, t2, modulus, t2)) != CRYPT_OK)                  { return err; }
+   if ((err = fp_store(t2, row, stride)) != CRYPT_OK)                         { return err; }
+   if ((err = mp_mulmod(P->y, t1, modulus, t1)) != CRYPT_OK)                  { return err; }
+   return fp_store(t1, row + stride, stride);
 }
 
 /* build the LUT by spacing the bits of the input by #modulus/FP_LUT bits apart 
  * 
  * The algorithm builds patterns in increasing bit order by first making all 
- * single bit input patterns, then all two bit input patterns and so on
+ * single bit input patterns, then all two bit input patterns and so on.
+ * Each entry is mapped to affine space as soon as it's computed, so only a
+ * few bignums are needed from the scratch pool. The LUT is published to
+ * other threads when complete.
  */
 static int build_lut(int idx, void *modulus, void *mp, void *mu)
 { 
-   unsigned x, y, err, bitlen, lut_gap;
-   void    *tmp;
+   unsigned long stride = fp_cache[idx].stride;
+   const unsigned char *key = fp_cache[idx].key;
+   unsigned char *lut = NULL;
+   unsigned x, y, bitlen, lut_gap;
+   ecc_point *P, Q;
+   void *t1, *t2;
+   int err;
 
-   tmp = NULL;
+   P = NULL;
+   Q.x = Q.y = Q.z = NULL;
+   t1 = t2 = NULL;
 
    /* sanity check to make sure lut_order table is of correct size, should compile out to a NOP if true */
    if ((sizeof(lut_orders) / sizeof(lut_orders[0])) < (1U<<FP_LUT)) {
-       err = CRYPT_INVALID_ARG;
-       goto DONE;
-   }       
+      err = CRYPT_INVALID_ARG;
+      goto DONE;
+   }
+
+   lut = XCALLOC(1U<<FP_LUT, FP_ROW_SIZE(stride));
+   if (lut == NULL) {
+      err = CRYPT_MEM;
+      goto DONE;
+   }
 
    /* get bitlen and round up to next multiple of FP_LUT */
    bitlen  = mp_unsigned_bin_size(modulus) << 3;
@@ -719,98 +882,82 @@ static int build_lut(int idx, void *modulus, void *mp, void *mu)
    }  
    lut_gap = bitlen / FP_LUT;
 
-   /* init the mu */
-   if ((err = mp_init_copy(&fp_cache[idx].mu, mu)) != CRYPT_OK) {
-      goto ERR;
-   }
-   
-   /* copy base */
-   if ((mp_mulmod(fp_cache[idx].g->x, mu, modulus, fp_cache[idx].LUT[1]->x) != CRYPT_OK) || 
-       (mp_mulmod(fp_cache[idx].g->y, mu, modulus, fp_cache[idx].LUT[1]->y) != CRYPT_OK) || 
-       (mp_mulmod(fp_cache[idx].g->z, mu, modulus, fp_cache[idx].LUT[1]->z) != CRYPT_OK))        { goto ERR; }
-       
+   if ((P = ltc_ecc_new_point()) == NULL)                                     { err = CRYPT_MEM; goto ERR; }
+   if ((err = mp_init_multi(&Q.x, &Q.y, &t1, &t2, NULL)) != CRYPT_OK)         { goto ERR; }
+
+   /* copy base to montgomery form */
+   if (((err = mp_read_unsigned_bin(P->x, (unsigned char *)key + stride, stride)) != CRYPT_OK) ||
+       ((err = mp_read_unsigned_bin(P->y, (unsigned char *)key + 2 * stride, stride)) != CRYPT_OK) ||
+       ((err = mp_read_unsigned_bin(P->z, (unsigned char *)key + 3 * stride, stride)) != CRYPT_OK)) { goto ERR; }
+   if (((err = mp_mulmod(P->x, mu, modulus, P->x)) != CRYPT_OK) ||
+       ((err = mp_mulmod(P->y, mu, modulus, P->y)) != CRYPT_OK) ||
+       ((err = mp_mulmod(P->z, mu, modulus, P->z)) != CRYPT_OK))             { goto ERR; }
+
    /* make all single bit entries */
-   for (x = 1; x < FP_LUT; x++) {
-      if ((mp_copy(fp_cache[idx].LUT[1<<(x-1)]->x, fp_cache[idx].LUT[1<<x]->x) != CRYPT_OK) || 
-          (mp_copy(fp_cache[idx].LUT[1<<(x-1)]->y, fp_cache[idx].LUT[1<<x]->y) != CRYPT_OK) || 
-          (mp_copy(fp_cache[idx].LUT[1<<(x-1)]->z, fp_cache[idx].LUT[1<<x]->z) != CRYPT_OK))     { goto ERR; }
-          
-      /* now double it bitlen/FP_LUT times */
-      for (y = 0; y < lut_gap; y++) {
-          if ((err = ltc_mp.ecc_ptdbl(fp_cache[idx].LUT[1<<x], fp_cache[idx].LUT[1<<x], modulus, mp)) != CRYPT_OK) {
-             goto ERR;
-          }
-      }          
+   for (x = 0; x < FP_LUT; x++) {
+      if (x) {
+         /* double the previous one bitlen/FP_LUT times */
+         for (y = 0; y < lut_gap; y++) {
+            if ((err = ltc_mp.ecc_ptdbl(P, P, modulus, mp)) != CRYPT_OK)     { goto ERR; }
+         }
+      }
+      if ((err = fp_store_affine(P, lut + (1U<<x) * FP_ROW_SIZE(stride), stride,
+                                 modulus, mp, t1, t2)) != CRYPT_OK)           { goto ERR; }
    }
-      
+
    /* now make all entries in increase order of hamming weight */
    for (x = 2; x <= FP_LUT; x++) {
        for (y = 0; y < (1UL<<FP_LUT); y++) {
            if (lut_orders[y].ham != (int)x) continue;
-                     
-           /* perform the add */
-           if ((err = ltc_mp.ecc_ptadd(fp_cache[idx].LUT[lut_orders[y].terma], fp_cache[idx].LUT[lut_orders[y].termb], 
-                                       fp_cache[idx].LUT[y], modulus, mp)) != CRYPT_OK) {
-              goto ERR;
-           }
+
+           /* perform the add, terma in jacobian form and termb affine */
+           if ((err = fp_load_row(P, lut + lut_orders[y].terma * FP_ROW_SIZE(stride), stride)) != CRYPT_OK ||
+               (err = mp_copy(mu, P->z)) != CRYPT_OK ||
+               (err = fp_load_row(&Q, lut + lut_orders[y].termb * FP_ROW_SIZE(stride), stride)) != CRYPT_OK) { goto ERR; }
+           if ((err = ltc_mp.ecc_ptadd(P, &Q, P, modulus, mp)) != CRYPT_OK)  { goto ERR; }
+           if ((err = fp_store_affine(P, lut + y * FP_ROW_SIZE(stride), stride,
+                                      modulus, mp, t1, t2)) != CRYPT_OK)      { goto ERR; }
        }
    }
-      
-   /* now map all entries back to affine space to make point addition faster */
-   if ((err = mp_init(&tmp)) != CRYPT_OK)                                                                    { goto ERR; }
-   for (x = 1; x < (1UL<<FP_LUT); x++) {
-       /* convert z to normal from montgomery */
-       if ((err = mp_montgomery_reduce(fp_cache[idx].LUT[x]->z, modulus, mp)) != CRYPT_OK)                   { goto ERR; }
- 
-       /* invert it */
-       if ((err = mp_invmod(fp_cache[idx].LUT[x]->z, modulus, fp_cache[idx].LUT[x]->z)) != CRYPT_OK)         { goto ERR; }
-
-       /* now square it */
-       if ((err = mp_sqrmod(fp_cache[idx].LUT[x]->z, modulus, tmp)) != CRYPT_OK)                             { goto ERR; }
-       
-       /* fix x */
-       if ((err = mp_mulmod(fp_cache[idx].LUT[x]->x, tmp, modulus, fp_cache[idx].LUT[x]->x)) != CRYPT_OK)    { goto ERR; }
-
-       /* get 1/z^3 */
-       if ((err = mp_mulmod(tmp, fp_cache[idx].LUT[x]->z, modulus, tmp)) != CRYPT_OK)                        { goto ERR; }
-
-       /* fix y */
-       if ((err = mp_mulmod(fp_cache[idx].LUT[x]->y, tmp, modulus, fp_cache[idx].LUT[x]->y)) != CRYPT_OK)    { goto ERR; }
-
-       /* free z */
-       mp_clear(fp_cache[idx].LUT[x]->z);
-       fp_cache[idx].LUT[x]->z = NULL;
-   }
-   mp_clear(tmp);
+   err = CRYPT_OK;
 
-   return CRYPT_OK;                                                                       
 ERR:
-   err = CRYPT_MEM;
-DONE:   
-   for (y = 0; y < (1U<<FP_LUT); y++) {
-      ltc_ecc_del_point(fp_cache[idx].LUT[y]);
-      fp_cache[idx].LUT[y] = NULL;
+   if (err != CRYPT_OK) {
+      zeromem(lut, (1U<<FP_LUT) * FP_ROW_SIZE(stride));
+      XFREE(lut);
+      lut = NULL;
    }
-   ltc_ecc_del_point(fp_cache[idx].g);
-   fp_cache[idx].g         = NULL;
-   fp_cache[idx].lru_count = 0;
-   if (fp_cache[idx].mu != NULL) {
-      mp_clear(fp_cache[idx].mu);
-      fp_cache[idx].mu = NULL;
+DONE:
+   if (P != NULL) {
+      ltc_ecc_del_point(P);
    }
-   if (tmp != NULL) {
-      mp_clear(tmp);
+   if (Q.x != NULL) {
+      mp_clear_multi(Q.x, Q.y, t1, t2, NULL);
    }
+   fp_publish(idx, lut);
    return err;
 }
 
-/* perform a fixed point ECC mulmod */
-static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp, int map)
+/* build the LUT of an entry flagged by fp_acquire(), unless the montgomery setup failed */
+static int fp_build(int idx, int err, void *modulus, void *mp, void *mu)
 {
-   unsigned char kb[128];
-   int      x;
-   unsigned y, z, err, bitlen, bitpos, lut_gap, first;
+   if (err != CRYPT_OK) {
+      fp_publish(idx, NULL);
+      return err;
+   }
+   return build_lut(idx, modulus, mp, mu);
+}
+
+/* store k reduced modulo the curve order as a little endian octet string */
+static int fp_get_scalar(void *k, void *modulus, unsigned char *kb, unsigned long kblen)
+{
+   unsigned long x, y;
+   unsigned char z;
    void     *tk, *order;
+   int       err;
+
+   tk    = k;
+   order = NULL;
 
    /* if it's smaller than modulus we fine */
    if (mp_unsigned_bin_size(k) > mp_unsigned_bin_size(modulus)) {
@@ -819,75 +966,117 @@ static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp,
       for (x = 0; ltc_ecc_sets[x].size; x++) {
          if (y <= (unsigned)ltc_ecc_sets[x].size) break;
       }
-   
-      /* back off if we are on the 521 bit curve */
-      if (y == 66) --x;
-      
-      if ((err = mp_init(&order)) != CRYPT_OK) {
-         return err;
-      }      
-      if ((err = mp_read_radix(order, ltc_ecc_sets[x].order, 16)) != CRYPT_OK) {
-         mp_clear(&order);
-         return err;
+      if (!ltc_ecc_sets[x].size) {
+         return CRYPT_INVALID_ARG;
       }
 
       /* k must be less than modulus */
-      if (mp_cmp(k, order) != LTC_MP_LT) {
-         if ((err = mp_init(&tk)) != CRYPT_OK) {
-            mp_clear(order);
-            return err;
-         }
-         if ((err = mp_mod(k, order, tk)) != CRYPT_OK) {
-            mp_clear(tk);
-            mp_clear(order);
-            return err;
-         }
-      } else {
-         tk = k;
+      if ((err = mp_init_multi(&order, &tk, NULL)) != CRYPT_OK) {
+         return err;
       }
-      mp_clear(order);
-   } else {
-       tk = k;
-   }       
-   
-   /* get bitlen and round up to next multiple of FP_LUT */
-   bitlen  = mp_unsigned_bin_size(modulus) << 3;
-   x       = bitlen % FP_LUT;
-   if (x) {
-      bitlen += FP_LUT - x;
-   }  
-   lut_gap = bitlen / FP_LUT;
-        
+      if ((err = mp_read_radix(order, ltc_ecc_sets[x].order, 16)) != CRYPT_OK) { goto LBL_ERR; }
+      if ((err = mp_mod(k, order, tk)) != CRYPT_OK)                              { goto LBL_ERR; }
+   }
+
    /* get the k value */
-   if (mp_unsigned_bin_size(tk) > (sizeof(kb) - 2)) {
-      if (tk != k) {
-         mp_clear(tk);
-      }         
-      return CRYPT_BUFFER_OVERFLOW;
+   if (mp_unsigned_bin_size(tk) > (kblen - 2)) {
+      err = CRYPT_BUFFER_OVERFLOW;
+      goto LBL_ERR;
    }
-   
+
    /* store k */
-   zeromem(kb, sizeof(kb));
+   zeromem(kb, kblen);
    if ((err = mp_to_unsigned_bin(tk, kb)) != CRYPT_OK) {
-      if (tk != k) {
-         mp_clear(tk);
-      }         
-      return err;
+      goto LBL_ERR;
    }
-   
+
    /* let's reverse kb so it's little endian */
    x = 0;
-   y = mp_unsigned_bin_size(tk) - 1;
-   if (tk != k) {
-      mp_clear(tk);
-   }         
-   while ((unsigned)x < y) {
+   y = mp_unsigned_bin_size(tk);
+   while (x + 1 < y) {
+      --y;
       z = kb[x]; kb[x] = kb[y]; kb[y] = z;
-      ++x; --y;
-   }      
-   
-   /* at this point we can start, yipee */
-   first = 1;
+      ++x;
+   }
+
+LBL_ERR:
+   if (tk != k) {
+      mp_clear_multi(order, tk, NULL);
+   }
+   return err;
+}
+
+/* copy row z of the LUT to out
+ *
+ * Every row is read and masked so neither the memory access pattern nor
+ * the timing depends on z, which holds bits of a possibly secret scalar.
+ */
+static void select_row(int idx, unsigned z, unsigned long *out)
+{
+   unsigned long        n   = FP_ROW_SIZE(fp_cache[idx].stride) / sizeof(unsigned long);
+   const unsigned long *row = (const unsigned long *)fp_cache[idx].lut;
+   unsigned long        mask;
+   unsigned             x, y;
+
+   for (y = 0; y < n; y++) {
+      out[y] = 0;
+   }
+   for (x = 0; x < (1U<<FP_LUT); x++, row += n) {
+      /* all ones if x == z, zero otherwise */
+      mask = 0UL - (((unsigned long)(x ^ z) - 1) >> (sizeof(unsigned long) * CHAR_BIT - 1));
+      for (y = 0; y < n; y++) {
+         out[y] |= row[y] & mask;
+      }
+   }
+}
+
+/* perform a fixed point ECC mulmod
+ *
+ * The scalar may be secret (key generation, signing, ECDH), so every one of
+ * the lut_gap steps does the same work regardless of the bits of k: a
+ * doubling, a constant time LUT lookup and an addition. Which of three
+ * points becomes the accumulator is selected with masks, the same way the
+ * timing resistant ltc_ecc_mulmod() picks its ladder points.
+ */
+static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp, void *mu, int map)
+{
+   /* the two other points of a rotation, see below */
+   static const unsigned char rot[3][2] = { { 1, 2 }, { 2, 0 }, { 0, 1 } };
+   unsigned long stride = fp_cache[idx].stride;
+   unsigned long sel[FP_ROW_SIZE(FP_MAX_STRIDE) / sizeof(unsigned long)];
+   unsigned char kb[128];
+   ecc_point *M[3], aff;
+   int      x;
+   unsigned y, z, bitlen, bitpos, lut_gap, cur, s, t, nz, inf, m_first, m_add;
+   int      err;
+
+   if ((err = fp_get_scalar(k, modulus, kb, sizeof(kb))) != CRYPT_OK) {
+      return err;
+   }
+
+   /* get bitlen and round up to next multiple of FP_LUT */
+   bitlen  = mp_unsigned_bin_size(modulus) << 3;
+   x       = bitlen % FP_LUT;
+   if (x) {
+      bitlen += FP_LUT - x;
+   }  
+   lut_gap = bitlen / FP_LUT;
+
+   M[0] = ltc_ecc_new_point();
+   M[1] = ltc_ecc_new_point();
+   M[2] = ltc_ecc_new_point();
+   if (M[0] == NULL || M[1] == NULL || M[2] == NULL) {
+      err = CRYPT_MEM;
+      goto done;
+   }
+
+   /* 
+    * M[cur] is the accumulator, M[s] receives the LUT entry and M[t] the
+    * sum of both. inf is set while the accumulator is still the point at
+    * infinity, before that the computations on M[cur] are just discarded.
+    */
+   cur = 0;
+   inf = 1;
    for (x = lut_gap-1; x >= 0; x--) {
        /* extract FP_LUT bits from kb spread out by lut_gap bits and offset by x bits from the start */
        bitpos = x;
@@ -895,123 +1084,98 @@ static int accel_fp_mul(int idx, void *k, ecc_point *R, void *modulus, void *mp,
           z |= ((kb[bitpos>>3] >> (bitpos&7)) & 1) << y;
           bitpos += lut_gap;                               /* it's y*lut_gap + x, but here we can avoid the mult in each loop */
        }
-              
-       /* double if not first */
-       if (!first) {
-          if ((err = ltc_mp.ecc_ptdbl(R, R, modulus, mp)) != CRYPT_OK) {
-             return err;
-          }
-       }
-       
-       /* add if not first, otherwise copy */          
-       if (!first && z) {
-          if ((err = ltc_mp.ecc_ptadd(R, fp_cache[idx].LUT[z], R, modulus, mp)) != CRYPT_OK) {
-             return err;
-          }
-       } else if (z) {
-          if ((mp_copy(fp_cache[idx].LUT[z]->x, R->x) != CRYPT_OK) || 
-              (mp_copy(fp_cache[idx].LUT[z]->y, R->y) != CRYPT_OK) || 
-              (mp_copy(fp_cache[idx].mu,        R->z) != CRYPT_OK)) { return CRYPT_MEM; }
-              first = 0;              
-       }
-   }     
+       s = rot[cur][0];
+       t = rot[cur][1];
+
+       if ((err = ltc_mp.ecc_ptdbl(M[cur], M[cur], modulus, mp)) != CRYPT_OK) { goto done; }
+
+       select_row(idx, z, sel);
+       if ((err = fp_load_row(M[s], (unsigned char *)sel, stride)) != CRYPT_OK ||
+           (err = mp_copy(mu, M[s]->z)) != CRYPT_OK)                         { goto done; }
+       aff.x = M[s]->x;
+       aff.y = M[s]->y;
+       aff.z = NULL;
+       if ((err = ltc_mp.ecc_ptadd(M[cur], &aff, M[t], modulus, mp)) != CRYPT_OK) { goto done; }
+
+       /* keep M[cur] if z is zero, else take M[s] if at infinity, else M[t] */
+       nz      = (z | (0U - z)) >> (sizeof(unsigned) * CHAR_BIT - 1);
+       m_first = 0U - (nz & inf);
+       m_add   = 0U - (nz & (inf ^ 1));
+       cur    ^= ((cur ^ s) & m_first) | ((cur ^ t) & m_add);
+       inf    &= nz ^ 1;
+   }
    z = 0;
-   zeromem(kb, sizeof(kb));
+
+   /* k was a multiple of the order */
+   if (inf) {
+      err = CRYPT_INVALID_ARG;
+      goto done;
+   }
+
+   if ((err = mp_copy(M[cur]->x, R->x)) != CRYPT_OK ||
+       (err = mp_copy(M[cur]->y, R->y)) != CRYPT_OK ||
+       (err = mp_copy(M[cur]->z, R->z)) != CRYPT_OK)                         { goto done; }
+
    /* map R back from projective space */
    if (map) {
       err = ltc_ecc_map(R, modulus, mp);
    } else {
       err = CRYPT_OK;
    }
+done:
+   zeromem(kb, sizeof(kb));
+   zeromem(sel, sizeof(sel));
+   for (y = 0; y < 3; y++) {
+      if (M[y] != NULL) {
+         ltc_ecc_del_point(M[y]);
+      }
+   }
    return err;
 }
 
 #ifdef LTC_ECC_SHAMIR
-/* perform a fixed point ECC mulmod */
-static int accel_fp_mul2add(int idx1, int idx2, 
-                            void *kA, void *kB,
-                            ecc_point *R, void *modulus, void *mp)
+/* add LUT row z to R, or copy it if R is still the point at infinity */
+static int fp_add_row(int idx, unsigned z, ecc_point *R, ecc_point *Q, int *first,
+                      void *modulus, void *mp, void *mu)
 {
-   unsigned char kb[2][128];
-   int      x;
-   unsigned y, z, err, bitlen, bitpos, lut_gap, first, zA, zB;
-   void     *tka, *tkb, *order;
+   const unsigned char *row = fp_cache[idx].lut + z * FP_ROW_SIZE(fp_cache[idx].stride);
+   int err;
 
-   /* if it's smaller than modulus we fine */
-   if (mp_unsigned_bin_size(kA) > mp_unsigned_bin_size(modulus)) {
-      /* find order */
-      y = mp_unsigned_bin_size(modulus);
-      for (x = 0; ltc_ecc_sets[x].size; x++) {
-         if (y <= (unsigned)ltc_ecc_sets[x].size) break;
-      }
-   
-      /* back off if we are on the 521 bit curve */
-      if (y == 66) --x;
-      
-      if ((err = mp_init(&order)) != CRYPT_OK) {
-         return err;
-      }      
-      if ((err = mp_read_radix(order, ltc_ecc_sets[x].order, 16)) != CRYPT_OK) {
-         mp_clear(&order);
+   if (!z) {
+      return CRYPT_OK;
+   }
+   if (*first) {
+      if ((err = fp_load_row(R, row, fp_cache[idx].stride)) != CRYPT_OK) {
          return err;
       }
+      *first = 0;
+      return mp_copy(mu, R->z);
+   }
+   if ((err = fp_load_row(Q, row, fp_cache[idx].stride)) != CRYPT_OK) {
+      return err;
+   }
+   return ltc_mp.ecc_ptadd(R, Q, R, modulus, mp);
+}
 
-      /* kA must be less than modulus */
-      if (mp_cmp(kA, order) != LTC_MP_LT) {
-         if ((err = mp_init(&tka)) != CRYPT_OK) {
-            mp_clear(order);
-            return err;
-         }
-         if ((err = mp_mod(kA, order, tka)) != CRYPT_OK) {
-            mp_clear(tka);
-            mp_clear(order);
-            return err;
-         }
-      } else {
-         tka = kA;
-      }
-      mp_clear(order);
-   } else {
-      tka = kA;
-   }       
-
-   /* if it's smaller than modulus we fine */
-   if (mp_unsigned_bin_size(kB) > mp_unsigned_bin_size(modulus)) {
-      /* find order */
-      y = mp_unsigned_bin_size(modulus);
-      for (x = 0; ltc_ecc_sets[x].size; x++) {
-         if (y <= (unsigned)ltc_ecc_sets[x].size) break;
-      }
-   
-      /* back off if we are on the 521 bit curve */
-      if (y == 66) --x;
-      
-      if ((err = mp_init(&order)) != CRYPT_OK) {
-         return err;
-      }      
-      if ((err = mp_read_radix(order, ltc_ecc_sets[x].order, 16)) != CRYPT_OK) {
-         mp_clear(&order);
-         return err;
-      }
+/* perform a fixed point ECC mulmod
+ *
+ * Only used for signature verification where both scalars are public, so
+ * the LUT rows are indexed directly.
+ */
+static int accel_fp_mul2add(int idx1, int idx2, 
+                            void *kA, void *kB,
+                            ecc_point *R, void *modulus, void *mp, void *mu)
+{
+   unsigned char kb[2][128];
+   int      x, first;
+   unsigned y, bitlen, bitpos, lut_gap, zA, zB;
+   ecc_point Q;
+   int      err;
 
-      /* kB must be less than modulus */
-      if (mp_cmp(kB, order) != LTC_MP_LT) {
-         if ((err = mp_init(&tkb)) != CRYPT_OK) {
-            mp_clear(order);
-            return err;
-         }
-         if ((err = mp_mod(kB, order, tkb)) != CRYPT_OK) {
-            mp_clear(tkb);
-            mp_clear(order);
-            return err;
-         }
-      } else {
-         tkb = kB;
-      }
-      mp_clear(order);
-   } else {
-      tkb = kB;
-   }     
+   if ((err = fp_get_scalar(kA, modulus, kb[0], sizeof(kb[0]))) != CRYPT_OK ||
+       (err = fp_get_scalar(kB, modulus, kb[1], sizeof(kb[1]))) != CRYPT_OK) {
+      return err;
+   }
 
    /* get bitlen and round up to next multiple of FP_LUT */
    bitlen  = mp_unsigned_bin_size(modulus) << 3;
@@ -1020,59 +1184,12 @@ static int accel_fp_mul2add(int idx1, int idx2,
       bitlen += FP_LUT - x;
    }  
    lut_gap = bitlen / FP_LUT;
-        
-   /* get the k value */
-   if ((mp_unsigned_bin_size(tka) > (sizeof(kb[0]) - 2)) || (mp_unsigned_bin_size(tkb) > (sizeof(kb[0]) - 2))  ) {
-      if (tka != kA) {
-         mp_clear(tka);
-      }         
-      if (tkb != kB) {
-         mp_clear(tkb);
-      }         
-      return CRYPT_BUFFER_OVERFLOW;
-   }
-   
-   /* store k */
-   zeromem(kb, sizeof(kb));
-   if ((err = mp_to_unsigned_bin(tka, kb[0])) != CRYPT_OK) {
-      if (tka != kA) {
-         mp_clear(tka);
-      }         
-      if (tkb != kB) {
-         mp_clear(tkb);
-      }         
-      return err;
-   }
-   
-   /* let's reverse kb so it's little endian */
-   x = 0;
-   y = mp_unsigned_bin_size(tka) - 1;
-   if (tka != kA) {
-      mp_clear(tka);
-   }         
-   while ((unsigned)x < y) {
-      z = kb[0][x]; kb[0][x] = kb[0][y]; kb[0][y] = z;
-      ++x; --y;
-   }      
-   
-   /* store b */
-   if ((err = mp_to_unsigned_bin(tkb, kb[1])) != CRYPT_OK) {
-      if (tkb != kB) {
-         mp_clear(tkb);
-      }         
+
+   Q.z = NULL;
+   if ((err = mp_init_multi(&Q.x, &Q.y, NULL)) != CRYPT_OK) {
       return err;
    }
 
-   x = 0;
-   y = mp_unsigned_bin_size(tkb) - 1;
-   if (tkb != kB) {
-      mp_clear(tkb);
-   }         
-   while ((unsigned)x < y) {
-      z = kb[1][x]; kb[1][x] = kb[1][y]; kb[1][y] = z;
-      ++x; --y;
-   }      
-
    /* at this point we can start, yipee */
    first = 1;
    for (x = lut_gap-1; x >= 0; x--) {
@@ -1083,49 +1200,25 @@ static int accel_fp_mul2add(int idx1, int idx2,
           zB |= ((kb[1][bitpos>>3] >> (bitpos&7)) & 1) << y;
           bitpos += lut_gap;                               /* it's y*lut_gap + x, but here we can avoid the mult in each loop */
        }
-              
+
        /* double if not first */
        if (!first) {
           if ((err = ltc_mp.ecc_ptdbl(R, R, modulus, mp)) != CRYPT_OK) {
-             return err;
+             goto done;
           }
        }
-       
-       /* add if not first, otherwise copy */          
-       if (!first) {
-          if (zA) {
-             if ((err = ltc_mp.ecc_ptadd(R, fp_cache[idx1].LUT[zA], R, modulus, mp)) != CRYPT_OK) {
-                return err;
-             }
-          }
-          if (zB) {
-             if ((err = ltc_mp.ecc_ptadd(R, fp_cache[idx2].LUT[zB], R, modulus, mp)) != CRYPT_OK) {
-                return err;
-             }
-          }
-       } else {
-          if (zA) {
-              if ((mp_copy(fp_cache[idx1].LUT[zA]->x, R->x) != CRYPT_OK) || 
-                 (mp_copy(fp_cache[idx1].LUT[zA]->y, R->y) != CRYPT_OK) || 
-                 (mp_copy(fp_cache[idx1].mu,        R->z) != CRYPT_OK)) { return CRYPT_MEM; }
-                 first = 0;              
-          }
-          if (zB && first == 0) {
-             if (zB) {
-                if ((err = ltc_mp.ecc_ptadd(R, fp_cache[idx2].LUT[zB], R, modulus, mp)) != CRYPT_OK) {
-                   return err;
-                }
-             }
-          } else if (zB && first == 1) {
-              if ((mp_copy(fp_cache[idx2].LUT[zB]->x, R->x) != CRYPT_OK) || 
-                 (mp_copy(fp_cache[idx2].LUT[zB]->y, R->y) != CRYPT_OK) || 
-                 (mp_copy(fp_cache[idx2].mu,        R->z) != CRYPT_OK)) { return CRYPT_MEM; }
-                 first = 0;              
-          }
+
+       /* add if not first, otherwise copy */
+       if ((err = fp_add_row(idx1, zA, R, &Q, &first, modulus, mp, mu)) != CRYPT_OK ||
+           (err = fp_add_row(idx2, zB, R, &Q, &first, modulus, mp, mu)) != CRYPT_OK) {
+          goto done;
        }
    }     
    zeromem(kb, sizeof(kb));
-   return ltc_ecc_map(R, modulus, mp);
+   err = ltc_ecc_map(R, modulus, mp);
+done:
+   mp_clear_multi(Q.x, Q.y, NULL);
+   return err;
 }
 
 /** ECC Fixed Point mulmod global
@@ -1142,105 +1235,53 @@ int ltc_ecc_fp_mul2add(ecc_point *A, void *kA,
                        ecc_point *B, void *kB,
                        ecc_point *C, void *modulus)
 {
-   int  idx1, idx2, err;
+   unsigned char key1[FP_KEY_SIZE(FP_MAX_STRIDE)], key2[FP_KEY_SIZE(FP_MAX_STRIDE)];
+   unsigned long stride;
+   int  idx1, idx2, build1, build2, err;
    void *mp, *mu;
    
    mp = NULL;
    mu = NULL;
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-      /* find point */
-      idx1 = find_base(A);
-
-      /* no entry? */
-      if (idx1 == -1) {
-         /* find hole and add it */
-         if ((idx1 = find_hole()) >= 0) {
-            if ((err = add_entry(idx1, A)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }
-         }
-      }
-      if (idx1 != -1) {
-         /* increment LRU */
-         ++(fp_cache[idx1].lru_count);
-      }
-
-      /* find point */
-      idx2 = find_base(B);
-
-      /* no entry? */
-      if (idx2 == -1) {
-         /* find hole and add it */
-         if ((idx2 = find_hole()) >= 0) {
-            if ((err = add_entry(idx2, B)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }
-         }
-      }
-      if (idx2 != -1) {
-         /* increment LRU */
-         ++(fp_cache[idx2].lru_count);
-      }
-
-      /* if it's 2 build the LUT, if it's higher just use the LUT */
-      if (idx1 >= 0 && fp_cache[idx1].lru_count == 2) {
-         /* compute mp */
-         if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-
-         /* compute mu */
-         if ((err = mp_init(&mu)) != CRYPT_OK) {
-             goto LBL_ERR;
-         }
-         if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-            goto LBL_ERR;
-         }            
-                 
-         /* build the LUT */
-         if ((err = build_lut(idx1, modulus, mp, mu)) != CRYPT_OK) {
-             goto LBL_ERR;;
-         }  
-      }
+   idx1 = idx2 = -1;
+   build1 = build2 = 0;
+
+   stride = fp_stride(modulus);
+   if (stride && fp_make_key(A, modulus, key1, stride) == CRYPT_OK &&
+       fp_make_key(B, modulus, key2, stride) == CRYPT_OK) {
+      LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
+      idx1 = fp_acquire(key1, stride, &build1);
+      idx2 = fp_acquire(key2, stride, &build2);
+      LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+   }
 
-      /* if it's 2 build the LUT, if it's higher just use the LUT */
-      if (idx2 >= 0 && fp_cache[idx2].lru_count == 2) {
-         if (mp == NULL) {
-            /* compute mp */
-            if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-
-            /* compute mu */
-            if ((err = mp_init(&mu)) != CRYPT_OK) {
-                goto LBL_ERR;
-            }
-            if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }            
-         }
-                 
-         /* build the LUT */
-         if ((err = build_lut(idx2, modulus, mp, mu)) != CRYPT_OK) {
-             goto LBL_ERR;;
-         }  
-      }
+   err = fp_setup(modulus, &mp, &mu);
+   if (build1) {
+      err = fp_build(idx1, err, modulus, mp, mu);
+   }
+   if (build2) {
+      err = fp_build(idx2, err, modulus, mp, mu);
+   }
 
+   /* use the LUTs if both are usable, otherwise plain Shamir's trick */
+   if (err == CRYPT_OK && idx1 >= 0 && idx2 >= 0) {
+      err = accel_fp_mul2add(idx1, idx2, kA, kB, C, modulus, mp, mu);
+   } else {
+      err = ltc_ecc_mul2add(A, kA, B, kB, C, modulus);
+   }
 
-      if (idx1 >=0 && idx2 >= 0 && fp_cache[idx1].lru_count >= 2 && fp_cache[idx2].lru_count >= 2) {
-         if (mp == NULL) {
-            /* compute mp */
-            if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-         }
-         err = accel_fp_mul2add(idx1, idx2, kA, kB, C, modulus, mp);
-      } else {
-         err = ltc_ecc_mul2add(A, kA, B, kB, C, modulus);
-      }
-LBL_ERR:
-    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-    if (mp != NULL) {
-       mp_montgomery_free(mp);
-    }       
-    if (mu != NULL) {
-       mp_clear(mu);
-    }       
-    return err;
+   if (idx1 >= 0) {
+      fp_release(idx1);
+   }
+   if (idx2 >= 0) {
+      fp_release(idx2);
+   }
+   if (mp != NULL) {
+      mp_montgomery_free(mp);
+   }       
+   if (mu != NULL) {
+      mp_clear(mu);
+   }       
+   return err;
 }
 #endif
 
@@ -1254,98 +1295,57 @@ LBL_ERR:
 */   
 int ltc_ecc_fp_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map)
 {
-   int   idx, err;
+   unsigned char key[FP_KEY_SIZE(FP_MAX_STRIDE)];
+   unsigned long stride;
+   int   idx, build, err;
    void *mp, *mu;
    
    mp = NULL;
    mu = NULL;
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-      /* find point */
-      idx = find_base(G);
-
-      /* no entry? */
-      if (idx == -1) {
-         /* find hole and add it */
-         idx = find_hole();
-
-         if (idx >= 0) {
-            if ((err = add_entry(idx, G)) != CRYPT_OK) {
-               goto LBL_ERR;
-            }
-         }
-      }
-      if (idx != -1) {
-         /* increment LRU */
-         ++(fp_cache[idx].lru_count);
-      }
-
- 
-      /* if it's 2 build the LUT, if it's higher just use the LUT */
-      if (idx >= 0 && fp_cache[idx].lru_count == 2) {
-         /* compute mp */
-         if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
+   idx = -1;
+   build = 0;
+
+   stride = fp_stride(modulus);
+   if (stride && fp_make_key(G, modulus, key, stride) == CRYPT_OK) {
+      LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
+      idx = fp_acquire(key, stride, &build);
+      LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+   }
+   if (idx == -1) {
+      return ltc_ecc_mulmod(k, G, R, modulus, map);
+   }
 
-         /* compute mu */
-         if ((err = mp_init(&mu)) != CRYPT_OK) {
-             goto LBL_ERR;
-         }
-         if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-            goto LBL_ERR;
-         }            
-                 
-         /* build the LUT */
-         if ((err = build_lut(idx, modulus, mp, mu)) != CRYPT_OK) {
-             goto LBL_ERR;;
-         }  
-      }
+   err = fp_setup(modulus, &mp, &mu);
+   if (build) {
+      err = fp_build(idx, err, modulus, mp, mu);
+   }
+   if (err == CRYPT_OK) {
+      err = accel_fp_mul(idx, k, R, modulus, mp, mu, map);
+   } else {
+      err = ltc_ecc_mulmod(k, G, R, modulus, map);
+   }
 
-      if (idx >= 0 && fp_cache[idx].lru_count >= 2) {
-         if (mp == NULL) {
-            /* compute mp */
-            if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) { goto LBL_ERR; }
-         }
-         err = accel_fp_mul(idx, k, R, modulus, mp, map);
-      } else {
-         err = ltc_ecc_mulmod(k, G, R, modulus, map);
-      }
-LBL_ERR:
-    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-    if (mp != NULL) {
-       mp_montgomery_free(mp);
-    }       
-    if (mu != NULL) {
-       mp_clear(mu);
-    }       
-    return err;
+   fp_release(idx);
+   if (mp != NULL) {
+      mp_montgomery_free(mp);
+   }       
+   if (mu != NULL) {
+      mp_clear(mu);
+   }       
+   return err;
 }
 
-/* helper function for freeing the cache ... must be called with the cache mutex locked */
-static void ltc_ecc_fp_free_cache(void)
-{
-   unsigned x, y;
-   for (x = 0; x < FP_ENTRIES; x++) {
-      if (fp_cache[x].g != NULL) {
-         for (y = 0; y < (1U<<FP_LUT); y++) {
-            ltc_ecc_del_point(fp_cache[x].LUT[y]);
-            fp_cache[x].LUT[y] = NULL;
-         }
-         ltc_ecc_del_point(fp_cache[x].g);
-         fp_cache[x].g         = NULL;
-         if (fp_cache[x].mu != NULL) {
-            mp_clear(fp_cache[x].mu);
-            fp_cache[x].mu     = NULL;
-         }
-         fp_cache[x].lru_count = 0;
-         fp_cache[x].lock = 0;
-      }         
-   }
-}         
-
-/** Free the Fixed Point cache */
+/** Free the Fixed Point cache, entries in use are left alone */
 void ltc_ecc_fp_free(void)
 {
+   unsigned x;
+
    LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   ltc_ecc_fp_free_cache();
+   for (x = 0; x < FP_ENTRIES; x++) {
+      if (fp_cache[x].key != NULL && fp_cache[x].refs == 0) {
+         fp_free_entry(x);
+      }
+   }
    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
 }
 
@@ -1358,48 +1358,49 @@ void ltc_ecc_fp_free(void)
 int
 ltc_ecc_fp_add_point(ecc_point *g, void *modulus, int lock)
 {
+   unsigned char key[FP_KEY_SIZE(FP_MAX_STRIDE)];
+   unsigned long stride;
    int idx;
    int err;
    void *mp = NULL;
    void *mu = NULL;
 
+   stride = fp_stride(modulus);
+   if (!stride) {
+      return CRYPT_INVALID_ARG;
+   }
+   if ((err = fp_make_key(g, modulus, key, stride)) != CRYPT_OK) {
+      return err;
+   }
+
    LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   if ((idx = find_base(g)) >= 0) {
-      /* it is already in the cache ... just check that the LUT is initialized */
-      if(fp_cache[idx].lru_count >= 2) {
+   if ((idx = find_base(key, stride)) == -1) {
+      if ((idx = find_hole()) == -1) {
          LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-         return CRYPT_OK;
+         return CRYPT_BUFFER_OVERFLOW;
+      }
+      if ((err = add_entry(idx, key, stride)) != CRYPT_OK) {
+         LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+         return err;
       }
    }
-
-   if(idx == -1 && (idx = find_hole()) == -1) {
-      err = CRYPT_BUFFER_OVERFLOW;
-      goto LBL_ERR;
-   }
-   if ((err = add_entry(idx, g)) != CRYPT_OK) {
-      goto LBL_ERR;
-   }
-   /* compute mp */
-   if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
-      goto LBL_ERR;
+   fp_cache[idx].lock = lock;
+   if (fp_cache[idx].lru_count < 2) {
+      fp_cache[idx].lru_count = 2;
    }
-
-   /* compute mu */
-   if ((err = mp_init(&mu)) != CRYPT_OK) {
-       goto LBL_ERR;
+   /* it is already in the cache ... just check that the LUT is initialized */
+   if (fp_cache[idx].lut != NULL || fp_cache[idx].building) {
+      LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+      return CRYPT_OK;
    }
-   if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
-      goto LBL_ERR;
-   }            
-	   
-   /* build the LUT */
-   if ((err = build_lut(idx, modulus, mp, mu)) != CRYPT_OK) {
-       goto LBL_ERR;
-   }  
-   fp_cache[idx].lru_count = 2;
-   fp_cache[idx].lock = lock;
-LBL_ERR:
+   fp_cache[idx].building = 1;
+   ++(fp_cache[idx].refs);
    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
+
+   err = fp_setup(modulus, &mp, &mu);
+   err = fp_build(idx, err, modulus, mp, mu);
+
+   fp_release(idx);
    if (mp != NULL) {
       mp_montgomery_free(mp);
    }       
@@ -1423,193 +1424,9 @@ void ltc_ecc_fp_tablelock(int lock)
    LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
 }
 
-/** Export the current cache as a binary packet
-    @param out      [out] pointer to malloc'ed space containing the packet
-    @param outlen   [out] size of exported packet
-    @return CRYPT_OK if successful
-*/
-int ltc_ecc_fp_save_state(unsigned char **out, unsigned long *outlen)
-{
-   ltc_asn1_list *cache_entry;
-   unsigned int   i, j, k;
-   unsigned long  fp_entries, fp_lut, num_entries;
-   int            err;
-
-   LTC_ARGCHK(out    != NULL);
-   LTC_ARGCHK(outlen != NULL);
-
-   fp_entries  = FP_ENTRIES;
-   fp_lut      = FP_LUT;
-   num_entries = 0;
-
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   /*
-    * build the list; 
-      Cache DEFINITIONS ::=
-      BEGIN
-       CacheDump ::= SEQUENCE {
-         numEntries    SHORTINTEGER,
-         maxEntries    SHORTINTEGER,
-         numLUT        SHORTINTEGER,
-         cache         SEQUENCE OF INTEGER
-       }
-      END
-    *      
-    */
-   /*
-    * The cache itself is a point (3 INTEGERS), 
-	* the LUT as pairs of INTEGERS (2 * 1<<FP_LUT), 
-	* and the mu INTEGER
-    */
-   cache_entry = XCALLOC(FP_ENTRIES*(2*(1U<<FP_LUT)+4)+3, sizeof(ltc_asn1_list));
-   if (cache_entry == NULL)
-      return CRYPT_MEM;
-   j = 1;   /* handle the zero'th element later */
-
-   LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_SHORT_INTEGER, &fp_entries, 1);
-   LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_SHORT_INTEGER, &fp_lut, 1);
-
-   for (i = 0; i < FP_ENTRIES; i++) {
-      /*
-       * do not save empty entries, or entries that have not yet had the lut built
-       */
-      if (fp_cache[i].g == NULL || fp_cache[i].lru_count < 2) {
-         continue;
-      }
-      num_entries++;
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].g->x, 1);
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].g->y, 1);
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].g->z, 1);
-      for (k = 0; k < (1U<<FP_LUT); k++) {
-         LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].LUT[k]->x, 1);
-         LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].LUT[k]->y, 1);
-      }
-      LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_INTEGER, fp_cache[i].mu, 1);
-   }
-   LTC_SET_ASN1(cache_entry, j++, LTC_ASN1_EOL, 0, 0);
-
-   LTC_SET_ASN1(cache_entry, 0, LTC_ASN1_SHORT_INTEGER, &num_entries, 1);
-
-   if ((err = der_length_sequence(cache_entry, j, outlen)) != CRYPT_OK) {
-      goto save_err;
-   }
-   if ((*out = XMALLOC(*outlen)) == NULL) {
-      err = CRYPT_MEM;
-      goto save_err;
-   }
-   err = der_encode_sequence(cache_entry, j, *out, outlen);
-save_err:
-   XFREE(cache_entry);
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   return err;
-}
-
-/** Import a binary packet into the current cache
-    @param in      [in] pointer to packet
-    @param inlen   [in] size of packet (bytes)
-    @return CRYPT_OK if successful
-*/
-int ltc_ecc_fp_restore_state(unsigned char *in, unsigned long inlen)
-{
-   int            err;
-   ltc_asn1_list *asn1_list;
-   unsigned long  num_entries, fp_entries, fp_lut;
-   unsigned long  i, j;
-   unsigned int   x;
-
-   LTC_ARGCHK(in != NULL);
-   if (inlen == 0) {
-      return CRYPT_INVALID_ARG;
-   } 
-
-   /* zero indecies */
-   i         = 0;
-   j         = 0;
-   asn1_list = NULL;
-
-   LTC_MUTEX_LOCK(&ltc_ecc_fp_lock);
-   /*
-    * start with an empty cache
-    */
-   ltc_ecc_fp_free_cache();
-
-   /*
-    * decode the input packet: It consists of a sequence with a few
-    * integers (including the FP_ENTRIES and FP_LUT sizes), followed by a
-    * SEQUENCE which is the cache itself.
-	*
-	* use standard decoding for the first part, then flexible for the second
-    */
-   if((err = der_decode_sequence_multi(in, inlen, 
-                                       LTC_ASN1_SHORT_INTEGER, 1, &num_entries,
-                                       LTC_ASN1_SHORT_INTEGER, 1, &fp_entries,
-                                       LTC_ASN1_SHORT_INTEGER, 1, &fp_lut,
-                                       LTC_ASN1_EOL,           0, 0)) != CRYPT_OK) {
-      goto ERR_OUT;
-   }
-   if (fp_entries != FP_ENTRIES || fp_lut != FP_LUT || num_entries > fp_entries) {
-      err = CRYPT_INVALID_PACKET;
-      goto ERR_OUT;
-   }
-   if ((asn1_list = XCALLOC(3+num_entries*(4+2*(1<<FP_LUT))+1, sizeof(ltc_asn1_list))) == NULL) {
-      err = CRYPT_MEM;
-      goto ERR_OUT;
-   }
-   j = 0;
-   LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_SHORT_INTEGER, &num_entries, 1);
-   LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_SHORT_INTEGER, &fp_entries, 1);
-   LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_SHORT_INTEGER, &fp_lut, 1);
-   for (i = 0; i < num_entries; i++) {
-      if((fp_cache[i].g = ltc_ecc_new_point()) == NULL) {
-         err = CRYPT_MEM;
-         goto ERR_OUT;
-      }
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].g->x, 1);
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].g->y, 1);
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].g->z, 1);
-      for (x = 0; x < (1U<<FP_LUT); x++) {
-         /* since we don't store z in the cache, don't use ltc_ecc_new_point() 
-          * (which allocates space for z, only to have to free it later) */
-         ecc_point *p = XCALLOC(1, sizeof(*p));
-
-         if (p == NULL) {
-            err = CRYPT_MEM;
-            goto ERR_OUT;
-         }
-         fp_cache[i].LUT[x] = p;
-         if ((err = mp_init_multi(&p->x, &p->y, NULL)) != CRYPT_OK) {
-            goto ERR_OUT;
-         }
-         p->z = NULL;
-         LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, p->x, 1);
-         LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, p->y, 1);
-      }
-      if((err = mp_init(&fp_cache[i].mu)) != CRYPT_OK) {
-         goto ERR_OUT;
-      }
-      LTC_SET_ASN1(asn1_list, j++, LTC_ASN1_INTEGER, fp_cache[i].mu, 1);
-      fp_cache[i].lru_count = 3;
-      fp_cache[i].lock = 1;
-   }
-
-   if ((err = der_decode_sequence(in, inlen, asn1_list, j)) != CRYPT_OK) {
-      goto ERR_OUT;
-   }
-   XFREE(asn1_list);
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   return CRYPT_OK;
-ERR_OUT:
-   if(asn1_list)
-      XFREE(asn1_list);
-   ltc_ecc_fp_free_cache();
-   LTC_MUTEX_UNLOCK(&ltc_ecc_fp_lock);
-   return err;
-}
-
 #endif
 
 
 /* $Source$ */
 /* $Revision$ */
 /* $Date$ */
-
@@ -505,25 +505,56 @@ TEE_Result crypto_hash_final(void *ctx, uint32_t algo, uint8_t *digest,
 #include <mm/core_mmu.h>
 
 /* allocate pageable_zi vmem for mpa scratch memory pool */
+static void *alloc_mpa_scratch_block(size_t size)
+{
+	void *data = tee_pager_alloc(size, 0);
+
+	if (!data)
+		panic();
+	return data;
+}
+
 static struct mempool *get_mpa_scratch_memory_pool(void)
 {
+	struct mempool *pool;
 	size_t size;
-	void *data;
+	size_t n;
 
 	size = ROUNDUP((LTC_MEMPOOL_U32_SIZE * sizeof(uint32_t)),
 		        SMALL_PAGE_SIZE);
-	data = tee_pager_alloc(size, 0);
-	if (!data)
+
+	pool = mempool_alloc_pool(alloc_mpa_scratch_block(size), size,
+				  tee_pager_release_phys);
+	if (!pool)
 		panic();
 
-	return mempool_alloc_pool(data, size, tee_pager_release_phys);
+	for (n = 1; n < CFG_CORE_BIGNUM_SCRATCH_POOLS; n++)
+		if (!mempool_add_block(pool, alloc_mpa_scratch_block(size),
+				       size))
+			panic();
+
+	return pool;
 }
 #else /* CFG_WITH_PAGER */
 static struct mempool *get_mpa_scratch_memory_pool(void)
 {
-	static uint32_t data[LTC_MEMPOOL_U32_SIZE] __aligned(__alignof__(long));
+	/* Rows rounded up to keep each block aligned for the mempool */
+	static uint32_t data[CFG_CORE_BIGNUM_SCRATCH_POOLS]
+			    [ROUNDUP(LTC_MEMPOOL_U32_SIZE,
+				     sizeof(long) / sizeof(uint32_t))]
+			    __aligned(__alignof__(long));
+	struct mempool *pool;
+	size_t n;
+
+	pool = mempool_alloc_pool(data[0], sizeof(data[0]), NULL);
+	if (!pool)
+		panic();
+
+	for (n = 1; n < ARRAY_SIZE(data); n++)
+		if (!mempool_add_block(pool, data[n], sizeof(data[n])))
+			panic();
 
-	return mempool_alloc_pool(data, sizeof(data), NULL);
+	return pool;
 }
 #endif
 
@@ -10,6 +10,30 @@
 #include <string.h>
 #include <tee/fs_dirfile.h>
 #include <types_ext.h>
+#include <util.h>
+
+/*
+ * In-memory index of the entries in dirf.db mapping (TA UUID, object ID)
+ * to the index of an entry. Only a hash of the key is kept for each
+ * entry, a match is confirmed by reading the entry.
+ *
+ * @nbuckets:	number of hash buckets, a power of 2
+ * @buckets:	index of the first entry in each bucket, -1 if empty
+ * @nents:	number of elements in @next, @keys and @used
+ * @next:	index of the next entry in the same bucket, -1 if last
+ * @keys:	hash of the key of each entry
+ * @used:	bit set for each entry holding an object
+ * @count:	number of bits set in @used
+ */
+struct dirfile_index {
+	size_t nbuckets;
+	int *buckets;
+	size_t nents;
+	int *next;
+	uint32_t *keys;
+	bitstr_t *used;
+	size_t count;
+};
 
 struct tee_fs_dirfile_dirh {
 	const struct tee_fs_dirfile_operations *fops;
@@ -17,6 +41,7 @@ struct tee_fs_dirfile_dirh {
 	int nbits;
 	bitstr_t *files;
 	size_t ndents;
+	struct dirfile_index *index;	/* NULL if lookups scan dirf.db */
 };
 
 struct dirfile_entry {
@@ -79,6 +104,151 @@ static bool test_file(struct tee_fs_dirfile_dirh *dirh, int idx)
 	return false;
 }
 
+/* FNV-1a */
+static uint32_t index_key(const TEE_UUID *uuid, const void *oid,
+			  size_t oidlen)
+{
+	const uint8_t *p = (const uint8_t *)uuid;
+	uint32_t h = 2166136261;
+	size_t n;
+
+	for (n = 0; n < sizeof(*uuid); n++)
+		h = (h ^ p[n]) * 16777619;
+	p = oid;
+	for (n = 0; n < oidlen; n++)
+		h = (h ^ p[n]) * 16777619;
+
+	return h;
+}
+
+static void index_free(struct dirfile_index *ix)
+{
+	if (ix) {
+		free(ix->buckets);
+		free(ix->next);
+		free(ix->keys);
+		free(ix->used);
+		free(ix);
+	}
+}
+
+static TEE_Result index_grow(struct dirfile_index *ix, size_t idx)
+{
+	size_t nents = MAX(ix->nents * 2, (size_t)16);
+	void *p;
+
+	if (idx < ix->nents)
+		return TEE_SUCCESS;
+	if (nents <= idx)
+		nents = idx + 1;
+
+	p = realloc(ix->next, nents * sizeof(*ix->next));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ix->next = p;
+	p = realloc(ix->keys, nents * sizeof(*ix->keys));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ix->keys = p;
+	p = realloc(ix->used, bitstr_size(nents));
+	if (!p)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	ix->used = p;
+
+	bit_nclear(ix->used, ix->nents, nents - 1);
+	ix->nents = nents;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result index_rehash(struct dirfile_index *ix, size_t nbuckets)
+{
+	int *buckets = malloc(nbuckets * sizeof(*buckets));
+	size_t n;
+
+	if (!buckets)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < nbuckets; n++)
+		buckets[n] = -1;
+	for (n = 0; n < ix->nents; n++) {
+		size_t b = ix->keys[n] & (nbuckets - 1);
+
+		if (!bit_test(ix->used, n))
+			continue;
+		ix->next[n] = buckets[b];
+		buckets[b] = n;
+	}
+
+	free(ix->buckets);
+	ix->buckets = buckets;
+	ix->nbuckets = nbuckets;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result index_add(struct dirfile_index *ix, int idx, uint32_t key)
+{
+	TEE_Result res;
+	size_t b;
+
+	res = index_grow(ix, idx);
+	if (res)
+		return res;
+
+	assert(!bit_test(ix->used, idx));
+	ix->keys[idx] = key;
+	bit_set(ix->used, idx);
+	ix->count++;
+
+	/* Keep the load factor at or below 1 */
+	if (ix->count > ix->nbuckets)
+		return index_rehash(ix, MAX(ix->nbuckets * 2, (size_t)16));
+
+	b = key & (ix->nbuckets - 1);
+	ix->next[idx] = ix->buckets[b];
+	ix->buckets[b] = idx;
+
+	return TEE_SUCCESS;
+}
+
+static void index_del(struct dirfile_index *ix, int idx)
+{
+	int *n;
+
+	if ((size_t)idx >= ix->nents || !bit_test(ix->used, idx))
+		return;
+
+	n = ix->buckets + (ix->keys[idx] & (ix->nbuckets - 1));
+	while (*n != idx) {
+		assert(*n != -1);
+		n = ix->next + *n;
+	}
+	*n = ix->next[idx];
+
+	bit_clear(ix->used, idx);
+	ix->count--;
+}
+
+/*
+ * Called each time entry @idx has been written. If the index can't be
+ * updated it's dropped and lookups fall back to scanning dirf.db.
+ */
+static void index_update(struct tee_fs_dirfile_dirh *dirh, int idx,
+			 const struct dirfile_entry *dent)
+{
+	if (!dirh->index)
+		return;
+
+	index_del(dirh->index, idx);
+	if (dent->oidlen &&
+	    index_add(dirh->index, idx,
+		      index_key(&dent->uuid, dent->oid, dent->oidlen))) {
+		index_free(dirh->index);
+		dirh->index = NULL;
+	}
+}
+
 static TEE_Result read_dent(struct tee_fs_dirfile_dirh *dirh, int idx,
 			    struct dirfile_entry *dent)
 {
@@ -101,8 +271,11 @@ static TEE_Result write_dent(struct tee_fs_dirfile_dirh *dirh, size_t n,
 
 	res = dirh->fops->write(dirh->fh, sizeof(*dent) * n,
 				dent, sizeof(*dent));
-	if (!res && n >= dirh->ndents)
-		dirh->ndents = n + 1;
+	if (!res) {
+		if (n >= dirh->ndents)
+			dirh->ndents = n + 1;
+		index_update(dirh, n, dent);
+	}
 
 	return res;
 }
@@ -123,6 +296,9 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 	if (res)
 		goto out;
 
+	/* Without an index lookups scan dirf.db instead */
+	dirh->index = calloc(1, sizeof(*dirh->index));
+
 	for (n = 0;; n++) {
 		struct dirfile_entry dent;
 
@@ -149,6 +325,8 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 		res = set_file(dirh, dent.file_number);
 		if (res != TEE_SUCCESS)
 			goto out;
+
+		index_update(dirh, n, &dent);
 	}
 out:
 	if (!res) {
@@ -165,6 +343,7 @@ void tee_fs_dirfile_close(struct tee_fs_dirfile_dirh *dirh)
 	if (dirh) {
 		dirh->fops->close(dirh->fh);
 		free(dirh->files);
+		index_free(dirh->index);
 		free(dirh);
 	}
 }
@@ -194,6 +373,54 @@ TEE_Result tee_fs_dirfile_get_tmp(struct tee_fs_dirfile_dirh *dirh,
 	return res;
 }
 
+static TEE_Result index_find(struct tee_fs_dirfile_dirh *dirh,
+			     const TEE_UUID *uuid, const void *oid,
+			     size_t oidlen, struct dirfile_entry *dent,
+			     int *idx)
+{
+	TEE_Result res;
+	struct dirfile_index *ix = dirh->index;
+	uint32_t key;
+	int n = -1;
+
+	if (!oidlen) {
+		/* First free entry, or one past the last entry */
+		size_t nents = MIN(ix->nents, dirh->ndents);
+
+		if (nents)
+			bit_ffc(ix->used, (int)nents, &n);
+		if (n == -1)
+			n = nents;
+		memset(dent, 0, sizeof(*dent));
+		*idx = n;
+		return TEE_SUCCESS;
+	}
+
+	if (!ix->count)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	key = index_key(uuid, oid, oidlen);
+	for (n = ix->buckets[key & (ix->nbuckets - 1)]; n != -1;
+	     n = ix->next[n]) {
+		if (ix->keys[n] != key)
+			continue;
+
+		res = read_dent(dirh, n, dent);
+		if (res)
+			return res;
+
+		if (dent->oidlen == oidlen &&
+		    !memcmp(&dent->uuid, uuid, sizeof(dent->uuid)) &&
+		    !memcmp(&dent->oid, oid, oidlen)) {
+			assert(test_file(dirh, dent->file_number));
+			*idx = n;
+			return TEE_SUCCESS;
+		}
+	}
+
+	return TEE_ERROR_ITEM_NOT_FOUND;
+}
+
 TEE_Result tee_fs_dirfile_find(struct tee_fs_dirfile_dirh *dirh,
 			       const TEE_UUID *uuid, const void *oid,
 			       size_t oidlen, struct tee_fs_dirfile_fileh *dfh)
@@ -203,6 +430,13 @@ TEE_Result tee_fs_dirfile_find(struct tee_fs_dirfile_dirh *dirh,
 	int n;
 	int first_free = -1;
 
+	if (dirh->index) {
+		res = index_find(dirh, uuid, oid, oidlen, &dent, &n);
+		if (res)
+			return res;
+		goto out;
+	}
+
 	for (n = 0;; n++) {
 		res = read_dent(dirh, n, &dent);
 		if (res == TEE_ERROR_ITEM_NOT_FOUND && !oidlen) {
@@ -229,6 +463,7 @@ TEE_Result tee_fs_dirfile_find(struct tee_fs_dirfile_dirh *dirh,
 			break;
 	}
 
+out:
 	if (dfh) {
 		dfh->idx = n;
 		dfh->file_number = dent.file_number;
@@ -6,11 +6,14 @@
 #include <assert.h>
 #include <crypto/crypto.h>
 #include <initcall.h>
+#include <kernel/mutex.h>
+#include <kernel/slab.h>
 #include <kernel/tee_common_otp.h>
 #include <optee_msg_supplicant.h>
 #include <stdlib.h>
 #include <string_ext.h>
 #include <string.h>
+#include <sys/queue.h>
 #include <tee/fs_htree.h>
 #include <tee/tee_fs_key_manager.h>
 #include <tee/tee_fs_rpc.h>
@@ -84,8 +87,47 @@ struct htree_node {
 	struct tee_fs_htree_node_image node;
 	struct htree_node *parent;
 	struct htree_node *child[2];
+	struct block_cache_entry *cached;
 };
 
+static struct slab_cache htree_node_cache =
+	SLAB_CACHE_INITIALIZER("htree_node", sizeof(struct htree_node), NULL);
+
+/*
+ * Decrypted data blocks are cached in secure memory. The cache is shared
+ * by all open hash trees and holds at most BLOCK_CACHE_SIZE bytes of
+ * block data, by default a quarter of the core heap.
+ *
+ * A dirty block has been written with tee_fs_htree_write_block() but is
+ * not yet encrypted and written to storage, that is done by
+ * tee_fs_htree_sync_to_storage(). Only clean blocks are evicted to make
+ * room for other blocks, if there's no room a written block goes to
+ * storage directly.
+ *
+ * The user of a hash tree serializes all access to it, but clean blocks
+ * may be evicted by any thread. So block_cache_mu is held while
+ * htree_node::cached or the data of a clean block is accessed.
+ */
+#ifdef CFG_FS_HTREE_CACHE_SIZE
+#define BLOCK_CACHE_SIZE	CFG_FS_HTREE_CACHE_SIZE
+#else
+#define BLOCK_CACHE_SIZE	(CFG_CORE_HEAP_SIZE / 4)
+#endif
+
+struct block_cache_entry {
+	struct htree_node *node;
+	size_t block_size;
+	bool dirty;
+	TAILQ_ENTRY(block_cache_entry) link;
+	uint8_t data[];
+};
+
+static struct mutex block_cache_mu = MUTEX_INITIALIZER;
+/* Least recently used first */
+static TAILQ_HEAD(, block_cache_entry) block_cache_lru =
+	TAILQ_HEAD_INITIALIZER(block_cache_lru);
+static size_t block_cache_used;
+
 struct tee_fs_htree {
 	struct htree_node root;
 	struct tee_fs_htree_image head;
@@ -106,6 +148,114 @@ struct traverse_arg {
 	void *arg;
 };
 
+/* Called with block_cache_mu held */
+static void cache_remove(struct block_cache_entry *e)
+{
+	TAILQ_REMOVE(&block_cache_lru, e, link);
+	e->node->cached = NULL;
+	block_cache_used -= e->block_size;
+	free(e);
+}
+
+/* Called with block_cache_mu held */
+static bool cache_make_room(size_t block_size)
+{
+	struct block_cache_entry *e = TAILQ_FIRST(&block_cache_lru);
+	struct block_cache_entry *next;
+
+	while (block_cache_used + block_size > BLOCK_CACHE_SIZE) {
+		while (e && e->dirty)
+			e = TAILQ_NEXT(e, link);
+		if (!e)
+			return false;
+		next = TAILQ_NEXT(e, link);
+		cache_remove(e);
+		e = next;
+	}
+
+	return true;
+}
+
+static bool cache_get(struct tee_fs_htree *ht, struct htree_node *node,
+		      void *block)
+{
+	struct block_cache_entry *e;
+
+	mutex_lock(&block_cache_mu);
+	e = node->cached;
+	if (e) {
+		memcpy(block, e->data, ht->stor->block_size);
+		TAILQ_REMOVE(&block_cache_lru, e, link);
+		TAILQ_INSERT_TAIL(&block_cache_lru, e, link);
+	}
+	mutex_unlock(&block_cache_mu);
+
+	return e;
+}
+
+static bool cache_put(struct tee_fs_htree *ht, struct htree_node *node,
+		      const void *block, bool dirty)
+{
+	size_t block_size = ht->stor->block_size;
+	struct block_cache_entry *e;
+
+	if (block_size > BLOCK_CACHE_SIZE)
+		return false;
+
+	mutex_lock(&block_cache_mu);
+	e = node->cached;
+	if (e) {
+		TAILQ_REMOVE(&block_cache_lru, e, link);
+	} else {
+		if (!cache_make_room(block_size))
+			goto out;
+		e = malloc(sizeof(*e) + block_size);
+		if (!e)
+			goto out;
+		e->node = node;
+		e->block_size = block_size;
+		node->cached = e;
+		block_cache_used += block_size;
+	}
+	TAILQ_INSERT_TAIL(&block_cache_lru, e, link);
+	memcpy(e->data, block, block_size);
+	e->dirty = dirty;
+out:
+	mutex_unlock(&block_cache_mu);
+
+	return e;
+}
+
+static bool cache_has(struct htree_node *node)
+{
+	bool ret;
+
+	mutex_lock(&block_cache_mu);
+	ret = node->cached;
+	mutex_unlock(&block_cache_mu);
+
+	return ret;
+}
+
+static bool cache_is_dirty(struct htree_node *node)
+{
+	bool ret;
+
+	mutex_lock(&block_cache_mu);
+	ret = node->cached && node->cached->dirty;
+	mutex_unlock(&block_cache_mu);
+
+	return ret;
+}
+
+static void cache_drop(struct htree_node *node)
+{
+	mutex_lock(&block_cache_mu);
+	if (node->cached)
+		cache_remove(node->cached);
+	mutex_unlock(&block_cache_mu);
+}
+
 static TEE_Result rpc_read(struct tee_fs_htree *ht, enum tee_fs_htree_type type,
 			   size_t idx, size_t vers, void *data, size_t dlen)
 {
@@ -284,7 +434,7 @@ static TEE_Result get_node(struct tee_fs_htree *ht, bool create,
 		assert((n >> 1) == node->id);
 		assert(!node->child[n & 1]);
 
-		nc = calloc(1, sizeof(*nc));
+		nc = slab_alloc(&htree_node_cache);
 		if (!nc)
 			return TEE_ERROR_OUT_OF_MEMORY;
 		nc->id = n;
@@ -690,8 +840,9 @@ void tee_fs_htree_meta_set_dirty(struct tee_fs_htree *ht)
 static TEE_Result free_node(struct traverse_arg *targ __unused,
 			    struct htree_node *node)
 {
+	cache_drop(node);
 	if (node->parent)
-		free(node);
+		slab_free(&htree_node_cache, node);
 	return TEE_SUCCESS;
 }
 
@@ -704,6 +855,35 @@ void tee_fs_htree_close(struct tee_fs_htree **ht)
 	*ht = NULL;
 }
 
+static TEE_Result write_block(struct tee_fs_htree *ht, struct htree_node *node,
+			      const void *block)
+{
+	TEE_Result res;
+	struct tee_fs_rpc_operation op;
+	uint8_t block_vers;
+	void *ctx;
+	void *enc_block;
+
+	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
+	res = ht->stor->rpc_write_init(ht->stor_aux, &op,
+				       TEE_FS_HTREE_TYPE_BLOCK,
+				       NODE_ID_TO_BLOCK_NUM(node->id),
+				       block_vers, &enc_block);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
+			   ht->stor->block_size);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = authenc_encrypt_final(ctx, node->node.tag, block,
+				    ht->stor->block_size, enc_block);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return ht->stor->rpc_write_final(&op);
+}
+
 static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 					     struct htree_node *node)
 {
@@ -721,6 +901,19 @@ static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 	if (!node->dirty)
 		return TEE_SUCCESS;
 
+	if (cache_is_dirty(node)) {
+		/*
+		 * A dirty block can't be evicted so its data can be used
+		 * without holding block_cache_mu.
+		 */
+		res = write_block(targ->ht, node, node->cached->data);
+		if (res != TEE_SUCCESS)
+			return res;
+		mutex_lock(&block_cache_mu);
+		node->cached->dirty = false;
+		mutex_unlock(&block_cache_mu);
+	}
+
 	if (node->parent) {
 		uint32_t f = HTREE_NODE_COMMITTED_CHILD(node->id & 1);
 
@@ -819,11 +1012,7 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 {
 	struct tee_fs_htree *ht = *ht_arg;
 	TEE_Result res;
-	struct tee_fs_rpc_operation op;
 	struct htree_node *node = NULL;
-	uint8_t block_vers;
-	void *ctx;
-	void *enc_block;
 
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
@@ -835,25 +1024,12 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 	if (!node->block_updated)
 		node->node.flags ^= HTREE_NODE_COMMITTED_BLOCK;
 
-	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
-	res = ht->stor->rpc_write_init(ht->stor_aux, &op,
-				       TEE_FS_HTREE_TYPE_BLOCK, block_num,
-				       block_vers, &enc_block);
-	if (res != TEE_SUCCESS)
-		goto out;
-
-	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
-			   ht->stor->block_size);
-	if (res != TEE_SUCCESS)
-		goto out;
-	res = authenc_encrypt_final(ctx, node->node.tag, block,
-				    ht->stor->block_size, enc_block);
-	if (res != TEE_SUCCESS)
-		goto out;
-
-	res = ht->stor->rpc_write_final(&op);
-	if (res != TEE_SUCCESS)
-		goto out;
+	/* Written to storage by tee_fs_htree_sync_to_storage() if cached */
+	if (!cache_put(ht, node, block, true)) {
+		res = write_block(ht, node, block);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
 
 	node->block_updated = true;
 	node->dirty = true;
@@ -883,6 +1059,9 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 	if (res != TEE_SUCCESS)
 		goto out;
 
+	if (cache_get(ht, node, block))
+		return TEE_SUCCESS;
+
 	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
 	res = ht->stor->rpc_read_init(ht->stor_aux, &op,
 				      TEE_FS_HTREE_TYPE_BLOCK, block_num,
@@ -905,12 +1084,37 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 
 	res = authenc_decrypt_final(ctx, node->node.tag, enc_block,
 				    ht->stor->block_size, block);
+	if (res == TEE_SUCCESS)
+		cache_put(ht, node, block, false);
 out:
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
 	return res;
 }
 
+void tee_fs_htree_read_ahead(struct tee_fs_htree *ht, size_t block_num,
+			     size_t num_blocks)
+{
+	struct htree_node *node;
+	size_t num_nodes;
+
+	if (!ht || !ht->stor->rpc_read_ahead)
+		return;
+
+	/* Block n is stored in node n + 1, don't read past the last node */
+	num_nodes = ht->imeta.max_node_id;
+	if (BLOCK_NUM_TO_NODE_ID(block_num) > num_nodes)
+		return;
+	num_blocks = MIN(num_blocks, num_nodes - block_num);
+
+	/* The block will be read from the cache */
+	if (get_block_node(ht, false, block_num, &node) || cache_has(node))
+		return;
+
+	if (num_blocks)
+		ht->stor->rpc_read_ahead(ht->stor_aux, block_num, num_blocks);
+}
+
 TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 {
 	struct tee_fs_htree *ht = *ht_arg;
@@ -927,7 +1131,8 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 		assert(node->parent);
 		assert(node->parent->child[node->id & 1] == node);
 		node->parent->child[node->id & 1] = NULL;
-		free(node);
+		cache_drop(node);
+		slab_free(&htree_node_cache, node);
 		ht->imeta.max_node_id--;
 		ht->dirty = true;
 	}
@@ -68,7 +68,7 @@ struct tee_tadb_ta_read {
 static const char tadb_obj_id[] = "ta.db";
 static struct tee_tadb_dir *tadb_db;
 static struct refcount tadb_db_refc;
-static struct mutex tadb_mutex = MUTEX_INITIALIZER;
+static struct mutex tadb_mutex = MUTEX_INITIALIZER_NAMED("tadb_mutex");
 
 static void file_num_to_str(char *buf, size_t blen, uint32_t file_number)
 {
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+/*
+ * NIST SP 800-90A Rev. 1 CTR_DRBG using AES-256 without derivation
+ * function, seeded by hw_get_random_bytes().
+ *
+ * Each thread has its own instance, a thread isn't migrated to another
+ * core while it owns the instance and no locking is needed. The
+ * generation itself is an AES-CTR operation of the crypto library which
+ * is accelerated with the Cryptographic Extensions when available.
+ *
+ * Small requests are served from a per-thread buffer filled by one
+ * generate call, consumed bytes are wiped from the buffer.
+ */
+
+#include <crypto/crypto.h>
+#include <kernel/thread.h>
+#include <rng_support.h>
+#include <string.h>
+#include <tee/tee_cryp_drbg.h>
+#include <trace.h>
+#include <util.h>
+#include <utee_defines.h>
+
+#define DRBG_ALGO		TEE_ALG_AES_CTR
+#define DRBG_KEY_SIZE		32
+#define DRBG_BLOCK_SIZE		TEE_AES_BLOCK_SIZE
+#define DRBG_SEED_SIZE		(DRBG_KEY_SIZE + DRBG_BLOCK_SIZE)
+
+/* Generate requests between two reseeds, SP 800-90A allows up to 2^48 */
+#define DRBG_RESEED_INTERVAL	1024
+
+/* Largest generate request, max_number_of_bits_per_request is 2^19 */
+#define DRBG_MAX_REQUEST	(64 * 1024)
+
+/* Requests smaller than this are served from the buffer */
+#define DRBG_BUF_SIZE		256
+
+struct drbg_state {
+	uint8_t key[DRBG_KEY_SIZE];
+	uint8_t v[DRBG_BLOCK_SIZE];
+	void *ctx;
+	/* Generate requests since last (re)seed, 0 if not instantiated */
+	size_t reseed_counter;
+	uint8_t buf[DRBG_BUF_SIZE];
+	/* Offset of the first unused byte in buf */
+	size_t buf_pos;
+};
+
+static struct drbg_state drbg_states[CFG_NUM_THREADS];
+
+/* V = V + n, V is a big endian 128-bit number */
+static void add_v(struct drbg_state *s, size_t n)
+{
+	size_t i = DRBG_BLOCK_SIZE;
+	unsigned int c = 0;
+
+	while (i && (n || c)) {
+		i--;
+		c += s->v[i] + (n & 0xff);
+		s->v[i] = c;
+		c >>= 8;
+		n >>= 8;
+	}
+}
+
+/*
+ * Encrypts buf in place with AES-CTR under the current key starting at
+ * counter V + 1, as the concatenated E(Key, V + i) of the generate and
+ * update functions. V is left at V + 1.
+ */
+static TEE_Result ctr_crypt(struct drbg_state *s, uint8_t *buf, size_t len)
+{
+	uint8_t iv[DRBG_BLOCK_SIZE];
+	TEE_Result res;
+
+	add_v(s, 1);
+	memcpy(iv, s->v, sizeof(iv));
+
+	res = crypto_cipher_init(s->ctx, DRBG_ALGO, TEE_MODE_ENCRYPT, s->key,
+				 sizeof(s->key), NULL, 0, iv, sizeof(iv));
+	if (res)
+		return res;
+	res = crypto_cipher_update(s->ctx, DRBG_ALGO, TEE_MODE_ENCRYPT, true,
+				   buf, len, buf);
+	crypto_cipher_final(s->ctx, DRBG_ALGO);
+	return res;
+}
+
+/* CTR_DRBG_Update(), provided_data is NULL for an all zero string */
+static TEE_Result drbg_update(struct drbg_state *s,
+			      const uint8_t *provided_data)
+{
+	uint8_t temp[DRBG_SEED_SIZE];
+	TEE_Result res;
+
+	if (provided_data)
+		memcpy(temp, provided_data, sizeof(temp));
+	else
+		memset(temp, 0, sizeof(temp));
+
+	/* V is replaced below, no need to step it past the used blocks */
+	res = ctr_crypt(s, temp, sizeof(temp));
+	if (!res) {
+		memcpy(s->key, temp, DRBG_KEY_SIZE);
+		memcpy(s->v, temp + DRBG_KEY_SIZE, DRBG_BLOCK_SIZE);
+	}
+
+	memset(temp, 0, sizeof(temp));
+	return res;
+}
+
+/* CTR_DRBG_Reseed_algorithm(), also instantiates with Key = V = 0 */
+static TEE_Result drbg_reseed(struct drbg_state *s)
+{
+	uint8_t seed[DRBG_SEED_SIZE];
+	TEE_Result res;
+
+	res = hw_get_random_bytes(seed, sizeof(seed));
+	if (!res)
+		res = drbg_update(s, seed);
+	memset(seed, 0, sizeof(seed));
+	if (res)
+		return res;
+
+	s->reseed_counter = 1;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result drbg_instantiate(struct drbg_state *s)
+{
+	TEE_Result res;
+
+	if (!s->ctx) {
+		res = crypto_cipher_alloc_ctx(&s->ctx, DRBG_ALGO);
+		if (res)
+			return res;
+	}
+
+	memset(s->key, 0, sizeof(s->key));
+	memset(s->v, 0, sizeof(s->v));
+	s->buf_pos = sizeof(s->buf);
+	return drbg_reseed(s);
+}
+
+/* CTR_DRBG_Generate_algorithm() without additional input */
+static TEE_Result drbg_generate(struct drbg_state *s, uint8_t *out,
+				size_t len)
+{
+	TEE_Result res;
+
+	if (s->reseed_counter > DRBG_RESEED_INTERVAL) {
+		res = drbg_reseed(s);
+		if (res)
+			return res;
+	}
+
+	memset(out, 0, len);
+	res = ctr_crypt(s, out, len);
+	if (res)
+		return res;
+	/* ctr_crypt() stepped V once, step past the remaining blocks */
+	add_v(s, ROUNDUP(len, DRBG_BLOCK_SIZE) / DRBG_BLOCK_SIZE - 1);
+
+	res = drbg_update(s, NULL);
+	if (res)
+		return res;
+
+	s->reseed_counter++;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result drbg_read(struct drbg_state *s, uint8_t *buf, size_t len)
+{
+	TEE_Result res;
+	size_t n;
+
+	while (len) {
+		if (len >= DRBG_BUF_SIZE) {
+			/* Large requests go straight to the destination */
+			n = MIN(len, (size_t)DRBG_MAX_REQUEST);
+			res = drbg_generate(s, buf, n);
+			if (res)
+				return res;
+		} else {
+			if (s->buf_pos == sizeof(s->buf)) {
+				res = drbg_generate(s, s->buf, sizeof(s->buf));
+				if (res)
+					return res;
+				s->buf_pos = 0;
+			}
+			n = MIN(len, sizeof(s->buf) - s->buf_pos);
+			memcpy(buf, s->buf + s->buf_pos, n);
+			memset(s->buf + s->buf_pos, 0, n);
+			s->buf_pos += n;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_cryp_drbg_read(void *buf, size_t len)
+{
+	int thread_id = thread_get_id_may_fail();
+	struct drbg_state *s;
+	TEE_Result res;
+
+	/*
+	 * Outside of a thread (early boot) there's no instance to use, the
+	 * platform source is read directly.
+	 */
+	if (thread_id < 0)
+		return hw_get_random_bytes(buf, len);
+
+	s = drbg_states + thread_id;
+	if (!s->reseed_counter) {
+		res = drbg_instantiate(s);
+		if (res) {
+			EMSG("DRBG instantiation failed: %#" PRIx32, res);
+			return res;
+		}
+	}
+
+	res = drbg_read(s, buf, len);
+	if (res) {
+		/* Start over with a fresh instance on the next request */
+		s->reseed_counter = 0;
+		memset(s->buf, 0, sizeof(s->buf));
+	}
+	return res;
+}
@@ -10,23 +10,21 @@
 #include <stdlib.h>
 #include <string_ext.h>
 #include <string.h>
+#include <tee/tee_cryp_drbg.h>
 #include <tee/tee_cryp_utl.h>
 #include <utee_defines.h>
 
 #if !defined(CFG_WITH_SOFTWARE_PRNG)
 TEE_Result get_rng_array(void *buffer, int len)
 {
-	char *buf_char = buffer;
-	int i;
-
-
-	if (buf_char == NULL)
+	if (buffer == NULL || len < 0)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	for (i = 0; i < len; i++)
-		buf_char[i] = hw_get_random_byte();
-
-	return TEE_SUCCESS;
+#if defined(CFG_HW_RNG_DRBG)
+	return tee_cryp_drbg_read(buffer, len);
+#else
+	return hw_get_random_bytes(buffer, len);
+#endif
 }
 #endif
 
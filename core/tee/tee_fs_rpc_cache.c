@@ -11,6 +11,7 @@
 
 void tee_fs_rpc_cache_clear(struct thread_specific_data *tsd)
 {
+	tsd->rpc_fs_payload_gen++;
 	if (tsd->rpc_fs_payload) {
 		thread_rpc_free_payload(tsd->rpc_fs_payload_cookie,
 					tsd->rpc_fs_payload_mobj);
@@ -32,6 +33,8 @@ void *tee_fs_rpc_cache_alloc(size_t size, struct mobj **mobj, uint64_t *cookie)
 	if (!size)
 		return NULL;
 
+	tsd->rpc_fs_payload_gen++;
+
 	/*
 	 * Always allocate in page chunks as normal world allocates payload
 	 * memory as complete pages.
@@ -68,3 +71,8 @@ err:
 	thread_rpc_free_payload(c, *mobj);
 	return NULL;
 }
+
+uint32_t tee_fs_rpc_cache_get_gen(void)
+{
+	return thread_get_tsd()->rpc_fs_payload_gen;
+}
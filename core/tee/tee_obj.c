@@ -5,6 +5,9 @@
 
 #include <tee/tee_obj.h>
 
+#include <kernel/handle.h>
+#include <kernel/slab.h>
+#include <kernel/user_ta.h>
 #include <stdlib.h>
 #include <tee_api_defines.h>
 #include <mm/tee_mmu.h>
@@ -14,28 +17,36 @@
 #include <tee/tee_svc_storage.h>
 #include <tee/tee_svc_cryp.h>
 
-void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
+static struct slab_cache tee_obj_cache =
+	SLAB_CACHE_INITIALIZER("tee_obj", sizeof(struct tee_obj), NULL);
+
+TEE_Result tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
 {
+	int handle = handle_get(&utc->object_db, o);
+
+	if (handle < 0)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	o->handle = handle;
 	TAILQ_INSERT_TAIL(&utc->objects, o, link);
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 		       struct tee_obj **obj)
 {
-	struct tee_obj *o;
+	struct tee_obj *o = handle_lookup(&utc->object_db, obj_id);
 
-	TAILQ_FOREACH(o, &utc->objects, link) {
-		if (obj_id == (vaddr_t)o) {
-			*obj = o;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	if (!o)
+		return TEE_ERROR_BAD_PARAMETERS;
+	*obj = o;
+	return TEE_SUCCESS;
 }
 
 void tee_obj_close(struct user_ta_ctx *utc, struct tee_obj *o)
 {
 	TAILQ_REMOVE(&utc->objects, o, link);
+	handle_put(&utc->object_db, o->handle);
 
 	if ((o->info.handleFlags & TEE_HANDLE_FLAG_PERSISTENT)) {
 		o->pobj->fops->close(&o->fh);
@@ -75,7 +86,7 @@ TEE_Result tee_obj_verify(struct tee_ta_session *sess, struct tee_obj *o)
 
 struct tee_obj *tee_obj_alloc(void)
 {
-	return calloc(1, sizeof(struct tee_obj));
+	return slab_alloc(&tee_obj_cache);
 }
 
 void tee_obj_free(struct tee_obj *o)
@@ -83,6 +94,6 @@ void tee_obj_free(struct tee_obj *o)
 	if (o) {
 		tee_obj_attr_free(o);
 		free(o->attr);
-		free(o);
+		slab_free(&tee_obj_cache, o);
 	}
 }
@@ -11,7 +11,7 @@
 
 static TAILQ_HEAD(tee_pobjs, tee_pobj) tee_pobjs =
 		TAILQ_HEAD_INITIALIZER(tee_pobjs);
-static struct mutex pobjs_mutex = MUTEX_INITIALIZER;
+static struct mutex pobjs_mutex = MUTEX_INITIALIZER_NAMED("pobjs_mutex");
 
 static TEE_Result tee_pobj_check_access(uint32_t oflags, uint32_t nflags)
 {
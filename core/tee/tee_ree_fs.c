@@ -28,11 +28,37 @@
 
 #define BLOCK_SIZE	(1 << BLOCK_SHIFT)
 
+/* Max number of data blocks fetched with a single RPC */
+#define READ_AHEAD_BLOCKS	8
+
 struct tee_fs_fd {
 	struct tee_fs_htree *ht;
 	int fd;
 	struct tee_fs_dirfile_fileh dfh;
 	const TEE_UUID *uuid;
+	struct mutex mutex;	/* Serializes I/O through @ht */
+	/*
+	 * While an existing file is opened its header and node images are
+	 * read one physical block at a time into @meta_blk, the htree
+	 * reads the individual elements from there. This replaces one RPC
+	 * per node with one RPC per physical block of node images.
+	 */
+	uint8_t *meta_blk;
+	size_t meta_blk_pbn;
+	size_t meta_blk_len;	/* Valid bytes in @meta_blk, 0 if none */
+	/*
+	 * Data blocks fetched by ree_fs_rpc_read_ahead() stay in the FS
+	 * RPC memory of the thread which fetched them. They can be used
+	 * as long as that memory isn't used for anything else, that is,
+	 * while @span_gen matches tee_fs_rpc_cache_get_gen() in thread
+	 * @span_thread_id.
+	 */
+	uint8_t *span;
+	size_t span_pbn;
+	size_t span_len;	/* Valid bytes in @span, 0 if none */
+	int span_thread_id;
+	uint32_t span_gen;
+	size_t next_block_num;	/* Block after the last one read */
 };
 
 struct tee_fs_dir {
@@ -47,31 +73,60 @@ static int pos_to_block_num(int position)
 	return position >> BLOCK_SHIFT;
 }
 
-static struct mutex ree_fs_mutex = MUTEX_INITIALIZER;
+/*
+ * Locking
+ *
+ * Each open file has its own mutex which is held while the hash tree of
+ * the file is accessed, so reads and writes of different files can
+ * proceed in parallel on different threads.
+ *
+ * @ree_fs_dirh_lock protects the content of dirf.db. Lookups take it as
+ * a reader while anything that updates dirf.db takes it as a writer.
+ * Reading dirf.db also takes the mutex of its file handle so concurrent
+ * lookups never access the hash tree at the same time.
+ *
+ * @ree_fs_dirh_ref_mutex protects @ree_fs_dirh and its reference
+ * counter, see get_dirh() and put_dirh().
+ *
+ * Lock order: file mutex, @ree_fs_dirh_lock, dirf.db file mutex,
+ * @ree_fs_dirh_ref_mutex.
+ */
+static struct mutex ree_fs_dirh_lock =
+	MUTEX_INITIALIZER_NAMED("ree_fs_dirh_lock");
+static struct mutex ree_fs_dirh_ref_mutex = MUTEX_INITIALIZER;
 
 #ifdef CFG_WITH_PAGER
-static void *ree_fs_tmp_block;
-static bool ree_fs_tmp_block_busy;
+/*
+ * One temporary block per thread, a thread never uses more than one at a
+ * time and they don't have to be shared between threads operating on
+ * different files.
+ */
+static void *ree_fs_tmp_block[CFG_NUM_THREADS];
+static bool ree_fs_tmp_block_busy[CFG_NUM_THREADS];
 
 static void *get_tmp_block(void)
 {
-	assert(!ree_fs_tmp_block_busy);
-	if (!ree_fs_tmp_block)
-		ree_fs_tmp_block = tee_pager_alloc(BLOCK_SIZE,
-						   TEE_MATTR_LOCKED);
+	int id = thread_get_id();
 
-	if (ree_fs_tmp_block)
-		ree_fs_tmp_block_busy = true;
+	assert(!ree_fs_tmp_block_busy[id]);
+	if (!ree_fs_tmp_block[id])
+		ree_fs_tmp_block[id] = tee_pager_alloc(BLOCK_SIZE,
+						       TEE_MATTR_LOCKED);
 
-	return ree_fs_tmp_block;
+	if (ree_fs_tmp_block[id])
+		ree_fs_tmp_block_busy[id] = true;
+
+	return ree_fs_tmp_block[id];
 }
 
 static void put_tmp_block(void *tmp_block)
 {
-	assert(ree_fs_tmp_block_busy);
-	assert(tmp_block == ree_fs_tmp_block);
+	int id = thread_get_id();
+
+	assert(ree_fs_tmp_block_busy[id]);
+	assert(tmp_block == ree_fs_tmp_block[id]);
 	tee_pager_release_phys(tmp_block, BLOCK_SIZE);
-	ree_fs_tmp_block_busy = false;
+	ree_fs_tmp_block_busy[id] = false;
 }
 #else
 static void *get_tmp_block(void)
@@ -107,7 +162,9 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 		if (size_to_write + offset > BLOCK_SIZE)
 			size_to_write = BLOCK_SIZE - offset;
 
-		if (start_block_num * BLOCK_SIZE <
+		/* A block which is completely overwritten isn't read first */
+		if (size_to_write < BLOCK_SIZE &&
+		    start_block_num * BLOCK_SIZE <
 		    ROUNDUP(meta->length, BLOCK_SIZE)) {
 			res = tee_fs_htree_read_block(&fdp->ht,
 						      start_block_num, block);
@@ -228,6 +285,114 @@ static TEE_Result get_offs_size(enum tee_fs_htree_type type, size_t idx,
 	}
 }
 
+static TEE_Result read_meta_blk(struct tee_fs_fd *fdp, size_t pbn)
+{
+	TEE_Result res;
+	struct tee_fs_rpc_operation op;
+	size_t bytes;
+	void *p;
+
+	fdp->meta_blk_len = 0;
+
+	res = tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
+				   pbn * BLOCK_SIZE, BLOCK_SIZE, &p);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = tee_fs_rpc_read_final(&op, &bytes);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (bytes > BLOCK_SIZE)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	memcpy(fdp->meta_blk, p, bytes);
+	fdp->meta_blk_pbn = pbn;
+	fdp->meta_blk_len = bytes;
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * An operation with no parameters is served from fdp->meta_blk, the
+ * number of bytes available is stored in params[0].u.value.a.
+ */
+static TEE_Result meta_blk_read_init(struct tee_fs_fd *fdp,
+				     struct tee_fs_rpc_operation *op,
+				     size_t offs, size_t size, void **data)
+{
+	TEE_Result res;
+	size_t pbn = offs / BLOCK_SIZE;
+	size_t blk_offs = offs % BLOCK_SIZE;
+
+	if (!fdp->meta_blk_len || fdp->meta_blk_pbn != pbn) {
+		res = read_meta_blk(fdp, pbn);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	memset(op, 0, sizeof(*op));
+	if (blk_offs < fdp->meta_blk_len)
+		op->params[0].u.value.a = MIN(size,
+					      fdp->meta_blk_len - blk_offs);
+	*data = fdp->meta_blk + blk_offs;
+
+	return TEE_SUCCESS;
+}
+
+static bool span_has(struct tee_fs_fd *fdp, size_t offs, size_t size)
+{
+	size_t span_offs = fdp->span_pbn * BLOCK_SIZE;
+
+	return fdp->span_len && fdp->span_thread_id == thread_get_id() &&
+	       fdp->span_gen == tee_fs_rpc_cache_get_gen() &&
+	       offs >= span_offs && offs + size <= span_offs + fdp->span_len;
+}
+
+static void ree_fs_rpc_read_ahead(void *aux, size_t idx, size_t num)
+{
+	struct tee_fs_fd *fdp = aux;
+	struct tee_fs_rpc_operation op;
+	size_t first_offs;
+	size_t last_offs;
+	size_t offs;
+	size_t bytes;
+	size_t size;
+	void *p;
+
+	/* A single block is cheaper to read on its own */
+	if (num < 2)
+		return;
+
+	num = MIN(num, (size_t)READ_AHEAD_BLOCKS);
+	if (get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx, 0, &first_offs,
+			  &size) ||
+	    get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx, 1, &offs, &size) ||
+	    get_offs_size(TEE_FS_HTREE_TYPE_BLOCK, idx + num - 1, 1,
+			  &last_offs, &size))
+		return;
+
+	/* Both versions of the first block are there already */
+	if (span_has(fdp, first_offs, size) && span_has(fdp, offs, size))
+		return;
+
+	/*
+	 * Both versions of each block and any node blocks in between are
+	 * fetched. The extra data is cheap compared to one RPC per block.
+	 */
+	fdp->span_len = 0;
+	if (tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
+				 first_offs, last_offs + size - first_offs,
+				 &p) ||
+	    tee_fs_rpc_read_final(&op, &bytes))
+		return;
+
+	fdp->span = p;
+	fdp->span_pbn = first_offs / BLOCK_SIZE;
+	fdp->span_len = MIN(bytes, last_offs + size - first_offs);
+	fdp->span_thread_id = thread_get_id();
+	fdp->span_gen = tee_fs_rpc_cache_get_gen();
+}
+
 static TEE_Result ree_fs_rpc_read_init(void *aux,
 				       struct tee_fs_rpc_operation *op,
 				       enum tee_fs_htree_type type, size_t idx,
@@ -242,10 +407,31 @@ static TEE_Result ree_fs_rpc_read_init(void *aux,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	if (fdp->meta_blk && type != TEE_FS_HTREE_TYPE_BLOCK)
+		return meta_blk_read_init(fdp, op, offs, size, data);
+
+	if (type == TEE_FS_HTREE_TYPE_BLOCK && span_has(fdp, offs, size)) {
+		memset(op, 0, sizeof(*op));
+		op->params[0].u.value.a = size;
+		*data = fdp->span + offs - fdp->span_pbn * BLOCK_SIZE;
+		return TEE_SUCCESS;
+	}
+
 	return tee_fs_rpc_read_init(op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
 				    offs, size, data);
 }
 
+static TEE_Result ree_fs_rpc_read_final(struct tee_fs_rpc_operation *op,
+					size_t *bytes)
+{
+	if (!op->num_params) {
+		*bytes = op->params[0].u.value.a;
+		return TEE_SUCCESS;
+	}
+
+	return tee_fs_rpc_read_final(op, bytes);
+}
+
 static TEE_Result ree_fs_rpc_write_init(void *aux,
 					struct tee_fs_rpc_operation *op,
 					enum tee_fs_htree_type type, size_t idx,
@@ -260,6 +446,10 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 	if (res != TEE_SUCCESS)
 		return res;
 
+	/* Don't let later reads see stale data */
+	if (fdp->meta_blk_len && fdp->meta_blk_pbn == offs / BLOCK_SIZE)
+		fdp->meta_blk_len = 0;
+
 	return tee_fs_rpc_write_init(op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
 				     offs, size, data);
 }
@@ -267,16 +457,21 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 static const struct tee_fs_htree_storage ree_fs_storage_ops = {
 	.block_size = BLOCK_SIZE,
 	.rpc_read_init = ree_fs_rpc_read_init,
-	.rpc_read_final = tee_fs_rpc_read_final,
+	.rpc_read_final = ree_fs_rpc_read_final,
 	.rpc_write_init = ree_fs_rpc_write_init,
 	.rpc_write_final = tee_fs_rpc_write_final,
+	.rpc_read_ahead = ree_fs_rpc_read_ahead,
 };
 
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
 					    tee_fs_off_t new_file_len)
 {
 	TEE_Result res;
-	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
+	struct tee_fs_htree_meta *meta;
+
+	if (!fdp->ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
+	meta = tee_fs_htree_get_meta(fdp->ht);
 
 	if ((size_t)new_file_len > meta->length) {
 		size_t ext_len = new_file_len - meta->length;
@@ -318,10 +513,16 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 	int start_block_num;
 	int end_block_num;
 	size_t remain_bytes;
+	size_t read_ahead = 0;
 	uint8_t *data_ptr = buf;
 	uint8_t *block = NULL;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
-	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
+	struct tee_fs_htree_meta *meta;
+
+	/* The hash tree is closed if a previous access failed */
+	if (!fdp->ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
+	meta = tee_fs_htree_get_meta(fdp->ht);
 
 	remain_bytes = *len;
 	if ((pos + remain_bytes) < remain_bytes || pos > meta->length)
@@ -345,6 +546,15 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 		goto exit;
 	}
 
+	/*
+	 * If the file is read sequentially fetch more blocks than needed
+	 * right now, the next read of this file on this thread can use
+	 * them without an RPC.
+	 */
+	if ((size_t)start_block_num == fdp->next_block_num)
+		read_ahead = READ_AHEAD_BLOCKS;
+	fdp->next_block_num = end_block_num + 1;
+
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_read = MIN(remain_bytes, (size_t)BLOCK_SIZE);
@@ -352,6 +562,10 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 		if (size_to_read + offset > BLOCK_SIZE)
 			size_to_read = BLOCK_SIZE - offset;
 
+		tee_fs_htree_read_ahead(fdp->ht, start_block_num,
+					MAX((size_t)(end_block_num -
+						     start_block_num + 1),
+					    read_ahead));
 		res = tee_fs_htree_read_block(&fdp->ht, start_block_num, block);
 		if (res != TEE_SUCCESS)
 			goto exit;
@@ -375,10 +589,11 @@ static TEE_Result ree_fs_read(struct tee_file_handle *fh, size_t pos,
 			      void *buf, size_t *len)
 {
 	TEE_Result res;
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&fdp->mutex);
 	res = ree_fs_read_primitive(fh, pos, buf, len);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&fdp->mutex);
 
 	return res;
 }
@@ -393,6 +608,8 @@ static TEE_Result ree_fs_write_primitive(struct tee_file_handle *fh, size_t pos,
 	if (!len)
 		return TEE_SUCCESS;
 
+	if (!fdp->ht)
+		return TEE_ERROR_CORRUPT_OBJECT;
 	file_size = tee_fs_htree_get_meta(fdp->ht)->length;
 
 	if ((pos + len) < len)
@@ -420,6 +637,7 @@ static TEE_Result ree_fs_open_primitive(bool create, uint8_t *hash,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	fdp->fd = -1;
 	fdp->uuid = uuid;
+	mutex_init(&fdp->mutex);
 
 	if (create)
 		res = tee_fs_rpc_create_dfh(OPTEE_MSG_RPC_CMD_FS,
@@ -430,8 +648,17 @@ static TEE_Result ree_fs_open_primitive(bool create, uint8_t *hash,
 	if (res != TEE_SUCCESS)
 		goto out;
 
+	/* If the allocation fails the metadata is read element by element */
+	if (!create)
+		fdp->meta_blk = malloc(BLOCK_SIZE);
+
 	res = tee_fs_htree_open(create, hash, uuid, &ree_fs_storage_ops,
 				fdp, &fdp->ht);
+
+	/* All metadata is kept in the htree once it's open */
+	free(fdp->meta_blk);
+	fdp->meta_blk = NULL;
+	fdp->meta_blk_len = 0;
 out:
 	if (res == TEE_SUCCESS) {
 		if (dfh)
@@ -475,10 +702,16 @@ static TEE_Result ree_dirf_commit_writes(struct tee_file_handle *fh,
 	return res;
 }
 
+/*
+ * Lookups in dirf.db can run in parallel while holding @ree_fs_dirh_lock
+ * as a reader, so reads go through ree_fs_read() which takes the mutex of
+ * the file handle. Writes and commits are done with @ree_fs_dirh_lock
+ * held as a writer and need nothing more.
+ */
 static const struct tee_fs_dirfile_operations ree_dirf_ops = {
 	.open = ree_fs_open_primitive,
 	.close = ree_fs_close_primitive,
-	.read = ree_fs_read_primitive,
+	.read = ree_fs_read,
 	.write = ree_fs_write_primitive,
 	.commit_writes = ree_dirf_commit_writes,
 };
@@ -560,23 +793,30 @@ static void close_dirh(struct tee_fs_dirfile_dirh **dirh)
 
 static TEE_Result get_dirh(struct tee_fs_dirfile_dirh **dirh)
 {
-	if (!ree_fs_dirh) {
-		TEE_Result res = open_dirh(&ree_fs_dirh);
+	TEE_Result res = TEE_SUCCESS;
 
+	mutex_lock(&ree_fs_dirh_ref_mutex);
+	if (!ree_fs_dirh) {
+		res = open_dirh(&ree_fs_dirh);
 		if (res) {
 			*dirh = NULL;
-			return res;
+			goto out;
 		}
 	}
 	ree_fs_dirh_refcount++;
 	assert(ree_fs_dirh);
 	assert(ree_fs_dirh_refcount);
 	*dirh = ree_fs_dirh;
-	return TEE_SUCCESS;
+out:
+	mutex_unlock(&ree_fs_dirh_ref_mutex);
+
+	return res;
 }
 
 static void put_dirh_primitive(bool close)
 {
+	mutex_lock(&ree_fs_dirh_ref_mutex);
+
 	assert(ree_fs_dirh_refcount);
 
 	/*
@@ -590,10 +830,15 @@ static void put_dirh_primitive(bool close)
 	 * But in the ree_fs_close() case there's no call to get_dirh()
 	 * only to this function, put_dirh_primitive(), and in this case
 	 * ree_fs_dirh may actually be NULL.
+	 *
+	 * A put with close=1 is only done with ree_fs_dirh_lock held as a
+	 * writer so no other thread can be using ree_fs_dirh at that time.
 	 */
 	ree_fs_dirh_refcount--;
 	if (ree_fs_dirh && (!ree_fs_dirh_refcount || close))
 		close_dirh(&ree_fs_dirh);
+
+	mutex_unlock(&ree_fs_dirh_ref_mutex);
 }
 
 static void put_dirh(struct tee_fs_dirfile_dirh *dirh, bool close)
@@ -611,7 +856,7 @@ static TEE_Result ree_fs_open(struct tee_pobj *po, size_t *size,
 	struct tee_fs_dirfile_dirh *dirh = NULL;
 	struct tee_fs_dirfile_fileh dfh;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_read_lock(&ree_fs_dirh_lock);
 
 	res = get_dirh(&dirh);
 	if (res != TEE_SUCCESS)
@@ -638,7 +883,7 @@ static TEE_Result ree_fs_open(struct tee_pobj *po, size_t *size,
 out:
 	if (res)
 		put_dirh(dirh, false);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_read_unlock(&ree_fs_dirh_lock);
 
 	return res;
 }
@@ -683,10 +928,7 @@ static TEE_Result set_name(struct tee_fs_dirfile_dirh *dirh,
 static void ree_fs_close(struct tee_file_handle **fh)
 {
 	if (*fh) {
-		mutex_lock(&ree_fs_mutex);
 		put_dirh_primitive(false);
-		mutex_unlock(&ree_fs_mutex);
-
 		ree_fs_close_primitive(*fh);
 		*fh = NULL;
 	}
@@ -705,7 +947,14 @@ static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 	size_t pos = 0;
 
 	*fh = NULL;
-	mutex_lock(&ree_fs_mutex);
+
+	/*
+	 * The temporary file number is only reserved in the in-memory
+	 * state of dirf.db so the lock is held until the file is named.
+	 * The new file isn't visible to anyone else so it's written
+	 * without taking its mutex.
+	 */
+	mutex_lock(&ree_fs_dirh_lock);
 
 	res = get_dirh(&dirh);
 	if (res)
@@ -754,39 +1003,56 @@ out:
 			tee_fs_rpc_remove_dfh(OPTEE_MSG_RPC_CMD_FS, &dfh);
 		}
 	}
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&ree_fs_dirh_lock);
 
 	return res;
 }
 
-static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
-			       const void *buf, size_t len)
+/*
+ * Records the new hash of a file in dirf.db after the file has been
+ * synced to storage, called with the mutex of the file held.
+ */
+static TEE_Result update_dirh_hash(struct tee_fs_fd *fdp)
 {
 	TEE_Result res;
 	struct tee_fs_dirfile_dirh *dirh = NULL;
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dirh_lock);
 
 	res = get_dirh(&dirh);
 	if (res)
 		goto out;
 
-	res = ree_fs_write_primitive(fh, pos, buf, len);
+	res = tee_fs_dirfile_update_hash(dirh, &fdp->dfh);
 	if (res)
 		goto out;
+	res = commit_dirh_writes(dirh);
+out:
+	put_dirh(dirh, res);
+	mutex_unlock(&ree_fs_dirh_lock);
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	return res;
+}
+
+static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
+			       const void *buf, size_t len)
+{
+	TEE_Result res;
+	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+
+	mutex_lock(&fdp->mutex);
+
+	res = ree_fs_write_primitive(fh, pos, buf, len);
 	if (res)
 		goto out;
 
-	res = tee_fs_dirfile_update_hash(dirh, &fdp->dfh);
+	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
 	if (res)
 		goto out;
-	res = commit_dirh_writes(dirh);
+
+	res = update_dirh_hash(fdp);
 out:
-	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&fdp->mutex);
 
 	return res;
 }
@@ -802,7 +1068,7 @@ static TEE_Result ree_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 	if (!new)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dirh_lock);
 	res = get_dirh(&dirh);
 	if (res)
 		goto out;
@@ -839,7 +1105,7 @@ static TEE_Result ree_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 
 out:
 	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&ree_fs_dirh_lock);
 
 	return res;
 
@@ -851,7 +1117,7 @@ static TEE_Result ree_fs_remove(struct tee_pobj *po)
 	struct tee_fs_dirfile_dirh *dirh = NULL;
 	struct tee_fs_dirfile_fileh dfh;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dirh_lock);
 	res = get_dirh(&dirh);
 	if (res)
 		goto out;
@@ -875,7 +1141,7 @@ static TEE_Result ree_fs_remove(struct tee_pobj *po)
 				   &dfh));
 out:
 	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&ree_fs_dirh_lock);
 
 	return res;
 }
@@ -883,14 +1149,9 @@ out:
 static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 {
 	TEE_Result res;
-	struct tee_fs_dirfile_dirh *dirh = NULL;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
-	mutex_lock(&ree_fs_mutex);
-
-	res = get_dirh(&dirh);
-	if (res)
-		goto out;
+	mutex_lock(&fdp->mutex);
 
 	res = ree_fs_ftruncate_internal(fdp, len);
 	if (res)
@@ -900,13 +1161,9 @@ static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 	if (res)
 		goto out;
 
-	res = tee_fs_dirfile_update_hash(dirh, &fdp->dfh);
-	if (res)
-		goto out;
-	res = commit_dirh_writes(dirh);
+	res = update_dirh_hash(fdp);
 out:
-	put_dirh(dirh, res);
-	mutex_unlock(&ree_fs_mutex);
+	mutex_unlock(&fdp->mutex);
 
 	return res;
 }
@@ -923,7 +1180,7 @@ static TEE_Result ree_fs_opendir_rpc(const TEE_UUID *uuid,
 
 	d->uuid = uuid;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_read_lock(&ree_fs_dirh_lock);
 
 	res = get_dirh(&d->dirh);
 	if (res)
@@ -944,7 +1201,7 @@ out:
 			put_dirh(d->dirh, false);
 		free(d);
 	}
-	mutex_unlock(&ree_fs_mutex);
+	mutex_read_unlock(&ree_fs_dirh_lock);
 
 	return res;
 }
@@ -952,12 +1209,12 @@ out:
 static void ree_fs_closedir_rpc(struct tee_fs_dir *d)
 {
 	if (d) {
-		mutex_lock(&ree_fs_mutex);
+		mutex_read_lock(&ree_fs_dirh_lock);
 
 		put_dirh(d->dirh, false);
 		free(d);
 
-		mutex_unlock(&ree_fs_mutex);
+		mutex_read_unlock(&ree_fs_dirh_lock);
 	}
 }
 
@@ -966,7 +1223,7 @@ static TEE_Result ree_fs_readdir_rpc(struct tee_fs_dir *d,
 {
 	TEE_Result res;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_read_lock(&ree_fs_dirh_lock);
 
 	d->d.oidlen = sizeof(d->d.oid);
 	res = tee_fs_dirfile_get_next(d->dirh, d->uuid, &d->idx, d->d.oid,
@@ -974,7 +1231,7 @@ static TEE_Result ree_fs_readdir_rpc(struct tee_fs_dir *d,
 	if (res == TEE_SUCCESS)
 		*ent = &d->d;
 
-	mutex_unlock(&ree_fs_mutex);
+	mutex_read_unlock(&ree_fs_dirh_lock);
 
 	return res;
 }
@@ -75,6 +75,8 @@ struct rpmb_file_handle {
 	char filename[TEE_RPMB_FS_FILENAME_LENGTH];
 	/* Address for current entry in RPMB */
 	uint32_t rpmb_fat_address;
+	/* Generation of the FAT mirror entry fat_entry was read from */
+	uint32_t fat_gen;
 };
 
 /**
@@ -238,7 +240,7 @@ static struct tee_rpmb_ctx *rpmb_ctx;
  * It protects rpmb_ctx and prevents overlapping operations on eMMC devices with
  * different IDs.
  */
-static struct mutex rpmb_mutex = MUTEX_INITIALIZER;
+static struct mutex rpmb_mutex = MUTEX_INITIALIZER_NAMED("rpmb_mutex");
 
 #ifdef CFG_RPMB_TESTKEY
 
@@ -560,14 +562,21 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 	return TEE_SUCCESS;
 }
 
+/*
+ * Builds the request frames one at a time in a private frame and copies
+ * them to the request. For data writes the MAC over all frames is
+ * computed in the same pass and stored in the last frame.
+ */
 static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 				    struct rpmb_raw_data *rawdata,
 				    uint16_t nbr_frms, uint16_t dev_id,
 				    const uint8_t *fek, const TEE_UUID *uuid)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
+	struct rpmb_data_frame *reqfrm = TEE_RPMB_REQ_DATA(req);
+	struct rpmb_data_frame *datafrm = NULL;
+	void *ctx = NULL;
 	int i;
-	struct rpmb_data_frame *datafrm;
 
 	if (!req || !rawdata || !nbr_frms)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -583,78 +592,94 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 		return TEE_ERROR_GENERIC;
 	}
 
+	/* Check the block index is within range. */
+	if (rawdata->blk_idx &&
+	    (*rawdata->blk_idx + nbr_frms) > rpmb_ctx->max_blk_idx)
+		return TEE_ERROR_GENERIC;
+
 	req->cmd = RPMB_CMD_DATA_REQ;
 	req->dev_id = dev_id;
 
-	/* Allocate memory for construct all data packets and calculate MAC. */
-	datafrm = calloc(nbr_frms, RPMB_DATA_FRAME_SIZE);
+	datafrm = malloc(RPMB_DATA_FRAME_SIZE);
 	if (!datafrm)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
+	if (rawdata->key_mac &&
+	    rawdata->msg_type == RPMB_MSG_TYPE_REQ_AUTH_DATA_WRITE) {
+		res = crypto_mac_alloc_ctx(&ctx, TEE_ALG_HMAC_SHA256);
+		if (res)
+			goto func_exit;
+
+		res = crypto_mac_init(ctx, TEE_ALG_HMAC_SHA256, rpmb_ctx->key,
+				      RPMB_KEY_MAC_SIZE);
+		if (res != TEE_SUCCESS)
+			goto func_exit;
+	}
+
 	for (i = 0; i < nbr_frms; i++) {
-		u16_to_bytes(rawdata->msg_type, datafrm[i].msg_type);
+		memset(datafrm, 0, RPMB_DATA_FRAME_SIZE);
+
+		u16_to_bytes(rawdata->msg_type, datafrm->msg_type);
 
 		if (rawdata->block_count)
 			u16_to_bytes(*rawdata->block_count,
-				     datafrm[i].block_count);
+				     datafrm->block_count);
 
-		if (rawdata->blk_idx) {
-			/* Check the block index is within range. */
-			if ((*rawdata->blk_idx + nbr_frms) >
-			    rpmb_ctx->max_blk_idx) {
-				res = TEE_ERROR_GENERIC;
-				goto func_exit;
-			}
-			u16_to_bytes(*rawdata->blk_idx, datafrm[i].address);
-		}
+		if (rawdata->blk_idx)
+			u16_to_bytes(*rawdata->blk_idx, datafrm->address);
 
 		if (rawdata->write_counter)
 			u32_to_bytes(*rawdata->write_counter,
-				     datafrm[i].write_counter);
+				     datafrm->write_counter);
 
 		if (rawdata->nonce)
-			memcpy(datafrm[i].nonce, rawdata->nonce,
+			memcpy(datafrm->nonce, rawdata->nonce,
 			       RPMB_NONCE_SIZE);
 
 		if (rawdata->data) {
 			if (fek)
-				encrypt_block(datafrm[i].data,
+				encrypt_block(datafrm->data,
 					rawdata->data + (i * RPMB_DATA_SIZE),
 					*rawdata->blk_idx + i, fek, uuid);
 			else
-				memcpy(datafrm[i].data,
+				memcpy(datafrm->data,
 				       rawdata->data + (i * RPMB_DATA_SIZE),
 				       RPMB_DATA_SIZE);
 		}
-	}
 
-	if (rawdata->key_mac) {
-		if (rawdata->msg_type == RPMB_MSG_TYPE_REQ_AUTH_DATA_WRITE) {
-			res =
-			    tee_rpmb_mac_calc(rawdata->key_mac,
-					      RPMB_KEY_MAC_SIZE, rpmb_ctx->key,
-					      RPMB_KEY_MAC_SIZE, datafrm,
-					      nbr_frms);
+		if (ctx) {
+			res = crypto_mac_update(ctx, TEE_ALG_HMAC_SHA256,
+						datafrm->data,
+						RPMB_MAC_PROTECT_DATA_SIZE);
 			if (res != TEE_SUCCESS)
 				goto func_exit;
 		}
-		memcpy(datafrm[nbr_frms - 1].key_mac,
-		       rawdata->key_mac, RPMB_KEY_MAC_SIZE);
-	}
 
-	memcpy(TEE_RPMB_REQ_DATA(req), datafrm,
-	       nbr_frms * RPMB_DATA_FRAME_SIZE);
+		if (rawdata->key_mac && i == nbr_frms - 1) {
+			if (ctx) {
+				res = crypto_mac_final(ctx,
+						       TEE_ALG_HMAC_SHA256,
+						       rawdata->key_mac,
+						       RPMB_KEY_MAC_SIZE);
+				if (res != TEE_SUCCESS)
+					goto func_exit;
+			}
+			memcpy(datafrm->key_mac, rawdata->key_mac,
+			       RPMB_KEY_MAC_SIZE);
+		}
 
 #ifdef CFG_RPMB_FS_DEBUG_DATA
-	for (i = 0; i < nbr_frms; i++) {
 		DMSG("Dumping data frame %d:", i);
-		DHEXDUMP((uint8_t *)&datafrm[i] + RPMB_STUFF_DATA_SIZE,
+		DHEXDUMP((uint8_t *)datafrm + RPMB_STUFF_DATA_SIZE,
 			 512 - RPMB_STUFF_DATA_SIZE);
-	}
 #endif
 
+		memcpy(reqfrm + i, datafrm, RPMB_DATA_FRAME_SIZE);
+	}
+
 	res = TEE_SUCCESS;
 func_exit:
+	crypto_mac_free_ctx(ctx, TEE_ALG_HMAC_SHA256);
 	free(datafrm);
 	return res;
 }
@@ -1138,10 +1163,15 @@ static TEE_Result tee_rpmb_init(uint16_t dev_id)
 
 		memcpy(rpmb_ctx->cid, dev_info.cid, RPMB_EMMC_CID_SIZE);
 
-#ifdef RPMB_DRIVER_MULTIPLE_WRITE_FIXED
-		rpmb_ctx->rel_wr_blkcnt = dev_info.rel_wr_sec_c * 2;
-#else
 		rpmb_ctx->rel_wr_blkcnt = 1;
+#ifdef CFG_RPMB_WRITE_MULTIPLE_BLOCKS
+		/*
+		 * A reliable write sector holds two data frames. Only pack
+		 * several frames into one request when the device reports
+		 * more than one reliable write sector.
+		 */
+		if (dev_info.rel_wr_sec_c > 1)
+			rpmb_ctx->rel_wr_blkcnt = dev_info.rel_wr_sec_c * 2;
 #endif
 
 		rpmb_ctx->dev_info_synced = true;
@@ -1512,6 +1542,7 @@ func_exit:
 
 static TEE_Result get_fat_start_address(uint32_t *addr);
 
+#if (TRACE_LEVEL >= TRACE_FLOW)
 static void dump_fat(void)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
@@ -1559,6 +1590,11 @@ static void dump_fat(void)
 out:
 	free(fat_entries);
 }
+#else
+static void dump_fat(void)
+{
+}
+#endif
 
 #if (TRACE_LEVEL >= TRACE_DEBUG)
 static void dump_fh(struct rpmb_file_handle *fh)
@@ -1591,8 +1627,150 @@ static struct rpmb_file_handle *alloc_file_handle(struct tee_pobj *po,
 	return fh;
 }
 
+/*
+ * In-memory mirror of the FAT
+ *
+ * The FAT is read from RPMB once and is then kept up to date by
+ * write_fat_entry(), the only function modifying the FAT. Since nothing
+ * but this file writes the RPMB partition the mirror stays coherent until
+ * a FAT update fails, then it's dropped and read again on next use.
+ *
+ * Only what's needed to find a file and to place file data is mirrored,
+ * the filename is represented by a hash and the matching entry is read
+ * from RPMB to confirm it. Each time an entry is written it gets a new
+ * generation number, a file handle holding the entry of the current
+ * generation doesn't need to read it again.
+ *
+ * @entries	mirrored entries, up to and including the last entry
+ * @pool	used areas of the partition, the FAT (@fat_mm) and the
+ *		data of all active files
+ * @gen		last assigned generation number, not reset when the
+ *		mirror is dropped
+ */
+struct rpmb_fat_mirror_entry {
+	uint32_t start_address;
+	uint32_t data_size;
+	uint32_t flags;
+	uint32_t name_hash;
+	uint32_t gen;
+};
+
+struct rpmb_fat_mirror {
+	struct rpmb_fat_mirror_entry *entries;
+	size_t num_entries;
+	size_t max_entries;
+	tee_mm_pool_t pool;
+	tee_mm_entry_t *fat_mm;
+	uint32_t gen;
+	bool valid;
+};
+
+static struct rpmb_fat_mirror fat_mirror;
+
+static uint32_t fat_name_hash(const char *name)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261U;
+	size_t n;
+
+	for (n = 0; n < TEE_RPMB_FS_FILENAME_LENGTH && name[n]; n++) {
+		h ^= (uint8_t)name[n];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static void fat_mirror_invalidate(void)
+{
+	if (fat_mirror.valid)
+		tee_mm_final(&fat_mirror.pool);
+	free(fat_mirror.entries);
+	fat_mirror.entries = NULL;
+	fat_mirror.num_entries = 0;
+	fat_mirror.max_entries = 0;
+	fat_mirror.fat_mm = NULL;
+	fat_mirror.valid = false;
+}
+
+/*
+ * Updates mirrored entry @idx with @fe. Data of the previous file in the
+ * entry is released from the pool and data of the new file is added
+ * unless the caller has allocated it already.
+ */
+static TEE_Result fat_mirror_set(size_t idx, const struct rpmb_fat_entry *fe)
+{
+	struct rpmb_fat_mirror_entry *me = NULL;
+	tee_mm_entry_t *mm = NULL;
+	size_t num = 0;
+
+	if (idx > fat_mirror.num_entries)
+		return TEE_ERROR_GENERIC;
+
+	if (idx == fat_mirror.num_entries) {
+		if (idx == fat_mirror.max_entries) {
+			num = MAX(fat_mirror.max_entries * 2, (size_t)N_ENTRIES);
+			me = realloc(fat_mirror.entries, num * sizeof(*me));
+			if (!me)
+				return TEE_ERROR_OUT_OF_MEMORY;
+			fat_mirror.entries = me;
+			fat_mirror.max_entries = num;
+		}
+		memset(fat_mirror.entries + idx, 0, sizeof(*me));
+		fat_mirror.num_entries++;
+	}
+
+	me = fat_mirror.entries + idx;
+
+	if ((me->flags & FILE_IS_ACTIVE) && me->data_size) {
+		mm = tee_mm_find(&fat_mirror.pool, me->start_address);
+		if (mm && tee_mm_get_smem(mm) == me->start_address)
+			tee_mm_free(mm);
+	}
+
+	if ((fe->flags & FILE_IS_ACTIVE) && fe->data_size &&
+	    !tee_mm_find(&fat_mirror.pool, fe->start_address) &&
+	    !tee_mm_alloc2(&fat_mirror.pool, fe->start_address,
+			   fe->data_size))
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	me->start_address = fe->start_address;
+	me->data_size = fe->data_size;
+	me->flags = fe->flags;
+	me->name_hash = fat_name_hash(fe->filename);
+	me->gen = ++fat_mirror.gen;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result fat_mirror_update(struct rpmb_file_handle *fh)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	size_t idx = 0;
+
+	if (!fat_mirror.valid)
+		return TEE_SUCCESS;
+
+	if (fh->rpmb_fat_address < fs_par->fat_start_address) {
+		fat_mirror_invalidate();
+		return TEE_SUCCESS;
+	}
+
+	idx = (fh->rpmb_fat_address - fs_par->fat_start_address) /
+	      sizeof(struct rpmb_fat_entry);
+	res = fat_mirror_set(idx, &fh->fat_entry);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	fh->fat_gen = fat_mirror.entries[idx].gen;
+
+	return TEE_SUCCESS;
+}
+
 /**
  * write_fat_entry: Store info in a fat_entry to RPMB.
+ * The FAT mirror is updated accordingly, or dropped if the FAT could
+ * not be updated.
  */
 static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 				  bool update_write_counter)
@@ -1620,10 +1798,16 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, fh->rpmb_fat_address,
 			     (uint8_t *)&fh->fat_entry,
 			     sizeof(struct rpmb_fat_entry), NULL, NULL);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = fat_mirror_update(fh);
 
 	dump_fat();
 
 out:
+	if (res != TEE_SUCCESS)
+		fat_mirror_invalidate();
 	return res;
 }
 
@@ -1739,159 +1923,213 @@ static TEE_Result get_fat_start_address(uint32_t *addr)
 	return TEE_SUCCESS;
 }
 
+static uint32_t fat_entry_address(size_t idx)
+{
+	return fs_par->fat_start_address + idx * sizeof(struct rpmb_fat_entry);
+}
+
+/*
+ * Makes sure that the FAT area in the pool covers the first @num_entries
+ * FAT entries.
+ */
+static TEE_Result fat_mirror_reserve(size_t num_entries)
+{
+	size_t old_size = tee_mm_get_bytes(fat_mirror.fat_mm);
+	size_t size = fat_entry_address(num_entries) -
+		      RPMB_STORAGE_START_ADDRESS;
+
+	if (size <= old_size)
+		return TEE_SUCCESS;
+
+	tee_mm_free(fat_mirror.fat_mm);
+	fat_mirror.fat_mm = tee_mm_alloc2(&fat_mirror.pool,
+					  RPMB_STORAGE_START_ADDRESS, size);
+	if (fat_mirror.fat_mm)
+		return TEE_SUCCESS;
+
+	fat_mirror.fat_mm = tee_mm_alloc2(&fat_mirror.pool,
+					  RPMB_STORAGE_START_ADDRESS, old_size);
+	if (!fat_mirror.fat_mm)
+		fat_mirror_invalidate();
+	return TEE_ERROR_OUT_OF_MEMORY;
+}
+
 /**
- * read_fat: Read FAT entries
- * Return matching FAT entry for read, rm rename and stat.
- * Build up memory pool and return matching entry for write operation.
- * "Last FAT entry" can be returned during write.
+ * fat_mirror_load: Read the FAT into the FAT mirror unless already done.
  */
-static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
+static TEE_Result fat_mirror_load(void)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
-	tee_mm_entry_t *mm = NULL;
 	struct rpmb_fat_entry *fat_entries = NULL;
-	uint32_t fat_address;
-	size_t size;
-	int i;
-	bool entry_found = false;
+	uint32_t fat_address = 0;
+	size_t size = 0;
+	size_t idx = 0;
+	size_t i = 0;
 	bool last_entry_found = false;
-	bool expand_fat = false;
-	struct rpmb_file_handle last_fh;
 
-	DMSG("fat_address %d", fh->rpmb_fat_address);
+	if (fat_mirror.valid)
+		return TEE_SUCCESS;
 
 	res = rpmb_fs_setup();
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	res = get_fat_start_address(&fat_address);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
 	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
 	fat_entries = malloc(size);
-	if (!fat_entries) {
+	if (!fat_entries)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	/* Upper memory allocation must be used for RPMB_FS. */
+	if (!tee_mm_init(&fat_mirror.pool, RPMB_STORAGE_START_ADDRESS,
+			 fs_par->max_rpmb_address, RPMB_BLOCK_SIZE_SHIFT,
+			 TEE_MM_POOL_HI_ALLOC)) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out;
 	}
+	fat_mirror.valid = true;
 
-	/*
-	 * The pool is used to represent the current RPMB layout. To find
-	 * a slot for the file tee_mm_alloc is called on the pool. Thus
-	 * if it is not NULL the entire FAT must be traversed to fill in
-	 * the pool.
-	 */
-	while (!last_entry_found && (!entry_found || p)) {
+	while (!last_entry_found) {
 		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
 				    (uint8_t *)fat_entries, size, NULL, NULL);
 		if (res != TEE_SUCCESS)
 			goto out;
 
 		for (i = 0; i < N_ENTRIES; i++) {
-			/*
-			 * Look for an entry, matching filenames. (read, rm,
-			 * rename and stat.). Only store first filename match.
-			 */
-			if (fh->filename &&
-			    (strcmp(fh->filename,
-				    fat_entries[i].filename) == 0) &&
-			    (fat_entries[i].flags & FILE_IS_ACTIVE) &&
-			    (!entry_found)) {
-				entry_found = true;
-				fh->rpmb_fat_address = fat_address;
-				memcpy(&fh->fat_entry, &fat_entries[i],
-				       sizeof(struct rpmb_fat_entry));
-				if (!p)
-					break;
+			res = fat_mirror_set(idx, fat_entries + i);
+			if (res != TEE_SUCCESS)
+				goto out;
+			idx++;
+
+			if (fat_entries[i].flags & FILE_IS_LAST_ENTRY) {
+				last_entry_found = true;
+				break;
 			}
+		}
 
-			/* Add existing files to memory pool. (write) */
-			if (p) {
-				if ((fat_entries[i].flags & FILE_IS_ACTIVE) &&
-				    (fat_entries[i].data_size > 0)) {
+		fat_address += size;
+	}
 
-					mm = tee_mm_alloc2
-						(p,
-						 fat_entries[i].start_address,
-						 fat_entries[i].data_size);
-					if (!mm) {
-						res = TEE_ERROR_OUT_OF_MEMORY;
-						goto out;
-					}
-				}
+	/* Represent the FAT table in the pool. */
+	fat_mirror.fat_mm = tee_mm_alloc2(&fat_mirror.pool,
+					  RPMB_STORAGE_START_ADDRESS,
+					  fat_entry_address(idx) -
+					  RPMB_STORAGE_START_ADDRESS);
+	if (!fat_mirror.fat_mm)
+		res = TEE_ERROR_OUT_OF_MEMORY;
 
-				/* Unused FAT entries can be reused (write) */
-				if (((fat_entries[i].flags & FILE_IS_ACTIVE) ==
-				     0) && (fh->rpmb_fat_address == 0)) {
-					fh->rpmb_fat_address = fat_address;
-					memcpy(&fh->fat_entry, &fat_entries[i],
-					       sizeof(struct rpmb_fat_entry));
-				}
-			}
+out:
+	if (res != TEE_SUCCESS)
+		fat_mirror_invalidate();
+	free(fat_entries);
+	return res;
+}
 
-			if ((fat_entries[i].flags & FILE_IS_LAST_ENTRY) != 0) {
-				last_entry_found = true;
+/**
+ * read_fat: Find the FAT entry of fh->filename
+ * Used by read, write, rm, rename and stat. On success fh->fat_entry and
+ * fh->rpmb_fat_address describe the first active entry with a matching
+ * filename. Only the matching entry is read from RPMB, and not even that
+ * if fh already holds the current version of it.
+ */
+static TEE_Result read_fat(struct rpmb_file_handle *fh)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	struct rpmb_fat_mirror_entry *me = NULL;
+	struct rpmb_fat_entry fe;
+	uint32_t fat_address = 0;
+	uint32_t name_hash = 0;
+	size_t idx = 0;
 
-				/*
-				 * If the last entry was reached and was chosen
-				 * by the previous check, then the FAT needs to
-				 * be expanded.
-				 * fh->rpmb_fat_address is the address chosen
-				 * to store the files FAT entry and fat_address
-				 * is the current FAT entry address being
-				 * compared.
-				 */
-				if (p && fh->rpmb_fat_address == fat_address)
-					expand_fat = true;
-				break;
-			}
+	DMSG("fat_address %d", fh->rpmb_fat_address);
 
-			/* Move to next fat_entry. */
-			fat_address += sizeof(struct rpmb_fat_entry);
+	res = fat_mirror_load();
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (fh->fat_gen && fh->rpmb_fat_address >= fat_entry_address(0)) {
+		idx = (fh->rpmb_fat_address - fat_entry_address(0)) /
+		      sizeof(struct rpmb_fat_entry);
+		if (idx < fat_mirror.num_entries &&
+		    fat_mirror.entries[idx].gen == fh->fat_gen &&
+		    (fh->fat_entry.flags & FILE_IS_ACTIVE) &&
+		    !strncmp(fh->filename, fh->fat_entry.filename,
+			     sizeof(fh->filename)))
+			return TEE_SUCCESS;
+	}
+
+	name_hash = fat_name_hash(fh->filename);
+	for (idx = 0; idx < fat_mirror.num_entries; idx++) {
+		me = fat_mirror.entries + idx;
+
+		if ((me->flags & FILE_IS_ACTIVE) &&
+		    me->name_hash == name_hash) {
+			fat_address = fat_entry_address(idx);
+			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+					    (uint8_t *)&fe, sizeof(fe),
+					    NULL, NULL);
+			if (res != TEE_SUCCESS)
+				return res;
+
+			if (!strncmp(fh->filename, fe.filename,
+				     sizeof(fh->filename))) {
+				fh->rpmb_fat_address = fat_address;
+				fh->fat_entry = fe;
+				fh->fat_gen = me->gen;
+				return TEE_SUCCESS;
+			}
 		}
+
+		if (me->flags & FILE_IS_LAST_ENTRY)
+			break;
 	}
 
-	/*
-	 * Represent the FAT table in the pool.
-	 */
-	if (p) {
-		/*
-		 * Since fat_address is the start of the last entry it needs to
-		 * be moved up by an entry.
-		 */
-		fat_address += sizeof(struct rpmb_fat_entry);
+	return TEE_ERROR_ITEM_NOT_FOUND;
+}
 
-		/* Make room for yet a FAT entry and add to memory pool. */
-		if (expand_fat)
-			fat_address += sizeof(struct rpmb_fat_entry);
+/**
+ * alloc_fat_entry: Choose an unused FAT entry for a new file
+ * If the last entry is chosen the FAT is expanded by writing a new last
+ * entry after it.
+ */
+static TEE_Result alloc_fat_entry(struct rpmb_file_handle *fh)
+{
+	TEE_Result res = TEE_ERROR_GENERIC;
+	struct rpmb_file_handle last_fh;
+	size_t idx = 0;
 
-		mm = tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address);
-		if (!mm) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
+	res = fat_mirror_load();
+	if (res != TEE_SUCCESS)
+		return res;
 
-		if (expand_fat) {
-			/*
-			 * Point fat_address to the beginning of the new
-			 * entry.
-			 */
-			fat_address -= sizeof(struct rpmb_fat_entry);
-			memset(&last_fh, 0, sizeof(last_fh));
-			last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
-			last_fh.rpmb_fat_address = fat_address;
-			res = write_fat_entry(&last_fh, true);
-			if (res != TEE_SUCCESS)
-				goto out;
-		}
+	for (idx = 0; idx < fat_mirror.num_entries; idx++)
+		if (!(fat_mirror.entries[idx].flags & FILE_IS_ACTIVE))
+			break;
+	if (idx == fat_mirror.num_entries)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	if (fat_mirror.entries[idx].flags & FILE_IS_LAST_ENTRY) {
+		/* Make room for yet a FAT entry */
+		res = fat_mirror_reserve(idx + 2);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		memset(&last_fh, 0, sizeof(last_fh));
+		last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
+		last_fh.rpmb_fat_address = fat_entry_address(idx + 1);
+		res = write_fat_entry(&last_fh, true);
+		if (res != TEE_SUCCESS)
+			return res;
 	}
 
-	if (fh->filename && !fh->rpmb_fat_address)
-		res = TEE_ERROR_ITEM_NOT_FOUND;
+	memset(&fh->fat_entry, 0, sizeof(fh->fat_entry));
+	fh->rpmb_fat_address = fat_entry_address(idx);
+	fh->fat_gen = 0;
 
-out:
-	free(fat_entries);
-	return res;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result generate_fek(struct rpmb_fat_entry *fe, const TEE_UUID *uuid)
@@ -1912,8 +2150,6 @@ again:
 static TEE_Result rpmb_fs_open_internal(struct rpmb_file_handle *fh,
 					const TEE_UUID *uuid, bool create)
 {
-	tee_mm_pool_t p;
-	bool pool_result;
 	TEE_Result res = TEE_ERROR_GENERIC;
 
 	/* We need to do setup in order to make sure fs_par is filled in */
@@ -1922,28 +2158,11 @@ static TEE_Result rpmb_fs_open_internal(struct rpmb_file_handle *fh,
 		goto out;
 
 	fh->uuid = uuid;
-	if (create) {
-		/* Upper memory allocation must be used for RPMB_FS. */
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-
-		res = read_fat(fh, &p);
-		tee_mm_final(&p);
-		if (res != TEE_SUCCESS)
-			goto out;
-	} else {
-		res = read_fat(fh, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
-	}
+	res = read_fat(fh);
+	if (res == TEE_ERROR_ITEM_NOT_FOUND && create)
+		res = alloc_fat_entry(fh);
+	if (res != TEE_SUCCESS)
+		goto out;
 
 	/*
 	 * If this is opened with create and the entry found was not active
@@ -1999,7 +2218,7 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, size_t pos,
 
 	dump_fh(fh);
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2028,9 +2247,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 					  size_t size)
 {
 	TEE_Result res;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
 	size_t end;
 	size_t newsize;
 	uint8_t *newbuf = NULL;
@@ -2047,18 +2264,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 	dump_fh(fh);
 
-	/* Upper memory allocation must be used for RPMB_FS. */
-	pool_result = tee_mm_init(&p,
-				  RPMB_STORAGE_START_ADDRESS,
-				  fs_par->max_rpmb_address,
-				  RPMB_BLOCK_SIZE_SHIFT,
-				  TEE_MM_POOL_HI_ALLOC);
-	if (!pool_result) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
-
-	res = read_fat(fh, &p);
+	res = read_fat(fh);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2084,7 +2290,7 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		DMSG("Need to re-allocate");
 		newsize = MAX(end, fh->fat_entry.data_size);
-		mm = tee_mm_alloc(&p, newsize);
+		mm = tee_mm_alloc(&fat_mirror.pool, newsize);
 		newbuf = calloc(1, newsize);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2110,14 +2316,16 @@ static TEE_Result rpmb_fs_write_primitive(struct rpmb_file_handle *fh,
 
 		fh->fat_entry.data_size = newsize;
 		fh->fat_entry.start_address = newaddr;
+		/* The FAT mirror takes over mm, or drops it on failure */
+		mm = NULL;
 		res = write_fat_entry(fh, true);
 		if (res != TEE_SUCCESS)
 			goto out;
 	}
 
 out:
-	if (pool_result)
-		tee_mm_final(&p);
+	if (mm)
+		tee_mm_free(mm);
 	if (newbuf)
 		free(newbuf);
 
@@ -2141,7 +2349,7 @@ static TEE_Result rpmb_fs_remove_internal(struct rpmb_file_handle *fh)
 {
 	TEE_Result res;
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh);
 	if (res)
 		return res;
 
@@ -2199,11 +2407,11 @@ static  TEE_Result rpmb_fs_rename_internal(struct tee_pobj *old,
 		goto out;
 	}
 
-	res = read_fat(fh_old, NULL);
+	res = read_fat(fh_old);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = read_fat(fh_new, NULL);
+	res = read_fat(fh_new);
 	if (res == TEE_SUCCESS) {
 		if (!overwrite) {
 			res = TEE_ERROR_ACCESS_CONFLICT;
@@ -2245,9 +2453,7 @@ static  TEE_Result rpmb_fs_rename(struct tee_pobj *old, struct tee_pobj *new,
 static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 {
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
 	uint32_t newsize;
 	uint8_t *newbuf = NULL;
 	uintptr_t newaddr;
@@ -2261,27 +2467,14 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	}
 	newsize = length;
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	if (newsize > fh->fat_entry.data_size) {
 		/* Extend file */
 
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-		res = read_fat(fh, &p);
-		if (res != TEE_SUCCESS)
-			goto out;
-
-		mm = tee_mm_alloc(&p, newsize);
+		mm = tee_mm_alloc(&fat_mirror.pool, newsize);
 		newbuf = calloc(1, newsize);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2311,12 +2504,14 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	/* fh->pos is unchanged */
 	fh->fat_entry.data_size = newsize;
 	fh->fat_entry.start_address = newaddr;
+	/* The FAT mirror takes over mm, or drops it on failure */
+	mm = NULL;
 	res = write_fat_entry(fh, true);
 
 out:
+	if (mm)
+		tee_mm_free(mm);
 	mutex_unlock(&rpmb_mutex);
-	if (pool_result)
-		tee_mm_final(&p);
 	if (newbuf)
 		free(newbuf);
 
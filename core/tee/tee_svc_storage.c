@@ -293,7 +293,13 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 	    TEE_HANDLE_FLAG_PERSISTENT | TEE_HANDLE_FLAG_INITIALIZED;
 	o->flags = flags;
 	o->pobj = po;
-	tee_obj_add(utc, o);
+	res = tee_obj_add(utc, o);
+	if (res != TEE_SUCCESS) {
+		tee_obj_free(o);
+		o = NULL;
+		tee_pobj_release(po);
+		goto err;
+	}
 
 	res = tee_svc_storage_read_head(o);
 	if (res != TEE_SUCCESS) {
@@ -304,7 +310,7 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 		goto oclose;
 	}
 
-	res = tee_svc_copy_kaddr_to_uref(obj, o);
+	res = tee_svc_copy_to_user(obj, &o->handle, sizeof(o->handle));
 	if (res != TEE_SUCCESS)
 		goto oclose;
 
@@ -449,20 +455,31 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 	o->pobj = po;
 
 	if (attr != TEE_HANDLE_NULL) {
-		res = tee_obj_get(utc, tee_svc_uref_to_vaddr(attr),
-				  &attr_o);
+		res = tee_obj_get(utc, attr, &attr_o);
 		if (res != TEE_SUCCESS)
 			goto err;
 	}
 
-	res = tee_svc_storage_init_file(o, attr_o, data, len);
+	/*
+	 * Allocate the handle before the file is created, a failure after
+	 * that would leave the new object, which may have replaced an old
+	 * one, on storage without a handle.
+	 */
+	res = tee_obj_add(utc, o);
 	if (res != TEE_SUCCESS)
 		goto err;
-
 	po = NULL; /* o owns it from now on */
-	tee_obj_add(utc, o);
 
-	res = tee_svc_copy_kaddr_to_uref(obj, o);
+	res = tee_svc_storage_init_file(o, attr_o, data, len);
+	if (res != TEE_SUCCESS) {
+		if (res == TEE_ERROR_NO_DATA || res == TEE_ERROR_BAD_FORMAT)
+			res = TEE_ERROR_CORRUPT_OBJECT;
+		if (res == TEE_ERROR_CORRUPT_OBJECT)
+			o->pobj->fops->remove(o->pobj);
+		goto oclose;
+	}
+
+	res = tee_svc_copy_to_user(obj, &o->handle, sizeof(o->handle));
 	if (res != TEE_SUCCESS)
 		goto oclose;
 
@@ -481,7 +498,7 @@ err:
 		fops->close(&o->fh);
 	if (po)
 		tee_pobj_release(po);
-	free(o);
+	tee_obj_free(o);
 
 	return res;
 }
@@ -498,7 +515,7 @@ TEE_Result syscall_storage_obj_del(unsigned long obj)
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -534,7 +551,7 @@ TEE_Result syscall_storage_obj_rename(unsigned long obj, void *object_id,
 		return res;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -802,7 +819,7 @@ TEE_Result syscall_storage_obj_read(unsigned long obj, void *data, size_t len,
 		goto exit;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -856,7 +873,7 @@ TEE_Result syscall_storage_obj_write(unsigned long obj, void *data, size_t len)
 		goto exit;
 	utc = to_user_ta_ctx(sess->ctx);
 
-	res = tee_obj_get(utc, tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -903,8 +920,7 @@ TEE_Result syscall_storage_obj_trunc(unsigned long obj, size_t len)
 	if (res != TEE_SUCCESS)
 		goto exit;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -953,8 +969,7 @@ TEE_Result syscall_storage_obj_seek(unsigned long obj, int32_t offset,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  tee_svc_uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
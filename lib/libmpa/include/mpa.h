@@ -163,6 +163,9 @@ void __mpa_mul_add_word(mpa_word_t a,
 void __mpa_mul_add_word_cum(mpa_word_t a,
 			    mpa_word_t b, mpa_word_t *p, mpa_word_t *carry);
 
+mpa_word_t __mpa_mul_add_row(mpa_word_t *dest, const mpa_word_t *src,
+			     mpa_usize_t len, mpa_word_t w);
+
 void __mpa_abs_mul_word(mpanum dest, const mpanum op1, mpa_word_t op2);
 
 void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2);
@@ -203,6 +206,10 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src);
 
 void __mpa_montgomery_mul_add(mpanum dest, mpanum src, mpa_word_t w);
 
+void __mpa_montgomery_mul_row(mpa_word_t *dest, const mpa_word_t *b,
+			      mpa_usize_t blen, const mpa_word_t *n,
+			      mpa_usize_t nlen, mpa_word_t a, mpa_word_t u);
+
 void __mpa_montgomery_mul(mpanum dest,
 			  mpanum op1, mpanum op2, mpanum n, mpa_word_t n_inv);
 
@@ -312,6 +312,20 @@ MPALIB_EXPORT void mpa_exp_mod(mpanum dest, const mpanum op1, const mpanum op2,
 			       const mpanum r2_modn, const mpa_word_t n_inv,
 			       mpa_scratch_mem pool);
 
+MPALIB_EXPORT void mpa_exp_mod_vartime(mpanum dest, const mpanum op1,
+				       const mpanum op2, const mpanum n,
+				       const mpanum r_modn,
+				       const mpanum r2_modn,
+				       const mpa_word_t n_inv,
+				       mpa_scratch_mem pool);
+
+MPALIB_EXPORT void mpa_exp_mod_ladder(mpanum dest, const mpanum op1,
+				      const mpanum op2, const mpanum n,
+				      const mpanum r_modn,
+				      const mpanum r2_modn,
+				      const mpa_word_t n_inv,
+				      mpa_scratch_mem pool);
+
 /*
  * From mpa_misc.c
  */
@@ -81,6 +81,15 @@ typedef uint8_t mpa_byte_t;
  */
 /* #define     USE_ARM_ASM */
 
+/*
+ * The multiply-accumulate row kernels have AArch64 assembler
+ * implementations in arch/arm/mpa_a64.S which are built for 64-bit
+ * targets only.
+ */
+#if defined(__aarch64__)
+#define USE_ARM64_ASM
+#endif
+
 /*
  * Include functionality for converting to and from strings; mpa_set_string
  * and mpa_get_string.
@@ -3,6 +3,7 @@
  * Copyright (c) 2014, STMicroelectronics International N.V.
  */
 #include "mpa.h"
+#include <util.h>
 
 #define swp(a, b) do { \
 		mpanum *tmp = *a; \
@@ -10,22 +11,32 @@
 		*b = tmp; \
 	} while (0)
 
+/*
+ * Largest window used by the windowed exponentiations, both use a table
+ * of at most 16 precomputed powers allocated from the scratch pool.
+ */
+#define MPA_EXPMOD_MAX_FIXED_WINDOW	4
+#define MPA_EXPMOD_MAX_SLIDING_WINDOW	5
+
 /*------------------------------------------------------------
  *
- *  mpa_exp_mod
+ *  mpa_exp_mod_ladder
  *
  *  Calculates dest = op1 ^ op2 mod n
  *
  * This function uses the Montgomery ladder concept as proposed by Marc Joye and
  * Sun-Ming Yen, which makes the function more resistant to timing attacks.
+ * Two Montgomery multiplications are done for each bit of the exponent but
+ * no table is needed, mpa_exp_mod() falls back to this function if there
+ * isn't enough scratch memory for the table.
  */
-void mpa_exp_mod(mpanum dest,
-		 const mpanum op1,
-		 const mpanum op2,
-		 const mpanum n,
-		 const mpanum r_modn,
-		 const mpanum r2_modn,
-		 const mpa_word_t n_inv, mpa_scratch_mem pool)
+void mpa_exp_mod_ladder(mpanum dest,
+			const mpanum op1,
+			const mpanum op2,
+			const mpanum n,
+			const mpanum r_modn,
+			const mpanum r2_modn,
+			const mpa_word_t n_inv, mpa_scratch_mem pool)
 {
 	mpanum A;
 	mpanum tmp_a;
@@ -96,3 +107,270 @@ void mpa_exp_mod(mpanum dest,
 	mpa_free_static_temp_var(&xtilde, pool);
 	mpa_free_static_temp_var(&tmp_xtilde, pool);
 }
+
+/*
+ * Window sizes minimizing the number of Montgomery multiplications for an
+ * exponent of @bits bits, including those needed to compute the table.
+ */
+static int fixed_window_size(int bits)
+{
+	if (bits <= 4)
+		return 1;
+	if (bits <= 24)
+		return 2;
+	if (bits <= 96)
+		return 3;
+	return MPA_EXPMOD_MAX_FIXED_WINDOW;
+}
+
+static int sliding_window_size(int bits)
+{
+	if (bits <= 6)
+		return 1;
+	if (bits <= 24)
+		return 2;
+	if (bits <= 80)
+		return 3;
+	if (bits <= 240)
+		return 4;
+	return MPA_EXPMOD_MAX_SLIDING_WINDOW;
+}
+
+/*
+ * Temporary variables of the exponentiations only hold values < n, but
+ * the intermediate sums in __mpa_montgomery_mul() may need two more words.
+ * Allocating them with that size instead of the default size of the pool
+ * keeps the tables small.
+ */
+static int alloc_vars(mpanum *vars, int num_vars, const mpanum n,
+		      mpa_scratch_mem pool)
+{
+	int size_bits = WORDS_TO_BITS(__mpanum_size(n) + 2);
+	int i;
+
+	for (i = 0; i < num_vars; i++) {
+		if (!mpa_alloc_static_temp_var_size(size_bits, vars + i,
+						    pool)) {
+			/* Free in reverse order to keep the pool stack like */
+			while (i--)
+				mpa_free_static_temp_var(vars + i, pool);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void free_vars(mpanum *vars, int num_vars, mpa_scratch_mem pool)
+{
+	while (num_vars--)
+		mpa_free_static_temp_var(vars + num_vars, pool);
+}
+
+/*
+ * Copies table[idx] into dest reading every entry of the table the same
+ * way, so neither the memory access pattern nor the timing depends on idx.
+ * All entries have their unused digits set to zero.
+ */
+static void select_ct(mpanum dest, mpanum *table, int num_entries,
+		      uint32_t idx, mpa_usize_t num_words)
+{
+	mpa_usize_t w;
+	uint32_t mask;
+	int i;
+
+	mpa_wipe(dest);
+	for (i = 0; i < num_entries; i++) {
+		/* mask is all ones if i == idx and zero otherwise */
+		mask = (((uint32_t)i ^ idx) - 1) >> 31;
+		mask = 0 - mask;
+
+		dest->size |= table[i]->size & mask;
+		for (w = 0; w < num_words; w++)
+			dest->d[w] |= table[i]->d[w] & mask;
+	}
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_exp_mod
+ *
+ *  Calculates dest = op1 ^ op2 mod n
+ *
+ * Fixed window exponentiation for secret exponents. For each window of
+ * w bits of the exponent w squarings are done followed by a multiplication
+ * with a precomputed power of op1 which is selected by scanning the entire
+ * table, so the sequence of operations and memory accesses only depends
+ * on the bit length of the exponent.
+ */
+void mpa_exp_mod(mpanum dest,
+		 const mpanum op1,
+		 const mpanum op2,
+		 const mpanum n,
+		 const mpanum r_modn,
+		 const mpanum r2_modn,
+		 const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	mpanum table[1 << MPA_EXPMOD_MAX_FIXED_WINDOW];
+	mpanum vars[3];
+	mpanum *ptr_a = vars;
+	mpanum *ptr_tmp_a = vars + 1;
+	mpanum sel;
+	int bits = mpa_highest_bit_index(op2) + 1;
+	int wsize = fixed_window_size(bits);
+	int num_entries = 1 << wsize;
+	uint32_t wval;
+	int idx;
+	int i;
+
+	if (alloc_vars(vars, ARRAY_SIZE(vars), n, pool))
+		goto fallback;
+	if (alloc_vars(table, num_entries, n, pool)) {
+		free_vars(vars, ARRAY_SIZE(vars), pool);
+		goto fallback;
+	}
+	sel = vars[2];
+
+	/* table[i] = op1^i in Montgomery space */
+	mpa_copy(table[0], r_modn);
+	__mpa_set_unused_digits_to_zero(table[0]);
+	__mpa_montgomery_mul(table[1], op1, r2_modn, n, n_inv);
+	for (i = 2; i < num_entries; i++)
+		__mpa_montgomery_mul(table[i], table[i - 1], table[1], n,
+				     n_inv);
+
+	mpa_copy(*ptr_a, r_modn);
+	__mpa_set_unused_digits_to_zero(*ptr_a);
+
+	/* The top window is padded with zeroes */
+	for (idx = ((bits + wsize - 1) / wsize - 1) * wsize; idx >= 0;
+	     idx -= wsize) {
+		wval = 0;
+		for (i = wsize - 1; i >= 0; i--) {
+			/* A = A^2 */
+			__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, *ptr_a, n,
+					     n_inv);
+			swp(&ptr_tmp_a, &ptr_a);
+
+			wval <<= 1;
+			if (idx + i < bits)
+				wval |= mpa_get_bit(op2, idx + i);
+		}
+
+		/* A = A*op1^wval */
+		select_ct(sel, table, num_entries, wval,
+			  __mpanum_size(n) + 1);
+		__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, sel, n, n_inv);
+		swp(&ptr_tmp_a, &ptr_a);
+	}
+
+	/* Transform back from Montgomery space */
+	__mpa_montgomery_mul(*ptr_tmp_a, (const mpanum)&const_one, *ptr_a,
+			     n, n_inv);
+	mpa_copy(dest, *ptr_tmp_a);
+
+	mpa_wipe(sel);
+	free_vars(table, num_entries, pool);
+	free_vars(vars, ARRAY_SIZE(vars), pool);
+	return;
+
+fallback:
+	mpa_exp_mod_ladder(dest, op1, op2, n, r_modn, r2_modn, n_inv, pool);
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_exp_mod_vartime
+ *
+ *  Calculates dest = op1 ^ op2 mod n
+ *
+ * Sliding window exponentiation using a table of the odd powers of op1.
+ * This needs fewer multiplications than mpa_exp_mod() but the sequence of
+ * operations depends on the value of the exponent, so it must only be
+ * used with public exponents.
+ */
+void mpa_exp_mod_vartime(mpanum dest,
+			 const mpanum op1,
+			 const mpanum op2,
+			 const mpanum n,
+			 const mpanum r_modn,
+			 const mpanum r2_modn,
+			 const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	mpanum table[1 << (MPA_EXPMOD_MAX_SLIDING_WINDOW - 1)];
+	mpanum vars[3];
+	mpanum *ptr_a = vars;
+	mpanum *ptr_tmp_a = vars + 1;
+	mpanum x2;
+	int bits = mpa_highest_bit_index(op2) + 1;
+	int wsize = sliding_window_size(bits);
+	int num_entries = 1 << (wsize - 1);
+	uint32_t wval;
+	int idx;
+	int low;
+	int i;
+
+	if (alloc_vars(vars, ARRAY_SIZE(vars), n, pool))
+		goto fallback;
+	if (alloc_vars(table, num_entries, n, pool)) {
+		free_vars(vars, ARRAY_SIZE(vars), pool);
+		goto fallback;
+	}
+	x2 = vars[2];
+
+	/* table[i] = op1^(2i+1) in Montgomery space */
+	__mpa_montgomery_mul(table[0], op1, r2_modn, n, n_inv);
+	if (num_entries > 1)
+		__mpa_montgomery_mul(x2, table[0], table[0], n, n_inv);
+	for (i = 1; i < num_entries; i++)
+		__mpa_montgomery_mul(table[i], table[i - 1], x2, n, n_inv);
+
+	mpa_copy(*ptr_a, r_modn);
+	__mpa_set_unused_digits_to_zero(*ptr_a);
+
+	idx = bits - 1;
+	while (idx >= 0) {
+		if (!mpa_get_bit(op2, idx)) {
+			/* A = A^2 */
+			__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, *ptr_a, n,
+					     n_inv);
+			swp(&ptr_tmp_a, &ptr_a);
+			idx--;
+			continue;
+		}
+
+		/* Longest window starting at idx ending with a set bit */
+		low = idx - wsize + 1;
+		if (low < 0)
+			low = 0;
+		while (!mpa_get_bit(op2, low))
+			low++;
+
+		wval = 0;
+		for (i = idx; i >= low; i--) {
+			/* A = A^2 */
+			__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, *ptr_a, n,
+					     n_inv);
+			swp(&ptr_tmp_a, &ptr_a);
+			wval = (wval << 1) | mpa_get_bit(op2, i);
+		}
+
+		/* A = A*op1^wval */
+		__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, table[wval >> 1], n,
+				     n_inv);
+		swp(&ptr_tmp_a, &ptr_a);
+		idx = low - 1;
+	}
+
+	/* Transform back from Montgomery space */
+	__mpa_montgomery_mul(*ptr_tmp_a, (const mpanum)&const_one, *ptr_a,
+			     n, n_inv);
+	mpa_copy(dest, *ptr_tmp_a);
+
+	free_vars(table, num_entries, pool);
+	free_vars(vars, ARRAY_SIZE(vars), pool);
+	return;
+
+fallback:
+	mpa_exp_mod_ladder(dest, op1, op2, n, r_modn, r2_modn, n_inv, pool);
+}
@@ -29,26 +29,17 @@ void __mpa_montgomery_mul_add(mpanum dest, mpanum src, mpa_word_t w)
 	mpa_word_t *ddig;
 	int32_t idx;
 	mpa_word_t carry;
-	mpa_word_t *dest_begin;
 
 	if (w == 0)
 		return;
-	dest_begin = dest->d;
-	ddig = dest->d;
-	carry = 0;
-	for (idx = 0; idx < src->size; idx++) {
-		a = (mpa_dword_t) *ddig +
-		    (mpa_dword_t) src->d[idx] * (mpa_dword_t) w +
-		    (mpa_dword_t) (carry);
-		*(ddig++) = (mpa_word_t) (a);
-		carry = (mpa_word_t) (a >> WORD_SIZE);
-	}
+	carry = __mpa_mul_add_row(dest->d, src->d, src->size, w);
+	ddig = dest->d + src->size;
 	while (carry) {
 		a = (mpa_dword_t) (*ddig) + (mpa_dword_t) (carry);
 		*(ddig++) = (mpa_word_t) (a);
 		carry = (mpa_word_t) (a >> WORD_SIZE);
 	}
-	idx = (mpa_word_t) (ddig - dest_begin);
+	idx = (mpa_word_t) (ddig - dest->d);
 	if (idx > dest->size)
 		dest->size = idx;
 
@@ -104,20 +95,60 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src)
 
 /*------------------------------------------------------------
  *
- *  __mpa_montgomery_mul
- *
- *  NOTE:
- *  Dest need to be able to hold one more word than the size of n
+ *  These functions have AArch64 assembler implementations
  *
  */
-void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
-			  mpa_word_t n_inv)
+#if !defined(USE_ARM64_ASM)
+
+/*  --------------------------------------------------------------------
+ *  Function:  __mpa_montgomery_mul_row
+ *  Calculates dest = (dest + a * b + u * n) / 2^WORD_SIZE
+ *  where u is chosen by the caller so that the division is exact.
+ *  b has blen <= nlen digits, dest has nlen + 1 digits.
+ *  Adding the two products and shifting one word is done in one pass.
+ */
+void __mpa_montgomery_mul_row(mpa_word_t *dest, const mpa_word_t *b,
+			      mpa_usize_t blen, const mpa_word_t *n,
+			      mpa_usize_t nlen, mpa_word_t a, mpa_word_t u)
 {
-	mpa_word_t u;
+#if defined(MPA_SUPPORT_DWORD_T)
+	mpa_dword_t t;
+	mpa_dword_t s;
+	mpa_word_t c1 = 0;
+	mpa_word_t c2 = 0;
 	mpa_usize_t idx;
 
-	/* set dest to zero (with all unused digits to zero as well) */
-	mpa_wipe(dest);
+	for (idx = 0; idx < nlen; idx++) {
+		t = (mpa_dword_t)dest[idx] + c1;
+		if (idx < blen)
+			t += (mpa_dword_t)a * b[idx];
+		c1 = (mpa_word_t)(t >> WORD_SIZE);
+		s = (mpa_word_t)t + (mpa_dword_t)u * n[idx] + c2;
+		c2 = (mpa_word_t)(s >> WORD_SIZE);
+		/* The least significant word is zero and shifted out */
+		if (idx)
+			dest[idx - 1] = (mpa_word_t)s;
+	}
+
+	s = (mpa_dword_t)dest[nlen] + c1 + c2;
+	dest[nlen - 1] = (mpa_word_t)s;
+	dest[nlen] = (mpa_word_t)(s >> WORD_SIZE);
+#else
+#error write non-dword code for __mpa_montgomery_mul_row
+#endif
+}
+
+#endif /* USE_ARM64_ASM */
+
+/*
+ * Adds op2 * op1[idx] and u * n word by word and shifts dest one word to
+ * the right for each word of op1, used when op2 is larger than n.
+ */
+static void montgomery_mul_words(mpanum dest, mpanum op1, mpanum op2,
+				 mpanum n, mpa_word_t n_inv)
+{
+	mpa_word_t u;
+	mpa_usize_t idx;
 
 	for (idx = 0; idx < n->size; idx++) {
 		u = (dest->d[0] +
@@ -134,6 +165,49 @@ void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
 			dest->d[i] = dest->d[i + 1];
 		*(dest->d + dest->size) = 0;	/* set unused digit to zero. */
 	}
+}
+
+/*
+ * Same as montgomery_mul_words() but with the additions and the shift
+ * done in a single pass over dest for each word of op1.
+ */
+static void montgomery_mul_rows(mpanum dest, mpanum op1, mpanum op2,
+				mpanum n, mpa_word_t n_inv)
+{
+	mpa_word_t u;
+	mpa_word_t a;
+	mpa_usize_t idx;
+
+	for (idx = 0; idx < n->size; idx++) {
+		a = __mpanum_get_word(idx, op1);
+		u = (dest->d[0] + a * __mpanum_get_word(0, op2)) * n_inv;
+		__mpa_montgomery_mul_row(dest->d, op2->d, __mpanum_size(op2),
+					 n->d, n->size, a, u);
+	}
+
+	dest->size = n->size + 1;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+}
+
+/*------------------------------------------------------------
+ *
+ *  __mpa_montgomery_mul
+ *
+ *  NOTE:
+ *  Dest need to be able to hold one more word than the size of n
+ *
+ */
+void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
+			  mpa_word_t n_inv)
+{
+	/* set dest to zero (with all unused digits to zero as well) */
+	mpa_wipe(dest);
+
+	if (__mpanum_size(op2) <= n->size)
+		montgomery_mul_rows(dest, op1, op2, n, n_inv);
+	else
+		montgomery_mul_words(dest, op1, op2, n, n_inv);
 
 	/* check if dest > n, if so set dest = dest - n */
 	if (__mpa_abs_cmp(dest, n) >= 0)
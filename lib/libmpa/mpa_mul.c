@@ -62,6 +62,41 @@ void __mpa_mul_add_word_cum(mpa_word_t a,
 
 #endif /* USE_ARM_ASM */
 
+/*------------------------------------------------------------
+ *
+ *  These functions have AArch64 assembler implementations
+ *
+ */
+#if !defined(USE_ARM64_ASM)
+
+/*  --------------------------------------------------------------------
+ *  Function:   __mpa_mul_add_row
+ *
+ *  Calculates dest[0..len-1] += src[0..len-1] * w and returns the
+ *  outgoing carry.
+ */
+mpa_word_t __mpa_mul_add_row(mpa_word_t *dest, const mpa_word_t *src,
+			     mpa_usize_t len, mpa_word_t w)
+{
+#if defined(MPA_SUPPORT_DWORD_T)
+	mpa_dword_t a;
+	mpa_word_t carry = 0;
+	mpa_usize_t idx;
+
+	for (idx = 0; idx < len; idx++) {
+		a = (mpa_dword_t)dest[idx] + (mpa_dword_t)src[idx] * w + carry;
+		dest[idx] = (mpa_word_t)a;
+		carry = (mpa_word_t)(a >> MPA_WORD_SIZE);
+	}
+
+	return carry;
+#else
+#error "error: write non-dword_t code for __mpa_mul_add_row"
+#endif
+}
+
+#endif /* USE_ARM64_ASM */
+
 /*  --------------------------------------------------------------------
  *  Function:   __mpa_abs_mul_word
  *
@@ -107,7 +142,6 @@ void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2)
 	mpa_word_t carry = 0;
 	mpa_word_t *prod;
 	const mpa_word_t *a;
-	const mpa_word_t *b;
 
 	/* clear dest digits */
 	mpa_memset(dest->d, 0, dest->alloc * BYTES_PER_WORD);
@@ -115,12 +149,8 @@ void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2)
 	a = op1->d;
 	prod = dest->d;
 	for (i = 0; i < __mpanum_size(op1); i++) {
-		b = op2->d;
-		carry = 0;
-		for (j = 0; j < __mpanum_size(op2); j++) {
-			__mpa_mul_add_word_cum(*a, *b, prod + j, &carry);
-			b++;
-		}
+		j = __mpanum_size(op2);
+		carry = __mpa_mul_add_row(prod, op2->d, j, *a);
 		if (carry)
 			*(prod + j) = carry;
 		a++;
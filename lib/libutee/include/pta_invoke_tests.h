@@ -52,7 +52,12 @@
 #define PTA_INVOKE_TESTS_CMD_COPY_SEC_TO_NSEC	5
 
 /*
- * Tests FS hash-tree corner cases in error handling
+ * Tests FS hash-tree corner cases in error handling and the storage
+ * requests saved by read-ahead, then measures sequential throughput
+ *
+ * [out] value[0].a	Sequential write throughput in KiB/s
+ * [out] value[0].b	Sequential read throughput in KiB/s
+ * [out] value[1].a	Sequential read throughput with read-ahead in KiB/s
  */
 #define PTA_INVOKE_TESTS_CMD_FS_HTREE		6
 
@@ -68,5 +73,84 @@
 #define PTA_MUTEX_TEST_READER			1
 #define PTA_INVOKE_TESTS_CMD_MUTEX		7
 
+/*
+ * Tests RPMB FS writes and reads of multiple blocks, then measures RPMB FS
+ * operations per second with enough files for the FAT to span several
+ * blocks, checking the outcome of each operation
+ *
+ * [out] value[0].a	Files created per second
+ * [out] value[0].b	Files opened and read per second
+ * [out] value[1].a	Files renamed per second
+ * [out] value[1].b	Files removed per second
+ */
+#define PTA_INVOKE_TESTS_CMD_FS_RPMB		8
+
+/*
+ * Measures the latency of pager faults on locked pages which are released
+ * between rounds and of accesses cycling through paged read-write pages,
+ * checking the content of the pages
+ *
+ * [out] value[0].a	Latency of a locked page fault in nanoseconds
+ * [out] value[0].b	Average latency of a paged read-write access in
+ *			nanoseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_PAGER		9
+
+/*
+ * Measures RSA signing throughput, invoked from several threads at once
+ * to measure how it scales with the number of cores
+ *
+ * [in]  value[0].a	Number of signatures, 0 for a default
+ * [out] value[1].a	Elapsed time in microseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_RSA		10
+
+/*
+ * Checks the modular exponentiations of libmpa against known answers and
+ * measures the time of each with a 2048-bit exponent
+ *
+ * [out] value[0].a	Time with the ladder in microseconds
+ * [out] value[0].b	Time with the fixed window in microseconds
+ * [out] value[1].a	Time with the sliding window in microseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_MPA		11
+
+/*
+ * Measures ECDSA P-256 signing and verification throughput
+ *
+ * [in]  value[0].a	Number of signatures and verifications, 0 for a default
+ * [out] value[1].a	Elapsed time signing in microseconds
+ * [out] value[1].b	Elapsed time verifying in microseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_ECC		12
+
+/*
+ * Checks that stale and made up handles are rejected by the handle
+ * tables of the crypto states and objects and measures lookups while many
+ * handles are live
+ *
+ * [in]  value[0].a	Number of live handles, 0 for a default
+ * [out] value[1].a	Elapsed time of the handle lookups in microseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_HANDLE		13
+
+/*
+ * Stresses the core heap with small allocations and frees, invoked from
+ * several threads at once to measure how it scales with the number of
+ * cores
+ *
+ * [in]  value[0].a	Number of allocations, 0 for a default
+ * [out] value[1].a	Elapsed time in microseconds
+ */
+#define PTA_INVOKE_TESTS_CMD_MALLOC		14
+
+/*
+ * Checks the objects of a slab cache, the return of empty slabs to the
+ * heap and the reuse of freed objects
+ *
+ * [in]  value[0].a	Number of live objects, 0 for a default
+ */
+#define PTA_INVOKE_TESTS_CMD_SLAB		15
+
 #endif /*__PTA_INVOKE_TESTS_H*/
 
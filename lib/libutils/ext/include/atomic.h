@@ -43,4 +43,9 @@ static inline void atomic_store_u32(uint32_t *p, uint32_t val)
 	__compiler_atomic_store(p, val);
 }
 
+static inline void atomic_store_release_u32(uint32_t *p, uint32_t val)
+{
+	__compiler_atomic_store_release(p, val);
+}
+
 #endif /*__ATOMIC_H*/
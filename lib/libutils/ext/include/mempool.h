@@ -30,6 +30,20 @@ struct mempool;
 struct mempool *mempool_alloc_pool(void *data, size_t size,
 				   void (*release_mem)(void *ptr, size_t size));
 
+/*
+ * mempool_add_block() - Add another block of memory to a memory pool
+ * @pool:		A memory pool created with mempool_alloc_pool()
+ * @data:		a block of memory to carve out items from
+ * @size:		size of the block of memory
+ *
+ * In the kernel each block is used by one thread at a time, so a pool
+ * with N blocks can serve N threads in parallel. The @release_mem function
+ * supplied to mempool_alloc_pool() is called for each block when it has
+ * been emptied.
+ * returns true on success or false on failure.
+ */
+bool mempool_add_block(struct mempool *pool, void *data, size_t size);
+
 /*
  * mempool_alloc() - Allocate an item from a memory pool
  * @pool:		A memory pool created with mempool_alloc_pool()
@@ -49,66 +49,133 @@
  *   - if an item A is allocated before another item B, then A should be
  *     released after B.
  *   So the potential fragmentation is mitigated.
+ *
+ * A pool may consist of several blocks of memory, see mempool_add_block().
+ * In the kernel a thread allocating an item gets a block for itself until
+ * it has freed all its items, other threads use other blocks or wait for
+ * one to become available.
  */
 
 #define POOL_ALIGN	__alignof__(long)
 
-struct mempool {
-	size_t size;  /* size of the memory pool, in bytes */
+struct mempool_block {
+	size_t size;  /* size of the memory block, in bytes */
 	ssize_t last_offset;   /* offset to the last one */
 	vaddr_t data;
+#if defined(__KERNEL__)
+	size_t count;
+	int owner;
+#endif
+};
+
+struct mempool {
+	struct mempool_block *blocks;
+	size_t num_blocks;
 #if defined(__KERNEL__)
 	void (*release_mem)(void *ptr, size_t size);
 	struct mutex mu;
 	struct condvar cv;
-	size_t count;
-	int owner;
 #endif
 };
 
-static void get_pool(struct mempool *pool __maybe_unused)
+static struct mempool_block *get_pool(struct mempool *pool)
 {
 #if defined(__KERNEL__)
-	mutex_lock(&pool->mu);
+	struct mempool_block *free_block = NULL;
+	struct mempool_block *b = NULL;
+	int id = thread_get_id();
+	size_t n;
 
-	if (pool->owner != thread_get_id()) {
-		/* Wait until the pool is available */
-		while (pool->owner != THREAD_ID_INVALID)
-			condvar_wait(&pool->cv, &pool->mu);
+	mutex_lock(&pool->mu);
 
-		pool->owner = thread_get_id();
-		assert(pool->count == 0);
+	while (true) {
+		for (n = 0; n < pool->num_blocks; n++) {
+			b = pool->blocks + n;
+			if (b->owner == id)
+				goto out;
+			if (!free_block && b->owner == THREAD_ID_INVALID)
+				free_block = b;
+		}
+		if (free_block)
+			break;
+		/* Wait until a block is available */
+		condvar_wait(&pool->cv, &pool->mu);
 	}
 
-	pool->count++;
+	b = free_block;
+	b->owner = id;
+	assert(b->count == 0);
+out:
+	b->count++;
 
 	mutex_unlock(&pool->mu);
+	return b;
+#else
+	return pool->blocks;
 #endif
 }
 
-static void put_pool(struct mempool *pool __maybe_unused)
+static void put_pool(struct mempool *pool __maybe_unused,
+		     struct mempool_block *b __maybe_unused)
 {
 #if defined(__KERNEL__)
 	mutex_lock(&pool->mu);
 
-	assert(pool->owner == thread_get_id());
-	assert(pool->count > 0);
+	assert(b->owner == thread_get_id());
+	assert(b->count > 0);
 
-	pool->count--;
-	if (!pool->count) {
-		pool->owner = THREAD_ID_INVALID;
+	b->count--;
+	if (!b->count) {
+		b->owner = THREAD_ID_INVALID;
 		condvar_signal(&pool->cv);
 		/* As the refcount is 0 there should be no items left */
-		if (pool->last_offset >= 0)
+		if (b->last_offset >= 0)
 			panic();
 		if (pool->release_mem)
-			pool->release_mem((void *)pool->data, pool->size);
+			pool->release_mem((void *)b->data, b->size);
 	}
 
 	mutex_unlock(&pool->mu);
 #endif
 }
 
+static struct mempool_block *find_block(struct mempool *pool, vaddr_t va)
+{
+	size_t n;
+
+	for (n = 0; n < pool->num_blocks; n++)
+		if (va - pool->blocks[n].data < pool->blocks[n].size)
+			return pool->blocks + n;
+
+	return NULL;
+}
+
+bool mempool_add_block(struct mempool *pool, void *data, size_t size)
+{
+	struct mempool_block *blocks;
+	struct mempool_block *b;
+
+	assert(!((vaddr_t)data & (POOL_ALIGN - 1)));
+
+	blocks = realloc(pool->blocks, (pool->num_blocks + 1) *
+					sizeof(*blocks));
+	if (!blocks)
+		return false;
+
+	b = blocks + pool->num_blocks;
+	b->size = size;
+	b->data = (vaddr_t)data;
+	b->last_offset = -1;
+#if defined(__KERNEL__)
+	b->count = 0;
+	b->owner = THREAD_ID_INVALID;
+#endif
+	pool->blocks = blocks;
+	pool->num_blocks++;
+
+	return true;
+}
+
 struct mempool *
 mempool_alloc_pool(void *data, size_t size,
 		   void (*release_mem)(void *ptr, size_t size) __maybe_unused)
@@ -116,17 +183,16 @@ mempool_alloc_pool(void *data, size_t size,
 	struct mempool *pool = calloc(1, sizeof(*pool));
 
 	COMPILE_TIME_ASSERT(POOL_ALIGN >= __alignof__(struct mempool_item));
-	assert(!((vaddr_t)data & (POOL_ALIGN - 1)));
 
 	if (pool) {
-		pool->size = size;
-		pool->data = (vaddr_t)data;
-		pool->last_offset = -1;
+		if (!mempool_add_block(pool, data, size)) {
+			free(pool);
+			return NULL;
+		}
 #if defined(__KERNEL__)
 		pool->release_mem = release_mem;
 		mutex_init(&pool->mu);
 		condvar_init(&pool->cv);
-		pool->owner = THREAD_ID_INVALID;
 #endif
 	}
 
@@ -138,38 +204,36 @@ void *mempool_alloc(struct mempool *pool, size_t size)
 	size_t offset;
 	struct mempool_item *new_item;
 	struct mempool_item *last_item = NULL;
+	struct mempool_block *b = get_pool(pool);
 
-	get_pool(pool);
-
-	if (pool->last_offset < 0) {
+	if (b->last_offset < 0) {
 		offset = 0;
 	} else {
-		last_item = (struct mempool_item *)(pool->data +
-						    pool->last_offset);
-		offset = pool->last_offset + last_item->size;
+		last_item = (struct mempool_item *)(b->data + b->last_offset);
+		offset = b->last_offset + last_item->size;
 
 		offset = ROUNDUP(offset, POOL_ALIGN);
-		if (offset > pool->size)
+		if (offset > b->size)
 			goto error;
 	}
 
 	size = sizeof(struct mempool_item) + size;
 	size = ROUNDUP(size, POOL_ALIGN);
-	if (offset + size > pool->size)
+	if (offset + size > b->size)
 		goto error;
 
-	new_item = (struct mempool_item *)(pool->data + offset);
+	new_item = (struct mempool_item *)(b->data + offset);
 	new_item->size = size;
-	new_item->prev_item_offset = pool->last_offset;
+	new_item->prev_item_offset = b->last_offset;
 	if (last_item)
 		last_item->next_item_offset = offset;
 	new_item->next_item_offset = -1;
-	pool->last_offset = offset;
+	b->last_offset = offset;
 
 	return new_item + 1;
 
 error:
-	put_pool(pool);
+	put_pool(pool, b);
 	return NULL;
 }
 
@@ -178,6 +242,7 @@ void mempool_free(struct mempool *pool, void *ptr)
 	struct mempool_item *item;
 	struct mempool_item *prev_item;
 	struct mempool_item *next_item;
+	struct mempool_block *b;
 	ssize_t last_offset = -1;
 
 	if (!ptr)
@@ -185,20 +250,23 @@ void mempool_free(struct mempool *pool, void *ptr)
 
 	item = (struct mempool_item *)((vaddr_t)ptr -
 				       sizeof(struct mempool_item));
+	b = find_block(pool, (vaddr_t)item);
+	assert(b);
+
 	if (item->prev_item_offset >= 0) {
-		prev_item = (struct mempool_item *)(pool->data +
+		prev_item = (struct mempool_item *)(b->data +
 						    item->prev_item_offset);
 		prev_item->next_item_offset = item->next_item_offset;
 		last_offset = item->prev_item_offset;
 	}
 
 	if (item->next_item_offset >= 0) {
-		next_item = (struct mempool_item *)(pool->data +
+		next_item = (struct mempool_item *)(b->data +
 						    item->next_item_offset);
 		next_item->prev_item_offset = item->prev_item_offset;
-		last_offset = pool->last_offset;
+		last_offset = b->last_offset;
 	}
 
-	pool->last_offset = last_offset;
-	put_pool(pool);
+	b->last_offset = last_offset;
+	put_pool(pool, b);
 }
@@ -157,6 +157,297 @@ static struct bpoolset malloc_poolset = { .freelist = {
 static struct malloc_pool *malloc_pool;
 static size_t malloc_pool_len;
 
+/* Most of the stuff in this function is copied from bgetr() in bget.c */
+static __maybe_unused bufsize bget_buf_size(void *buf)
+{
+	bufsize osize;          /* Old size of buffer */
+	struct bhead *b;
+
+	b = BH(((char *)buf) - sizeof(struct bhead));
+	osize = -b->bsize;
+#ifdef BECtl
+	if (osize == 0) {
+		/*  Buffer acquired directly through acqfcn. */
+		struct bdhead *bd;
+
+		bd = BDH(((char *)buf) - sizeof(struct bdhead));
+		osize = bd->tsize - sizeof(struct bdhead);
+	} else
+#endif
+		osize -= sizeof(struct bhead);
+	assert(osize > 0);
+	return osize;
+}
+
+#if defined(__KERNEL__) && defined(CFG_CORE_MALLOC_CACHE) && \
+	!defined(ENABLE_MDBG)
+/*
+ * Per-thread caches of free small buffers in front of bget.
+ *
+ * A freed buffer of up to the largest size class is pushed on a small
+ * stack, a magazine, of its class in the cache of the current thread
+ * instead of being returned to bget. Allocations of the class are served
+ * from there without taking the heap lock. Each cache has its own lock,
+ * taken by the owning thread with exceptions masked, the lock is only
+ * contended when the caches are flushed.
+ *
+ * Small allocations are rounded up to the size of their class so that
+ * the freed buffers can serve any allocation of their class. A thread
+ * caches at most MALLOC_CACHE_DEPTH buffers per class and
+ * MALLOC_CACHE_MAX_BYTES in total, and all caches are flushed before an
+ * allocation from bget fails.
+ */
+
+#define MALLOC_CACHE_DEPTH	4
+#define MALLOC_CACHE_MAX_BYTES	1024
+
+static const size_t malloc_cache_class_size[] = {
+	16, 32, 48, 64, 96, 128, 192, 256
+};
+
+#define MALLOC_CACHE_NUM_CLASSES	ARRAY_SIZE(malloc_cache_class_size)
+
+struct malloc_mag {
+	size_t count;
+	void *bufs[MALLOC_CACHE_DEPTH];
+};
+
+struct malloc_cache {
+	unsigned int lock;
+	struct malloc_mag mags[MALLOC_CACHE_NUM_CLASSES];
+	size_t num_bytes;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+static struct malloc_cache malloc_caches[CFG_NUM_THREADS];
+
+/* Size of the bget block holding @buf, as accounted in totalloc */
+static size_t malloc_cache_block_size(void *buf)
+{
+	return bget_buf_size(buf) + sizeof(struct bhead);
+}
+
+/*
+ * Returns the locked cache of the current thread with exceptions masked,
+ * or NULL outside of a thread.
+ */
+static struct malloc_cache *malloc_cache_lock(uint32_t *exceptions)
+{
+	struct malloc_cache *mc;
+	int thread_id;
+
+	*exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	thread_id = thread_get_id_may_fail();
+	if (thread_id < 0) {
+		thread_unmask_exceptions(*exceptions);
+		return NULL;
+	}
+	mc = malloc_caches + thread_id;
+	cpu_spin_lock(&mc->lock);
+	return mc;
+}
+
+static void malloc_cache_unlock(struct malloc_cache *mc, uint32_t exceptions)
+{
+	cpu_spin_unlock(&mc->lock);
+	thread_unmask_exceptions(exceptions);
+}
+
+static size_t malloc_cache_round(size_t size)
+{
+	size_t n;
+
+	for (n = 0; n < MALLOC_CACHE_NUM_CLASSES; n++)
+		if (size <= malloc_cache_class_size[n])
+			return malloc_cache_class_size[n];
+	return size;
+}
+
+static void *malloc_cache_alloc(size_t size, bool zero)
+{
+	struct malloc_cache *mc;
+	struct malloc_mag *mag;
+	uint32_t exceptions;
+	void *p = NULL;
+	size_t n;
+
+	for (n = 0; n < MALLOC_CACHE_NUM_CLASSES; n++)
+		if (size <= malloc_cache_class_size[n])
+			break;
+	if (n == MALLOC_CACHE_NUM_CLASSES)
+		return NULL;
+
+	mc = malloc_cache_lock(&exceptions);
+	if (!mc)
+		return NULL;
+
+	mag = mc->mags + n;
+	if (mag->count) {
+		mag->count--;
+		p = mag->bufs[mag->count];
+		mc->num_bytes -= malloc_cache_block_size(p);
+		mc->hits++;
+	} else {
+		mc->misses++;
+	}
+
+	malloc_cache_unlock(mc, exceptions);
+
+	if (p) {
+		tag_asan_alloced(p, bget_buf_size(p));
+		if (zero)
+			memset(p, 0, size);
+	}
+	return p;
+}
+
+/* Returns true if @buf was put in the cache */
+static bool malloc_cache_free(void *buf)
+{
+	size_t size = bget_buf_size(buf);
+	struct malloc_cache *mc;
+	struct malloc_mag *mag;
+	uint32_t exceptions;
+	bool ret = false;
+	size_t n;
+
+	if (size > malloc_cache_class_size[MALLOC_CACHE_NUM_CLASSES - 1])
+		return false;
+	/* The largest class the buffer can serve */
+	for (n = MALLOC_CACHE_NUM_CLASSES; n > 0; n--)
+		if (malloc_cache_class_size[n - 1] <= size)
+			break;
+	if (!n)
+		return false;
+
+	mc = malloc_cache_lock(&exceptions);
+	if (!mc)
+		return false;
+
+	mag = mc->mags + n - 1;
+	if (mag->count < MALLOC_CACHE_DEPTH &&
+	    mc->num_bytes + size + sizeof(struct bhead) <=
+	    MALLOC_CACHE_MAX_BYTES) {
+		tag_asan_free(buf, size);
+		mag->bufs[mag->count] = buf;
+		mag->count++;
+		mc->num_bytes += size + sizeof(struct bhead);
+		ret = true;
+	}
+
+	malloc_cache_unlock(mc, exceptions);
+	return ret;
+}
+
+/*
+ * Returns the buffers of all caches to bget, called with the heap lock
+ * held. Returns true if any buffer was returned.
+ */
+static bool malloc_cache_flush(struct bpoolset *poolset)
+{
+	struct malloc_cache *mc;
+	struct malloc_mag *mag;
+	bool ret = false;
+	size_t n;
+
+	for (mc = malloc_caches; mc < malloc_caches + CFG_NUM_THREADS; mc++) {
+		cpu_spin_lock(&mc->lock);
+		for (n = 0; n < MALLOC_CACHE_NUM_CLASSES; n++) {
+			mag = mc->mags + n;
+			while (mag->count) {
+				mag->count--;
+				tag_asan_alloced(mag->bufs[mag->count],
+					bget_buf_size(mag->bufs[mag->count]));
+				brel(mag->bufs[mag->count], poolset);
+				ret = true;
+			}
+		}
+		mc->num_bytes = 0;
+		cpu_spin_unlock(&mc->lock);
+	}
+
+	return ret;
+}
+
+/* Bytes held by the caches of all threads */
+static size_t malloc_cache_num_bytes(void)
+{
+	size_t num_bytes = 0;
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++)
+		num_bytes += malloc_caches[n].num_bytes;
+	return num_bytes;
+}
+
+#ifdef BufStats
+void malloc_get_cache_stats(struct malloc_cache_stats *stats)
+{
+	size_t n;
+
+	memset(stats, 0, sizeof(*stats));
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		stats->hits += malloc_caches[n].hits;
+		stats->misses += malloc_caches[n].misses;
+		stats->cached += malloc_caches[n].num_bytes;
+	}
+}
+
+static void malloc_cache_reset_stats(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		malloc_caches[n].hits = 0;
+		malloc_caches[n].misses = 0;
+	}
+}
+#endif /* BufStats */
+
+#else
+
+static inline size_t malloc_cache_round(size_t size)
+{
+	return size;
+}
+
+static inline void *malloc_cache_alloc(size_t size __unused,
+				       bool zero __unused)
+{
+	return NULL;
+}
+
+static inline bool malloc_cache_free(void *buf __unused)
+{
+	return false;
+}
+
+static inline bool malloc_cache_flush(struct bpoolset *poolset __unused)
+{
+	return false;
+}
+
+static inline size_t malloc_cache_num_bytes(void)
+{
+	return 0;
+}
+
+#ifdef BufStats
+#ifdef __KERNEL__
+void malloc_get_cache_stats(struct malloc_cache_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+#endif
+
+static inline void malloc_cache_reset_stats(void)
+{
+}
+#endif /* BufStats */
+
+#endif
+
 #ifdef BufStats
 
 static struct malloc_stats mstats;
@@ -184,6 +475,7 @@ void malloc_reset_stats(void)
 	mstats.num_alloc_fail = 0;
 	mstats.biggest_alloc_fail = 0;
 	mstats.biggest_alloc_fail_used = 0;
+	malloc_cache_reset_stats();
 	malloc_unlock(exceptions);
 }
 
@@ -192,7 +484,8 @@ void malloc_get_stats(struct malloc_stats *stats)
 	uint32_t exceptions = malloc_lock();
 
 	memcpy(stats, &mstats, sizeof(*stats));
-	stats->allocated = malloc_poolset.totalloc;
+	/* Buffers in the caches are free as far as the users can tell */
+	stats->allocated = malloc_poolset.totalloc - malloc_cache_num_bytes();
 	malloc_unlock(exceptions);
 }
 
@@ -311,6 +604,8 @@ static void *raw_malloc(size_t hdr_size, size_t ftr_size, size_t pl_size,
 		s++;
 
 	ptr = bget(s,  poolset);
+	if (!ptr && malloc_cache_flush(poolset))
+		ptr = bget(s, poolset);
 out:
 	raw_malloc_return_hook(ptr, pl_size, poolset);
 
@@ -346,6 +641,8 @@ static void *raw_calloc(size_t hdr_size, size_t ftr_size, size_t pl_nmemb,
 		s++;
 
 	ptr = bgetz(s, poolset);
+	if (!ptr && malloc_cache_flush(poolset))
+		ptr = bgetz(s, poolset);
 out:
 	raw_malloc_return_hook(ptr, pl_nmemb * pl_size, poolset);
 
@@ -371,6 +668,8 @@ static void *raw_realloc(void *ptr, size_t hdr_size, size_t ftr_size,
 		s++;
 
 	p = bgetr(ptr, s, poolset);
+	if (!p && malloc_cache_flush(poolset))
+		p = bgetr(ptr, s, poolset);
 out:
 	raw_malloc_return_hook(p, pl_size, poolset);
 
@@ -550,6 +849,8 @@ static void *raw_memalign(size_t hdr_size, size_t ftr_size, size_t alignment,
 		return NULL;
 
 	b = (uintptr_t)bget(s, poolset);
+	if (!b && malloc_cache_flush(poolset))
+		b = (uintptr_t)bget(s, poolset);
 	if (!b)
 		goto out;
 
@@ -591,28 +892,6 @@ out:
 	return (void *)b;
 }
 
-/* Most of the stuff in this function is copied from bgetr() in bget.c */
-static __maybe_unused bufsize bget_buf_size(void *buf)
-{
-	bufsize osize;          /* Old size of buffer */
-	struct bhead *b;
-
-	b = BH(((char *)buf) - sizeof(struct bhead));
-	osize = -b->bsize;
-#ifdef BECtl
-	if (osize == 0) {
-		/*  Buffer acquired directly through acqfcn. */
-		struct bdhead *bd;
-
-		bd = BDH(((char *)buf) - sizeof(struct bdhead));
-		osize = bd->tsize - sizeof(struct bdhead);
-	} else
-#endif
-		osize -= sizeof(struct bhead);
-	assert(osize > 0);
-	return osize;
-}
-
 #ifdef ENABLE_MDBG
 
 struct mdbg_hdr {
@@ -815,27 +1094,46 @@ void mdbg_check(int bufdump)
 
 void *malloc(size_t size)
 {
-	void *p;
-	uint32_t exceptions = malloc_lock();
+	void *p = malloc_cache_alloc(size, false);
+	uint32_t exceptions;
+
+	if (p)
+		return p;
 
-	p = raw_malloc(0, 0, size, &malloc_poolset);
+	exceptions = malloc_lock();
+	p = raw_malloc(0, 0, malloc_cache_round(size), &malloc_poolset);
 	malloc_unlock(exceptions);
 	return p;
 }
 
 void free(void *ptr)
 {
-	uint32_t exceptions = malloc_lock();
+	uint32_t exceptions;
 
+	if (ptr && malloc_cache_free(ptr))
+		return;
+
+	exceptions = malloc_lock();
 	raw_free(ptr, &malloc_poolset);
 	malloc_unlock(exceptions);
 }
 
 void *calloc(size_t nmemb, size_t size)
 {
-	void *p;
-	uint32_t exceptions = malloc_lock();
+	void *p = NULL;
+	uint32_t exceptions;
+	size_t s;
 
+	if (!MUL_OVERFLOW(nmemb, size, &s)) {
+		p = malloc_cache_alloc(s, true);
+		if (p)
+			return p;
+		/* Rounded up to the size class as in malloc() */
+		nmemb = 1;
+		size = malloc_cache_round(s);
+	}
+
+	exceptions = malloc_lock();
 	p = raw_calloc(0, 0, nmemb, size, &malloc_poolset);
 	malloc_unlock(exceptions);
 	return p;
@@ -81,6 +81,15 @@ struct malloc_stats {
 
 void malloc_get_stats(struct malloc_stats *stats);
 void malloc_reset_stats(void);
+
+/* Counters of the per-thread caches of small buffers in TEE core */
+struct malloc_cache_stats {
+	uint32_t hits;		/* Allocations served from a cache */
+	uint32_t misses;	/* Cacheable allocations served by bget */
+	uint32_t cached;	/* Bytes currently held in the caches */
+};
+
+void malloc_get_cache_stats(struct malloc_cache_stats *stats);
 #endif /* CFG_WITH_STATS */
 
 #endif /* MALLOC_H */
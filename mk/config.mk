@@ -82,12 +82,18 @@ CFG_MSG_LONG_PREFIX_MASK ?= 0x1a
 # PRNG configuration
 # If CFG_WITH_SOFTWARE_PRNG is enabled, crypto provider provided
 # software PRNG implementation is used.
-# Otherwise, you need to implement hw_get_random_byte() for your platform
+# Otherwise, you need to implement hw_get_random_bytes() for your platform
 CFG_WITH_SOFTWARE_PRNG ?= y
 
 # Number of threads
 CFG_NUM_THREADS ?= 2
 
+# Maximum time in microseconds a thread spins waiting for a mutex held by
+# a thread running on another core before it waits in normal world with
+# an OPTEE_MSG_RPC_CMD_WAIT_QUEUE RPC. A waiter never spins on a mutex
+# held by a suspended thread. 0 disables spinning.
+CFG_MUTEX_SPIN_US ?= 20
+
 # API implementation version
 CFG_TEE_API_VERSION ?= GPD-1.1-dev
 
@@ -127,6 +133,12 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 # TEE_STORAGE_PRIVATE is passed to the trusted storage API)
 CFG_REE_FS ?= y
 
+# Bytes of decrypted data blocks of open secure storage files cached in
+# core heap, shared by all files. Blocks written between two syncs of a
+# file are kept in the cache until the sync. Left unset the cache takes
+# up to a quarter of CFG_CORE_HEAP_SIZE, 0 disables the cache.
+CFG_FS_HTREE_CACHE_SIZE ?=
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -135,6 +147,12 @@ CFG_RPMB_FS ?= n
 # tee-supplicant process will open /dev/mmcblk<id>rpmb
 CFG_RPMB_FS_DEV_ID ?= 0
 
+# Pack as many RPMB data frames into one authenticated write request as the
+# device reports it can write reliably (two frames per reliable write
+# sector, only used when the device reports more than one sector). Only
+# enable if the normal world RPMB driver handles multiple frame writes.
+CFG_RPMB_WRITE_MULTIPLE_BLOCKS ?= n
+
 # Enables RPMB key programming by the TEE, in case the RPMB partition has not
 # been configured yet.
 # !!! Security warning !!!
@@ -220,6 +238,33 @@ CFG_WITH_PAGER ?= n
 # Use the pager for user TAs
 CFG_PAGED_USER_TA ?= $(CFG_WITH_PAGER)
 
+# Page replacement policy of the pager, one of:
+# hide:    FIFO, a third of the pages is hidden after each fault to give
+#          recently used pages a second chance
+# clock:   second chance, pages are only hidden by the clock hand when
+#          looking for a page to evict
+# wsclock: as clock, but pages referenced within the last
+#          (number of pages / 2) faults are kept as the working set
+CFG_PAGER_POLICY ?= clock
+
+# Maximum number of pages of a paged read-only area loaded ahead when a
+# fault hits the page following the previously loaded ones, limited at
+# runtime to a quarter of the physical pages available to the pager.
+# 0 disables fault-around.
+CFG_PAGER_FAULT_AROUND ?= 4
+
+# Keep the translation tables of a user TA populated while the TA isn't
+# mapped instead of populating per-thread tables each time the TA is
+# entered. The tables are taken from a pool of
+# CFG_PERSISTENT_USER_MAP_NUM_PGT tables, the tables of the least recently
+# used TAs are reclaimed when the pool runs out. Not supported with the
+# pager.
+CFG_PERSISTENT_USER_MAP ?= n
+CFG_PERSISTENT_USER_MAP_NUM_PGT ?= 16
+ifeq ($(CFG_PERSISTENT_USER_MAP)-$(CFG_WITH_PAGER),y-y)
+$(error CFG_PERSISTENT_USER_MAP is not supported with CFG_WITH_PAGER)
+endif
+
 # Enable support for detected undefined behavior in C
 # Uses a lot of memory, can't be enabled by default
 CFG_CORE_SANITIZE_UNDEFINED ?= n
@@ -251,6 +296,12 @@ CFG_BOOT_SECONDARY_REQUEST ?= n
 # Default heap size for Core, 64 kB
 CFG_CORE_HEAP_SIZE ?= 65536
 
+# Per-thread caches of recently freed small buffers in front of the core
+# heap, most small allocations and frees are then done without taking the
+# heap lock. Each thread caches a few buffers of at most 256 bytes and
+# 1 kB in total.
+CFG_CORE_MALLOC_CACHE ?= y
+
 # TA profiling.
 # When this option is enabled, OP-TEE can execute Trusted Applications
 # instrumented with GCC's -pg flag and will output profiling information
@@ -316,6 +367,20 @@ CFG_TA_BIGNUM_MAX_BITS ?= 2048
 # Set this to a lower value to reduce the memory footprint.
 CFG_CORE_BIGNUM_MAX_BITS ?= 4096
 
+# Number of scratch memory pools for big number computations in the TEE
+# core. Each pool can be used by one thread at a time so this is the number
+# of asymmetric crypto operations that can run in parallel, more than
+# CFG_NUM_THREADS is of no use. Each pool takes roughly
+# 50 * CFG_CORE_BIGNUM_MAX_BITS / 4 bytes (about 52 KiB for 4096 bits).
+# With the pager the pools are pageable and only backed by physical pages
+# while in use, so by default there's one per thread. Without the pager the
+# pools are statically allocated and the default is a single pool.
+ifeq ($(CFG_WITH_PAGER),y)
+CFG_CORE_BIGNUM_SCRATCH_POOLS ?= $(CFG_NUM_THREADS)
+else
+CFG_CORE_BIGNUM_SCRATCH_POOLS ?= 1
+endif
+
 # Compiles mbedTLS for TA usage
 CFG_TA_MBEDTLS ?= y
 